@@ -0,0 +1,202 @@
+#include "cbor_read.h"
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_BYTES 2
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_TAG 6
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_INDEFINITE 31
+#define CBOR_FALSE 20
+#define CBOR_TRUE 21
+#define CBOR_BREAK 0xff
+
+#define CBOR_MAX_DEPTH 32
+
+void cbor_reader_init(cbor_reader_t* reader, const void* data, size_t len)
+{
+    *reader = (cbor_reader_t) {
+        .data = data,
+        .len = len,
+    };
+}
+
+static bool cbor_fail(cbor_reader_t* reader)
+{
+    reader->error = true;
+    return false;
+}
+
+// Reads the initial byte and its argument, an indefinite length gives UINT64_MAX
+static bool cbor_read_head(cbor_reader_t* reader, uint8_t* major, uint64_t* argument)
+{
+    if (reader->error || reader->pos >= reader->len) {
+        return cbor_fail(reader);
+    }
+
+    const uint8_t initial = reader->data[reader->pos++];
+    const uint8_t info = initial & 0x1f;
+    *major = initial >> 5;
+
+    if (info < 24) {
+        *argument = info;
+        return true;
+    }
+    if (info == CBOR_INDEFINITE) {
+        *argument = UINT64_MAX;
+        return true;
+    }
+    if (info > 27) {
+        return cbor_fail(reader);
+    }
+
+    const size_t bytes = 1 << (info - 24);
+    if (reader->len - reader->pos < bytes) {
+        return cbor_fail(reader);
+    }
+    *argument = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        *argument = (*argument << 8) | reader->data[reader->pos++];
+    }
+    return true;
+}
+
+static bool cbor_read_container(cbor_reader_t* reader, uint8_t expected, cbor_container_t* container)
+{
+    uint8_t major;
+    uint64_t argument;
+    if (!cbor_read_head(reader, &major, &argument) || major != expected) {
+        return cbor_fail(reader);
+    }
+
+    container->indefinite = (argument == UINT64_MAX);
+    container->remaining = container->indefinite ? 0 : argument * ((major == CBOR_MAJOR_MAP) ? 2 : 1);
+    return true;
+}
+
+bool cbor_read_map(cbor_reader_t* reader, cbor_container_t* map)
+{
+    return cbor_read_container(reader, CBOR_MAJOR_MAP, map);
+}
+
+bool cbor_read_array(cbor_reader_t* reader, cbor_container_t* array)
+{
+    return cbor_read_container(reader, CBOR_MAJOR_ARRAY, array);
+}
+
+bool cbor_read_next(cbor_reader_t* reader, cbor_container_t* container)
+{
+    if (reader->error) {
+        return false;
+    }
+    if (!container->indefinite) {
+        if (container->remaining == 0) {
+            return false;
+        }
+        container->remaining--;
+        return true;
+    }
+    if (reader->pos >= reader->len) {
+        return cbor_fail(reader);
+    }
+    if (reader->data[reader->pos] == CBOR_BREAK) {
+        reader->pos++;
+        return false;
+    }
+    return true;
+}
+
+bool cbor_read_uint(cbor_reader_t* reader, uint64_t* out)
+{
+    uint8_t major;
+    if (!cbor_read_head(reader, &major, out) || major != CBOR_MAJOR_UINT) {
+        return cbor_fail(reader);
+    }
+    return true;
+}
+
+bool cbor_read_int(cbor_reader_t* reader, int64_t* out)
+{
+    uint8_t major;
+    uint64_t argument;
+    if (!cbor_read_head(reader, &major, &argument) || (major != CBOR_MAJOR_UINT && major != CBOR_MAJOR_NINT)
+        || argument > INT64_MAX) {
+        return cbor_fail(reader);
+    }
+    *out = (major == CBOR_MAJOR_UINT) ? (int64_t)argument : -1 - (int64_t)argument;
+    return true;
+}
+
+bool cbor_read_bool(cbor_reader_t* reader, bool* out)
+{
+    uint8_t major;
+    uint64_t argument;
+    if (!cbor_read_head(reader, &major, &argument) || major != CBOR_MAJOR_SIMPLE
+        || (argument != CBOR_FALSE && argument != CBOR_TRUE)) {
+        return cbor_fail(reader);
+    }
+    *out = (argument == CBOR_TRUE);
+    return true;
+}
+
+bool cbor_read_text(cbor_reader_t* reader, const char** text, size_t* len)
+{
+    uint8_t major;
+    uint64_t argument;
+    // Chunked strings are not written by the firmware
+    if (!cbor_read_head(reader, &major, &argument) || major != CBOR_MAJOR_TEXT || argument > reader->len - reader->pos) {
+        return cbor_fail(reader);
+    }
+    *text = (const char*)&reader->data[reader->pos];
+    *len = argument;
+    reader->pos += argument;
+    return true;
+}
+
+static bool cbor_skip_depth(cbor_reader_t* reader, int depth)
+{
+    uint8_t major;
+    uint64_t argument;
+    if (depth > CBOR_MAX_DEPTH || !cbor_read_head(reader, &major, &argument)) {
+        return cbor_fail(reader);
+    }
+
+    switch (major) {
+    case CBOR_MAJOR_UINT:
+    case CBOR_MAJOR_NINT:
+        return true;
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+        if (argument == UINT64_MAX || argument > reader->len - reader->pos) {
+            return cbor_fail(reader);
+        }
+        reader->pos += argument;
+        return true;
+    case CBOR_MAJOR_ARRAY:
+    case CBOR_MAJOR_MAP: {
+        cbor_container_t container = {
+            .indefinite = (argument == UINT64_MAX),
+            .remaining = (argument == UINT64_MAX) ? 0 : argument * ((major == CBOR_MAJOR_MAP) ? 2 : 1),
+        };
+        while (cbor_read_next(reader, &container)) {
+            if (!cbor_skip_depth(reader, depth + 1)) {
+                return false;
+            }
+        }
+        return !reader->error;
+    }
+    case CBOR_MAJOR_TAG:
+        return cbor_skip_depth(reader, depth + 1);
+    default:
+        // Simple values and floats, the argument already covered the payload
+        return argument != UINT64_MAX || cbor_fail(reader);
+    }
+}
+
+bool cbor_skip(cbor_reader_t* reader)
+{
+    return cbor_skip_depth(reader, 0);
+}
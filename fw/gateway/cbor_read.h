@@ -0,0 +1,39 @@
+#pragma once
+
+// Minimal CBOR reader working in place on the received buffer. Items are read one after the
+// other, containers are walked with cbor_read_next. Any malformed input sets error and makes
+// every further read fail.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    bool error;
+} cbor_reader_t;
+
+// State of a map or array being walked, a map has two items per entry
+typedef struct
+{
+    bool indefinite;
+    uint64_t remaining;
+} cbor_container_t;
+
+void cbor_reader_init(cbor_reader_t* reader, const void* data, size_t len);
+
+bool cbor_read_map(cbor_reader_t* reader, cbor_container_t* map);
+bool cbor_read_array(cbor_reader_t* reader, cbor_container_t* array);
+// True while the container has another item, consumes the end of an indefinite one
+bool cbor_read_next(cbor_reader_t* reader, cbor_container_t* container);
+
+bool cbor_read_uint(cbor_reader_t* reader, uint64_t* out);
+bool cbor_read_int(cbor_reader_t* reader, int64_t* out);
+bool cbor_read_bool(cbor_reader_t* reader, bool* out);
+// Points into the buffer, not terminated
+bool cbor_read_text(cbor_reader_t* reader, const char** text, size_t* len);
+// Skips one item including everything nested in it
+bool cbor_skip(cbor_reader_t* reader);
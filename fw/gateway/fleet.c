@@ -0,0 +1,453 @@
+#include "fleet.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cbor_read.h"
+#include "json_scan.h"
+#include "status_cbor.h"
+#include "util.h"
+
+#define FLEET_TABLE_SIZE (FLEET_MAX_CONTROLLERS * 2) // Open addressing, kept at most half full
+#define FLEET_MAX_TOKENS 4096 // A status report has about 1000
+#define FLEET_UJ_PER_WH 3600000000.0
+
+typedef struct
+{
+    bool used;
+    fleet_controller_t controller;
+} fleet_slot_t;
+
+static fleet_slot_t s_table[FLEET_TABLE_SIZE];
+static size_t s_controllers;
+static uint64_t s_reports;
+static uint64_t s_rejected;
+static int64_t s_stale_us;
+static pthread_rwlock_t s_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Slot holding id, or the free slot it would go into. NULL when the table is full.
+static fleet_slot_t* fleet_find_unsafe(const char* id, size_t id_len)
+{
+    uint32_t i = fnv1a32(id, id_len) % FLEET_TABLE_SIZE;
+    for (size_t probes = 0; probes < FLEET_TABLE_SIZE; ++probes) {
+        fleet_slot_t* slot = &s_table[i];
+        if (!slot->used || (strlen(slot->controller.id) == id_len && memcmp(slot->controller.id, id, id_len) == 0)) {
+            return slot;
+        }
+        i = (i + 1) % FLEET_TABLE_SIZE;
+    }
+    return NULL;
+}
+
+static uint32_t fleet_uint(const json_scan_t* scan, int object, const char* path)
+{
+    uint64_t value = 0;
+    json_scan_uint(scan, json_scan_path(scan, object, path), &value);
+    return value;
+}
+
+static bool fleet_decode(const json_scan_t* scan, fleet_controller_t* c)
+{
+    static const char* const duty_keys[FLEET_FANS] = { "fan1_pwm8", "fan2_pwm8", "fan3_pwm8", "fan4_pwm8", "fan5_pwm8" };
+    static const char* const rpm_keys[FLEET_FANS] = { "fan1_rpm", "fan2_rpm", "fan3_rpm", "fan4_rpm", "fan5_rpm" };
+    static const char* const current_keys[FLEET_FANS] = { "vfan1_ma", "vfan2_ma", "vfan3_ma", "vfan4_ma", "vfan5_ma" };
+    static const char* const health_keys[FLEET_FANS] = { "fan1", "fan2", "fan3", "fan4", "fan5" };
+
+    if (scan->count == 0 || scan->tokens[0].type != JSON_SCAN_OBJECT) {
+        return false;
+    }
+
+    // Look the sections up once, the keys inside are searched from there
+    const int duty = json_scan_get(scan, 0, "duty");
+    const int power = json_scan_get(scan, 0, "power");
+    const int tacho = json_scan_get(scan, 0, "tacho");
+    const int health = json_scan_get(scan, 0, "health");
+    const int sensors = json_scan_get(scan, 0, "sensors");
+    if (duty < 0 || power < 0 || tacho < 0) {
+        return false;
+    }
+
+    json_scan_string(scan, json_scan_get(scan, 0, "app_version"), c->app_version, sizeof(c->app_version));
+    uint64_t runtime_us = 0;
+    json_scan_uint(scan, json_scan_get(scan, 0, "runtime_us"), &runtime_us);
+    c->runtime_us = runtime_us;
+
+    for (size_t i = 0; i < FLEET_FANS; ++i) {
+        c->duty[i] = fleet_uint(scan, duty, duty_keys[i]);
+        c->rpm[i] = fleet_uint(scan, tacho, rpm_keys[i]);
+
+        const int current = json_scan_get(scan, power, current_keys[i]);
+        c->fan_ma[i] = fleet_uint(scan, current, "rms");
+
+        // "fault" stays in the report after a recovery, the state is what is wrong now
+        const int state = json_scan_get(scan, json_scan_get(scan, health, health_keys[i]), "state");
+        c->faults += json_scan_string_is(scan, state, "stalled") || json_scan_string_is(scan, state, "blocked")
+            || json_scan_string_is(scan, state, "disconnected");
+    }
+
+    c->vbus_mv = fleet_uint(scan, power, "vbus_mv.rms");
+    c->vbus_ma = fleet_uint(scan, power, "vbus_ma.rms");
+    c->vbus_mw = fleet_uint(scan, power, "vbus_mw");
+    json_scan_number(scan, json_scan_path(scan, 0, "energy.vbus_wh"), &c->vbus_wh);
+
+    json_scan_bool(scan, json_scan_path(scan, 0, "supervisor.tripped"), &c->tripped);
+    c->trips = fleet_uint(scan, 0, "supervisor.trips");
+
+    double temperature_mc;
+    int temperature = json_scan_path(scan, sensors, "temphum_external.temperature_mc");
+    if (temperature < 0) {
+        temperature = json_scan_path(scan, sensors, "temphum_on_board.temperature_mc");
+    }
+    c->has_temperature = json_scan_number(scan, temperature, &temperature_mc);
+    c->temperature_mc = c->has_temperature ? (int32_t)temperature_mc : 0;
+
+    return true;
+}
+
+static bool fleet_text_is(const char* text, size_t len, const char* str)
+{
+    return len == strlen(str) && memcmp(text, str, len) == 0;
+}
+
+// First value of an array such as a sample or a reading, the rest is skipped
+static int64_t fleet_cbor_first(cbor_reader_t* r)
+{
+    int64_t value = 0;
+    cbor_container_t array;
+    if (cbor_read_array(r, &array) && cbor_read_next(r, &array)) {
+        cbor_read_int(r, &value);
+        while (cbor_read_next(r, &array)) {
+            cbor_skip(r);
+        }
+    }
+    return value;
+}
+
+// Reads a per fan array of up to FLEET_FANS values, or of the first value of nested arrays
+static bool fleet_cbor_fans(cbor_reader_t* r, uint32_t* out, bool nested)
+{
+    cbor_container_t array;
+    cbor_read_array(r, &array);
+    for (size_t i = 0; cbor_read_next(r, &array); ++i) {
+        int64_t value = 0;
+        if (nested) {
+            value = fleet_cbor_first(r);
+        } else {
+            cbor_read_int(r, &value);
+        }
+        if (i < FLEET_FANS) {
+            out[i] = value;
+        }
+    }
+    return !r->error;
+}
+
+static void fleet_cbor_power(cbor_reader_t* r, fleet_controller_t* c)
+{
+    cbor_container_t map;
+    cbor_read_map(r, &map);
+    while (cbor_read_next(r, &map)) {
+        uint64_t key = UINT64_MAX;
+        uint64_t value = 0;
+        cbor_read_uint(r, &key);
+        cbor_read_next(r, &map);
+        switch (key) {
+        case STATUS_CBOR_POWER_VBUS_MV:
+            c->vbus_mv = fleet_cbor_first(r);
+            break;
+        case STATUS_CBOR_POWER_VBUS_MA:
+            c->vbus_ma = fleet_cbor_first(r);
+            break;
+        case STATUS_CBOR_POWER_VFAN_MA:
+            fleet_cbor_fans(r, c->fan_ma, true);
+            break;
+        case STATUS_CBOR_POWER_VBUS_MW:
+            cbor_read_uint(r, &value);
+            c->vbus_mw = value;
+            break;
+        default:
+            cbor_skip(r);
+            break;
+        }
+    }
+}
+
+static void fleet_cbor_energy(cbor_reader_t* r, fleet_controller_t* c)
+{
+    cbor_container_t map;
+    cbor_read_map(r, &map);
+    while (cbor_read_next(r, &map)) {
+        uint64_t key = UINT64_MAX;
+        uint64_t value = 0;
+        cbor_read_uint(r, &key);
+        cbor_read_next(r, &map);
+        if (key == STATUS_CBOR_ENERGY_VBUS_UJ && cbor_read_uint(r, &value)) {
+            c->vbus_wh = value / FLEET_UJ_PER_WH;
+        } else {
+            cbor_skip(r);
+        }
+    }
+}
+
+static void fleet_cbor_supervisor(cbor_reader_t* r, fleet_controller_t* c)
+{
+    cbor_container_t map;
+    cbor_read_map(r, &map);
+    while (cbor_read_next(r, &map)) {
+        uint64_t key = UINT64_MAX;
+        uint64_t value = 0;
+        cbor_read_uint(r, &key);
+        cbor_read_next(r, &map);
+        if (key == STATUS_CBOR_SUPERVISOR_TRIPPED) {
+            cbor_read_bool(r, &c->tripped);
+        } else if (key == STATUS_CBOR_SUPERVISOR_TRIPS && cbor_read_uint(r, &value)) {
+            c->trips = value;
+        } else {
+            cbor_skip(r);
+        }
+    }
+}
+
+static void fleet_cbor_health(cbor_reader_t* r, fleet_controller_t* c)
+{
+    cbor_container_t fans;
+    cbor_read_array(r, &fans);
+    while (cbor_read_next(r, &fans)) {
+        cbor_container_t map;
+        cbor_read_map(r, &map);
+        while (cbor_read_next(r, &map)) {
+            uint64_t key = UINT64_MAX;
+            const char* state;
+            size_t len;
+            cbor_read_uint(r, &key);
+            cbor_read_next(r, &map);
+            if (key == STATUS_CBOR_HEALTH_STATE && cbor_read_text(r, &state, &len)) {
+                c->faults += fleet_text_is(state, len, "stalled") || fleet_text_is(state, len, "blocked")
+                    || fleet_text_is(state, len, "disconnected");
+            } else {
+                cbor_skip(r);
+            }
+        }
+    }
+}
+
+static void fleet_cbor_sensors(cbor_reader_t* r, fleet_controller_t* c)
+{
+    bool external = false;
+    cbor_container_t map;
+    cbor_read_map(r, &map);
+    while (cbor_read_next(r, &map)) {
+        uint64_t key = UINT64_MAX;
+        cbor_read_uint(r, &key);
+        cbor_read_next(r, &map);
+        // The external probe wins over the on-board sensor, whatever the order
+        if ((key == STATUS_CBOR_SENSORS_ON_BOARD && !external) || key == STATUS_CBOR_SENSORS_EXTERNAL) {
+            c->temperature_mc = fleet_cbor_first(r);
+            c->has_temperature = true;
+            external |= (key == STATUS_CBOR_SENSORS_EXTERNAL);
+        } else {
+            cbor_skip(r);
+        }
+    }
+}
+
+static bool fleet_decode_cbor(const uint8_t* data, size_t len, fleet_controller_t* c)
+{
+    cbor_reader_t r;
+    cbor_reader_init(&r, data, len);
+
+    cbor_container_t root;
+    uint64_t key = UINT64_MAX;
+    uint64_t version = 0;
+    // The schema version comes first, anything newer is not decoded with old keys
+    if (!cbor_read_map(&r, &root) || !cbor_read_next(&r, &root) || !cbor_read_uint(&r, &key) || key != STATUS_CBOR_SCHEMA
+        || !cbor_read_next(&r, &root) || !cbor_read_uint(&r, &version) || version != STATUS_CBOR_SCHEMA_VERSION) {
+        return false;
+    }
+
+    bool has_duty = false;
+    while (cbor_read_next(&r, &root)) {
+        uint64_t value = 0;
+        const char* text;
+        size_t text_len;
+        cbor_read_uint(&r, &key);
+        cbor_read_next(&r, &root);
+        switch (key) {
+        case STATUS_CBOR_APP_VERSION:
+            if (cbor_read_text(&r, &text, &text_len)) {
+                snprintf(c->app_version, sizeof(c->app_version), "%.*s", (int)text_len, text);
+            }
+            break;
+        case STATUS_CBOR_RUNTIME_US:
+            cbor_read_uint(&r, &value);
+            c->runtime_us = value;
+            break;
+        case STATUS_CBOR_DUTY:
+            has_duty = fleet_cbor_fans(&r, c->duty, false);
+            break;
+        case STATUS_CBOR_TACHO:
+            fleet_cbor_fans(&r, c->rpm, false);
+            break;
+        case STATUS_CBOR_POWER:
+            fleet_cbor_power(&r, c);
+            break;
+        case STATUS_CBOR_ENERGY:
+            fleet_cbor_energy(&r, c);
+            break;
+        case STATUS_CBOR_SUPERVISOR:
+            fleet_cbor_supervisor(&r, c);
+            break;
+        case STATUS_CBOR_HEALTH:
+            fleet_cbor_health(&r, c);
+            break;
+        case STATUS_CBOR_SENSORS:
+            fleet_cbor_sensors(&r, c);
+            break;
+        default:
+            cbor_skip(&r);
+            break;
+        }
+    }
+
+    return !r.error && r.pos == len && has_duty;
+}
+
+void fleet_init(int64_t stale_us)
+{
+    s_stale_us = stale_us;
+}
+
+static bool fleet_store(const char* id, size_t id_len, bool decoded_ok, fleet_controller_t* decoded, int64_t now_us)
+{
+    const bool ok = decoded_ok && id_len > 0 && id_len < FLEET_ID_SIZE;
+
+    pthread_rwlock_wrlock(&s_lock);
+    if (!ok) {
+        s_rejected++;
+        pthread_rwlock_unlock(&s_lock);
+        return false;
+    }
+
+    fleet_slot_t* slot = fleet_find_unsafe(id, id_len);
+    if (slot == NULL || (!slot->used && s_controllers >= FLEET_MAX_CONTROLLERS)) {
+        s_rejected++;
+        pthread_rwlock_unlock(&s_lock);
+        return false;
+    }
+
+    if (!slot->used) {
+        slot->used = true;
+        memcpy(decoded->id, id, id_len);
+        decoded->first_seen_us = now_us;
+        s_controllers++;
+    } else {
+        memcpy(decoded->id, slot->controller.id, sizeof(decoded->id));
+        decoded->first_seen_us = slot->controller.first_seen_us;
+        decoded->reports = slot->controller.reports;
+    }
+    decoded->last_seen_us = now_us;
+    decoded->reports++;
+    slot->controller = *decoded;
+    s_reports++;
+    pthread_rwlock_unlock(&s_lock);
+
+    return true;
+}
+
+bool fleet_update(const char* id, size_t id_len, const char* json, size_t json_len, int64_t now_us)
+{
+    static __thread json_scan_token_t tokens[FLEET_MAX_TOKENS];
+    fleet_controller_t decoded = { 0 };
+
+    const int count = json_scan_parse(json, json_len, tokens, FLEET_MAX_TOKENS);
+    const json_scan_t scan = {
+        .json = json,
+        .tokens = tokens,
+        .count = (count > 0) ? count : 0,
+    };
+    const bool ok = count > 0 && fleet_decode(&scan, &decoded);
+
+    return fleet_store(id, id_len, ok, &decoded, now_us);
+}
+
+bool fleet_update_cbor(const char* id, size_t id_len, const void* cbor, size_t cbor_len, int64_t now_us)
+{
+    fleet_controller_t decoded = { 0 };
+    const bool ok = fleet_decode_cbor(cbor, cbor_len, &decoded);
+
+    return fleet_store(id, id_len, ok, &decoded, now_us);
+}
+
+bool fleet_fetch(const char* id, fleet_controller_t* controller, bool* online, int64_t now_us)
+{
+    pthread_rwlock_rdlock(&s_lock);
+    const fleet_slot_t* slot = fleet_find_unsafe(id, strlen(id));
+    const bool found = (slot != NULL && slot->used);
+    if (found) {
+        *controller = slot->controller;
+        *online = (now_us - controller->last_seen_us < s_stale_us);
+    }
+    pthread_rwlock_unlock(&s_lock);
+
+    return found;
+}
+
+void fleet_summary(fleet_summary_t* summary, int64_t now_us)
+{
+    uint64_t rpm_sum = 0;
+    size_t rpm_count = 0;
+
+    *summary = (fleet_summary_t) {
+        .rpm_min = UINT32_MAX,
+        .temperature_max_mc = INT32_MIN,
+    };
+
+    pthread_rwlock_rdlock(&s_lock);
+    summary->controllers = s_controllers;
+    summary->reports = s_reports;
+    summary->rejected = s_rejected;
+
+    for (size_t i = 0; i < FLEET_TABLE_SIZE; ++i) {
+        const fleet_controller_t* c = &s_table[i].controller;
+        if (!s_table[i].used || now_us - c->last_seen_us >= s_stale_us) {
+            continue;
+        }
+
+        summary->online++;
+        summary->tripped += c->tripped;
+        summary->faults += (c->faults > 0);
+        summary->vbus_mw += c->vbus_mw;
+        summary->vbus_wh += c->vbus_wh;
+        if (c->has_temperature && c->temperature_mc > summary->temperature_max_mc) {
+            summary->temperature_max_mc = c->temperature_mc;
+        }
+
+        for (size_t fan = 0; fan < FLEET_FANS; ++fan) {
+            if (c->duty[fan] == 0) {
+                continue;
+            }
+            rpm_sum += c->rpm[fan];
+            rpm_count++;
+            summary->rpm_min = (c->rpm[fan] < summary->rpm_min) ? c->rpm[fan] : summary->rpm_min;
+            summary->rpm_max = (c->rpm[fan] > summary->rpm_max) ? c->rpm[fan] : summary->rpm_max;
+        }
+    }
+    pthread_rwlock_unlock(&s_lock);
+
+    if (rpm_count == 0) {
+        summary->rpm_min = 0;
+    }
+    summary->rpm_mean = (rpm_count > 0) ? (double)rpm_sum / rpm_count : 0;
+}
+
+void fleet_visit(fleet_visit_t visit, void* ctx, int64_t now_us)
+{
+    pthread_rwlock_rdlock(&s_lock);
+    for (size_t i = 0; i < FLEET_TABLE_SIZE; ++i) {
+        if (s_table[i].used) {
+            visit(&s_table[i].controller, now_us - s_table[i].controller.last_seen_us < s_stale_us, ctx);
+        }
+    }
+    pthread_rwlock_unlock(&s_lock);
+}
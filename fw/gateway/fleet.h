@@ -0,0 +1,64 @@
+#pragma once
+
+// In-memory state of every controller seen on the broker, updated from the status reports
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLEET_FANS 5
+#define FLEET_ID_SIZE 18 // MAC address as in the topic
+#define FLEET_VERSION_SIZE 32
+#define FLEET_MAX_CONTROLLERS 4096
+
+typedef struct
+{
+    char id[FLEET_ID_SIZE];
+    char app_version[FLEET_VERSION_SIZE];
+    int64_t first_seen_us;
+    int64_t last_seen_us;
+    uint64_t reports;
+    uint64_t runtime_us;
+    uint32_t duty[FLEET_FANS];
+    uint32_t rpm[FLEET_FANS];
+    uint32_t fan_ma[FLEET_FANS];
+    uint32_t vbus_mv;
+    uint32_t vbus_ma;
+    uint32_t vbus_mw;
+    double vbus_wh;
+    bool tripped;
+    uint32_t trips;
+    uint32_t faults; // Fans currently stalled, blocked or disconnected
+    bool has_temperature;
+    int32_t temperature_mc; // External probe, or the on-board sensor without one
+} fleet_controller_t;
+
+typedef struct
+{
+    size_t controllers;
+    size_t online;
+    size_t tripped;
+    size_t faults;
+    uint64_t reports;
+    uint64_t rejected;
+    uint64_t vbus_mw; // Online controllers only
+    double vbus_wh;
+    uint32_t rpm_min;
+    uint32_t rpm_max;
+    double rpm_mean; // Over the fans with a commanded duty
+    int32_t temperature_max_mc;
+} fleet_summary_t;
+
+typedef void (*fleet_visit_t)(const fleet_controller_t* controller, bool online, void* ctx);
+
+void fleet_init(int64_t stale_us);
+
+// Decodes a status report, id comes from the topic. Returns false for a report that does not parse.
+bool fleet_update(const char* id, size_t id_len, const char* json, size_t json_len, int64_t now_us);
+// Same for a report in the CBOR encoding of status_cbor.h
+bool fleet_update_cbor(const char* id, size_t id_len, const void* cbor, size_t cbor_len, int64_t now_us);
+
+bool fleet_fetch(const char* id, fleet_controller_t* controller, bool* online, int64_t now_us);
+void fleet_summary(fleet_summary_t* summary, int64_t now_us);
+// Calls visit for every controller under the table lock, visit must not call back into the fleet
+void fleet_visit(fleet_visit_t visit, void* ctx, int64_t now_us);
@@ -0,0 +1,13 @@
+#pragma once
+
+// Shared by the gateway modules
+
+#include <stdint.h>
+#include <time.h>
+
+static inline int64_t gateway_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
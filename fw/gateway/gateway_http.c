@@ -0,0 +1,406 @@
+#include "gateway_http.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "fleet.h"
+#include "gateway.h"
+
+#define GATEWAY_HTTP_REQUEST_SIZE 8192 // Headers and a duty command
+#define GATEWAY_HTTP_TOPIC_SIZE 64
+#define GATEWAY_HTTP_ESCAPED_SIZE (FLEET_VERSION_SIZE * 6) // Every character as \u00XX
+#define GATEWAY_HTTP_IO_TIMEOUT_S 2 // Per recv or send, the requests are handled one at a time
+#define GATEWAY_HTTP_REQUEST_TIMEOUT_US 5000000 // For the whole request, against clients sending a byte at a time
+
+typedef struct
+{
+    char* data;
+    size_t len;
+    size_t size;
+    bool failed;
+} gateway_http_buffer_t;
+
+typedef struct
+{
+    gateway_http_buffer_t* out;
+    int64_t now_us;
+    bool first;
+} gateway_http_list_t;
+
+typedef struct
+{
+    char (*ids)[FLEET_ID_SIZE];
+    size_t count;
+} gateway_http_targets_t;
+
+static int s_listen_fd = -1;
+static mqtt_client_t* s_client;
+
+static void gateway_http_printf(gateway_http_buffer_t* buffer, const char* format, ...)
+{
+    va_list args;
+    while (!buffer->failed) {
+        va_start(args, format);
+        const int n = vsnprintf(buffer->data + buffer->len, buffer->size - buffer->len, format, args);
+        va_end(args);
+        if (n < 0) {
+            buffer->failed = true;
+        } else if ((size_t)n < buffer->size - buffer->len) {
+            buffer->len += n;
+            return;
+        } else {
+            const size_t size = (buffer->size + n + 1) * 2;
+            char* data = realloc(buffer->data, size);
+            if (data == NULL) {
+                buffer->failed = true;
+            } else {
+                buffer->data = data;
+                buffer->size = size;
+            }
+        }
+    }
+}
+
+// The id comes from the topic and the version from the report, neither can be trusted to be printable
+static const char* gateway_http_escape(const char* in, bool json, char* out, size_t size)
+{
+    size_t len = 0;
+    for (; *in != '\0' && len + 7 <= size; ++in) {
+        const unsigned char c = *in;
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = c;
+        } else if (c == '\n') {
+            out[len++] = '\\';
+            out[len++] = 'n';
+        } else if (c < 0x20 && json) {
+            len += snprintf(&out[len], size - len, "\\u%04x", c);
+        } else {
+            out[len++] = c;
+        }
+    }
+    out[len] = '\0';
+    return out;
+}
+
+static void gateway_http_controller_to_json(gateway_http_buffer_t* out, const fleet_controller_t* c, bool online, int64_t now_us)
+{
+    char id[GATEWAY_HTTP_ESCAPED_SIZE];
+    char app_version[GATEWAY_HTTP_ESCAPED_SIZE];
+    gateway_http_printf(out,
+        "{\"id\":\"%s\",\"online\":%s,\"app_version\":\"%s\",\"age_ms\":%lld,\"reports\":%llu,\"runtime_us\":%llu,",
+        gateway_http_escape(c->id, true, id, sizeof(id)), online ? "true" : "false",
+        gateway_http_escape(c->app_version, true, app_version, sizeof(app_version)), (long long)((now_us - c->last_seen_us) / 1000),
+        (unsigned long long)c->reports, (unsigned long long)c->runtime_us);
+    gateway_http_printf(out, "\"duty\":[%u,%u,%u,%u,%u],\"rpm\":[%u,%u,%u,%u,%u],\"fan_ma\":[%u,%u,%u,%u,%u],",
+        c->duty[0], c->duty[1], c->duty[2], c->duty[3], c->duty[4],
+        c->rpm[0], c->rpm[1], c->rpm[2], c->rpm[3], c->rpm[4],
+        c->fan_ma[0], c->fan_ma[1], c->fan_ma[2], c->fan_ma[3], c->fan_ma[4]);
+    gateway_http_printf(out, "\"vbus_mv\":%u,\"vbus_ma\":%u,\"vbus_mw\":%u,\"vbus_wh\":%.6f,\"tripped\":%s,\"trips\":%u,\"faults\":%u",
+        c->vbus_mv, c->vbus_ma, c->vbus_mw, c->vbus_wh, c->tripped ? "true" : "false", c->trips, c->faults);
+    if (c->has_temperature) {
+        gateway_http_printf(out, ",\"temperature_mc\":%d", c->temperature_mc);
+    }
+    gateway_http_printf(out, "}");
+}
+
+static void gateway_http_list_visit(const fleet_controller_t* controller, bool online, void* ctx)
+{
+    gateway_http_list_t* list = ctx;
+    if (!list->first) {
+        gateway_http_printf(list->out, ",");
+    }
+    list->first = false;
+    gateway_http_controller_to_json(list->out, controller, online, list->now_us);
+}
+
+static void gateway_http_metrics_visit(const fleet_controller_t* c, bool online, void* ctx)
+{
+    gateway_http_buffer_t* out = ctx;
+    char id[GATEWAY_HTTP_ESCAPED_SIZE];
+    gateway_http_escape(c->id, false, id, sizeof(id));
+    gateway_http_printf(out, "fancontroller_online{id=\"%s\"} %d\n", id, online);
+    gateway_http_printf(out, "fancontroller_vbus_mw{id=\"%s\"} %u\n", id, c->vbus_mw);
+    gateway_http_printf(out, "fancontroller_vbus_wh{id=\"%s\"} %.6f\n", id, c->vbus_wh);
+    gateway_http_printf(out, "fancontroller_trips_total{id=\"%s\"} %u\n", id, c->trips);
+    for (size_t fan = 0; fan < FLEET_FANS; ++fan) {
+        gateway_http_printf(out, "fancontroller_fan_rpm{id=\"%s\",fan=\"%zu\"} %u\n", id, fan + 1, c->rpm[fan]);
+        gateway_http_printf(out, "fancontroller_fan_ma{id=\"%s\",fan=\"%zu\"} %u\n", id, fan + 1, c->fan_ma[fan]);
+    }
+    if (c->has_temperature) {
+        gateway_http_printf(out, "fancontroller_temperature_mc{id=\"%s\"} %d\n", id, c->temperature_mc);
+    }
+}
+
+static void gateway_http_summary_to_json(gateway_http_buffer_t* out, const fleet_summary_t* s)
+{
+    gateway_http_printf(out,
+        "{\"controllers\":%zu,\"online\":%zu,\"tripped\":%zu,\"faults\":%zu,\"reports\":%llu,\"rejected\":%llu,"
+        "\"vbus_mw\":%llu,\"vbus_wh\":%.6f,\"rpm\":{\"min\":%u,\"max\":%u,\"mean\":%.1f}",
+        s->controllers, s->online, s->tripped, s->faults, (unsigned long long)s->reports, (unsigned long long)s->rejected,
+        (unsigned long long)s->vbus_mw, s->vbus_wh, s->rpm_min, s->rpm_max, s->rpm_mean);
+    if (s->temperature_max_mc != INT32_MIN) {
+        gateway_http_printf(out, ",\"temperature_max_mc\":%d", s->temperature_max_mc);
+    }
+    gateway_http_printf(out, "}");
+}
+
+static void gateway_http_metrics(gateway_http_buffer_t* out, int64_t now_us)
+{
+    fleet_summary_t s;
+    fleet_summary(&s, now_us);
+    gateway_http_printf(out, "fancontroller_gateway_controllers %zu\n", s.controllers);
+    gateway_http_printf(out, "fancontroller_gateway_online %zu\n", s.online);
+    gateway_http_printf(out, "fancontroller_gateway_reports_total %llu\n", (unsigned long long)s.reports);
+    gateway_http_printf(out, "fancontroller_gateway_rejected_total %llu\n", (unsigned long long)s.rejected);
+    fleet_visit(gateway_http_metrics_visit, out, now_us);
+}
+
+static void gateway_http_targets_visit(const fleet_controller_t* controller, bool online, void* ctx)
+{
+    gateway_http_targets_t* targets = ctx;
+    if (online) {
+        memcpy(targets->ids[targets->count++], controller->id, FLEET_ID_SIZE);
+    }
+}
+
+// The command is passed through as is, each controller validates it. Publishing happens outside
+// the table lock so a slow broker does not hold up the report decoding. Returns the number of failed publishes.
+static size_t gateway_http_duty(const gateway_http_targets_t* targets, const char* body, size_t body_len, gateway_http_buffer_t* out)
+{
+    size_t sent = 0;
+    for (size_t i = 0; i < targets->count; ++i) {
+        char topic[GATEWAY_HTTP_TOPIC_SIZE];
+        snprintf(topic, sizeof(topic), "fancontroller/%s/duty", targets->ids[i]);
+        sent += (mqtt_client_publish(s_client, topic, body, body_len) == 0);
+    }
+    gateway_http_printf(out, "{\"sent\":%zu,\"failed\":%zu}", sent, targets->count - sent);
+    return targets->count - sent;
+}
+
+// Fills out with the body, returns the HTTP status
+static int gateway_http_route(const char* method, const char* path, const char* body, size_t body_len,
+    gateway_http_buffer_t* out, const char** content_type)
+{
+    const int64_t now_us = gateway_now_us();
+    *content_type = "application/json";
+
+    if (strcmp(method, "GET") == 0) {
+        if (strcmp(path, "/fleet") == 0) {
+            gateway_http_list_t list = { .out = out, .now_us = now_us, .first = true };
+            gateway_http_printf(out, "[");
+            fleet_visit(gateway_http_list_visit, &list, now_us);
+            gateway_http_printf(out, "]");
+            return 200;
+        }
+        if (strncmp(path, "/fleet/", 7) == 0) {
+            fleet_controller_t controller;
+            bool online;
+            if (!fleet_fetch(path + 7, &controller, &online, now_us)) {
+                gateway_http_printf(out, "{\"error\":\"unknown controller\"}");
+                return 404;
+            }
+            gateway_http_controller_to_json(out, &controller, online, now_us);
+            return 200;
+        }
+        if (strcmp(path, "/summary") == 0) {
+            fleet_summary_t summary;
+            fleet_summary(&summary, now_us);
+            gateway_http_summary_to_json(out, &summary);
+            return 200;
+        }
+        if (strcmp(path, "/metrics") == 0) {
+            *content_type = "text/plain; version=0.0.4";
+            gateway_http_metrics(out, now_us);
+            return 200;
+        }
+    } else if (strcmp(method, "POST") == 0 && strncmp(path, "/duty/", 6) == 0) {
+        const char* target = path + 6;
+        static char ids[FLEET_MAX_CONTROLLERS][FLEET_ID_SIZE]; // Only the HTTP thread uses it
+        gateway_http_targets_t targets = { .ids = ids };
+        if (strcmp(target, "all") == 0) {
+            fleet_visit(gateway_http_targets_visit, &targets, now_us);
+        } else {
+            fleet_controller_t controller;
+            bool online;
+            if (!fleet_fetch(target, &controller, &online, now_us)) {
+                gateway_http_printf(out, "{\"error\":\"unknown controller\"}");
+                return 404;
+            }
+            memcpy(ids[targets.count++], controller.id, FLEET_ID_SIZE);
+        }
+        return (gateway_http_duty(&targets, body, body_len, out) > 0) ? 502 : 200;
+    }
+
+    gateway_http_printf(out, "{\"error\":\"not found\"}");
+    return 404;
+}
+
+static const char* gateway_http_reason(int status)
+{
+    switch (status) {
+    case 200:
+        return "OK";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 413:
+        return "Payload Too Large";
+    case 502:
+        return "Bad Gateway";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+static int gateway_http_write_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        const ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        len -= written;
+    }
+    return 0;
+}
+
+static void gateway_http_respond(int fd, int status, const char* content_type, const gateway_http_buffer_t* body)
+{
+    char header[256];
+    const int n = snprintf(header, sizeof(header),
+        "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        status, gateway_http_reason(status), content_type, body->len);
+    if (gateway_http_write_all(fd, header, n) == 0 && body->len > 0) {
+        gateway_http_write_all(fd, body->data, body->len);
+    }
+}
+
+static void gateway_http_handle(int fd)
+{
+    char request[GATEWAY_HTTP_REQUEST_SIZE + 1];
+    size_t len = 0;
+    const char* body = NULL;
+    size_t content_length = 0;
+    int status = 400;
+    const char* content_type = "application/json";
+    gateway_http_buffer_t out = { 0 };
+    const int64_t deadline_us = gateway_now_us() + GATEWAY_HTTP_REQUEST_TIMEOUT_US;
+
+    // Read the headers, then as much of the body as announced
+    while (len < GATEWAY_HTTP_REQUEST_SIZE) {
+        if (gateway_now_us() > deadline_us) {
+            goto done;
+        }
+        const ssize_t received = recv(fd, &request[len], GATEWAY_HTTP_REQUEST_SIZE - len, 0);
+        if (received <= 0) {
+            goto done;
+        }
+        len += received;
+        request[len] = '\0';
+
+        if (body == NULL) {
+            char* end = strstr(request, "\r\n\r\n");
+            if (end == NULL) {
+                continue;
+            }
+            body = end + 4;
+            const char* header = strcasestr(request, "\r\nContent-Length:");
+            if (header != NULL && header < end) {
+                content_length = strtoul(header + 17, NULL, 10);
+            }
+        }
+        if ((size_t)(&request[len] - body) >= content_length) {
+            break;
+        }
+    }
+    if (body == NULL || (size_t)(&request[len] - body) < content_length) {
+        status = (body == NULL) ? 400 : 413;
+        gateway_http_printf(&out, "{\"error\":\"%s\"}", (status == 400) ? "bad request" : "request too large");
+        goto respond;
+    }
+
+    char method[8];
+    char path[128];
+    if (sscanf(request, "%7s %127s", method, path) != 2) {
+        gateway_http_printf(&out, "{\"error\":\"bad request\"}");
+        goto respond;
+    }
+    status = gateway_http_route(method, path, body, content_length, &out, &content_type);
+
+respond:
+    if (out.failed) {
+        status = 500;
+        out.len = 0;
+    }
+    gateway_http_respond(fd, status, content_type, &out);
+done:
+    free(out.data);
+    close(fd);
+}
+
+static void* gateway_http_task(void* arg)
+{
+    while (1) {
+        const int fd = accept(s_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+            }
+            continue;
+        }
+        // Requests are short, one at a time keeps the table lock out of the picture. A client that stops
+        // reading or writing only holds up the others for the timeout.
+        const struct timeval timeout = { .tv_sec = GATEWAY_HTTP_IO_TIMEOUT_S };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        gateway_http_handle(fd);
+    }
+    return NULL;
+}
+
+int gateway_http_start(uint16_t port, mqtt_client_t* client)
+{
+    s_client = client;
+
+    s_listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (s_listen_fd < 0) {
+        return -1;
+    }
+    const int one = 1;
+    const int zero = 0;
+    setsockopt(s_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(s_listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+    const struct sockaddr_in6 address = {
+        .sin6_family = AF_INET6,
+        .sin6_port = htons(port),
+        .sin6_addr = IN6ADDR_ANY_INIT,
+    };
+    if (bind(s_listen_fd, (const struct sockaddr*)&address, sizeof(address)) != 0 || listen(s_listen_fd, 64) != 0) {
+        close(s_listen_fd);
+        s_listen_fd = -1;
+        return -1;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, gateway_http_task, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
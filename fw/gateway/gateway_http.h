@@ -0,0 +1,10 @@
+#pragma once
+
+// Queries on the fleet table and fan-out of duty commands over HTTP
+
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+// Serves on its own thread, commands are published through client
+int gateway_http_start(uint16_t port, mqtt_client_t* client);
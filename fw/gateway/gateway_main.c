@@ -0,0 +1,248 @@
+// Fleet gateway: subscribes to the status reports of all controllers on a broker, keeps their
+// latest state and serves it over HTTP
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cbor_read.h"
+#include "fleet.h"
+#include "gateway.h"
+#include "gateway_http.h"
+#include "mqtt_client.h"
+
+#define GATEWAY_STATUS_FILTER "fancontroller/+/status"
+#define GATEWAY_STATUS_CBOR_FILTER "fancontroller/+/status/cbor"
+#define GATEWAY_TOPIC_PREFIX "fancontroller/"
+#define GATEWAY_TOPIC_SUFFIX "/status"
+#define GATEWAY_TOPIC_CBOR_SUFFIX "/status/cbor"
+#define GATEWAY_CBOR_MAP 0xbf // Indefinite length map, the first byte of every CBOR report
+#define GATEWAY_KEEPALIVE_S 30
+#define GATEWAY_RECONNECT_MAX_S 30
+#define GATEWAY_BENCH_MAX_LINES 1024
+
+static mqtt_client_t s_client;
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --broker HOST[:PORT]  MQTT broker the controllers report to (default 127.0.0.1:1883)\n"
+        "  --listen PORT         HTTP port for the fleet queries (default 8080)\n"
+        "  --stale S             seconds without a report until a controller counts as offline (default 5)\n"
+        "  --bench FILE          decode the status reports in FILE (JSON lines or a CBOR sequence) and print\n"
+        "                        the throughput\n"
+        "  --controllers N       controllers the benchmark spreads the reports over (default 64)\n"
+        "  --iterations N        reports the benchmark decodes (default 200000)\n",
+        argv0);
+}
+
+static bool gateway_topic_is(const char* topic, size_t topic_len, const char* suffix, size_t* id_len)
+{
+    const size_t prefix_len = strlen(GATEWAY_TOPIC_PREFIX);
+    const size_t suffix_len = strlen(suffix);
+    if (topic_len <= prefix_len + suffix_len || memcmp(topic, GATEWAY_TOPIC_PREFIX, prefix_len) != 0
+        || memcmp(&topic[topic_len - suffix_len], suffix, suffix_len) != 0) {
+        return false;
+    }
+    *id_len = topic_len - prefix_len - suffix_len;
+    return true;
+}
+
+// Topic is fancontroller/<id>/status or fancontroller/<id>/status/cbor, not terminated
+static void gateway_on_message(const char* topic, size_t topic_len, const char* payload, size_t payload_len, void* ctx)
+{
+    const char* id = &topic[strlen(GATEWAY_TOPIC_PREFIX)];
+    size_t id_len;
+    if (gateway_topic_is(topic, topic_len, GATEWAY_TOPIC_CBOR_SUFFIX, &id_len)) {
+        fleet_update_cbor(id, id_len, payload, payload_len, gateway_now_us());
+    } else if (gateway_topic_is(topic, topic_len, GATEWAY_TOPIC_SUFFIX, &id_len)) {
+        fleet_update(id, id_len, payload, payload_len, gateway_now_us());
+    }
+}
+
+// Splits a file into reports pointing into data: JSON lines, or CBOR reports back to back as
+// written by fancontroller-sim --cbor
+static size_t gateway_bench_split(char* data, size_t len, bool cbor, char** reports, size_t* lengths)
+{
+    size_t count = 0;
+    size_t pos = 0;
+    while (count < GATEWAY_BENCH_MAX_LINES && pos < len) {
+        size_t end;
+        if (cbor) {
+            cbor_reader_t reader;
+            cbor_reader_init(&reader, &data[pos], len - pos);
+            if (!cbor_skip(&reader)) {
+                break;
+            }
+            end = pos + reader.pos;
+        } else {
+            const char* newline = memchr(&data[pos], '\n', len - pos);
+            end = (newline != NULL) ? (size_t)(newline - data) : len;
+        }
+        // Other output of the simulation is skipped, its summary counts as rejected
+        if (cbor || data[pos] == '{') {
+            reports[count] = &data[pos];
+            lengths[count++] = end - pos;
+        }
+        pos = cbor ? end : end + 1;
+    }
+    return count;
+}
+
+static int gateway_bench(const char* path, size_t controllers, size_t iterations)
+{
+    // The reports are spread as i % controllers, and averaged over the iterations
+    if (controllers == 0 || iterations == 0) {
+        fprintf(stderr, "the benchmark needs at least one controller and one iteration\n");
+        return 1;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+    char* data = malloc(size > 0 ? size : 1);
+    const size_t len = fread(data, 1, size > 0 ? size : 0, file);
+    fclose(file);
+
+    static char* reports[GATEWAY_BENCH_MAX_LINES];
+    static size_t lengths[GATEWAY_BENCH_MAX_LINES];
+    const bool cbor = len > 0 && (uint8_t)data[0] == GATEWAY_CBOR_MAP;
+    const size_t count = gateway_bench_split(data, len, cbor, reports, lengths);
+    if (count == 0) {
+        fprintf(stderr, "%s: no status reports\n", path);
+        free(data);
+        return 1;
+    }
+
+    char (*ids)[FLEET_ID_SIZE] = calloc(controllers, FLEET_ID_SIZE);
+    for (size_t i = 0; i < controllers; ++i) {
+        snprintf(ids[i], FLEET_ID_SIZE, "02:00:00:00:%02zx:%02zx", (i >> 8) & 0xff, i & 0xff);
+    }
+
+    size_t rejected = 0;
+    uint64_t bytes = 0;
+    const int64_t start = gateway_now_us();
+    for (size_t i = 0; i < iterations; ++i) {
+        const size_t report = i % count;
+        const size_t id = i % controllers;
+        const int64_t now_us = gateway_now_us();
+        rejected += cbor ? !fleet_update_cbor(ids[id], strlen(ids[id]), reports[report], lengths[report], now_us)
+                         : !fleet_update(ids[id], strlen(ids[id]), reports[report], lengths[report], now_us);
+        bytes += lengths[report];
+    }
+    const int64_t elapsed = gateway_now_us() - start;
+
+    fleet_summary_t summary;
+    fleet_summary(&summary, gateway_now_us());
+    printf("%zu %s reports (%zu distinct, %.0f bytes average) over %zu controllers in %.3f s\n",
+        iterations, cbor ? "CBOR" : "JSON", count, (double)bytes / iterations, controllers, elapsed / 1e6);
+    printf("%.0f msgs/s, %.1f MB/s, %.2f us/msg, %zu rejected\n",
+        iterations * 1e6 / elapsed, bytes / (double)elapsed, (double)elapsed / iterations, rejected);
+    printf("fleet: %zu controllers, %zu online, vbus %llu mW, rpm %u..%u\n", summary.controllers, summary.online,
+        (unsigned long long)summary.vbus_mw, summary.rpm_min, summary.rpm_max);
+
+    free(data);
+    free(ids);
+    return (rejected == iterations) ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = {
+        { "broker", required_argument, NULL, 'b' },
+        { "listen", required_argument, NULL, 'l' },
+        { "stale", required_argument, NULL, 's' },
+        { "bench", required_argument, NULL, 'B' },
+        { "controllers", required_argument, NULL, 'c' },
+        { "iterations", required_argument, NULL, 'i' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    char host[256] = "127.0.0.1";
+    unsigned long port = 1883;
+    unsigned long listen_port = 8080;
+    double stale_s = 5;
+    const char* bench = NULL;
+    size_t controllers = 64;
+    size_t iterations = 200000;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'b': {
+            snprintf(host, sizeof(host), "%s", optarg);
+            char* colon = strrchr(host, ':');
+            if (colon != NULL) {
+                *colon = '\0';
+                port = strtoul(colon + 1, NULL, 10);
+            }
+            break;
+        }
+        case 'l':
+            listen_port = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            stale_s = atof(optarg);
+            break;
+        case 'B':
+            bench = optarg;
+            break;
+        case 'c':
+            controllers = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (port == 0 || port > UINT16_MAX || listen_port == 0 || listen_port > UINT16_MAX || stale_s <= 0
+        || controllers == 0 || controllers > FLEET_MAX_CONTROLLERS || iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fleet_init(stale_s * 1000000);
+    if (bench != NULL) {
+        return gateway_bench(bench, controllers, iterations);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    mqtt_client_init(&s_client);
+    if (gateway_http_start(listen_port, &s_client) != 0) {
+        perror("HTTP server");
+        return 1;
+    }
+
+    char client_id[32];
+    snprintf(client_id, sizeof(client_id), "fancontroller-gateway-%d", (int)getpid());
+    unsigned int backoff_s = 1;
+    while (1) {
+        if (mqtt_client_connect(&s_client, host, port, client_id, GATEWAY_KEEPALIVE_S) == 0
+            && mqtt_client_subscribe(&s_client, GATEWAY_STATUS_FILTER) == 0
+            && mqtt_client_subscribe(&s_client, GATEWAY_STATUS_CBOR_FILTER) == 0) {
+            fprintf(stderr, "connected to %s:%lu, serving on port %lu\n", host, port, listen_port);
+            backoff_s = 1;
+            mqtt_client_run(&s_client, gateway_on_message, NULL);
+            mqtt_client_close(&s_client);
+            fprintf(stderr, "connection to %s:%lu lost\n", host, port);
+        } else {
+            fprintf(stderr, "cannot connect to %s:%lu, retrying in %u s\n", host, port, backoff_s);
+        }
+        sleep(backoff_s);
+        backoff_s = (backoff_s * 2 > GATEWAY_RECONNECT_MAX_S) ? GATEWAY_RECONNECT_MAX_S : backoff_s * 2;
+    }
+}
@@ -0,0 +1,312 @@
+#include "json_scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_SCAN_MAX_DEPTH 32
+
+typedef struct
+{
+    const char* json;
+    size_t len;
+    size_t pos;
+    json_scan_token_t* tokens;
+    size_t max_tokens;
+    int count;
+    int depth;
+} json_scan_parser_t;
+
+static void json_scan_ws(json_scan_parser_t* p)
+{
+    while (p->pos < p->len && (p->json[p->pos] == ' ' || p->json[p->pos] == '\t' || p->json[p->pos] == '\n' || p->json[p->pos] == '\r')) {
+        p->pos++;
+    }
+}
+
+static int json_scan_token(json_scan_parser_t* p, json_scan_type_t type, size_t start)
+{
+    if ((size_t)p->count >= p->max_tokens) {
+        return JSON_SCAN_ERROR_TOKENS;
+    }
+    p->tokens[p->count] = (json_scan_token_t) {
+        .type = type,
+        .start = start,
+        .end = start,
+        .next = p->count + 1,
+    };
+    return p->count++;
+}
+
+static int json_scan_parse_string(json_scan_parser_t* p)
+{
+    const size_t start = ++p->pos; // Opening quote
+    while (p->pos < p->len) {
+        const unsigned char c = p->json[p->pos];
+        if (c == '"') {
+            const int token = json_scan_token(p, JSON_SCAN_STRING, start);
+            if (token >= 0) {
+                p->tokens[token].end = p->pos;
+            }
+            p->pos++;
+            return token;
+        }
+        if (c < 0x20) {
+            return JSON_SCAN_ERROR_INVALID;
+        }
+        p->pos += (c == '\\') ? 2 : 1;
+    }
+    return JSON_SCAN_ERROR_INVALID;
+}
+
+static int json_scan_parse_literal(json_scan_parser_t* p, const char* literal, json_scan_type_t type)
+{
+    const size_t len = strlen(literal);
+    if (p->len - p->pos < len || memcmp(&p->json[p->pos], literal, len) != 0) {
+        return JSON_SCAN_ERROR_INVALID;
+    }
+
+    const int token = json_scan_token(p, type, p->pos);
+    p->pos += len;
+    if (token >= 0) {
+        p->tokens[token].end = p->pos;
+    }
+    return token;
+}
+
+static int json_scan_parse_number(json_scan_parser_t* p)
+{
+    const size_t start = p->pos;
+    bool digits = false;
+    while (p->pos < p->len && strchr("+-0123456789.eE", p->json[p->pos]) != NULL && p->json[p->pos] != '\0') {
+        digits |= (p->json[p->pos] >= '0' && p->json[p->pos] <= '9');
+        p->pos++;
+    }
+    if (!digits) {
+        return JSON_SCAN_ERROR_INVALID;
+    }
+
+    const int token = json_scan_token(p, JSON_SCAN_NUMBER, start);
+    if (token >= 0) {
+        p->tokens[token].end = p->pos;
+    }
+    return token;
+}
+
+static int json_scan_parse_value(json_scan_parser_t* p);
+
+static int json_scan_parse_container(json_scan_parser_t* p, bool object)
+{
+    if (++p->depth > JSON_SCAN_MAX_DEPTH) {
+        return JSON_SCAN_ERROR_INVALID;
+    }
+
+    const char close = object ? '}' : ']';
+    const int container = json_scan_token(p, object ? JSON_SCAN_OBJECT : JSON_SCAN_ARRAY, p->pos);
+    if (container < 0) {
+        return container;
+    }
+    p->pos++;
+
+    json_scan_ws(p);
+    if (p->pos < p->len && p->json[p->pos] == close) {
+        p->pos++;
+    } else {
+        while (1) {
+            json_scan_ws(p);
+            if (object) {
+                if (p->pos >= p->len || p->json[p->pos] != '"') {
+                    return JSON_SCAN_ERROR_INVALID;
+                }
+                const int key = json_scan_parse_string(p);
+                if (key < 0) {
+                    return key;
+                }
+                json_scan_ws(p);
+                if (p->pos >= p->len || p->json[p->pos] != ':') {
+                    return JSON_SCAN_ERROR_INVALID;
+                }
+                p->pos++;
+            }
+
+            const int value = json_scan_parse_value(p);
+            if (value < 0) {
+                return value;
+            }
+            p->tokens[container].size++;
+
+            json_scan_ws(p);
+            if (p->pos < p->len && p->json[p->pos] == ',') {
+                p->pos++;
+            } else if (p->pos < p->len && p->json[p->pos] == close) {
+                p->pos++;
+                break;
+            } else {
+                return JSON_SCAN_ERROR_INVALID;
+            }
+        }
+    }
+
+    p->tokens[container].end = p->pos;
+    p->tokens[container].next = p->count;
+    p->depth--;
+    return container;
+}
+
+static int json_scan_parse_value(json_scan_parser_t* p)
+{
+    json_scan_ws(p);
+    if (p->pos >= p->len) {
+        return JSON_SCAN_ERROR_INVALID;
+    }
+
+    switch (p->json[p->pos]) {
+    case '{':
+        return json_scan_parse_container(p, true);
+    case '[':
+        return json_scan_parse_container(p, false);
+    case '"':
+        return json_scan_parse_string(p);
+    case 't':
+        return json_scan_parse_literal(p, "true", JSON_SCAN_TRUE);
+    case 'f':
+        return json_scan_parse_literal(p, "false", JSON_SCAN_FALSE);
+    case 'n':
+        return json_scan_parse_literal(p, "null", JSON_SCAN_NULL);
+    default:
+        return json_scan_parse_number(p);
+    }
+}
+
+int json_scan_parse(const char* json, size_t len, json_scan_token_t* tokens, size_t max_tokens)
+{
+    json_scan_parser_t p = {
+        .json = json,
+        .len = len,
+        .tokens = tokens,
+        .max_tokens = max_tokens,
+    };
+
+    const int root = json_scan_parse_value(&p);
+    if (root < 0) {
+        return root;
+    }
+
+    json_scan_ws(&p);
+    return (p.pos == len) ? p.count : JSON_SCAN_ERROR_INVALID;
+}
+
+static bool json_scan_key_is(const json_scan_t* scan, int token, const char* key, size_t key_len)
+{
+    const json_scan_token_t* t = &scan->tokens[token];
+    return t->end - t->start == key_len && memcmp(&scan->json[t->start], key, key_len) == 0;
+}
+
+static int json_scan_get_n(const json_scan_t* scan, int object, const char* key, size_t key_len)
+{
+    if (object < 0 || object >= scan->count || scan->tokens[object].type != JSON_SCAN_OBJECT) {
+        return -1;
+    }
+
+    int token = object + 1;
+    for (uint32_t i = 0; i < scan->tokens[object].size; ++i) {
+        if (json_scan_key_is(scan, token, key, key_len)) {
+            return token + 1;
+        }
+        token = scan->tokens[token + 1].next;
+    }
+    return -1;
+}
+
+int json_scan_get(const json_scan_t* scan, int object, const char* key)
+{
+    return json_scan_get_n(scan, object, key, strlen(key));
+}
+
+int json_scan_path(const json_scan_t* scan, int object, const char* path)
+{
+    while (object >= 0) {
+        const char* dot = strchr(path, '.');
+        if (dot == NULL) {
+            return json_scan_get(scan, object, path);
+        }
+        object = json_scan_get_n(scan, object, path, dot - path);
+        path = dot + 1;
+    }
+    return -1;
+}
+
+bool json_scan_uint(const json_scan_t* scan, int token, uint64_t* out)
+{
+    if (token < 0 || scan->tokens[token].type != JSON_SCAN_NUMBER) {
+        return false;
+    }
+
+    // Integers are the common case, fractions go through strtod
+    const json_scan_token_t* t = &scan->tokens[token];
+    uint64_t value = 0;
+    for (uint32_t i = t->start; i < t->end; ++i) {
+        const char c = scan->json[i];
+        if (c < '0' || c > '9') {
+            double number;
+            if (!json_scan_number(scan, token, &number) || number < 0) {
+                return false;
+            }
+            *out = number;
+            return true;
+        }
+        value = value * 10 + (c - '0');
+    }
+    *out = value;
+    return true;
+}
+
+bool json_scan_number(const json_scan_t* scan, int token, double* out)
+{
+    if (token < 0 || scan->tokens[token].type != JSON_SCAN_NUMBER) {
+        return false;
+    }
+
+    // strtod needs a terminator the buffer does not have
+    char number[64];
+    const json_scan_token_t* t = &scan->tokens[token];
+    const size_t len = t->end - t->start;
+    if (len >= sizeof(number)) {
+        return false;
+    }
+    memcpy(number, &scan->json[t->start], len);
+    number[len] = '\0';
+
+    char* end;
+    *out = strtod(number, &end);
+    return *end == '\0';
+}
+
+bool json_scan_bool(const json_scan_t* scan, int token, bool* out)
+{
+    if (token < 0 || (scan->tokens[token].type != JSON_SCAN_TRUE && scan->tokens[token].type != JSON_SCAN_FALSE)) {
+        return false;
+    }
+    *out = (scan->tokens[token].type == JSON_SCAN_TRUE);
+    return true;
+}
+
+bool json_scan_string(const json_scan_t* scan, int token, char* out, size_t size)
+{
+    if (token < 0 || scan->tokens[token].type != JSON_SCAN_STRING || size == 0) {
+        return false;
+    }
+
+    const json_scan_token_t* t = &scan->tokens[token];
+    size_t len = t->end - t->start;
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(out, &scan->json[t->start], len);
+    out[len] = '\0';
+    return true;
+}
+
+bool json_scan_string_is(const json_scan_t* scan, int token, const char* str)
+{
+    return token >= 0 && scan->tokens[token].type == JSON_SCAN_STRING && json_scan_key_is(scan, token, str, strlen(str));
+}
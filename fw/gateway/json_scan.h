@@ -0,0 +1,51 @@
+#pragma once
+
+// Zero-copy JSON tokenizer: tokens are offsets into the caller's buffer, nothing is allocated or unescaped
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    JSON_SCAN_OBJECT,
+    JSON_SCAN_ARRAY,
+    JSON_SCAN_STRING, // Without the quotes, escapes left as they are
+    JSON_SCAN_NUMBER,
+    JSON_SCAN_TRUE,
+    JSON_SCAN_FALSE,
+    JSON_SCAN_NULL,
+} json_scan_type_t;
+
+typedef struct
+{
+    json_scan_type_t type;
+    uint32_t start;
+    uint32_t end;
+    uint32_t size; // Members of an object (key and value count as one) or elements of an array
+    uint32_t next; // Index of the first token after this one and everything it contains
+} json_scan_token_t;
+
+typedef struct
+{
+    const char* json;
+    const json_scan_token_t* tokens;
+    int count;
+} json_scan_t;
+
+#define JSON_SCAN_ERROR_INVALID (-1)
+#define JSON_SCAN_ERROR_TOKENS (-2) // More tokens than fit
+
+// Returns the number of tokens, the root is token 0. Object members are a key token followed by the value.
+int json_scan_parse(const char* json, size_t len, json_scan_token_t* tokens, size_t max_tokens);
+
+// Value token of key in the object token, or -1
+int json_scan_get(const json_scan_t* scan, int object, const char* key);
+// Follows a dotted path of keys from the object token, e.g. "power.vbus_ma.rms"
+int json_scan_path(const json_scan_t* scan, int object, const char* path);
+
+bool json_scan_number(const json_scan_t* scan, int token, double* out);
+bool json_scan_uint(const json_scan_t* scan, int token, uint64_t* out);
+bool json_scan_bool(const json_scan_t* scan, int token, bool* out);
+// Copies a string token into out, truncated to size
+bool json_scan_string(const json_scan_t* scan, int token, char* out, size_t size);
+bool json_scan_string_is(const json_scan_t* scan, int token, const char* str);
@@ -0,0 +1,294 @@
+#include "mqtt_client.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gateway.h"
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_SUBSCRIBE 0x82 // Reserved flags 0010
+#define MQTT_SUBACK 0x90
+#define MQTT_PINGREQ 0xc0
+#define MQTT_PINGRESP 0xd0
+#define MQTT_DISCONNECT 0xe0
+
+#define MQTT_HEADER_MAX 5 // Type and up to four bytes of remaining length
+
+static size_t mqtt_client_put_length(uint8_t* out, size_t length)
+{
+    size_t n = 0;
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        out[n++] = byte | ((length > 0) ? 0x80 : 0);
+    } while (length > 0);
+    return n;
+}
+
+static size_t mqtt_client_put_string(uint8_t* out, const char* str, size_t len)
+{
+    out[0] = len >> 8;
+    out[1] = len & 0xff;
+    memcpy(&out[2], str, len);
+    return len + 2;
+}
+
+static int mqtt_client_write_unsafe(mqtt_client_t* client, const struct iovec* iov, int iovcnt)
+{
+    struct msghdr msg = {
+        .msg_iov = (struct iovec*)iov,
+        .msg_iovlen = iovcnt,
+    };
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        total += iov[i].iov_len;
+    }
+
+    // Packets are small next to the socket buffer, a short write only happens on a congested link
+    while (total > 0) {
+        ssize_t written = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total -= written;
+        while (written > 0 && msg.msg_iovlen > 0) {
+            if ((size_t)written >= msg.msg_iov->iov_len) {
+                written -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov->iov_base = (uint8_t*)msg.msg_iov->iov_base + written;
+                msg.msg_iov->iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+    client->last_write_us = gateway_now_us();
+    return 0;
+}
+
+static int mqtt_client_send(mqtt_client_t* client, uint8_t type, const uint8_t* head, size_t head_len, const void* body, size_t body_len)
+{
+    uint8_t header[MQTT_HEADER_MAX];
+    header[0] = type;
+    const size_t header_len = 1 + mqtt_client_put_length(&header[1], head_len + body_len);
+
+    struct iovec iov[3] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = (void*)head, .iov_len = head_len },
+        { .iov_base = (void*)body, .iov_len = body_len },
+    };
+
+    pthread_mutex_lock(&client->write_lock);
+    const int ret = (client->fd >= 0) ? mqtt_client_write_unsafe(client, iov, 3) : -1;
+    pthread_mutex_unlock(&client->write_lock);
+    return ret;
+}
+
+// Blocks until one whole packet is in the buffer, returns it and its length, 0 on timeout or -1
+static ssize_t mqtt_client_read_packet(mqtt_client_t* client, int timeout_ms, const uint8_t** packet, size_t* header_len, size_t* remaining)
+{
+    while (1) {
+        // Try to decode what is there already
+        const uint8_t* p = &client->buffer[client->buffer_start];
+        const size_t available = client->buffer_len - client->buffer_start;
+        size_t length = 0;
+        size_t i = 1;
+        for (uint32_t multiplier = 1; i < available && i < MQTT_HEADER_MAX; ++i, multiplier *= 128) {
+            length += (p[i] & 0x7f) * multiplier;
+            if (!(p[i] & 0x80)) {
+                break;
+            }
+        }
+        if (i < available && !(p[i] & 0x80)) {
+            if (i + 1 + length > sizeof(client->buffer)) {
+                return -1;
+            }
+            if (available >= i + 1 + length) {
+                *packet = p;
+                *header_len = i + 1;
+                *remaining = length;
+                client->buffer_start += i + 1 + length;
+                return i + 1 + length;
+            }
+        } else if (available >= MQTT_HEADER_MAX) {
+            return -1; // Malformed length
+        }
+
+        struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+        const int ready = poll(&pfd, 1, timeout_ms);
+        if (ready == 0) {
+            return 0;
+        }
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        // Only the partial packet at the end is moved
+        memmove(client->buffer, &client->buffer[client->buffer_start], available);
+        client->buffer_start = 0;
+        client->buffer_len = available;
+
+        const ssize_t received = recv(client->fd, &client->buffer[client->buffer_len], sizeof(client->buffer) - client->buffer_len, 0);
+        if (received <= 0) {
+            return -1;
+        }
+        client->buffer_len += received;
+    }
+}
+
+void mqtt_client_init(mqtt_client_t* client)
+{
+    client->fd = -1;
+    client->buffer_start = 0;
+    client->buffer_len = 0;
+    pthread_mutex_init(&client->write_lock, NULL);
+}
+
+int mqtt_client_connect(mqtt_client_t* client, const char* host, uint16_t port, const char* client_id, uint16_t keepalive_s)
+{
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo* addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* a = addresses; a != NULL && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return -1;
+    }
+
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Commands should not wait for the next report
+
+    pthread_mutex_lock(&client->write_lock);
+    client->fd = fd;
+    pthread_mutex_unlock(&client->write_lock);
+    client->buffer_start = 0;
+    client->buffer_len = 0;
+    client->keepalive_s = keepalive_s;
+
+    uint8_t head[64];
+    size_t n = mqtt_client_put_string(head, "MQTT", 4);
+    head[n++] = 4; // Protocol level 3.1.1
+    head[n++] = 0x02; // Clean session
+    head[n++] = keepalive_s >> 8;
+    head[n++] = keepalive_s & 0xff;
+    const size_t id_len = strnlen(client_id, sizeof(head) - n - 2);
+    n += mqtt_client_put_string(&head[n], client_id, id_len);
+
+    const uint8_t* packet;
+    size_t header_len;
+    size_t remaining;
+    if (mqtt_client_send(client, MQTT_CONNECT, head, n, NULL, 0) != 0
+        || mqtt_client_read_packet(client, 5000, &packet, &header_len, &remaining) <= 0
+        || packet[0] != MQTT_CONNACK || remaining != 2 || packet[header_len + 1] != 0) {
+        mqtt_client_close(client);
+        return -1;
+    }
+
+    return 0;
+}
+
+int mqtt_client_subscribe(mqtt_client_t* client, const char* filter)
+{
+    uint8_t head[256];
+    const size_t len = strlen(filter);
+    if (len + 5 > sizeof(head)) {
+        return -1;
+    }
+
+    const uint16_t id = ++client->packet_id ? client->packet_id : ++client->packet_id;
+    size_t n = 0;
+    head[n++] = id >> 8;
+    head[n++] = id & 0xff;
+    n += mqtt_client_put_string(&head[n], filter, len);
+    head[n++] = 0; // QoS 0
+    return mqtt_client_send(client, MQTT_SUBSCRIBE, head, n, NULL, 0);
+}
+
+int mqtt_client_publish(mqtt_client_t* client, const char* topic, const void* payload, size_t len)
+{
+    uint8_t head[256];
+    const size_t topic_len = strlen(topic);
+    if (topic_len + 2 > sizeof(head)) {
+        return -1;
+    }
+
+    const size_t n = mqtt_client_put_string(head, topic, topic_len);
+    return mqtt_client_send(client, MQTT_PUBLISH, head, n, payload, len);
+}
+
+int mqtt_client_run(mqtt_client_t* client, mqtt_client_message_t on_message, void* ctx)
+{
+    const int64_t ping_interval_us = client->keepalive_s * 1000000LL / 2;
+
+    while (1) {
+        const int64_t now = gateway_now_us();
+        if (client->keepalive_s > 0 && now - client->last_write_us >= ping_interval_us) {
+            if (mqtt_client_send(client, MQTT_PINGREQ, NULL, 0, NULL, 0) != 0) {
+                return -1;
+            }
+        }
+
+        const uint8_t* packet;
+        size_t header_len;
+        size_t remaining;
+        const ssize_t len = mqtt_client_read_packet(client, 500, &packet, &header_len, &remaining);
+        if (len < 0) {
+            return -1;
+        } else if (len == 0) {
+            continue;
+        }
+
+        const uint8_t* body = &packet[header_len];
+        if ((packet[0] & 0xf0) == MQTT_PUBLISH && remaining >= 2) {
+            const size_t topic_len = (body[0] << 8) | body[1];
+            // A QoS 1 or 2 delivery carries a packet id, the subscription asks for QoS 0 so it is skipped
+            const size_t skip = 2 + topic_len + ((packet[0] & 0x06) ? 2 : 0);
+            if (skip <= remaining) {
+                on_message((const char*)&body[2], topic_len, (const char*)&body[skip], remaining - skip, ctx);
+            }
+        }
+        // SUBACK and PINGRESP need no handling
+    }
+}
+
+void mqtt_client_close(mqtt_client_t* client)
+{
+    pthread_mutex_lock(&client->write_lock);
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    pthread_mutex_unlock(&client->write_lock);
+}
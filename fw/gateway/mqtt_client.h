@@ -0,0 +1,34 @@
+#pragma once
+
+// Minimal MQTT 3.1.1 client over plain TCP: QoS 0 publish and subscribe, enough to talk to the controllers' broker
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MQTT_CLIENT_BUFFER_SIZE (256 * 1024) // Several status reports, they are parsed in place
+
+typedef void (*mqtt_client_message_t)(const char* topic, size_t topic_len, const char* payload, size_t payload_len, void* ctx);
+
+typedef struct
+{
+    int fd;
+    uint16_t keepalive_s;
+    uint16_t packet_id;
+    int64_t last_write_us;
+    pthread_mutex_t write_lock; // Publishing happens from other threads than the receive loop
+    uint8_t buffer[MQTT_CLIENT_BUFFER_SIZE];
+    size_t buffer_start; // Packets are consumed from here, the rest is only moved down before the next read
+    size_t buffer_len;
+} mqtt_client_t;
+
+void mqtt_client_init(mqtt_client_t* client);
+
+// Returns 0 once the broker has accepted the connection
+int mqtt_client_connect(mqtt_client_t* client, const char* host, uint16_t port, const char* client_id, uint16_t keepalive_s);
+int mqtt_client_subscribe(mqtt_client_t* client, const char* filter);
+int mqtt_client_publish(mqtt_client_t* client, const char* topic, const void* payload, size_t len);
+
+// Dispatches incoming messages until the connection fails, then returns -1
+int mqtt_client_run(mqtt_client_t* client, mqtt_client_message_t on_message, void* ctx);
+void mqtt_client_close(mqtt_client_t* client);
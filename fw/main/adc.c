@@ -1,18 +1,34 @@
 #include "adc.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
-#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <esp_adc/adc_cali.h>
 #include <esp_adc/adc_cali_scheme.h>
 #include <esp_adc/adc_continuous.h>
+#include <soc/soc_caps.h>
+#if SOC_ADC_MONITOR_SUPPORTED && CONFIG_SUPERVISOR_BUS_HW_MONITOR
+#include <esp_adc/adc_monitor.h>
+#define ADC_BUS_MONITOR 1
+#endif
 
+#include <sdkconfig.h>
+
+#include "calibration.h"
+#include "energy.h"
 #include "events.h"
+#include "periodic.h"
+#include "settings.h"
+#include "supervisor.h"
+#include "tasks.h"
+#include "trace.h"
 #include "util.h"
+#include "watchdog.h"
 
 #define TAG "adc"
 
@@ -22,9 +38,6 @@
 #define ADC_ATTEN ADC_ATTEN_DB_0 /* Up to 750mV */
 #define ADC_RAW_RANGE (1 << ADC_BIT_WIDTH)
 
-#define CURRENT_SENSE_RES_MILLIOHM 30
-#define CURRENT_SENSE_AMPLIFICATION 20
-
 #define ADC_CHANNEL(adc_channel_nr) ADC_CHANNEL_##adc_channel_nr
 
 static adc_channel_t adc_channel[8] = {
@@ -38,24 +51,70 @@ static adc_channel_t adc_channel[8] = {
     ADC_CHANNEL(8),
 };
 
-#define ADC_OVERSAMPLING 32
-#define ADC_FRAME_LEN (SOC_ADC_DIGI_DATA_BYTES_PER_CONV * ARRAY_SIZE(adc_channel) * ADC_OVERSAMPLING)
+// The rail voltages barely move, the currents carry the PWM ripple and get the extra conversions
+#define ADC_VOLTAGE_CHANNELS 2
+#define ADC_PATTERN_LEN (ADC_VOLTAGE_CHANNELS + (ARRAY_SIZE(adc_channel) - ADC_VOLTAGE_CHANNELS) * CONFIG_ADC_CURRENT_WEIGHT)
+_Static_assert(ADC_PATTERN_LEN <= SOC_ADC_PATT_LEN_MAX, "CONFIG_ADC_CURRENT_WEIGHT does not fit the pattern table");
+
+// Oversampling counts repetitions of the whole pattern
+#define ADC_FRAME_LEN(oversampling) (SOC_ADC_DIGI_DATA_BYTES_PER_CONV * ADC_PATTERN_LEN * (oversampling))
+#define ADC_FRAME_LEN_MAX ADC_FRAME_LEN(SETTINGS_ADC_OVERSAMPLING_MAX)
 
 #define SAMPLES_COUNT ARRAY_SIZE(adc_channel)
+_Static_assert(CALIBRATION_INPUT_COUNT == SAMPLES_COUNT, "Calibration inputs follow the sample channels");
+
+// Nominal rail voltage divider, replaced by the calibration where there is one
+#define ADC_DIVIDER_R1 1000
+#define ADC_DIVIDER_R2 47
+
+#define ADC_PIN_AVERAGE_SHIFT 4 // Calibration points are taken from a moving average over about 16 frames
+
+#define ADC_ACTIVITY_THRESHOLD_MA 20 // Bus current drift that counts as the load changing
+
+#ifdef CONFIG_POWER_SAVE
+#define ADC_DEADLINE_MS (CONFIG_POWER_SAVE_ADC_INTERVAL_MS + 1000)
+#else
+#define ADC_DEADLINE_MS 1000
+#endif
+
+#define ADC_HISTOGRAM_BINS 128
+#define ADC_HISTOGRAM_BIN_CODES (ADC_RAW_RANGE / ADC_HISTOGRAM_BINS)
 
 typedef struct
 {
     uint32_t min;
     uint32_t max;
     uint32_t rms;
+    uint32_t sum;
     uint32_t count;
+    uint64_t power; // Sum of the products with the rail voltage, current channels only
+    uint16_t bins[ADC_HISTOGRAM_BINS]; // Raw codes, a frame holds at most a few hundred conversions per channel
 } sample_intermediate_t;
 
+typedef sample_intermediate_t samples_intermediate_t[SAMPLES_COUNT];
+
+// Millivolts at the pin to the reading, precomputed so a frame needs no divisions
+typedef struct
+{
+    uint32_t gain_q16;
+    int32_t offset;
+} adc_scale_t;
+
 static TaskHandle_t s_task_handle;
+static volatile int64_t s_conv_done_us;
 static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
 
-static adc_cali_handle_t s_cali_handle;
+static uint16_t s_millivolts[ADC_RAW_RANGE]; // Calibrated voltage of every raw code, filled before the conversions start
 static adc_samples_t s_samples;
+static uint8_t s_frame[ADC_FRAME_LEN_MAX]; // Only touched by the task, kept off its stack
+static uint32_t s_frame_len;
+static samples_intermediate_t s_intermediate; // Only touched by the task, too large for its stack
+static uint32_t s_frames;
+static volatile uint32_t s_pool_overflows;
+static adc_scale_t s_scale[SAMPLES_COUNT]; // Only touched by the task once it runs
+static volatile bool s_scale_stale; // Set on settings and calibration changes, picked up before the next frame
+static int32_t s_pin_uv[SAMPLES_COUNT]; // Averaged means at the pins, for taking calibration points
 
 static uint32_t min(uint32_t x, uint32_t y)
 {
@@ -67,85 +126,344 @@ static uint32_t max(uint32_t x, uint32_t y)
     return (y < x) ? x : y;
 }
 
-static uint32_t raw_to_millivolts(uint32_t raw)
+static inline uint32_t raw_to_millivolts(uint32_t raw)
 {
-    int voltage;
-    ESP_ERROR_CHECK(adc_cali_raw_to_voltage(s_cali_handle, raw, &voltage));
-    return voltage;
+    return s_millivolts[raw];
 }
 
-static adc_sample_t sample_voltage_divider(adc_sample_t sample, uint32_t r1, uint32_t r2)
+// The curve fitting is evaluated once per code here rather than once per conversion in the frame loop
+static void millivolts_init(void)
 {
-    sample.rms = ((uint32_t)sample.rms) * (r1 + r2) / r2;
-    sample.max = ((uint32_t)sample.max) * (r1 + r2) / r2;
-    return sample;
+    adc_cali_handle_t cali_handle;
+    adc_cali_curve_fitting_config_t cali_config = {
+        .unit_id = ADC_UNIT,
+        .atten = ADC_ATTEN,
+        .bitwidth = ADC_BIT_WIDTH,
+    };
+    ESP_ERROR_CHECK(adc_cali_create_scheme_curve_fitting(&cali_config, &cali_handle));
+
+    for (uint32_t raw = 0; raw < ADC_RAW_RANGE; ++raw) {
+        int voltage;
+        ESP_ERROR_CHECK(adc_cali_raw_to_voltage(cali_handle, raw, &voltage));
+        s_millivolts[raw] = voltage;
+    }
+
+    ESP_ERROR_CHECK(adc_cali_delete_scheme_curve_fitting(cali_handle));
+}
+
+static uint16_t isqrt(uint32_t x)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+static uint16_t clamp_u16(int64_t value)
+{
+    return (value < 0) ? 0 : (value > UINT16_MAX) ? UINT16_MAX : value;
+}
+
+static int64_t scale_value(uint32_t millivolts, adc_scale_t scale)
+{
+    return (int64_t)(((uint64_t)millivolts * scale.gain_q16) >> CALIBRATION_GAIN_SHIFT) + scale.offset;
 }
 
-static adc_sample_t sample_current_sense(adc_sample_t sample)
+static adc_sample_t sample_scale(adc_sample_t sample, adc_scale_t scale)
 {
-    sample.rms = ((uint32_t)sample.rms) * 1000 / CURRENT_SENSE_RES_MILLIOHM / CURRENT_SENSE_AMPLIFICATION;
-    sample.max = ((uint32_t)sample.max) * 1000 / CURRENT_SENSE_RES_MILLIOHM / CURRENT_SENSE_AMPLIFICATION;
+    // With an offset the RMS is no longer proportional: E[(ax + b)^2] = (a rms)^2 + 2ab mean + b^2
+    if (scale.offset == 0) {
+        sample.rms = clamp_u16(scale_value(sample.rms, scale));
+    } else {
+        const int64_t a_rms = scale_value(sample.rms, (adc_scale_t) { .gain_q16 = scale.gain_q16 });
+        const int64_t a_mean = scale_value(sample.mean, (adc_scale_t) { .gain_q16 = scale.gain_q16 });
+        const int64_t square = a_rms * a_rms + 2 * scale.offset * a_mean + (int64_t)scale.offset * scale.offset;
+        sample.rms = (square < 0) ? 0 : (square > UINT32_MAX) ? UINT16_MAX : isqrt(square);
+    }
+    sample.max = clamp_u16(scale_value(sample.max, scale));
+    sample.mean = clamp_u16(scale_value(sample.mean, scale));
+    sample.min = clamp_u16(scale_value(sample.min, scale));
+    sample.p95 = clamp_u16(scale_value(sample.p95, scale));
+    sample.p99 = clamp_u16(scale_value(sample.p99, scale));
     return sample;
 }
 
-static adc_sample_t sample_from_intermediate(sample_intermediate_t sample_intermediate)
+// Interpolated within the bin the rank falls in, as if its values were spread evenly over the part
+// of the bin between the exact extremes
+static uint32_t sample_percentile_in_bin(const sample_intermediate_t* sample_intermediate, uint32_t bin, uint32_t rank_in_bin)
 {
-    uint16_t rms = sqrt(sample_intermediate.rms / sample_intermediate.count);
+    const uint32_t low = max(raw_to_millivolts(bin * ADC_HISTOGRAM_BIN_CODES), sample_intermediate->min);
+    const uint32_t high = min(raw_to_millivolts((bin + 1) * ADC_HISTOGRAM_BIN_CODES - 1), sample_intermediate->max);
+    if (high <= low) {
+        return low;
+    }
+    return low + (high - low) * rank_in_bin / (sample_intermediate->bins[bin] + 1);
+}
 
-    return (adc_sample_t) {
-        .max = sample_intermediate.max,
+// Both percentiles from one walk over the bins, p99 is never below p95
+static void sample_percentiles(const sample_intermediate_t* sample_intermediate, adc_sample_t* sample)
+{
+    const uint32_t p95_rank = (sample_intermediate->count * 95 + 99) / 100;
+    const uint32_t p99_rank = (sample_intermediate->count * 99 + 99) / 100;
+    sample->p95 = sample_intermediate->max;
+    sample->p99 = sample_intermediate->max;
+
+    uint32_t seen = 0;
+    for (uint32_t bin = 0; bin < ADC_HISTOGRAM_BINS; ++bin) {
+        const uint32_t in_bin = sample_intermediate->bins[bin];
+        if (seen < p95_rank && seen + in_bin >= p95_rank) {
+            sample->p95 = sample_percentile_in_bin(sample_intermediate, bin, p95_rank - seen);
+        }
+        if (seen + in_bin >= p99_rank) {
+            sample->p99 = sample_percentile_in_bin(sample_intermediate, bin, p99_rank - seen);
+            return;
+        }
+        seen += in_bin;
+    }
+}
+
+static adc_sample_t sample_from_intermediate(const sample_intermediate_t* sample_intermediate)
+{
+    uint16_t rms = isqrt(sample_intermediate->rms / sample_intermediate->count);
+
+    adc_sample_t sample = {
+        .max = sample_intermediate->max,
         .rms = rms,
+        .mean = sample_intermediate->sum / sample_intermediate->count,
+        .min = sample_intermediate->min,
     };
+    sample_percentiles(sample_intermediate, &sample);
+    return sample;
 }
 
-typedef sample_intermediate_t samples_intermediate_t[SAMPLES_COUNT];
+#define SAMPLE_VBUS_MV_I 0
+#define SAMPLE_VFAN_MV_I 1
+#define SAMPLE_VBUS_MA_I 2
+
+// E[(av v + bv)(ai i + bi)] with v and i still in millivolts at the ADC pins
+static uint32_t sample_power_mw(const samples_intermediate_t sample_intermediate, uint32_t current_i, uint32_t voltage_i)
+{
+    const sample_intermediate_t* current = &sample_intermediate[current_i];
+    const sample_intermediate_t* voltage = &sample_intermediate[voltage_i];
+    if (current->count == 0 || voltage->count == 0) {
+        return 0;
+    }
+
+    const adc_scale_t current_scale = s_scale[current_i];
+    const adc_scale_t voltage_scale = s_scale[voltage_i];
+    const uint64_t product = current->power / current->count;
+    const int64_t product_uw = (((product * voltage_scale.gain_q16) >> CALIBRATION_GAIN_SHIFT) * current_scale.gain_q16) >> CALIBRATION_GAIN_SHIFT;
+    int64_t power_uw = product_uw;
+    if (current_scale.offset != 0 || voltage_scale.offset != 0) {
+        const int64_t voltage_mv = scale_value(voltage->sum / voltage->count, (adc_scale_t) { .gain_q16 = voltage_scale.gain_q16 });
+        const int64_t current_ma = scale_value(current->sum / current->count, (adc_scale_t) { .gain_q16 = current_scale.gain_q16 });
+        power_uw += voltage_mv * current_scale.offset + voltage_scale.offset * current_ma + (int64_t)voltage_scale.offset * current_scale.offset;
+    }
+    return (power_uw < 0) ? 0 : power_uw / 1000;
+}
 
 static void samples_from_intermediate(const samples_intermediate_t sample_intermediate, adc_samples_t* samples)
 {
-    samples->vbus_mv = sample_voltage_divider(sample_from_intermediate(sample_intermediate[0]), 1000, 47);
-    samples->vfan_mv = sample_voltage_divider(sample_from_intermediate(sample_intermediate[1]), 1000, 47);
-    samples->vbus_ma = sample_current_sense(sample_from_intermediate(sample_intermediate[2]));
+    samples->vbus_mv = sample_scale(sample_from_intermediate(&sample_intermediate[0]), s_scale[0]);
+    samples->vfan_mv = sample_scale(sample_from_intermediate(&sample_intermediate[1]), s_scale[1]);
+    samples->vbus_ma = sample_scale(sample_from_intermediate(&sample_intermediate[2]), s_scale[2]);
+
+    samples->vbus_mw = sample_power_mw(sample_intermediate, SAMPLE_VBUS_MA_I, SAMPLE_VBUS_MV_I);
 
     for (int i = 0; i < 5; i++) {
-        samples->vfan_ma[i] = sample_current_sense(sample_from_intermediate(sample_intermediate[3 + i]));
+        samples->vfan_ma[i] = sample_scale(sample_from_intermediate(&sample_intermediate[3 + i]), s_scale[3 + i]);
+        samples->vfan_mw[i] = sample_power_mw(sample_intermediate, 3 + i, SAMPLE_VFAN_MV_I);
+    }
+}
+
+// The calibrated line where there is one, otherwise the nominal divider and current sense
+static void adc_scale_update(void)
+{
+    settings_t settings;
+    settings_fetch(&settings);
+    calibration_t calibration;
+    calibration_fetch(&calibration);
+
+    const uint32_t voltage_gain_q16 = ((ADC_DIVIDER_R1 + ADC_DIVIDER_R2) << CALIBRATION_GAIN_SHIFT) / ADC_DIVIDER_R2;
+    const uint32_t current_gain_q16 = (1000 << CALIBRATION_GAIN_SHIFT) / (settings.current_sense_milliohm * settings.current_sense_gain);
+
+    for (size_t i = 0; i < SAMPLES_COUNT; ++i) {
+        const calibration_channel_t* channel = &calibration.channels[i];
+        if (channel->points != 0) {
+            s_scale[i] = (adc_scale_t) {
+                .gain_q16 = channel->gain_q16,
+                .offset = channel->offset,
+            };
+        } else {
+            s_scale[i] = (adc_scale_t) {
+                .gain_q16 = (i < ADC_VOLTAGE_CHANNELS) ? voltage_gain_q16 : current_gain_q16,
+            };
+        }
+    }
+}
+
+static void adc_pin_average(const samples_intermediate_t sample_intermediate, bool first)
+{
+    for (size_t i = 0; i < SAMPLES_COUNT; ++i) {
+        if (sample_intermediate[i].count == 0) {
+            continue;
+        }
+        const int32_t mean_uv = (uint64_t)sample_intermediate[i].sum * 1000 / sample_intermediate[i].count;
+        s_pin_uv[i] = first ? mean_uv : s_pin_uv[i] + ((mean_uv - s_pin_uv[i]) >> ADC_PIN_AVERAGE_SHIFT);
+    }
+}
+
+static void channel_map_init(uint8_t channel_map[SOC_ADC_PATT_LEN_MAX])
+{
+    memset(channel_map, 0xff, SOC_ADC_PATT_LEN_MAX);
+    for (uint8_t i = 0; i < ARRAY_SIZE(adc_channel); i++) {
+        channel_map[adc_channel[i]] = i;
+    }
+}
+
+// Aggregate one DMA frame of conversion results into per-channel intermediates
+static void samples_intermediate_from_frame(const uint8_t channel_map[SOC_ADC_PATT_LEN_MAX], const uint8_t* result, uint32_t result_len, samples_intermediate_t samples)
+{
+    for (int i = 0; i < SAMPLES_COUNT; ++i) {
+        samples[i] = (sample_intermediate_t) {
+            .rms = 0,
+            .sum = 0,
+            .min = 0xffffffff,
+            .max = 0,
+            .count = 0,
+            .power = 0,
+        };
     }
+
+    // The pattern converts the rail voltages before the currents, each current is paired with the latest one
+    uint32_t vbus_mv = 0;
+    uint32_t vfan_mv = 0;
+
+    for (int i = 0; i < result_len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* p = (const void*)&result[i];
+        uint32_t chan_num = p->type2.channel;
+        uint32_t data = p->type2.data;
+        /* Check the channel number validation, the data is invalid if the channel num exceed the maximum channel */
+        if (chan_num < SOC_ADC_CHANNEL_NUM(ADC_UNIT)) {
+            // ESP_LOGI(TAG, "Channel: %" PRIu32 ", Value: %" PRIx32 ", Real: %lu", chan_num, data, data * 750 / 4095);
+
+            uint8_t channel_i = channel_map[chan_num];
+            if (channel_i < SAMPLES_COUNT) {
+                samples[channel_i].bins[data / ADC_HISTOGRAM_BIN_CODES]++;
+                data = raw_to_millivolts(data);
+
+                samples[channel_i].rms += data * data;
+                samples[channel_i].sum += data;
+                samples[channel_i].min = min(samples[channel_i].min, data);
+                samples[channel_i].max = max(samples[channel_i].max, data);
+                samples[channel_i].count++;
+
+                if (channel_i == SAMPLE_VBUS_MV_I) {
+                    vbus_mv = data;
+                } else if (channel_i == SAMPLE_VFAN_MV_I) {
+                    vfan_mv = data;
+                } else {
+                    samples[channel_i].power += data * ((channel_i == SAMPLE_VBUS_MA_I) ? vbus_mv : vfan_mv);
+                }
+            } else {
+                ESP_LOGW(TAG, "Invalid mapped channel");
+            }
+        } else {
+            ESP_LOGW(TAG, "Invalid data [%" PRIu32 "_%" PRIx32 "]", chan_num, data);
+        }
+    }
+}
+
+// The driver dropped the oldest frame because the task did not read in time
+static bool IRAM_ATTR s_pool_ovf_cb(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data)
+{
+    s_pool_overflows++;
+    watchdog_lost(TASK_ADC, 1);
+    return false;
 }
 
 static bool IRAM_ATTR s_conv_done_cb(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data)
 {
     BaseType_t must_yield = pdFALSE;
+    s_conv_done_us = esp_timer_get_time();
     // Notify that ADC continuous driver has done enough number of conversions
     vTaskNotifyGiveFromISR(s_task_handle, &must_yield);
 
     return (must_yield == pdTRUE);
 }
 
+#ifdef ADC_BUS_MONITOR
+static bool IRAM_ATTR s_bus_monitor_cb(adc_monitor_handle_t monitor_handle, const adc_monitor_evt_data_t* event_data, void* user_data)
+{
+    supervisor_bus_trip_from_isr();
+    return false;
+}
+
+// Trips on a single conversion above the peak limit, without waiting for the frame to be aggregated.
+// The threshold is set once, a changed current sense or calibration takes effect here after a restart.
+static void bus_monitor_init(adc_continuous_handle_t handle)
+{
+    const adc_scale_t scale = s_scale[SAMPLE_VBUS_MA_I];
+    const int32_t threshold_mv = ((int64_t)(CONFIG_SUPERVISOR_BUS_PEAK_LIMIT_MA - scale.offset) << CALIBRATION_GAIN_SHIFT) / scale.gain_q16;
+    adc_monitor_handle_t monitor = NULL;
+
+    adc_monitor_config_t config = {
+        .adc_unit = ADC_UNIT,
+        .channel = adc_channel[SAMPLE_VBUS_MA_I],
+        .h_threshold = threshold_mv * ADC_RAW_RANGE / 750,
+        .l_threshold = -1,
+    };
+    ESP_ERROR_CHECK(adc_new_continuous_monitor(handle, &config, &monitor));
+
+    adc_monitor_evt_cbs_t cbs = {
+        .on_over_high_thresh = s_bus_monitor_cb,
+    };
+    ESP_ERROR_CHECK(adc_continuous_monitor_register_event_callbacks(monitor, &cbs, NULL));
+    ESP_ERROR_CHECK(adc_continuous_monitor_enable(monitor));
+}
+#endif
+
 static void continuous_adc_init(adc_continuous_handle_t* out_handle)
 {
     adc_continuous_handle_t handle = NULL;
 
+    // Room for a few frames, so the task can be held up without the driver dropping any
     adc_continuous_handle_cfg_t adc_config = {
-        .max_store_buf_size = 1024,
-        .conv_frame_size = ADC_FRAME_LEN,
+        .max_store_buf_size = s_frame_len * CONFIG_ADC_POOL_FRAMES,
+        .conv_frame_size = s_frame_len,
     };
     ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_config, &handle));
 
     adc_continuous_config_t dig_cfg = {
-        .sample_freq_hz = 10000,
+        .sample_freq_hz = CONFIG_ADC_SAMPLE_FREQ_HZ,
         .conv_mode = ADC_CONV_SINGLE_UNIT_1,
         .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
     };
 
     adc_digi_pattern_config_t adc_pattern[SOC_ADC_PATT_LEN_MAX] = { 0 };
 
-    dig_cfg.pattern_num = ARRAY_SIZE(adc_channel);
-    for (int i = 0; i < ARRAY_SIZE(adc_channel); i++) {
-        adc_pattern[i] = (adc_digi_pattern_config_t) {
-            .atten = ADC_ATTEN,
-            .channel = adc_channel[i],
-            .unit = ADC_UNIT,
-            .bit_width = ADC_BIT_WIDTH,
-        };
+    // The voltages lead every pattern, so each current conversion still pairs with a fresh one
+    dig_cfg.pattern_num = 0;
+    for (int weight = 0; weight < CONFIG_ADC_CURRENT_WEIGHT; weight++) {
+        for (int i = (weight == 0) ? 0 : ADC_VOLTAGE_CHANNELS; i < ARRAY_SIZE(adc_channel); i++) {
+            adc_pattern[dig_cfg.pattern_num++] = (adc_digi_pattern_config_t) {
+                .atten = ADC_ATTEN,
+                .channel = adc_channel[i],
+                .unit = ADC_UNIT,
+                .bit_width = ADC_BIT_WIDTH,
+            };
+        }
     }
     dig_cfg.adc_pattern = adc_pattern;
     ESP_ERROR_CHECK(adc_continuous_config(handle, &dig_cfg));
@@ -156,8 +474,7 @@ static void continuous_adc_init(adc_continuous_handle_t* out_handle)
 static void adc_task(void* arg)
 {
     uint32_t ret_num = 0;
-    uint8_t result[ADC_FRAME_LEN] = { 0 };
-    memset(result, 0xcc, ADC_FRAME_LEN);
+    memset(s_frame, 0xcc, sizeof(s_frame));
 
     s_task_handle = xTaskGetCurrentTaskHandle();
 
@@ -166,24 +483,23 @@ static void adc_task(void* arg)
 
     adc_continuous_evt_cbs_t cbs = {
         .on_conv_done = s_conv_done_cb,
+        .on_pool_ovf = s_pool_ovf_cb,
     };
     ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(handle, &cbs, NULL));
 
-    adc_cali_curve_fitting_config_t cali_config = {
-        .unit_id = ADC_UNIT,
-        .atten = ADC_ATTEN,
-        .bitwidth = ADC_BIT_WIDTH,
-    };
-    ESP_ERROR_CHECK(adc_cali_create_scheme_curve_fitting(&cali_config, &s_cali_handle));
+#ifdef ADC_BUS_MONITOR
+    bus_monitor_init(handle);
+#endif
 
-    ESP_ERROR_CHECK(adc_continuous_start(handle));
+    millivolts_init();
 
-    uint8_t channel_map[SOC_ADC_PATT_LEN_MAX] = { 0xff };
-    sample_intermediate_t samples[ARRAY_SIZE(adc_channel)];
+    ESP_ERROR_CHECK(adc_continuous_start(handle));
 
-    for (uint8_t i = 0; i < ARRAY_SIZE(adc_channel); i++) {
-        channel_map[adc_channel[i]] = i;
-    }
+    uint8_t channel_map[SOC_ADC_PATT_LEN_MAX];
+    adc_samples_t frame_samples;
+    int64_t last_frame_us = 0;
+    channel_map_init(channel_map);
+    uint16_t activity_reference_ma = 0;
 
     while (1) {
         /**
@@ -195,55 +511,48 @@ static void adc_task(void* arg)
          * `adc_continuous_read()` here in a loop, with/without a certain block timeout.
          */
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        tasks_wakeup(TASK_ADC, s_conv_done_us);
 
         while (1) {
-            for (int i = 0; i < ARRAY_SIZE(samples); ++i) {
-                samples[i] = (sample_intermediate_t) {
-                    .rms = 0,
-                    .min = 0xffffffff,
-                    .max = 0,
-                    .count = 0,
-                };
-            }
-
-            esp_err_t ret = adc_continuous_read(handle, result, ADC_FRAME_LEN, &ret_num, 0);
+            esp_err_t ret = adc_continuous_read(handle, s_frame, s_frame_len, &ret_num, 0);
             if (ret == ESP_OK) {
-                for (int i = 0; i < ret_num; i += SOC_ADC_DIGI_RESULT_BYTES) {
-                    adc_digi_output_data_t* p = (void*)&result[i];
-                    uint32_t chan_num = p->type2.channel;
-                    uint32_t data = p->type2.data;
-                    /* Check the channel number validation, the data is invalid if the channel num exceed the maximum channel */
-                    if (chan_num < SOC_ADC_CHANNEL_NUM(ADC_UNIT)) {
-                        // ESP_LOGI(TAG, "Channel: %" PRIu32 ", Value: %" PRIx32 ", Real: %lu", chan_num, data, data * 750 / 4095);
-
-                        uint8_t channel_i = channel_map[chan_num];
-                        if (channel_i < ARRAY_SIZE(samples)) {
-                            data = raw_to_millivolts(data);
-
-                            samples[channel_i].rms += data * data;
-                            samples[channel_i].min = min(samples[channel_i].min, data);
-                            samples[channel_i].max = max(samples[channel_i].max, data);
-                            samples[channel_i].count++;
-                        } else {
-                            ESP_LOGW(TAG, "Invalid mapped channel");
-                        }
-                    } else {
-                        ESP_LOGW(TAG, "Invalid data [%" PRIu32 "_%" PRIx32 "]", chan_num, data);
-                    }
+                if (s_scale_stale) {
+                    s_scale_stale = false;
+                    adc_scale_update();
                 }
-                /**
-                 * Because printing is slow, so every time you call `ulTaskNotifyTake`, it will immediately return.
-                 * To avoid a task watchdog timeout, add a delay here. When you replace the way you process the data,
-                 * usually you don't need this delay (as this task will block for a while).
-                 */
-                vTaskDelay(1);
 
+                TRACE_SPAN_BEGIN(ADC_FRAME);
+                samples_intermediate_from_frame(channel_map, s_frame, ret_num, s_intermediate);
+                samples_from_intermediate(s_intermediate, &frame_samples);
+                supervisor_check(&frame_samples);
+
+                // Wall time rather than the frame length, so bursts in low power mode also cover the gaps
+                const int64_t frame_us = esp_timer_get_time();
+                if (last_frame_us != 0) {
+                    energy_accumulate(&frame_samples, frame_us - last_frame_us);
+                }
+                last_frame_us = frame_us;
+                TRACE_SPAN_END(ADC_FRAME);
+
+                // The task blocks on the next notification once the pool is drained, no delay needed
                 xSemaphoreTake(s_mutex, portMAX_DELAY);
-                samples_from_intermediate(samples, &s_samples);
+                memcpy(&s_samples, &frame_samples, sizeof(s_samples));
+                adc_pin_average(s_intermediate, s_frames == 0);
+                s_frames++;
                 xSemaphoreGive(s_mutex);
+                watchdog_beat(TASK_ADC, 1);
+                const uint16_t vbus_ma = frame_samples.vbus_ma.rms;
+
+                // Compared against the last reported level, so slow ramps are caught as well
+                if (abs((int)vbus_ma - activity_reference_ma) > ADC_ACTIVITY_THRESHOLD_MA) {
+                    activity_reference_ma = vbus_ma;
+                    periodic_activity();
+                }
 
-                ESP_ERROR_CHECK(esp_event_post(EVENTS, EVENT_ADC_SAMPLED,
-                    NULL, 0, portMAX_DELAY));
+                // Never waits for the event loop, a slow handler there would hold up the sampling
+                if (esp_event_post(EVENTS, EVENT_ADC_SAMPLED, NULL, 0, 0) != ESP_OK) {
+                    watchdog_lost(TASK_ADC, 1);
+                }
 
                 // for (int i = 0; i < ARRAY_SIZE(samples); ++i)
                 // {
@@ -255,17 +564,70 @@ static void adc_task(void* arg)
                 break;
             }
         }
+
+#ifdef CONFIG_POWER_SAVE
+        // Sample in bursts, the driver holds an APB frequency lock for as long as it is running
+        ESP_ERROR_CHECK(adc_continuous_stop(handle));
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_POWER_SAVE_ADC_INTERVAL_MS));
+        ESP_ERROR_CHECK(adc_continuous_start(handle));
+#endif
     }
 }
 
+static void adc_settings_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    if (*(const uint32_t*)event_data & SETTINGS_CURRENT_SENSE) {
+        s_scale_stale = true;
+    }
+}
+
+static void adc_calibration_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    s_scale_stale = true;
+}
+
 esp_err_t adc_init(void)
 {
-    s_mutex = xSemaphoreCreateMutex();
-    xTaskCreate(adc_task, "adc", 1024 * 4, (void*)0, 9, NULL);
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    // The frame length sizes the driver buffers, a changed oversampling takes effect after a restart
+    settings_t settings;
+    settings_fetch(&settings);
+    s_frame_len = ADC_FRAME_LEN(settings.adc_oversampling);
+    adc_scale_update();
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_SETTINGS_CHANGED, adc_settings_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_CALIBRATION_CHANGED, adc_calibration_handler, NULL));
+
+    // The driver is set up by the task, a stuck one is not restarted but escalates to a reboot
+    const watchdog_config_t watchdog = {
+        .deadline_ms = ADC_DEADLINE_MS,
+    };
+    ESP_ERROR_CHECK(watchdog_register(TASK_ADC, &watchdog));
+    ESP_ERROR_CHECK(tasks_create(TASK_ADC, adc_task, NULL, NULL));
 
     return ESP_OK;
 }
 
+void adc_fetch_stats(adc_stats_t* stats)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *stats = (adc_stats_t) {
+        .frames = s_frames,
+        .pool_overflows = s_pool_overflows,
+        .sample_freq_hz = CONFIG_ADC_SAMPLE_FREQ_HZ,
+        .frame_conversions = s_frame_len / SOC_ADC_DIGI_DATA_BYTES_PER_CONV,
+    };
+    xSemaphoreGive(s_mutex);
+}
+
+int32_t adc_fetch_pin_uv(size_t channel)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int32_t pin_uv = (channel < SAMPLES_COUNT) ? s_pin_uv[channel] : 0;
+    xSemaphoreGive(s_mutex);
+    return pin_uv;
+}
+
 void adc_fetch(adc_samples_t* samples)
 {
     xSemaphoreTake(s_mutex, portMAX_DELAY);
@@ -1,11 +1,18 @@
 #pragma once
 
 #include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
 
+// Statistics of one channel over one frame, max - min is the ripple
 typedef struct
 {
     uint16_t max;
     uint16_t rms;
+    uint16_t mean;
+    uint16_t min;
+    uint16_t p95; // Percentiles to the resolution of the raw code histogram
+    uint16_t p99;
 } adc_sample_t;
 
 typedef struct
@@ -14,8 +21,22 @@ typedef struct
     adc_sample_t vfan_mv;
     adc_sample_t vbus_ma;
     adc_sample_t vfan_ma[5];
+    uint32_t vbus_mw; // Mean of the instantaneous V x I over the frame
+    uint32_t vfan_mw[5];
 } adc_samples_t;
 
+typedef struct
+{
+    uint32_t frames; // Processed since boot
+    uint32_t pool_overflows; // Frames the driver dropped because the task fell behind
+    uint32_t sample_freq_hz; // Conversions per second over all channels
+    uint32_t frame_conversions;
+} adc_stats_t;
+
 esp_err_t adc_init(void);
 
 void adc_fetch(adc_samples_t* samples);
+void adc_fetch_stats(adc_stats_t* stats);
+// Uncalibrated mean at the ADC pin, averaged over the last frames. The channel is in the order of
+// adc_samples_t, as calibration_input_t.
+int32_t adc_fetch_pin_uv(size_t channel);
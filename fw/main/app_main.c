@@ -1,47 +1,96 @@
 #include <esp_log.h>
 #include <nvs_flash.h>
 
+#include <sdkconfig.h>
+
 #include "adc.h"
+#include "boot.h"
+#include "calibration.h"
+#include "control.h"
+#include "data.h"
+#include "energy.h"
 #include "events.h"
+#include "fan_health.h"
 #include "fans.h"
 #include "http_server.h"
 #include "i2c_bus.h"
+#include "json_pool.h"
+#include "latency.h"
 #include "led.h"
 #include "mqtt.h"
+#include "ota.h"
 #include "performance.h"
 #include "periodic.h"
+#include "power.h"
+#include "settings.h"
+#include "supervisor.h"
 #include "tacho.h"
+#include "telemetry.h"
 #include "temperature.h"
+#include "util.h"
+#include "watchdog.h"
 #include "wifi.h"
 
 #define TAG "main"
 
+#if CONFIG_BOOT_PARALLEL
+// Nothing local waits for Wi-Fi, and it is the slowest stage
+static const boot_stage_config_t s_network_stages[] = {
+    { "wifi", wifi_init },
+};
+#endif
+
 void app_main(void)
 {
-    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(boot_init());
+    boot_run("nvs", nvs_flash_init);
+    boot_run("events", events_init);
+    boot_run("settings", settings_init);
 
-    ESP_ERROR_CHECK(events_init());
-    ESP_ERROR_CHECK(performance_init());
-    ESP_ERROR_CHECK(i2c_bus_init());
-
-    ESP_ERROR_CHECK(led_init());
+    // The fans resume as early as possible, everything after them only delays the reporting
+    boot_run("latency", latency_init); // The fans record their first LEDC writes
+    boot_run("led", led_init);
     led_set_color((rgb_t) {
         .r = 0x10,
         .g = 0x00,
         .b = 0x00,
     });
+    boot_run("fans", fans_init);
+
+    boot_run("json_pool", json_pool_init);
+    boot_run("data", data_init);
+    boot_run("periodic", periodic_init);
+    boot_run("power", power_init);
+    boot_run("performance", performance_init);
+    boot_run("supervisor", supervisor_init);
+    boot_run("watchdog", watchdog_init);
+    boot_run("energy", energy_init);
+    boot_run("calibration", calibration_init);
 
-    ESP_ERROR_CHECK(adc_init());
-    ESP_ERROR_CHECK(tacho_init());
-    ESP_ERROR_CHECK(fans_init());
+    // Before the network comes up, the health check of a new image waits for it
+    boot_run("ota", ota_init);
 
-    ESP_ERROR_CHECK(temperature_init());
+#if CONFIG_BOOT_PARALLEL
+    ESP_ERROR_CHECK(boot_run_parallel(s_network_stages, ARRAY_SIZE(s_network_stages)));
+#else
+    boot_run("wifi", wifi_init);
+#endif
 
-    ESP_ERROR_CHECK(wifi_init());
-    ESP_ERROR_CHECK(http_server_init());
-    ESP_ERROR_CHECK(mqtt_init());
+    boot_run("i2c_bus", i2c_bus_init);
+    boot_run("adc", adc_init);
+    boot_run("tacho", tacho_init);
+    boot_run("fan_health", fan_health_init);
+    boot_run("control", control_init);
+    boot_run("temperature", temperature_init);
 
-    ESP_ERROR_CHECK(periodic_init());
+    // The servers report the local hardware, so they start once it is all set up
+#if CONFIG_BOOT_PARALLEL
+    boot_join();
+#endif
+    boot_run("http_server", http_server_init);
+    boot_run("mqtt", mqtt_init);
+    boot_run("telemetry", telemetry_init);
 
+    boot_done();
     ESP_LOGI(TAG, "Device initialized, running event loop");
 }
@@ -0,0 +1,118 @@
+#include "boot.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "tasks.h"
+#include "util.h"
+
+#define TAG "boot"
+
+typedef struct
+{
+    const boot_stage_config_t* stages;
+    size_t count;
+} boot_lane_t;
+
+static boot_stats_t s_stats;
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static SemaphoreHandle_t s_lane_done;
+static StaticSemaphore_t s_lane_done_buffer;
+static boot_lane_t s_lane;
+static TaskHandle_t s_lane_task;
+
+static void boot_record(const char* name, int64_t start_us, int64_t end_us)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_stats.stages_number < ARRAY_SIZE(s_stats.stages)) {
+        s_stats.stages[s_stats.stages_number++] = (boot_stage_t) {
+            .name = name,
+            .start_us = start_us,
+            .duration_us = end_us - start_us,
+            .parallel = (s_lane_task != NULL && xTaskGetCurrentTaskHandle() == s_lane_task),
+        };
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+static void boot_lane_task(void* arg)
+{
+    for (size_t i = 0; i < s_lane.count; ++i) {
+        boot_run(s_lane.stages[i].name, s_lane.stages[i].init);
+    }
+
+    xSemaphoreGive(s_lane_done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t boot_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+    s_lane_done = xSemaphoreCreateBinaryStatic(&s_lane_done_buffer);
+
+    return ESP_OK;
+}
+
+void boot_run(const char* name, boot_init_t init)
+{
+    const int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = init();
+    boot_record(name, start_us, esp_timer_get_time());
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Stage %s failed: %s", name, esp_err_to_name(ret));
+        ESP_ERROR_CHECK(ret);
+    }
+}
+
+esp_err_t boot_run_parallel(const boot_stage_config_t* stages, size_t count)
+{
+    s_lane = (boot_lane_t) {
+        .stages = stages,
+        .count = count,
+    };
+
+    // The handle is set before the task runs, so its stages are recorded as parallel
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    esp_err_t ret = tasks_create(TASK_BOOT, boot_lane_task, NULL, &s_lane_task);
+    xSemaphoreGive(s_mutex);
+
+    return ret;
+}
+
+void boot_join(void)
+{
+    xSemaphoreTake(s_lane_done, portMAX_DELAY);
+    s_lane_task = NULL;
+}
+
+void boot_done(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_stats.done_us = esp_timer_get_time();
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGI(TAG, "Booted in %lu us, %u stages", (unsigned long)s_stats.done_us, (unsigned int)s_stats.stages_number);
+}
+
+void boot_fetch(boot_fetch_cb_t cb, void* ctx)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < s_stats.stages_number; ++i) {
+        cb(&s_stats.stages[i], ctx);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+uint32_t boot_fetch_done_us(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    uint32_t done_us = s_stats.done_us;
+    xSemaphoreGive(s_mutex);
+
+    return done_us;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOT_STAGES_MAX 32
+
+typedef esp_err_t (*boot_init_t)(void);
+
+typedef struct
+{
+    const char* name;
+    boot_init_t init;
+} boot_stage_config_t;
+
+typedef struct
+{
+    const char* name;
+    uint32_t start_us; // Since the timer started, shortly after the bootloader handed over
+    uint32_t duration_us;
+    bool parallel; // Ran in the parallel lane, next to the stages app_main runs
+} boot_stage_t;
+
+typedef struct
+{
+    boot_stage_t stages[BOOT_STAGES_MAX];
+    size_t stages_number;
+    uint32_t done_us; // 0 until every stage has run
+} boot_stats_t;
+
+// Before any stage, it only sets up the bookkeeping
+esp_err_t boot_init(void);
+
+// Runs and times one init function, aborts like ESP_ERROR_CHECK when it fails
+void boot_run(const char* name, boot_init_t init);
+
+// Runs the stages in order on a task of their own, while the caller goes on with stages that do not
+// depend on them. Only one lane at a time, the stage table has to outlive it.
+esp_err_t boot_run_parallel(const boot_stage_config_t* stages, size_t count);
+// Waits for the parallel lane to finish
+void boot_join(void);
+
+// All stages have run
+void boot_done(void);
+
+typedef void (*boot_fetch_cb_t)(const boot_stage_t*, void*);
+
+// Stages in the order they finished
+void boot_fetch(boot_fetch_cb_t cb, void* ctx);
+uint32_t boot_fetch_done_us(void);
@@ -0,0 +1,233 @@
+#include "calibration.h"
+
+#include <esp_event.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <nvs.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "events.h"
+#include "util.h"
+
+#define TAG "calibration"
+
+#define CALIBRATION_NVS_NAMESPACE "calibration"
+#define CALIBRATION_NVS_KEY "channels"
+#define CALIBRATION_VERSION 1 // Bump when the layout of calibration_t changes, stored blobs are then ignored
+
+// Points closer than this at the pin give a gain dominated by the ADC noise
+#define CALIBRATION_MIN_SPAN_UV 20000
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t size;
+    calibration_t calibration;
+} calibration_blob_t;
+
+static const char* const s_input_names[CALIBRATION_INPUT_COUNT] = {
+    [CALIBRATION_VBUS_MV] = "vbus_mv",
+    [CALIBRATION_VFAN_MV] = "vfan_mv",
+    [CALIBRATION_VBUS_MA] = "vbus_ma",
+    [CALIBRATION_VFAN1_MA] = "vfan1_ma",
+    [CALIBRATION_VFAN2_MA] = "vfan2_ma",
+    [CALIBRATION_VFAN3_MA] = "vfan3_ma",
+    [CALIBRATION_VFAN4_MA] = "vfan4_ma",
+    [CALIBRATION_VFAN5_MA] = "vfan5_ma",
+};
+
+static calibration_t s_calibration;
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static SemaphoreHandle_t s_update_mutex; // Serializes updates, without holding up readers during the flash write
+static StaticSemaphore_t s_update_mutex_buffer;
+
+// Solves the line through the points, in the integer form the ADC task applies per frame
+static bool calibration_solve(calibration_channel_t* channel)
+{
+    const calibration_point_t* a = &channel->point[0];
+    int64_t gain_q16;
+    int64_t offset = 0;
+
+    if (channel->points == 0) {
+        channel->gain_q16 = 0;
+        channel->offset = 0;
+        return true;
+    } else if (channel->points == 1) {
+        if (a->measured_uv < CALIBRATION_MIN_SPAN_UV) {
+            return false;
+        }
+        gain_q16 = ((int64_t)a->reference * 1000 << CALIBRATION_GAIN_SHIFT) / a->measured_uv;
+    } else {
+        const calibration_point_t* b = &channel->point[1];
+        const int64_t span_uv = (int64_t)b->measured_uv - a->measured_uv;
+        if (llabs(span_uv) < CALIBRATION_MIN_SPAN_UV) {
+            return false;
+        }
+        gain_q16 = (((int64_t)b->reference - a->reference) * 1000 << CALIBRATION_GAIN_SHIFT) / span_uv;
+        offset = a->reference - (((int64_t)a->measured_uv * gain_q16) >> CALIBRATION_GAIN_SHIFT) / 1000;
+    }
+
+    if (gain_q16 <= 0 || gain_q16 > UINT32_MAX || llabs(offset) > INT16_MAX) {
+        return false;
+    }
+    channel->gain_q16 = gain_q16;
+    channel->offset = offset;
+    return true;
+}
+
+static bool calibration_load_nvs(calibration_t* calibration)
+{
+    nvs_handle_t handle;
+    if (nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    calibration_blob_t blob;
+    size_t length = sizeof(blob);
+    esp_err_t ret = nvs_get_blob(handle, CALIBRATION_NVS_KEY, &blob, &length);
+    nvs_close(handle);
+
+    if (ret != ESP_OK || length != sizeof(blob) || blob.version != CALIBRATION_VERSION || blob.size != sizeof(blob.calibration)) {
+        ESP_LOGW(TAG, "Ignoring stored calibration (%s, %u bytes)", esp_err_to_name(ret), (unsigned int)length);
+        return false;
+    }
+
+    // Solved again, so a stored line always matches its points
+    for (size_t i = 0; i < ARRAY_SIZE(blob.calibration.channels); ++i) {
+        calibration_channel_t* channel = &blob.calibration.channels[i];
+        if (channel->points > CALIBRATION_POINTS_MAX || !calibration_solve(channel)) {
+            ESP_LOGW(TAG, "Ignoring invalid stored calibration of %s", s_input_names[i]);
+            *channel = (calibration_channel_t) { 0 };
+        }
+    }
+
+    *calibration = blob.calibration;
+    return true;
+}
+
+static esp_err_t calibration_store_nvs(const calibration_t* calibration)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    const calibration_blob_t blob = {
+        .version = CALIBRATION_VERSION,
+        .size = sizeof(blob.calibration),
+        .calibration = *calibration,
+    };
+
+    ERROR_CHECK_SIMPLE(nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READWRITE, &handle));
+    ret = nvs_set_blob(handle, CALIBRATION_NVS_KEY, &blob, sizeof(blob));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    ERROR_CHECK_SIMPLE(ret);
+
+    return ESP_OK;
+err:
+    return ret;
+}
+
+static esp_err_t calibration_update(calibration_input_t input, const calibration_channel_t* channel)
+{
+    calibration_t calibration;
+    calibration_fetch(&calibration);
+    calibration.channels[input] = *channel;
+
+    esp_err_t ret = calibration_store_nvs(&calibration);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_calibration = calibration;
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGI(TAG, "Calibrated %s with %u points: gain %lu/65536, offset %ld", s_input_names[input],
+        channel->points, (unsigned long)channel->gain_q16, (long)channel->offset);
+    ESP_ERROR_CHECK(esp_event_post(EVENTS, EVENT_CALIBRATION_CHANGED,
+        &input, sizeof(input), portMAX_DELAY));
+    return ESP_OK;
+}
+
+esp_err_t calibration_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+    s_update_mutex = xSemaphoreCreateMutexStatic(&s_update_mutex_buffer);
+
+    if (calibration_load_nvs(&s_calibration)) {
+        ESP_LOGI(TAG, "Loaded calibration from NVS");
+    } else {
+        memset(&s_calibration, 0, sizeof(s_calibration));
+    }
+
+    return ESP_OK;
+}
+
+void calibration_fetch(calibration_t* calibration)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *calibration = s_calibration;
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t calibration_add_point(calibration_input_t input, int32_t reference, int32_t measured_uv)
+{
+    if (input >= CALIBRATION_INPUT_COUNT || reference < 0 || measured_uv < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_update_mutex, portMAX_DELAY);
+    calibration_t calibration;
+    calibration_fetch(&calibration);
+    calibration_channel_t channel = calibration.channels[input];
+
+    const calibration_point_t point = {
+        .reference = reference,
+        .measured_uv = measured_uv,
+    };
+    if (channel.points < CALIBRATION_POINTS_MAX) {
+        channel.point[channel.points++] = point;
+    } else {
+        // Measuring again near a stored point refines it rather than collapsing the span
+        const bool first = llabs((int64_t)channel.point[0].measured_uv - measured_uv) < llabs((int64_t)channel.point[1].measured_uv - measured_uv);
+        channel.point[first ? 0 : 1] = point;
+    }
+
+    esp_err_t ret = calibration_solve(&channel) ? calibration_update(input, &channel) : ESP_ERR_INVALID_ARG;
+    xSemaphoreGive(s_update_mutex);
+
+    return ret;
+}
+
+esp_err_t calibration_clear(calibration_input_t input)
+{
+    if (input >= CALIBRATION_INPUT_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_update_mutex, portMAX_DELAY);
+    const calibration_channel_t channel = { 0 };
+    esp_err_t ret = calibration_update(input, &channel);
+    xSemaphoreGive(s_update_mutex);
+
+    return ret;
+}
+
+const char* calibration_input_name(calibration_input_t input)
+{
+    return (input < CALIBRATION_INPUT_COUNT) ? s_input_names[input] : "unknown";
+}
+
+calibration_input_t calibration_input_from_name(const char* name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(s_input_names); ++i) {
+        if (strcmp(name, s_input_names[i]) == 0) {
+            return i;
+        }
+    }
+    return CALIBRATION_INPUT_COUNT;
+}
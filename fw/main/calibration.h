@@ -0,0 +1,52 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+// Same order as the channels of adc_samples_t
+typedef enum {
+    CALIBRATION_VBUS_MV,
+    CALIBRATION_VFAN_MV,
+    CALIBRATION_VBUS_MA,
+    CALIBRATION_VFAN1_MA,
+    CALIBRATION_VFAN2_MA,
+    CALIBRATION_VFAN3_MA,
+    CALIBRATION_VFAN4_MA,
+    CALIBRATION_VFAN5_MA,
+    CALIBRATION_INPUT_COUNT,
+} calibration_input_t;
+
+#define CALIBRATION_POINTS_MAX 2
+#define CALIBRATION_GAIN_SHIFT 16
+
+typedef struct
+{
+    int32_t reference; // mV or mA as applied by the lab supply
+    int32_t measured_uv; // At the ADC pin, averaged over a few frames
+} calibration_point_t;
+
+// reading = (pin_mv * gain_q16 >> CALIBRATION_GAIN_SHIFT) + offset
+typedef struct
+{
+    uint8_t points; // 0 uses the nominal components, 1 corrects the gain, 2 also the offset
+    calibration_point_t point[CALIBRATION_POINTS_MAX];
+    uint32_t gain_q16;
+    int32_t offset;
+} calibration_channel_t;
+
+typedef struct
+{
+    calibration_channel_t channels[CALIBRATION_INPUT_COUNT];
+} calibration_t;
+
+esp_err_t calibration_init(void);
+
+void calibration_fetch(calibration_t* calibration);
+
+// A third point replaces the stored one closest to it. ESP_ERR_INVALID_ARG if the points give no usable line.
+esp_err_t calibration_add_point(calibration_input_t input, int32_t reference, int32_t measured_uv);
+esp_err_t calibration_clear(calibration_input_t input);
+
+const char* calibration_input_name(calibration_input_t input);
+// CALIBRATION_INPUT_COUNT if unknown
+calibration_input_t calibration_input_from_name(const char* name);
@@ -0,0 +1,113 @@
+#include "cbor.h"
+
+#include <string.h>
+
+#define CBOR_MAJOR_UINT (0 << 5)
+#define CBOR_MAJOR_NINT (1 << 5)
+#define CBOR_MAJOR_TEXT (3 << 5)
+#define CBOR_MAJOR_ARRAY (4 << 5)
+#define CBOR_MAJOR_MAP (5 << 5)
+#define CBOR_MAJOR_SIMPLE (7 << 5)
+
+#define CBOR_INDEFINITE 31
+#define CBOR_FALSE (CBOR_MAJOR_SIMPLE | 20)
+#define CBOR_TRUE (CBOR_MAJOR_SIMPLE | 21)
+#define CBOR_NULL (CBOR_MAJOR_SIMPLE | 22)
+#define CBOR_BREAK (CBOR_MAJOR_SIMPLE | CBOR_INDEFINITE)
+
+void cbor_writer_init(cbor_writer_t* writer, uint8_t* buffer, size_t size)
+{
+    *writer = (cbor_writer_t) {
+        .buffer = buffer,
+        .size = size,
+    };
+}
+
+static void cbor_put(cbor_writer_t* writer, const void* data, size_t len)
+{
+    if (writer->overflow || writer->size - writer->len < len) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(&writer->buffer[writer->len], data, len);
+    writer->len += len;
+}
+
+static void cbor_byte(cbor_writer_t* writer, uint8_t byte)
+{
+    cbor_put(writer, &byte, 1);
+}
+
+// Initial byte and argument in the shortest form, big endian
+static void cbor_head(cbor_writer_t* writer, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    size_t len;
+
+    if (value < 24) {
+        head[0] = major | value;
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = major | 24;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major | 25;
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major | 26;
+        len = 5;
+    } else {
+        head[0] = major | 27;
+        len = 9;
+    }
+    for (size_t i = len - 1; i > 0; --i, value >>= 8) {
+        head[i] = value & 0xff;
+    }
+    cbor_put(writer, head, len);
+}
+
+void cbor_map_begin(cbor_writer_t* writer)
+{
+    cbor_byte(writer, CBOR_MAJOR_MAP | CBOR_INDEFINITE);
+}
+
+void cbor_array_begin(cbor_writer_t* writer)
+{
+    cbor_byte(writer, CBOR_MAJOR_ARRAY | CBOR_INDEFINITE);
+}
+
+void cbor_end(cbor_writer_t* writer)
+{
+    cbor_byte(writer, CBOR_BREAK);
+}
+
+void cbor_uint(cbor_writer_t* writer, uint64_t value)
+{
+    cbor_head(writer, CBOR_MAJOR_UINT, value);
+}
+
+void cbor_int(cbor_writer_t* writer, int64_t value)
+{
+    if (value >= 0) {
+        cbor_head(writer, CBOR_MAJOR_UINT, value);
+    } else {
+        cbor_head(writer, CBOR_MAJOR_NINT, -1 - value);
+    }
+}
+
+void cbor_bool(cbor_writer_t* writer, bool value)
+{
+    cbor_byte(writer, value ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void cbor_null(cbor_writer_t* writer)
+{
+    cbor_byte(writer, CBOR_NULL);
+}
+
+void cbor_text(cbor_writer_t* writer, const char* text)
+{
+    const size_t len = strlen(text);
+    cbor_head(writer, CBOR_MAJOR_TEXT, len);
+    cbor_put(writer, text, len);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Minimal CBOR (RFC 8949) writer into a caller provided buffer. Maps and arrays are written with
+// indefinite length, so entries can be left out without counting them first. Writes past the end
+// of the buffer are dropped and flag the writer as overflowed.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t* buffer;
+    size_t size;
+    size_t len;
+    bool overflow;
+} cbor_writer_t;
+
+void cbor_writer_init(cbor_writer_t* writer, uint8_t* buffer, size_t size);
+
+void cbor_map_begin(cbor_writer_t* writer);
+void cbor_array_begin(cbor_writer_t* writer);
+// Closes the innermost map or array
+void cbor_end(cbor_writer_t* writer);
+
+void cbor_uint(cbor_writer_t* writer, uint64_t value);
+void cbor_int(cbor_writer_t* writer, int64_t value);
+void cbor_bool(cbor_writer_t* writer, bool value);
+void cbor_null(cbor_writer_t* writer);
+void cbor_text(cbor_writer_t* writer, const char* text);
+
+// Map entries with an integer key
+static inline void cbor_key(cbor_writer_t* writer, unsigned int key)
+{
+    cbor_uint(writer, key);
+}
@@ -0,0 +1,77 @@
+#include "control.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <sdkconfig.h>
+
+#include "fan_health.h"
+#include "fans.h"
+#include "latency.h"
+#include "periodic.h"
+#include "tasks.h"
+#include "watchdog.h"
+
+// Once every output has settled the loop only has the fan health to watch, it backs off to that rate
+#if CONFIG_FAN_HEALTH_INTERVAL_MS > CONFIG_CONTROL_INTERVAL_MS
+#define CONTROL_SLOW_INTERVAL_MS CONFIG_FAN_HEALTH_INTERVAL_MS
+#else
+#define CONTROL_SLOW_INTERVAL_MS CONFIG_CONTROL_INTERVAL_MS
+#endif
+// Half a tick early still counts, the scheduler merges deadlines that close
+#define CONTROL_HEALTH_INTERVAL_US ((CONFIG_FAN_HEALTH_INTERVAL_MS - CONFIG_CONTROL_INTERVAL_MS / 2) * 1000LL)
+
+#define CONTROL_DEADLINE_MS 500
+
+static TaskHandle_t s_task_handle;
+static volatile int64_t s_tick_us;
+
+// The esp_timer task shares the network core, so it only wakes the control task
+static void control_tick(int64_t now_us)
+{
+    s_tick_us = now_us;
+    xTaskNotifyGive(s_task_handle);
+}
+
+static void control_task(void* arg)
+{
+    int64_t health_us = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        tasks_wakeup(TASK_CONTROL, s_tick_us);
+
+        const int64_t now = esp_timer_get_time();
+        if (fans_output_step(now)) {
+            periodic_activity(); // Keeps the loop, and the reports, at the fast rate while a fan ramps
+        }
+        latency_expire(now);
+        if (now - health_us >= CONTROL_HEALTH_INTERVAL_US) {
+            health_us = now;
+            fan_health_evaluate();
+        }
+        watchdog_beat(TASK_CONTROL, 1);
+    }
+}
+
+esp_err_t control_init(void)
+{
+    // The task holds the fan output lock while it steps, a stuck one escalates to a reboot
+    const watchdog_config_t watchdog = {
+        .deadline_ms = CONTROL_DEADLINE_MS,
+    };
+    ESP_ERROR_CHECK(watchdog_register(TASK_CONTROL, &watchdog));
+    ESP_ERROR_CHECK(tasks_create(TASK_CONTROL, control_task, NULL, &s_task_handle));
+
+    // Shares the scheduler timer, commands and overrides pull it back to the fast rate
+    const periodic_consumer_config_t periodic = {
+        .name = "control",
+        .callback = control_tick,
+        .fast_interval_ms = CONFIG_CONTROL_INTERVAL_MS,
+        .slow_interval_ms = CONTROL_SLOW_INTERVAL_MS,
+    };
+    ESP_ERROR_CHECK(periodic_register(&periodic));
+
+    return ESP_OK;
+}
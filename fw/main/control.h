@@ -0,0 +1,7 @@
+#pragma once
+
+#include <esp_err.h>
+
+// Runs the control task: steps the fan outputs every CONFIG_CONTROL_INTERVAL_MS and evaluates the fan
+// health every CONFIG_FAN_HEALTH_INTERVAL_MS. Needs fans_init and fan_health_init first.
+esp_err_t control_init(void);
@@ -8,17 +8,47 @@
 #include <esp_ota_ops.h>
 #include <esp_system.h>
 #include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <string.h>
 
 #include <sdkconfig.h>
 
 #include "adc.h"
+#include "boot.h"
+#include "calibration.h"
+#include "cbor.h"
+#include "energy.h"
+#include "fan_health.h"
 #include "fans.h"
+#include "json_pool.h"
+#include "latency.h"
+#include "ota.h"
 #include "performance.h"
+#include "power.h"
+#include "settings.h"
+#include "status_cbor.h"
+#include "supervisor.h"
+#include "tasks.h"
 #include "tacho.h"
 #include "temperature.h"
+#include "trace.h"
+#include "util.h"
+#include "watchdog.h"
 
 #define TAG "data"
 
+// One rendering at a time, so the JSON pool only has to hold a single status tree
+static SemaphoreHandle_t s_print_mutex;
+static StaticSemaphore_t s_print_mutex_buffer;
+
+esp_err_t data_init(void)
+{
+    s_print_mutex = xSemaphoreCreateMutexStatic(&s_print_mutex_buffer);
+
+    return ESP_OK;
+}
+
 static void mac_to_str(uint8_t mac_addr[8], char (*mac_addr_str)[18])
 {
     sprintf(*mac_addr_str, "%02x:%02x:%02x:%02x:%02x:%02x", mac_addr[0],
@@ -84,6 +114,16 @@ static void data_status_misc_to_json(cJSON* root)
     cJSON_AddNumberToObject(root, "free_heap_internal", esp_get_free_internal_heap_size());
     cJSON_AddNumberToObject(root, "minimum_heap_internal",
         heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+
+    json_pool_stats_t pool;
+    json_pool_fetch(&pool);
+    cJSON* pool_obj = cJSON_AddObjectToObject(root, "json_pool");
+    cJSON_AddNumberToObject(pool_obj, "blocks", pool.blocks);
+    cJSON_AddNumberToObject(pool_obj, "block_size", pool.block_size);
+    cJSON_AddNumberToObject(pool_obj, "used", pool.used);
+    cJSON_AddNumberToObject(pool_obj, "peak", pool.peak);
+    cJSON_AddNumberToObject(pool_obj, "fallbacks", pool.fallbacks);
+
     cJSON_AddNumberToObject(root, "chip_revision", chip_info.revision);
     cJSON_AddStringToObject(root, "esp_idf_version", esp_get_idf_version());
     cJSON_AddStringToObject(root, "app_version", app_desc->version);
@@ -94,6 +134,25 @@ static void data_status_misc_to_json(cJSON* root)
     cJSON_AddStringToObject(root, "reset_reason", data_reset_reason_to_str(esp_reset_reason()));
 }
 
+esp_err_t data_print(data_to_json_t to_json, char* buffer, size_t size)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    xSemaphoreTake(s_print_mutex, portMAX_DELAY);
+    cJSON* root = cJSON_CreateObject();
+    if (root != NULL) {
+        ret = to_json(root);
+        if (ret == ESP_OK && !cJSON_PrintPreallocated(root, buffer, size, false)) {
+            ESP_LOGW(TAG, "Rendering does not fit %u bytes", (unsigned int)size);
+            ret = ESP_ERR_NO_MEM;
+        }
+        cJSON_Delete(root);
+    }
+    xSemaphoreGive(s_print_mutex);
+
+    return ret;
+}
+
 esp_err_t data_status_to_json(cJSON* root)
 {
     cJSON_AddStringToObject(root, "id", data_get_id());
@@ -104,22 +163,54 @@ esp_err_t data_status_to_json(cJSON* root)
     cJSON_AddItemToObject(root, "duty", duty_obj);
     ESP_ERROR_CHECK(data_duty_to_json(duty_obj));
 
+    cJSON* output_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "output", output_obj);
+    ESP_ERROR_CHECK(data_output_to_json(output_obj));
+
     cJSON* power_obj = cJSON_CreateObject();
     cJSON_AddItemToObject(root, "power", power_obj);
     ESP_ERROR_CHECK(data_power_to_json(power_obj));
 
+    cJSON* energy_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "energy", energy_obj);
+    ESP_ERROR_CHECK(data_energy_to_json(energy_obj));
+
+    cJSON* supervisor_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "supervisor", supervisor_obj);
+    ESP_ERROR_CHECK(data_supervisor_to_json(supervisor_obj));
+
+    cJSON* ota_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "ota", ota_obj);
+    ESP_ERROR_CHECK(data_ota_to_json(ota_obj));
+
     cJSON* tacho_obj = cJSON_CreateObject();
     cJSON_AddItemToObject(root, "tacho", tacho_obj);
     ESP_ERROR_CHECK(data_tacho_to_json(tacho_obj));
 
+    cJSON* health_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "health", health_obj);
+    ESP_ERROR_CHECK(data_health_to_json(health_obj));
+
     cJSON* sensors_obj = cJSON_CreateObject();
     cJSON_AddItemToObject(root, "sensors", sensors_obj);
     ESP_ERROR_CHECK(data_sensors_to_json(sensors_obj));
 
+    cJSON* latency_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "latency", latency_obj);
+    ESP_ERROR_CHECK(data_latency_to_json(latency_obj));
+
     cJSON* performance_obj = cJSON_CreateObject();
     cJSON_AddItemToObject(root, "performance", performance_obj);
     ESP_ERROR_CHECK(data_performance_to_json(performance_obj));
 
+    cJSON* boot_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "boot", boot_obj);
+    ESP_ERROR_CHECK(data_boot_to_json(boot_obj));
+
+    cJSON* watchdog_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "watchdog", watchdog_obj);
+    ESP_ERROR_CHECK(data_watchdog_to_json(watchdog_obj));
+
     return ESP_OK;
 }
 
@@ -130,6 +221,11 @@ static void sample_to_json(cJSON* root, const char* name, const adc_sample_t* sa
 
     cJSON_AddNumberToObject(obj, "rms", sample->rms);
     cJSON_AddNumberToObject(obj, "max", sample->max);
+    cJSON_AddNumberToObject(obj, "mean", sample->mean);
+    cJSON_AddNumberToObject(obj, "min", sample->min);
+    cJSON_AddNumberToObject(obj, "p2p", sample->max - sample->min);
+    cJSON_AddNumberToObject(obj, "p95", sample->p95);
+    cJSON_AddNumberToObject(obj, "p99", sample->p99);
 }
 
 esp_err_t data_power_to_json(cJSON* root)
@@ -147,6 +243,46 @@ esp_err_t data_power_to_json(cJSON* root)
     sample_to_json(root, "vfan4_ma", &samples.vfan_ma[3]);
     sample_to_json(root, "vfan5_ma", &samples.vfan_ma[4]);
 
+    cJSON_AddNumberToObject(root, "vbus_mw", samples.vbus_mw);
+    cJSON_AddNumberToObject(root, "vfan1_mw", samples.vfan_mw[0]);
+    cJSON_AddNumberToObject(root, "vfan2_mw", samples.vfan_mw[1]);
+    cJSON_AddNumberToObject(root, "vfan3_mw", samples.vfan_mw[2]);
+    cJSON_AddNumberToObject(root, "vfan4_mw", samples.vfan_mw[3]);
+    cJSON_AddNumberToObject(root, "vfan5_mw", samples.vfan_mw[4]);
+
+    power_stats_t stats;
+    power_fetch(&stats);
+    cJSON_AddBoolToObject(root, "low_power", stats.low_power);
+    cJSON_AddNumberToObject(root, "vbus_avg_ma", stats.vbus_avg_ma);
+    cJSON_AddNumberToObject(root, "vbus_avg_1m_ma", stats.vbus_avg_1m_ma);
+
+    adc_stats_t adc;
+    adc_fetch_stats(&adc);
+    cJSON* adc_obj = cJSON_AddObjectToObject(root, "adc");
+    cJSON_AddNumberToObject(adc_obj, "frames", adc.frames);
+    cJSON_AddNumberToObject(adc_obj, "pool_overflows", adc.pool_overflows);
+    cJSON_AddNumberToObject(adc_obj, "sample_freq_hz", adc.sample_freq_hz);
+    cJSON_AddNumberToObject(adc_obj, "frame_conversions", adc.frame_conversions);
+
+    return ESP_OK;
+}
+
+#define UJ_PER_WH 3600000000.0
+
+esp_err_t data_energy_to_json(cJSON* root)
+{
+    energy_stats_t stats;
+    energy_fetch(&stats);
+
+    cJSON_AddNumberToObject(root, "vbus_wh", stats.counters.vbus_uj / UJ_PER_WH);
+    cJSON_AddNumberToObject(root, "vfan1_wh", stats.counters.vfan_uj[0] / UJ_PER_WH);
+    cJSON_AddNumberToObject(root, "vfan2_wh", stats.counters.vfan_uj[1] / UJ_PER_WH);
+    cJSON_AddNumberToObject(root, "vfan3_wh", stats.counters.vfan_uj[2] / UJ_PER_WH);
+    cJSON_AddNumberToObject(root, "vfan4_wh", stats.counters.vfan_uj[3] / UJ_PER_WH);
+    cJSON_AddNumberToObject(root, "vfan5_wh", stats.counters.vfan_uj[4] / UJ_PER_WH);
+    cJSON_AddNumberToObject(root, "nvs_writes", stats.nvs_writes);
+    cJSON_AddNumberToObject(root, "persisted_us", stats.persisted_us);
+
     return ESP_OK;
 }
 
@@ -164,6 +300,138 @@ esp_err_t data_duty_to_json(cJSON* root)
     return ESP_OK;
 }
 
+static void fan_output_to_json(cJSON* root, const char* name, const fan_output_t* output)
+{
+    cJSON* obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, name, obj);
+
+    cJSON_AddNumberToObject(obj, "pwm8", output->pwm8);
+    cJSON_AddNumberToObject(obj, "min_pwm8", output->min_pwm8);
+}
+
+esp_err_t data_output_to_json(cJSON* root)
+{
+    fans_output_t output;
+    fans_fetch_output(output);
+
+    fan_output_to_json(root, "fan1", &output[0]);
+    fan_output_to_json(root, "fan2", &output[1]);
+    fan_output_to_json(root, "fan3", &output[2]);
+    fan_output_to_json(root, "fan4", &output[3]);
+    fan_output_to_json(root, "fan5", &output[4]);
+
+    return ESP_OK;
+}
+
+static const char* fans_resume_source_name(fans_resume_source_t source)
+{
+    switch (source) {
+    case FANS_RESUME_RTC:
+        return "rtc";
+    case FANS_RESUME_NVS:
+        return "nvs";
+    default:
+        return "none";
+    }
+}
+
+static void data_boot_to_json_emit(const boot_stage_t* stage, void* ctx)
+{
+    cJSON* root = (cJSON*)ctx;
+    cJSON_AddNumberToObject(cJSON_GetObjectItem(root, "stages"), stage->name, stage->duration_us);
+    if (stage->parallel) {
+        cJSON_AddItemToArray(cJSON_GetObjectItem(root, "parallel"), cJSON_CreateString(stage->name));
+    }
+}
+
+esp_err_t data_boot_to_json(cJSON* root)
+{
+    cJSON_AddNumberToObject(root, "done_us", boot_fetch_done_us());
+    cJSON_AddStringToObject(root, "fans_resume", fans_resume_source_name(fans_fetch_resume_source()));
+    cJSON_AddItemToObject(root, "stages", cJSON_CreateObject());
+    cJSON_AddItemToObject(root, "parallel", cJSON_CreateArray());
+    boot_fetch(data_boot_to_json_emit, root);
+
+    return ESP_OK;
+}
+
+esp_err_t data_watchdog_to_json(cJSON* root)
+{
+    cJSON_AddNumberToObject(root, "faults", watchdog_fetch_faults());
+
+    cJSON* tasks_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "tasks", tasks_obj);
+    for (task_id_t id = 0; id < TASK_MAX_COUNT; ++id) {
+        watchdog_stats_t stats;
+        if (!watchdog_fetch(id, &stats)) {
+            continue;
+        }
+
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(tasks_obj, tasks_config(id)->name, obj);
+        cJSON_AddStringToObject(obj, "state", watchdog_state_name(stats.state));
+        cJSON_AddNumberToObject(obj, "processed", stats.processed);
+        cJSON_AddNumberToObject(obj, "lost", stats.lost);
+        cJSON_AddNumberToObject(obj, "misses", stats.misses);
+        cJSON_AddNumberToObject(obj, "restarts", stats.restarts);
+    }
+
+    return ESP_OK;
+}
+
+static void trip_to_json(cJSON* root, const char* name, const supervisor_trip_t* trip)
+{
+    if (!trip->tripped) {
+        return;
+    }
+
+    cJSON* obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, name, obj);
+
+    cJSON_AddNumberToObject(obj, "time_us", trip->time_us);
+    cJSON_AddNumberToObject(obj, "current_ma", trip->current_ma);
+    cJSON_AddBoolToObject(obj, "hardware", trip->hardware);
+}
+
+esp_err_t data_supervisor_to_json(cJSON* root)
+{
+    supervisor_state_t state;
+    supervisor_fetch(&state);
+
+    bool tripped = state.bus.tripped;
+    for (size_t i = 0; i < ARRAY_SIZE(state.fans); ++i) {
+        tripped |= state.fans[i].tripped;
+    }
+    cJSON_AddBoolToObject(root, "tripped", tripped);
+    cJSON_AddNumberToObject(root, "trips", state.trips);
+
+    trip_to_json(root, "bus", &state.bus);
+    trip_to_json(root, "fan1", &state.fans[0]);
+    trip_to_json(root, "fan2", &state.fans[1]);
+    trip_to_json(root, "fan3", &state.fans[2]);
+    trip_to_json(root, "fan4", &state.fans[3]);
+    trip_to_json(root, "fan5", &state.fans[4]);
+
+    return ESP_OK;
+}
+
+esp_err_t data_ota_to_json(cJSON* root)
+{
+    ota_status_t ota;
+    ota_fetch(&ota);
+
+    cJSON_AddStringToObject(root, "running", ota.running);
+    cJSON_AddBoolToObject(root, "pending_verify", ota.pending_verify);
+    cJSON_AddStringToObject(root, "state", ota_state_name(ota.state));
+    cJSON_AddNumberToObject(root, "written", ota.written);
+    cJSON_AddNumberToObject(root, "size", ota.size);
+    if (ota.error != ESP_OK) {
+        cJSON_AddStringToObject(root, "error", esp_err_to_name(ota.error));
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t data_tacho_to_json(cJSON* root)
 {
     tacho_fans_rpm_t rpm;
@@ -178,6 +446,50 @@ esp_err_t data_tacho_to_json(cJSON* root)
     return ESP_OK;
 }
 
+static void fan_health_to_json(cJSON* root, const char* name, const fan_health_t* health)
+{
+    cJSON* obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, name, obj);
+
+    cJSON_AddStringToObject(obj, "state", fan_health_state_name(health->state));
+    cJSON_AddNumberToObject(obj, "since_us", health->since_us);
+    cJSON_AddNumberToObject(obj, "stalls", health->stalls);
+    cJSON_AddNumberToObject(obj, "kicks", health->kicks);
+    if (health->fault != FAN_HEALTH_OFF) {
+        cJSON_AddStringToObject(obj, "fault", fan_health_state_name(health->fault));
+        cJSON_AddNumberToObject(obj, "fault_us", health->fault_us);
+    }
+}
+
+esp_err_t data_health_to_json(cJSON* root)
+{
+    fans_health_t health;
+    fan_health_fetch(health);
+
+    fan_health_to_json(root, "fan1", &health[0]);
+    fan_health_to_json(root, "fan2", &health[1]);
+    fan_health_to_json(root, "fan3", &health[2]);
+    fan_health_to_json(root, "fan4", &health[3]);
+    fan_health_to_json(root, "fan5", &health[4]);
+
+    return ESP_OK;
+}
+
+static void i2c_stats_to_json(cJSON* root, const char* name, temperature_channel_t channel)
+{
+    i2c_bus_device_stats_t stats;
+
+    if (temperature_fetch_i2c_stats(channel, &stats)) {
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, name, obj);
+
+        cJSON_AddNumberToObject(obj, "transactions", stats.transactions);
+        cJSON_AddNumberToObject(obj, "errors", stats.errors);
+        cJSON_AddNumberToObject(obj, "timeouts", stats.timeouts);
+        cJSON_AddNumberToObject(obj, "recoveries", stats.recoveries);
+    }
+}
+
 esp_err_t data_sensors_to_json(cJSON* root)
 {
     temperature_sample_t sample;
@@ -198,32 +510,854 @@ esp_err_t data_sensors_to_json(cJSON* root)
         cJSON_AddNumberToObject(external_obj, "rel_hum_mperct", sample.rel_hum_mperct);
     }
 
+    cJSON_AddBoolToObject(root, "external_present", temperature_is_present(TEMPERATURE_CHANNEL_EXTERNAL));
+
+    i2c_stats_to_json(root, "i2c_on_board", TEMPERATURE_CHANNEL_ON_BOARD);
+    i2c_stats_to_json(root, "i2c_external", TEMPERATURE_CHANNEL_EXTERNAL);
+
     return ESP_OK;
 }
 
 static void data_performance_to_json_emit(performance_entry_t entry, void* ctx)
 {
     cJSON* root = (cJSON*)ctx;
-    cJSON_AddNumberToObject(root, entry.task_name, entry.percentage);
+    cJSON* obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, entry.task_name, obj);
+
+    cJSON_AddNumberToObject(obj, "percentage", entry.percentage);
+    cJSON_AddNumberToObject(obj, "core", entry.core_id);
+    cJSON_AddNumberToObject(obj, "priority", entry.priority);
+    cJSON_AddNumberToObject(obj, "stack_free", entry.stack_high_water_mark);
 }
 
 esp_err_t data_performance_to_json(cJSON* root)
 {
-    performance_fetch(data_performance_to_json_emit, root);
+    performance_summary_t summary;
+    performance_fetch_summary(&summary);
+
+    cJSON_AddNumberToObject(root, "interval_ms", summary.interval_ms);
+
+    cJSON* cores_obj = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "cores", cores_obj);
+    for (size_t i = 0; i < ARRAY_SIZE(summary.core_percentage); ++i) {
+        cJSON_AddItemToArray(cores_obj, cJSON_CreateNumber(summary.core_percentage[i]));
+    }
+
+    cJSON* tasks_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "tasks", tasks_obj);
+    performance_fetch(data_performance_to_json_emit, tasks_obj);
+
+    cJSON* wakeup_obj = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "wakeup", wakeup_obj);
+    ESP_ERROR_CHECK(data_wakeup_to_json(wakeup_obj));
+
+    return ESP_OK;
+}
+
+esp_err_t data_wakeup_to_json(cJSON* root)
+{
+    histogram_stats_t stats;
+
+    for (task_id_t id = 0; id < TASK_MAX_COUNT; ++id) {
+        if (!tasks_config(id)->realtime || !tasks_fetch_wakeup(id, &stats)) {
+            continue;
+        }
+
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, tasks_config(id)->name, obj);
+
+        cJSON_AddNumberToObject(obj, "count", stats.count);
+        cJSON_AddNumberToObject(obj, "min_us", stats.min);
+        cJSON_AddNumberToObject(obj, "p50_us", stats.p50);
+        cJSON_AddNumberToObject(obj, "p99_us", stats.p99);
+        cJSON_AddNumberToObject(obj, "max_us", stats.max);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t data_trace_to_json(cJSON* root)
+{
+    histogram_stats_t stats;
+
+    for (trace_span_t span = 0; span < TRACE_SPAN_MAX_COUNT; ++span) {
+        if (!trace_fetch(span, &stats)) {
+            continue;
+        }
+
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, trace_span_name(span), obj);
+
+        cJSON_AddNumberToObject(obj, "count", stats.count);
+        cJSON_AddNumberToObject(obj, "min_cycles", stats.min);
+        cJSON_AddNumberToObject(obj, "p50_cycles", stats.p50);
+        cJSON_AddNumberToObject(obj, "p99_cycles", stats.p99);
+        cJSON_AddNumberToObject(obj, "max_cycles", stats.max);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t data_latency_to_json(cJSON* root)
+{
+    histogram_stats_t stats;
+
+    for (latency_stage_t stage = 0; stage < LATENCY_STAGE_MAX_COUNT; ++stage) {
+        if (!latency_fetch(stage, &stats)) {
+            continue;
+        }
+
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, latency_stage_name(stage), obj);
+
+        cJSON_AddNumberToObject(obj, "count", stats.count);
+        cJSON_AddNumberToObject(obj, "min_us", stats.min);
+        cJSON_AddNumberToObject(obj, "p50_us", stats.p50);
+        cJSON_AddNumberToObject(obj, "p99_us", stats.p99);
+        cJSON_AddNumberToObject(obj, "max_us", stats.max);
+    }
+    cJSON_AddNumberToObject(root, "rpm_timeouts", latency_fetch_timeouts());
+
+    return ESP_OK;
+}
+
+esp_err_t data_print_cbor(data_to_cbor_t to_cbor, uint8_t* buffer, size_t size, size_t* len_out)
+{
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buffer, size);
+
+    esp_err_t ret = to_cbor(&writer);
+    if (ret == ESP_OK && writer.overflow) {
+        ESP_LOGW(TAG, "Rendering does not fit %u bytes", (unsigned int)size);
+        ret = ESP_ERR_NO_MEM;
+    }
+    *len_out = writer.len;
+
+    return ret;
+}
+
+static void data_uints_to_cbor(cbor_writer_t* writer, const uint32_t* values, size_t count)
+{
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < count; ++i) {
+        cbor_uint(writer, values[i]);
+    }
+    cbor_end(writer);
+}
+
+static void data_sample_to_cbor(cbor_writer_t* writer, const adc_sample_t* sample)
+{
+    const uint32_t values[] = { sample->rms, sample->max, sample->mean, sample->min, sample->p95, sample->p99 };
+    data_uints_to_cbor(writer, values, ARRAY_SIZE(values));
+}
+
+static void data_boot_stage_to_cbor_emit(const boot_stage_t* stage, void* ctx)
+{
+    cbor_writer_t* writer = (cbor_writer_t*)ctx;
+    cbor_text(writer, stage->name);
+    cbor_uint(writer, stage->duration_us);
+}
+
+static void data_boot_parallel_to_cbor_emit(const boot_stage_t* stage, void* ctx)
+{
+    if (stage->parallel) {
+        cbor_text((cbor_writer_t*)ctx, stage->name);
+    }
+}
+
+static void data_boot_to_cbor(cbor_writer_t* writer)
+{
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_BOOT_DONE_US);
+    cbor_uint(writer, boot_fetch_done_us());
+    cbor_key(writer, STATUS_CBOR_BOOT_FANS_RESUME);
+    cbor_uint(writer, fans_fetch_resume_source());
+    cbor_key(writer, STATUS_CBOR_BOOT_STAGES);
+    cbor_map_begin(writer);
+    boot_fetch(data_boot_stage_to_cbor_emit, writer);
+    cbor_end(writer);
+    cbor_key(writer, STATUS_CBOR_BOOT_PARALLEL);
+    cbor_array_begin(writer);
+    boot_fetch(data_boot_parallel_to_cbor_emit, writer);
+    cbor_end(writer);
+    cbor_end(writer);
+}
+
+static void data_watchdog_to_cbor(cbor_writer_t* writer)
+{
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_WATCHDOG_FAULTS);
+    cbor_uint(writer, watchdog_fetch_faults());
+    cbor_key(writer, STATUS_CBOR_WATCHDOG_TASKS);
+    cbor_map_begin(writer);
+    for (task_id_t id = 0; id < TASK_MAX_COUNT; ++id) {
+        watchdog_stats_t stats;
+        if (!watchdog_fetch(id, &stats)) {
+            continue;
+        }
+
+        cbor_text(writer, tasks_config(id)->name);
+        cbor_array_begin(writer);
+        cbor_uint(writer, stats.state);
+        cbor_uint(writer, stats.processed);
+        cbor_uint(writer, stats.lost);
+        cbor_uint(writer, stats.misses);
+        cbor_uint(writer, stats.restarts);
+        cbor_end(writer);
+    }
+    cbor_end(writer);
+    cbor_end(writer);
+}
+
+static void data_histogram_to_cbor(cbor_writer_t* writer, const histogram_stats_t* stats)
+{
+    const uint32_t values[] = { stats->count, stats->min, stats->p50, stats->p99, stats->max };
+    data_uints_to_cbor(writer, values, ARRAY_SIZE(values));
+}
+
+static void data_status_misc_to_cbor(cbor_writer_t* writer)
+{
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
+
+    const esp_app_desc_t* app_desc = esp_app_get_description();
+
+    char hash_buf[17];
+    esp_app_get_elf_sha256(hash_buf, sizeof(hash_buf));
+
+    cbor_key(writer, STATUS_CBOR_FREE_HEAP);
+    cbor_uint(writer, esp_get_free_heap_size());
+    cbor_key(writer, STATUS_CBOR_MINIMUM_HEAP);
+    cbor_uint(writer, esp_get_minimum_free_heap_size());
+    cbor_key(writer, STATUS_CBOR_FREE_HEAP_INTERNAL);
+    cbor_uint(writer, esp_get_free_internal_heap_size());
+    cbor_key(writer, STATUS_CBOR_MINIMUM_HEAP_INTERNAL);
+    cbor_uint(writer, heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
+
+    json_pool_stats_t pool;
+    json_pool_fetch(&pool);
+    const uint32_t pool_values[] = { pool.blocks, pool.block_size, pool.used, pool.peak, pool.fallbacks };
+    cbor_key(writer, STATUS_CBOR_JSON_POOL);
+    data_uints_to_cbor(writer, pool_values, ARRAY_SIZE(pool_values));
+
+    cbor_key(writer, STATUS_CBOR_CHIP_REVISION);
+    cbor_uint(writer, chip_info.revision);
+    cbor_key(writer, STATUS_CBOR_ESP_IDF_VERSION);
+    cbor_text(writer, esp_get_idf_version());
+    cbor_key(writer, STATUS_CBOR_APP_VERSION);
+    cbor_text(writer, app_desc->version);
+    cbor_key(writer, STATUS_CBOR_APP_HASH);
+    cbor_text(writer, hash_buf);
+    cbor_key(writer, STATUS_CBOR_COMPILE_DATE);
+    cbor_text(writer, app_desc->date);
+    cbor_key(writer, STATUS_CBOR_COMPILE_TIME);
+    cbor_text(writer, app_desc->time);
+    cbor_key(writer, STATUS_CBOR_RUNTIME_US);
+    cbor_uint(writer, esp_timer_get_time());
+    cbor_key(writer, STATUS_CBOR_RESET_REASON);
+    cbor_text(writer, data_reset_reason_to_str(esp_reset_reason()));
+}
+
+static void data_power_to_cbor(cbor_writer_t* writer)
+{
+    adc_samples_t samples;
+    adc_fetch(&samples);
+
+    power_stats_t stats;
+    power_fetch(&stats);
+
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_POWER_VBUS_MV);
+    data_sample_to_cbor(writer, &samples.vbus_mv);
+    cbor_key(writer, STATUS_CBOR_POWER_VBUS_MA);
+    data_sample_to_cbor(writer, &samples.vbus_ma);
+    cbor_key(writer, STATUS_CBOR_POWER_VFAN_MV);
+    data_sample_to_cbor(writer, &samples.vfan_mv);
+
+    cbor_key(writer, STATUS_CBOR_POWER_VFAN_MA);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < ARRAY_SIZE(samples.vfan_ma); ++i) {
+        data_sample_to_cbor(writer, &samples.vfan_ma[i]);
+    }
+    cbor_end(writer);
+
+    cbor_key(writer, STATUS_CBOR_POWER_VBUS_MW);
+    cbor_uint(writer, samples.vbus_mw);
+    cbor_key(writer, STATUS_CBOR_POWER_VFAN_MW);
+    data_uints_to_cbor(writer, samples.vfan_mw, ARRAY_SIZE(samples.vfan_mw));
+
+    cbor_key(writer, STATUS_CBOR_POWER_LOW_POWER);
+    cbor_bool(writer, stats.low_power);
+    cbor_key(writer, STATUS_CBOR_POWER_VBUS_AVG_MA);
+    cbor_uint(writer, stats.vbus_avg_ma);
+    cbor_key(writer, STATUS_CBOR_POWER_VBUS_AVG_1M_MA);
+    cbor_uint(writer, stats.vbus_avg_1m_ma);
+
+    adc_stats_t adc;
+    adc_fetch_stats(&adc);
+    cbor_key(writer, STATUS_CBOR_POWER_ADC);
+    cbor_array_begin(writer);
+    cbor_uint(writer, adc.frames);
+    cbor_uint(writer, adc.pool_overflows);
+    cbor_uint(writer, adc.sample_freq_hz);
+    cbor_uint(writer, adc.frame_conversions);
+    cbor_end(writer);
+    cbor_end(writer);
+}
+
+static void data_energy_to_cbor(cbor_writer_t* writer)
+{
+    energy_stats_t stats;
+    energy_fetch(&stats);
+
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_ENERGY_VBUS_UJ);
+    cbor_uint(writer, stats.counters.vbus_uj);
+    cbor_key(writer, STATUS_CBOR_ENERGY_VFAN_UJ);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < ARRAY_SIZE(stats.counters.vfan_uj); ++i) {
+        cbor_uint(writer, stats.counters.vfan_uj[i]);
+    }
+    cbor_end(writer);
+    cbor_key(writer, STATUS_CBOR_ENERGY_NVS_WRITES);
+    cbor_uint(writer, stats.nvs_writes);
+    cbor_key(writer, STATUS_CBOR_ENERGY_PERSISTED_US);
+    cbor_uint(writer, stats.persisted_us);
+    cbor_end(writer);
+}
+
+static void data_trip_to_cbor(cbor_writer_t* writer, const supervisor_trip_t* trip)
+{
+    if (!trip->tripped) {
+        cbor_null(writer);
+        return;
+    }
+
+    cbor_array_begin(writer);
+    cbor_uint(writer, trip->time_us);
+    cbor_uint(writer, trip->current_ma);
+    cbor_bool(writer, trip->hardware);
+    cbor_end(writer);
+}
+
+static void data_supervisor_to_cbor(cbor_writer_t* writer)
+{
+    supervisor_state_t state;
+    supervisor_fetch(&state);
+
+    bool tripped = state.bus.tripped;
+    for (size_t i = 0; i < ARRAY_SIZE(state.fans); ++i) {
+        tripped |= state.fans[i].tripped;
+    }
+
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_SUPERVISOR_TRIPPED);
+    cbor_bool(writer, tripped);
+    cbor_key(writer, STATUS_CBOR_SUPERVISOR_TRIPS);
+    cbor_uint(writer, state.trips);
+    cbor_key(writer, STATUS_CBOR_SUPERVISOR_BUS);
+    data_trip_to_cbor(writer, &state.bus);
+    cbor_key(writer, STATUS_CBOR_SUPERVISOR_FANS);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < ARRAY_SIZE(state.fans); ++i) {
+        data_trip_to_cbor(writer, &state.fans[i]);
+    }
+    cbor_end(writer);
+    cbor_end(writer);
+}
+
+static void data_ota_to_cbor(cbor_writer_t* writer)
+{
+    ota_status_t ota;
+    ota_fetch(&ota);
+
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_OTA_RUNNING);
+    cbor_text(writer, ota.running);
+    cbor_key(writer, STATUS_CBOR_OTA_PENDING_VERIFY);
+    cbor_bool(writer, ota.pending_verify);
+    cbor_key(writer, STATUS_CBOR_OTA_STATE);
+    cbor_text(writer, ota_state_name(ota.state));
+    cbor_key(writer, STATUS_CBOR_OTA_WRITTEN);
+    cbor_uint(writer, ota.written);
+    cbor_key(writer, STATUS_CBOR_OTA_SIZE);
+    cbor_uint(writer, ota.size);
+    if (ota.error != ESP_OK) {
+        cbor_key(writer, STATUS_CBOR_OTA_ERROR);
+        cbor_text(writer, esp_err_to_name(ota.error));
+    }
+    cbor_end(writer);
+}
+
+static void data_health_to_cbor(cbor_writer_t* writer)
+{
+    fans_health_t health;
+    fan_health_fetch(health);
+
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cbor_map_begin(writer);
+        cbor_key(writer, STATUS_CBOR_HEALTH_STATE);
+        cbor_text(writer, fan_health_state_name(health[i].state));
+        cbor_key(writer, STATUS_CBOR_HEALTH_SINCE_US);
+        cbor_uint(writer, health[i].since_us);
+        cbor_key(writer, STATUS_CBOR_HEALTH_STALLS);
+        cbor_uint(writer, health[i].stalls);
+        cbor_key(writer, STATUS_CBOR_HEALTH_KICKS);
+        cbor_uint(writer, health[i].kicks);
+        if (health[i].fault != FAN_HEALTH_OFF) {
+            cbor_key(writer, STATUS_CBOR_HEALTH_FAULT);
+            cbor_text(writer, fan_health_state_name(health[i].fault));
+            cbor_key(writer, STATUS_CBOR_HEALTH_FAULT_US);
+            cbor_uint(writer, health[i].fault_us);
+        }
+        cbor_end(writer);
+    }
+    cbor_end(writer);
+}
+
+static void data_temperature_to_cbor(cbor_writer_t* writer, unsigned int key, unsigned int i2c_key, temperature_channel_t channel)
+{
+    temperature_sample_t sample;
+    i2c_bus_device_stats_t stats;
+
+    if (temperature_fetch(channel, &sample)) {
+        cbor_key(writer, key);
+        cbor_array_begin(writer);
+        cbor_int(writer, sample.temperature_mc);
+        cbor_int(writer, sample.rel_hum_mperct);
+        cbor_end(writer);
+    }
+    if (temperature_fetch_i2c_stats(channel, &stats)) {
+        const uint32_t values[] = { stats.transactions, stats.errors, stats.timeouts, stats.recoveries };
+        cbor_key(writer, i2c_key);
+        data_uints_to_cbor(writer, values, ARRAY_SIZE(values));
+    }
+}
+
+static void data_sensors_to_cbor(cbor_writer_t* writer)
+{
+    cbor_map_begin(writer);
+    data_temperature_to_cbor(writer, STATUS_CBOR_SENSORS_ON_BOARD, STATUS_CBOR_SENSORS_I2C_ON_BOARD, TEMPERATURE_CHANNEL_ON_BOARD);
+    data_temperature_to_cbor(writer, STATUS_CBOR_SENSORS_EXTERNAL, STATUS_CBOR_SENSORS_I2C_EXTERNAL, TEMPERATURE_CHANNEL_EXTERNAL);
+    cbor_key(writer, STATUS_CBOR_SENSORS_EXTERNAL_PRESENT);
+    cbor_bool(writer, temperature_is_present(TEMPERATURE_CHANNEL_EXTERNAL));
+    cbor_end(writer);
+}
+
+static void data_latency_to_cbor(cbor_writer_t* writer)
+{
+    histogram_stats_t stats;
+
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_LATENCY_STAGES);
+    cbor_map_begin(writer);
+    for (latency_stage_t stage = 0; stage < LATENCY_STAGE_MAX_COUNT; ++stage) {
+        if (latency_fetch(stage, &stats)) {
+            cbor_text(writer, latency_stage_name(stage));
+            data_histogram_to_cbor(writer, &stats);
+        }
+    }
+    cbor_end(writer);
+    cbor_key(writer, STATUS_CBOR_LATENCY_RPM_TIMEOUTS);
+    cbor_uint(writer, latency_fetch_timeouts());
+    cbor_end(writer);
+}
+
+static void data_performance_to_cbor_emit(performance_entry_t entry, void* ctx)
+{
+    cbor_writer_t* writer = ctx;
+
+    cbor_text(writer, entry.task_name);
+    cbor_array_begin(writer);
+    cbor_uint(writer, entry.percentage);
+    cbor_int(writer, entry.core_id);
+    cbor_uint(writer, entry.priority);
+    cbor_uint(writer, entry.stack_high_water_mark);
+    cbor_end(writer);
+}
+
+static void data_performance_to_cbor(cbor_writer_t* writer)
+{
+    performance_summary_t summary;
+    performance_fetch_summary(&summary);
+
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_PERFORMANCE_INTERVAL_MS);
+    cbor_uint(writer, summary.interval_ms);
+
+    cbor_key(writer, STATUS_CBOR_PERFORMANCE_CORES);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < ARRAY_SIZE(summary.core_percentage); ++i) {
+        cbor_uint(writer, summary.core_percentage[i]);
+    }
+    cbor_end(writer);
+
+    cbor_key(writer, STATUS_CBOR_PERFORMANCE_TASKS);
+    cbor_map_begin(writer);
+    performance_fetch(data_performance_to_cbor_emit, writer);
+    cbor_end(writer);
+
+    histogram_stats_t stats;
+    cbor_key(writer, STATUS_CBOR_PERFORMANCE_WAKEUP);
+    cbor_map_begin(writer);
+    for (task_id_t id = 0; id < TASK_MAX_COUNT; ++id) {
+        if (tasks_config(id)->realtime && tasks_fetch_wakeup(id, &stats)) {
+            cbor_text(writer, tasks_config(id)->name);
+            data_histogram_to_cbor(writer, &stats);
+        }
+    }
+    cbor_end(writer);
+    cbor_end(writer);
+}
+
+esp_err_t data_status_to_cbor(cbor_writer_t* writer)
+{
+    cbor_map_begin(writer);
+    cbor_key(writer, STATUS_CBOR_SCHEMA);
+    cbor_uint(writer, STATUS_CBOR_SCHEMA_VERSION);
+    cbor_key(writer, STATUS_CBOR_ID);
+    cbor_text(writer, data_get_id());
+
+    data_status_misc_to_cbor(writer);
+
+    fans_pwm8_t fans;
+    fans_fetch(fans);
+    cbor_key(writer, STATUS_CBOR_DUTY);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cbor_uint(writer, fans[i]);
+    }
+    cbor_end(writer);
+
+    cbor_key(writer, STATUS_CBOR_POWER);
+    data_power_to_cbor(writer);
+    cbor_key(writer, STATUS_CBOR_ENERGY);
+    data_energy_to_cbor(writer);
+    cbor_key(writer, STATUS_CBOR_SUPERVISOR);
+    data_supervisor_to_cbor(writer);
+    cbor_key(writer, STATUS_CBOR_OTA);
+    data_ota_to_cbor(writer);
+
+    tacho_fans_rpm_t rpm;
+    tacho_fetch(rpm);
+    cbor_key(writer, STATUS_CBOR_TACHO);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cbor_uint(writer, rpm[i]);
+    }
+    cbor_end(writer);
+
+    cbor_key(writer, STATUS_CBOR_HEALTH);
+    data_health_to_cbor(writer);
+    cbor_key(writer, STATUS_CBOR_SENSORS);
+    data_sensors_to_cbor(writer);
+    cbor_key(writer, STATUS_CBOR_LATENCY);
+    data_latency_to_cbor(writer);
+    cbor_key(writer, STATUS_CBOR_PERFORMANCE);
+    data_performance_to_cbor(writer);
+
+    fans_output_t output;
+    fans_fetch_output(output);
+    cbor_key(writer, STATUS_CBOR_OUTPUT);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cbor_array_begin(writer);
+        cbor_uint(writer, output[i].pwm8);
+        cbor_uint(writer, output[i].min_pwm8);
+        cbor_end(writer);
+    }
+    cbor_end(writer);
+
+    cbor_key(writer, STATUS_CBOR_BOOT);
+    data_boot_to_cbor(writer);
+
+    cbor_key(writer, STATUS_CBOR_WATCHDOG);
+    data_watchdog_to_cbor(writer);
+    cbor_end(writer);
+
+    return ESP_OK;
+}
+
+esp_err_t data_telemetry_to_cbor(cbor_writer_t* writer, uint32_t sequence, int64_t timestamp_us)
+{
+    fans_pwm8_t fans;
+    fans_fetch(fans);
+    tacho_fans_rpm_t rpm;
+    tacho_fetch(rpm);
+    adc_samples_t samples;
+    adc_fetch(&samples);
+    supervisor_state_t state;
+    supervisor_fetch(&state);
+
+    bool tripped = state.bus.tripped;
+    for (size_t i = 0; i < ARRAY_SIZE(state.fans); ++i) {
+        tripped |= state.fans[i].tripped;
+    }
+
+    cbor_array_begin(writer);
+    cbor_uint(writer, STATUS_CBOR_TELEMETRY_VERSION);
+    cbor_uint(writer, sequence);
+    cbor_uint(writer, timestamp_us);
+    cbor_text(writer, data_get_id());
+
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cbor_uint(writer, fans[i]);
+    }
+    cbor_end(writer);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cbor_uint(writer, rpm[i]);
+    }
+    cbor_end(writer);
+    cbor_array_begin(writer);
+    for (size_t i = 0; i < ARRAY_SIZE(samples.vfan_ma); ++i) {
+        cbor_uint(writer, samples.vfan_ma[i].rms);
+    }
+    cbor_end(writer);
+
+    cbor_uint(writer, samples.vbus_mv.rms);
+    cbor_uint(writer, samples.vbus_ma.rms);
+    cbor_uint(writer, samples.vbus_mw);
+    cbor_bool(writer, tripped);
+
+    temperature_sample_t sample;
+    if (temperature_fetch(TEMPERATURE_CHANNEL_EXTERNAL, &sample) || temperature_fetch(TEMPERATURE_CHANNEL_ON_BOARD, &sample)) {
+        cbor_int(writer, sample.temperature_mc);
+    } else {
+        cbor_null(writer);
+    }
+    cbor_end(writer);
+
+    return ESP_OK;
+}
+
+static const char* const s_settings_groups[] = {
+    "wifi", "mqtt", "report", "pwm", "tacho", "adc", "current_sense", "output"
+};
+
+esp_err_t data_settings_to_json(cJSON* root)
+{
+    settings_t settings;
+    settings_fetch(&settings);
+
+    cJSON_AddStringToObject(root, "wifi_ssid", settings.wifi_ssid);
+    cJSON_AddBoolToObject(root, "wifi_passphrase_set", settings.wifi_passphrase[0] != '\0'); // Write only
+    cJSON_AddStringToObject(root, "mqtt_broker_url", settings.mqtt_broker_url);
+    cJSON_AddNumberToObject(root, "report_fast_interval_ms", settings.report_fast_interval_ms);
+    cJSON_AddNumberToObject(root, "report_slow_interval_ms", settings.report_slow_interval_ms);
+    cJSON_AddNumberToObject(root, "pwm_frequency_hz", settings.pwm_frequency_hz);
+
+    cJSON* gpios = cJSON_AddArrayToObject(root, "tacho_gpio");
+    for (size_t i = 0; i < ARRAY_SIZE(settings.tacho_gpio); ++i) {
+        cJSON_AddItemToArray(gpios, cJSON_CreateNumber(settings.tacho_gpio[i]));
+    }
+
+    cJSON_AddNumberToObject(root, "adc_oversampling", settings.adc_oversampling);
+    cJSON_AddNumberToObject(root, "current_sense_milliohm", settings.current_sense_milliohm);
+    cJSON_AddNumberToObject(root, "current_sense_gain", settings.current_sense_gain);
+
+    cJSON* slew = cJSON_AddArrayToObject(root, "output_slew_pwm8_per_s");
+    cJSON* dwell = cJSON_AddArrayToObject(root, "output_dwell_ms");
+    cJSON* deadband = cJSON_AddArrayToObject(root, "output_deadband_pwm8");
+    cJSON* min = cJSON_AddArrayToObject(root, "output_min_pwm8");
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        cJSON_AddItemToArray(slew, cJSON_CreateNumber(settings.output_slew_pwm8_per_s[i]));
+        cJSON_AddItemToArray(dwell, cJSON_CreateNumber(settings.output_dwell_ms[i]));
+        cJSON_AddItemToArray(deadband, cJSON_CreateNumber(settings.output_deadband_pwm8[i]));
+        cJSON_AddItemToArray(min, cJSON_CreateNumber(settings.output_min_pwm8[i]));
+    }
+
+    const uint32_t restart_pending = settings_restart_pending();
+    cJSON* pending = cJSON_AddArrayToObject(root, "restart_pending");
+    for (size_t i = 0; i < ARRAY_SIZE(s_settings_groups); ++i) {
+        if (restart_pending & (1 << i)) {
+            cJSON_AddItemToArray(pending, cJSON_CreateString(s_settings_groups[i]));
+        }
+    }
+
+    return ESP_OK;
+}
+
+// Keeps the setting when the key is missing, fails on a value of the wrong type or size
+static bool data_settings_string(const cJSON* root, const char* key, char* out, size_t size)
+{
+    const cJSON* obj = cJSON_GetObjectItemCaseSensitive(root, key);
+    if (obj == NULL) {
+        return true;
+    }
+    if (!cJSON_IsString(obj) || strlen(cJSON_GetStringValue(obj)) >= size) {
+        ESP_LOGW(TAG, "Invalid setting %s", key);
+        return false;
+    }
+    strcpy(out, cJSON_GetStringValue(obj));
+    return true;
+}
+
+static bool data_settings_value(const cJSON* obj, const char* key, uint32_t max, uint32_t* out)
+{
+    const double value = cJSON_GetNumberValue(obj);
+    if (!cJSON_IsNumber(obj) || value < 0 || value > max || value != (uint32_t)value) {
+        ESP_LOGW(TAG, "Invalid setting %s", key);
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static bool data_settings_number(const cJSON* root, const char* key, uint32_t max, uint32_t* out)
+{
+    const cJSON* obj = cJSON_GetObjectItemCaseSensitive(root, key);
+    return obj == NULL || data_settings_value(obj, key, max, out);
+}
+
+// One value per fan, all of them or none
+static bool data_settings_array(const cJSON* root, const char* key, uint32_t max, uint32_t out[FANS_COUNT])
+{
+    const cJSON* array = cJSON_GetObjectItemCaseSensitive(root, key);
+    if (array == NULL) {
+        return true;
+    }
+    if (!cJSON_IsArray(array) || cJSON_GetArraySize(array) != FANS_COUNT) {
+        ESP_LOGW(TAG, "Invalid setting %s", key);
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < FANS_COUNT; ++i) {
+        ok = data_settings_value(cJSON_GetArrayItem(array, i), key, max, &out[i]);
+    }
+    return ok;
+}
+
+esp_err_t data_process_settings_json_str(const char* str, size_t str_len)
+{
+    cJSON* root = cJSON_ParseWithLength(str, str_len);
+    if (!cJSON_IsObject(root)) {
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(root, "reset"))) {
+        cJSON_Delete(root);
+        return settings_reset();
+    }
+
+    // Starts from the current settings, the update only goes through as a whole
+    settings_t settings;
+    settings_fetch(&settings);
+
+    uint32_t oversampling = settings.adc_oversampling;
+    uint32_t milliohm = settings.current_sense_milliohm;
+    uint32_t gain = settings.current_sense_gain;
+    uint32_t gpios[FANS_COUNT], slew[FANS_COUNT], dwell[FANS_COUNT], deadband[FANS_COUNT], min[FANS_COUNT];
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        gpios[i] = settings.tacho_gpio[i];
+        slew[i] = settings.output_slew_pwm8_per_s[i];
+        dwell[i] = settings.output_dwell_ms[i];
+        deadband[i] = settings.output_deadband_pwm8[i];
+        min[i] = settings.output_min_pwm8[i];
+    }
+
+    bool ok = data_settings_string(root, "wifi_ssid", settings.wifi_ssid, sizeof(settings.wifi_ssid))
+        && data_settings_string(root, "wifi_passphrase", settings.wifi_passphrase, sizeof(settings.wifi_passphrase))
+        && data_settings_string(root, "mqtt_broker_url", settings.mqtt_broker_url, sizeof(settings.mqtt_broker_url))
+        && data_settings_number(root, "report_fast_interval_ms", UINT32_MAX, &settings.report_fast_interval_ms)
+        && data_settings_number(root, "report_slow_interval_ms", UINT32_MAX, &settings.report_slow_interval_ms)
+        && data_settings_number(root, "pwm_frequency_hz", UINT32_MAX, &settings.pwm_frequency_hz)
+        && data_settings_number(root, "adc_oversampling", UINT8_MAX, &oversampling)
+        && data_settings_number(root, "current_sense_milliohm", UINT16_MAX, &milliohm)
+        && data_settings_number(root, "current_sense_gain", UINT16_MAX, &gain)
+        && data_settings_array(root, "tacho_gpio", UINT8_MAX, gpios)
+        && data_settings_array(root, "output_slew_pwm8_per_s", UINT16_MAX, slew)
+        && data_settings_array(root, "output_dwell_ms", UINT16_MAX, dwell)
+        && data_settings_array(root, "output_deadband_pwm8", UINT8_MAX, deadband)
+        && data_settings_array(root, "output_min_pwm8", UINT8_MAX, min);
+    cJSON_Delete(root);
+
+    settings.adc_oversampling = oversampling;
+    settings.current_sense_milliohm = milliohm;
+    settings.current_sense_gain = gain;
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        settings.tacho_gpio[i] = gpios[i];
+        settings.output_slew_pwm8_per_s[i] = slew[i];
+        settings.output_dwell_ms[i] = dwell[i];
+        settings.output_deadband_pwm8[i] = deadband[i];
+        settings.output_min_pwm8[i] = min[i];
+    }
+
+    return ok ? settings_update(&settings) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t data_calibration_to_json(cJSON* root)
+{
+    calibration_t calibration;
+    calibration_fetch(&calibration);
+
+    for (size_t i = 0; i < CALIBRATION_INPUT_COUNT; ++i) {
+        const calibration_channel_t* channel = &calibration.channels[i];
+        cJSON* input = cJSON_AddObjectToObject(root, calibration_input_name(i));
+
+        cJSON* points = cJSON_AddArrayToObject(input, "points");
+        for (size_t j = 0; j < channel->points; ++j) {
+            cJSON* point = cJSON_CreateObject();
+            cJSON_AddNumberToObject(point, "reference", channel->point[j].reference);
+            cJSON_AddNumberToObject(point, "measured_uv", channel->point[j].measured_uv);
+            cJSON_AddItemToArray(points, point);
+        }
+        if (channel->points != 0) {
+            cJSON_AddNumberToObject(input, "gain", (double)channel->gain_q16 / (1 << CALIBRATION_GAIN_SHIFT));
+            cJSON_AddNumberToObject(input, "offset", channel->offset);
+        }
+        cJSON_AddNumberToObject(input, "pin_uv", adc_fetch_pin_uv(i));
+    }
+
     return ESP_OK;
 }
 
-static void data_try_process_duty_json(cJSON* root, const char* key, uint8_t fan_i)
+esp_err_t data_process_calibration_json_str(const char* str, size_t str_len)
+{
+    cJSON* root = cJSON_ParseWithLength(str, str_len);
+    if (!cJSON_IsObject(root)) {
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char* name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "input"));
+    const calibration_input_t input = (name != NULL) ? calibration_input_from_name(name) : CALIBRATION_INPUT_COUNT;
+    const bool clear = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(root, "clear"));
+    uint32_t reference = UINT32_MAX;
+    const bool ok = input < CALIBRATION_INPUT_COUNT
+        && data_settings_number(root, "reference", UINT16_MAX, &reference)
+        && (clear || reference != UINT32_MAX);
+    cJSON_Delete(root);
+
+    if (!ok) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // The reading the supply is applied to right now, as the pin sees it
+    return clear ? calibration_clear(input) : calibration_add_point(input, reference, adc_fetch_pin_uv(input));
+}
+
+static void data_command_fan(uint8_t fan_i, fan_pwm8_t duty, int64_t received_us)
+{
+    latency_command_pending(fan_i, received_us);
+    fans_command(fan_i, duty);
+}
+
+static void data_try_process_duty_json(cJSON* root, const char* key, uint8_t fan_i, int64_t received_us)
 {
     cJSON* obj = cJSON_GetObjectItemCaseSensitive(root, key);
     if (cJSON_IsNumber(obj)) {
-        fans_command(fan_i, cJSON_GetNumberValue(obj));
+        data_command_fan(fan_i, cJSON_GetNumberValue(obj), received_us);
     }
 }
 
-esp_err_t data_process_duty_json_str(const char* str, size_t str_len)
+esp_err_t data_process_duty_json_str(const char* str, size_t str_len, int64_t received_us)
 {
     cJSON* root = cJSON_ParseWithLength(str, str_len);
+    const int64_t parsed_us = esp_timer_get_time();
 
     if (root == NULL) {
         const char* error_ptr = cJSON_GetErrorPtr();
@@ -232,19 +1366,25 @@ esp_err_t data_process_duty_json_str(const char* str, size_t str_len)
         }
         return ESP_ERR_INVALID_ARG;
     }
+    latency_command_parsed(received_us, parsed_us);
+
+    // Before the duties, so a command can clear the trips and set new duties at once
+    if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(root, "clear_trips"))) {
+        supervisor_clear();
+    }
 
     cJSON* obj = cJSON_GetObjectItemCaseSensitive(root, "fans_pwm8");
     if (cJSON_IsNumber(obj)) {
         for (size_t i = 0; i < FANS_COUNT; ++i) {
-            fans_command(i, cJSON_GetNumberValue(obj));
+            data_command_fan(i, cJSON_GetNumberValue(obj), received_us);
         }
     }
 
-    data_try_process_duty_json(root, "fan1_pwm8", 0);
-    data_try_process_duty_json(root, "fan2_pwm8", 1);
-    data_try_process_duty_json(root, "fan3_pwm8", 2);
-    data_try_process_duty_json(root, "fan4_pwm8", 3);
-    data_try_process_duty_json(root, "fan5_pwm8", 4);
+    data_try_process_duty_json(root, "fan1_pwm8", 0, received_us);
+    data_try_process_duty_json(root, "fan2_pwm8", 1, received_us);
+    data_try_process_duty_json(root, "fan3_pwm8", 2, received_us);
+    data_try_process_duty_json(root, "fan4_pwm8", 3, received_us);
+    data_try_process_duty_json(root, "fan5_pwm8", 4, received_us);
 
     cJSON_Delete(root);
 
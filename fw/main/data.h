@@ -3,15 +3,49 @@
 #include <cJSON.h>
 #include <esp_err.h>
 
+#include "cbor.h"
 #include "fans.h"
 
+typedef esp_err_t (*data_to_json_t)(cJSON* root);
+typedef esp_err_t (*data_to_cbor_t)(cbor_writer_t* writer);
+
+esp_err_t data_init(void);
+
 const char* data_get_id(void);
 
+// Renders into a caller provided buffer, cJSON needs about 5 bytes of slack beyond the document
+esp_err_t data_print(data_to_json_t to_json, char* buffer, size_t size);
+// Writes straight into the buffer without a tree, so it needs neither the JSON pool nor the print mutex
+esp_err_t data_print_cbor(data_to_cbor_t to_cbor, uint8_t* buffer, size_t size, size_t* len_out);
+
 esp_err_t data_status_to_json(cJSON* root);
+// Same data as data_status_to_json, integer keys as in status_cbor.h
+esp_err_t data_status_to_cbor(cbor_writer_t* writer);
+// The few values a live view needs, as a STATUS_CBOR_TELEMETRY frame
+esp_err_t data_telemetry_to_cbor(cbor_writer_t* writer, uint32_t sequence, int64_t timestamp_us);
 esp_err_t data_power_to_json(cJSON* root);
+esp_err_t data_energy_to_json(cJSON* root);
 esp_err_t data_duty_to_json(cJSON* root);
+// Conditioned duties as driven, see fans_output_step
+esp_err_t data_output_to_json(cJSON* root);
+esp_err_t data_boot_to_json(cJSON* root);
+esp_err_t data_watchdog_to_json(cJSON* root);
+esp_err_t data_supervisor_to_json(cJSON* root);
+esp_err_t data_ota_to_json(cJSON* root);
 esp_err_t data_tacho_to_json(cJSON* root);
+esp_err_t data_health_to_json(cJSON* root);
 esp_err_t data_sensors_to_json(cJSON* root);
 esp_err_t data_performance_to_json(cJSON* root);
+esp_err_t data_trace_to_json(cJSON* root);
+esp_err_t data_wakeup_to_json(cJSON* root);
+
+esp_err_t data_latency_to_json(cJSON* root);
+esp_err_t data_settings_to_json(cJSON* root);
+// Stored points and lines per ADC input, with the current pin reading to calibrate against
+esp_err_t data_calibration_to_json(cJSON* root);
 
-esp_err_t data_process_duty_json_str(const char* str, size_t str_len);
+esp_err_t data_process_duty_json_str(const char* str, size_t str_len, int64_t received_us);
+// A partial settings object, or {"reset":true} for the build defaults
+esp_err_t data_process_settings_json_str(const char* str, size_t str_len);
+// {"input":"vbus_mv","reference":12000} takes a point at the applied reference, {"input":...,"clear":true} drops them
+esp_err_t data_process_calibration_json_str(const char* str, size_t str_len);
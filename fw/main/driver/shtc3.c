@@ -1,14 +1,21 @@
 #include "shtc3.h"
 
 #include <esp_log.h>
+#include <esp_rom_sys.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include "util.h"
 
 #define TAG "shtc3"
 
-#define I2C_MASTER_TIMEOUT_MS 1000
 #define SHTC3_SENSOR_ADDR 0x70
+#define SHTC3_WAKEUP_TIME_US 240
+#define SHTC3_READ_RETRIES 5
+
+#define SHTC3_COMMAND_WAKEUP 0x3517
+#define SHTC3_COMMAND_MEASURE_T_FIRST 0x7866 // Normal mode, clock stretching disabled
+#define SHTC3_COMMAND_SLEEP 0xB098
 
 static inline uint16_t sys_get_be16(const uint8_t src[2])
 {
@@ -21,53 +28,57 @@ static inline void sys_put_be16(uint16_t val, uint8_t dst[2])
     dst[1] = val;
 }
 
-// static esp_err_t shtc3_register_read_register(i2c_port_t port, uint16_t command, uint16_t *data)
-// {
-//     uint8_t write_buf[2];
-//     sys_put_be16(command, write_buf);
-//     uint8_t *read_buf = (uint8_t *)data;
-//     return i2c_master_write_read_device(port, SHTC3_SENSOR_ADDR, write_buf, sizeof(write_buf), read_buf, 2, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
-// }
-
-static esp_err_t shtc3_register_read(i2c_port_t port, uint8_t* data, size_t len)
-{
-    return i2c_master_read_from_device(port, SHTC3_SENSOR_ADDR, data, len, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
-}
-
-static esp_err_t shtc3_register_write_command(i2c_port_t port, uint16_t command)
+static esp_err_t shtc3_register_write_command(i2c_bus_device_t* device, uint16_t command)
 {
-    int ret;
     uint8_t write_buf[2];
     sys_put_be16(command, write_buf);
 
-    ret = i2c_master_write_to_device(port, SHTC3_SENSOR_ADDR, write_buf, sizeof(write_buf), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS);
+    return i2c_bus_transmit(device, write_buf, sizeof(write_buf));
+}
 
-    return ret;
+esp_err_t shtc3_init(i2c_bus_t bus, i2c_bus_device_t** device_out)
+{
+    return i2c_bus_device_add(bus, SHTC3_SENSOR_ADDR, device_out);
 }
 
-esp_err_t shtc3_measure(i2c_port_t port, shtc3_sample_t* sample_out)
+esp_err_t shtc3_measure_start(i2c_bus_device_t* device)
 {
     esp_err_t ret;
-    ERROR_CHECK_SIMPLE(shtc3_register_write_command(port, 0x3517));
-    vTaskDelay(pdMS_TO_TICKS(20));
+    ERROR_CHECK_SIMPLE(shtc3_register_write_command(device, SHTC3_COMMAND_WAKEUP));
+    esp_rom_delay_us(SHTC3_WAKEUP_TIME_US);
 
-    ERROR_CHECK_SIMPLE(shtc3_register_write_command(port, 0x7866));
+    ERROR_CHECK_SIMPLE(shtc3_register_write_command(device, SHTC3_COMMAND_MEASURE_T_FIRST));
+    return ESP_OK;
+err:
+    return ret;
+}
 
+esp_err_t shtc3_measure_read(i2c_bus_device_t* device, shtc3_sample_t* sample_out)
+{
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+
+    // The sensor NACKs reads while the measurement is still in progress
     uint8_t data[6] = { 0 };
-    while (1) {
-        if (ESP_OK == shtc3_register_read(port, data, sizeof(data))) {
+    for (size_t i = 0; i < SHTC3_READ_RETRIES; ++i) {
+        if (ESP_OK == i2c_bus_receive(device, data, sizeof(data))) {
             uint16_t temp_raw = sys_get_be16(&data[0]);
             uint16_t hum_raw = sys_get_be16(&data[3]);
 
             sample_out->temperature_mc = ((((int32_t)temp_raw) * 21875) >> 13) - 45000;
             sample_out->rel_hum_mperct = (((int32_t)hum_raw) * 12500) >> 13;
+            ret = ESP_OK;
             break;
         }
-        vTaskDelay(pdMS_TO_TICKS(1));
+        vTaskDelay(1); // Wait for one tick, pdMS_TO_TICKS(1) rounds down to 0 at 100Hz
     }
 
-    ERROR_CHECK_SIMPLE(shtc3_register_write_command(port, 0xB098));
-    return ESP_OK;
-err:
+    // Nobody waits for the sensor to go to sleep, let the bus worker handle it
+    uint8_t sleep_buf[2];
+    sys_put_be16(SHTC3_COMMAND_SLEEP, sleep_buf);
+    i2c_bus_transmit_async(device, sleep_buf, sizeof(sleep_buf), NULL, NULL);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Measurement not ready after %d retries", SHTC3_READ_RETRIES);
+    }
     return ret;
-}
\ No newline at end of file
+}
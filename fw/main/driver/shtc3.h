@@ -1,12 +1,20 @@
 #pragma once
 
-#include <driver/i2c.h>
 #include <esp_err.h>
 
+#include "i2c_bus.h"
+
+#define SHTC3_MEASUREMENT_DURATION_MS 13 // 12.1ms max in normal mode
+
 typedef struct
 {
     int32_t temperature_mc;
     int32_t rel_hum_mperct;
 } shtc3_sample_t;
 
-esp_err_t shtc3_measure(i2c_port_t port, shtc3_sample_t* sample_out);
+esp_err_t shtc3_init(i2c_bus_t bus, i2c_bus_device_t** device_out);
+
+// Wake up the sensor and start a measurement, the result is available after SHTC3_MEASUREMENT_DURATION_MS
+esp_err_t shtc3_measure_start(i2c_bus_device_t* device);
+// Fetch the measurement result and put the sensor back to sleep
+esp_err_t shtc3_measure_read(i2c_bus_device_t* device, shtc3_sample_t* sample_out);
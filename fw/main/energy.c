@@ -0,0 +1,144 @@
+#include "energy.h"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <nvs.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "events.h"
+#include "util.h"
+
+#define TAG "energy"
+
+#define ENERGY_NVS_NAMESPACE "energy"
+#define ENERGY_NVS_KEY "counters"
+#define ENERGY_RTC_MAGIC 0x454e5247 // "ENRG"
+#define ENERGY_PERSIST_INTERVAL_US (CONFIG_ENERGY_PERSIST_INTERVAL_S * 1000000LL)
+
+// Survives software resets and panics, so at most a frame is lost there. NVS covers power loss.
+typedef struct
+{
+    uint32_t magic;
+    energy_counters_t counters;
+    uint32_t checksum;
+} energy_rtc_t;
+
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static RTC_NOINIT_ATTR energy_rtc_t s_rtc;
+static energy_stats_t s_stats;
+
+static bool energy_load_rtc(energy_counters_t* counters)
+{
+    if (esp_reset_reason() == ESP_RST_POWERON || s_rtc.magic != ENERGY_RTC_MAGIC
+        || s_rtc.checksum != fnv1a32(&s_rtc.counters, sizeof(s_rtc.counters))) {
+        return false;
+    }
+
+    *counters = s_rtc.counters;
+    return true;
+}
+
+static bool energy_load_nvs(energy_counters_t* counters)
+{
+    nvs_handle_t handle;
+    if (nvs_open(ENERGY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t length = sizeof(*counters);
+    esp_err_t ret = nvs_get_blob(handle, ENERGY_NVS_KEY, counters, &length);
+    nvs_close(handle);
+
+    return ret == ESP_OK && length == sizeof(*counters);
+}
+
+static esp_err_t energy_store_nvs(const energy_counters_t* counters)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+
+    ERROR_CHECK_SIMPLE(nvs_open(ENERGY_NVS_NAMESPACE, NVS_READWRITE, &handle));
+    ret = nvs_set_blob(handle, ENERGY_NVS_KEY, counters, sizeof(*counters));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    ERROR_CHECK_SIMPLE(ret);
+
+    return ESP_OK;
+err:
+    return ret;
+}
+
+// Writes from the event loop, flash writes stall the caller for a while
+static void energy_adc_sampled_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    const int64_t now = esp_timer_get_time();
+    energy_counters_t counters;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const bool due = (now - s_stats.persisted_us >= ENERGY_PERSIST_INTERVAL_US);
+    counters = s_stats.counters;
+    xSemaphoreGive(s_mutex);
+
+    if (!due || energy_store_nvs(&counters) != ESP_OK) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_stats.persisted_us = now;
+    s_stats.nvs_writes++;
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t energy_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    if (energy_load_rtc(&s_stats.counters)) {
+        ESP_LOGI(TAG, "Restored counters from RTC memory");
+    } else if (energy_load_nvs(&s_stats.counters)) {
+        ESP_LOGI(TAG, "Restored counters from NVS");
+    } else {
+        memset(&s_stats.counters, 0, sizeof(s_stats.counters));
+    }
+
+    s_rtc.counters = s_stats.counters;
+    s_rtc.checksum = fnv1a32(&s_rtc.counters, sizeof(s_rtc.counters));
+    s_rtc.magic = ENERGY_RTC_MAGIC;
+
+    // The first write happens one interval after boot
+    s_stats.persisted_us = esp_timer_get_time();
+
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ADC_SAMPLED, energy_adc_sampled_handler, NULL));
+
+    return ESP_OK;
+}
+
+void energy_accumulate(const adc_samples_t* samples, int64_t duration_us)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    // mW * us = nJ
+    s_stats.counters.vbus_uj += (uint64_t)samples->vbus_mw * duration_us / 1000;
+    for (size_t i = 0; i < ARRAY_SIZE(s_stats.counters.vfan_uj); ++i) {
+        s_stats.counters.vfan_uj[i] += (uint64_t)samples->vfan_mw[i] * duration_us / 1000;
+    }
+
+    s_rtc.counters = s_stats.counters;
+    s_rtc.checksum = fnv1a32(&s_rtc.counters, sizeof(s_rtc.counters));
+    xSemaphoreGive(s_mutex);
+}
+
+void energy_fetch(energy_stats_t* stats_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    memcpy(stats_out, &s_stats, sizeof(s_stats));
+    xSemaphoreGive(s_mutex);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+#include "adc.h"
+#include "fans.h"
+
+typedef struct
+{
+    uint64_t vbus_uj;
+    uint64_t vfan_uj[FANS_COUNT];
+} energy_counters_t;
+
+typedef struct
+{
+    energy_counters_t counters;
+    uint32_t nvs_writes; // Since boot
+    int64_t persisted_us; // Time of the last NVS write, 0 if none
+} energy_stats_t;
+
+esp_err_t energy_init(void);
+
+// Add one ADC frame worth of energy, called from the ADC task
+void energy_accumulate(const adc_samples_t* samples, int64_t duration_us);
+
+void energy_fetch(energy_stats_t* stats_out);
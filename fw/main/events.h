@@ -9,6 +9,11 @@ enum {
     EVENT_OFFLINE, // Network was disconnected (interface went down)
     EVENT_STATUS_PING, // Emit our status via MQTT
     EVENT_ADC_SAMPLED, // ADC sample completed
+    EVENT_SENSOR_ATTACHED, // Temperature sensor was plugged in (data is the temperature_channel_t)
+    EVENT_SENSOR_DETACHED, // Temperature sensor was removed (data is the temperature_channel_t)
+    EVENT_SETTINGS_CHANGED, // Settings were updated (data is the uint32_t mask of changed settings_group_t)
+    EVENT_CALIBRATION_CHANGED, // ADC calibration was updated (data is the calibration_input_t)
+    EVENT_TASK_STUCK, // A watched task is to be restarted (data is the task_id_t)
 };
 
 esp_err_t events_init(void);
@@ -0,0 +1,232 @@
+#include "fan_health.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "adc.h"
+#include "periodic.h"
+#include "supervisor.h"
+#include "tacho.h"
+#include "util.h"
+
+#define TAG "fan_health"
+
+#define FAN_HEALTH_STALL_TIMEOUT_US (CONFIG_FAN_HEALTH_STALL_TIMEOUT_MS * 1000LL)
+#define FAN_HEALTH_STALL_TIMEOUT_MIN_US (100 * 1000LL)
+#define FAN_HEALTH_STALL_PERIODS 3 // Missed tacho periods before a running fan counts as stopped
+
+typedef struct
+{
+    fan_health_t health;
+    bool kicking;
+    bool kick_on; // Inside a pulse, otherwise in the gap after it
+    uint8_t kick_pulse;
+    int64_t kick_until_us;
+    int64_t kick_released_us; // End of the last pulse, only later edges show the fan turning by itself
+    int64_t retry_us;
+    fan_pwm8_t stall_duty; // Output when the fan last stalled, what it did not start at
+} fan_health_channel_t;
+
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static fan_health_channel_t s_channels[FANS_COUNT];
+
+static const char* const s_state_names[] = {
+    [FAN_HEALTH_OFF] = "off",
+    [FAN_HEALTH_SPINNING_UP] = "spinning_up",
+    [FAN_HEALTH_RUNNING] = "running",
+    [FAN_HEALTH_STALLED] = "stalled",
+    [FAN_HEALTH_BLOCKED] = "blocked",
+    [FAN_HEALTH_DISCONNECTED] = "disconnected",
+};
+
+const char* fan_health_state_name(fan_health_state_t state)
+{
+    return (state < ARRAY_SIZE(s_state_names)) ? s_state_names[state] : "unknown";
+}
+
+// Slow fans get a few of their own periods, fast ones are declared stopped after the minimum
+static bool fan_health_turning(const tacho_edge_t* edge, int64_t now)
+{
+    int64_t timeout_us = edge->period_us * FAN_HEALTH_STALL_PERIODS;
+    if (timeout_us < FAN_HEALTH_STALL_TIMEOUT_MIN_US) {
+        timeout_us = FAN_HEALTH_STALL_TIMEOUT_MIN_US;
+    } else if (timeout_us > FAN_HEALTH_STALL_TIMEOUT_US) {
+        timeout_us = FAN_HEALTH_STALL_TIMEOUT_US;
+    }
+
+    return edge->last_us != 0 && now - (int64_t)edge->last_us < timeout_us;
+}
+
+static bool fan_health_enter(uint8_t fan_i, fan_health_state_t state, int64_t now)
+{
+    fan_health_t* health = &s_channels[fan_i].health;
+    if (health->state == state) {
+        return false;
+    }
+
+    health->state = state;
+    health->since_us = now;
+
+    if (state == FAN_HEALTH_STALLED || state == FAN_HEALTH_BLOCKED || state == FAN_HEALTH_DISCONNECTED) {
+        health->fault = state;
+        health->fault_us = now;
+        health->stalls += (state == FAN_HEALTH_STALLED);
+        ESP_LOGW(TAG, "Fan %u %s", fan_i + 1, fan_health_state_name(state));
+        return true;
+    }
+    return false;
+}
+
+static void fan_health_kick_start(uint8_t fan_i, int64_t now)
+{
+    fan_health_channel_t* channel = &s_channels[fan_i];
+    channel->kicking = true;
+    channel->kick_on = false;
+    channel->kick_pulse = 0;
+    channel->kick_until_us = now;
+    channel->kick_released_us = now;
+}
+
+static void fan_health_kick_stop(uint8_t fan_i)
+{
+    fan_health_channel_t* channel = &s_channels[fan_i];
+    if (channel->kicking) {
+        channel->kicking = false;
+        fans_override_release(fan_i);
+    }
+}
+
+// Pulses at the kick duty, each followed by a gap at the commanded duty to look for tacho pulses
+static bool fan_health_kick_step(uint8_t fan_i, int64_t now)
+{
+    fan_health_channel_t* channel = &s_channels[fan_i];
+    if (now < channel->kick_until_us) {
+        return false;
+    }
+
+    if (channel->kick_on) {
+        fans_override_release(fan_i);
+        channel->kick_on = false;
+        channel->kick_released_us = now;
+        channel->kick_until_us = now + FAN_HEALTH_STALL_TIMEOUT_US;
+    } else if (channel->kick_pulse < CONFIG_FAN_HEALTH_KICK_PULSES) {
+        fans_override(fan_i, CONFIG_FAN_HEALTH_KICK_DUTY);
+        channel->kick_on = true;
+        channel->kick_pulse++;
+        channel->kick_until_us = now + CONFIG_FAN_HEALTH_KICK_PULSE_MS * 1000LL;
+        channel->health.kicks++;
+    } else {
+        channel->kicking = false;
+        channel->retry_us = now + CONFIG_FAN_HEALTH_RETRY_MS * 1000LL;
+        return fan_health_enter(fan_i, FAN_HEALTH_BLOCKED, now);
+    }
+    return false;
+}
+
+static bool fan_health_step(uint8_t fan_i, int64_t now, fan_pwm8_t duty, const tacho_edge_t* edge, uint16_t current_ma, bool tripped)
+{
+    fan_health_channel_t* channel = &s_channels[fan_i];
+    const bool turning = fan_health_turning(edge, now);
+    bool fault = false;
+
+    if (duty == 0 || tripped) {
+        fan_health_kick_stop(fan_i);
+        fan_health_enter(fan_i, FAN_HEALTH_OFF, now);
+        return false;
+    }
+
+    switch (channel->health.state) {
+    case FAN_HEALTH_OFF:
+        // Edges now may be the fan coasting from before the trip or the stop, it gets the full grace
+        fan_health_enter(fan_i, FAN_HEALTH_SPINNING_UP, now);
+        return false;
+    case FAN_HEALTH_SPINNING_UP:
+    case FAN_HEALTH_RUNNING:
+        if (channel->health.state == FAN_HEALTH_SPINNING_UP && now - channel->health.since_us < CONFIG_FAN_HEALTH_SPINUP_MS * 1000LL) {
+            return false;
+        }
+        if (turning) {
+            fan_health_enter(fan_i, FAN_HEALTH_RUNNING, now);
+            return false;
+        }
+        if (current_ma < CONFIG_FAN_HEALTH_OPEN_MA) {
+            return fan_health_enter(fan_i, FAN_HEALTH_DISCONNECTED, now);
+        }
+        fault = fan_health_enter(fan_i, FAN_HEALTH_STALLED, now);
+        channel->stall_duty = duty;
+        fan_health_kick_start(fan_i, now);
+        break;
+    case FAN_HEALTH_STALLED:
+    case FAN_HEALTH_BLOCKED:
+        // An edge during the kick itself may just be the kick, only trust the ones after it was released
+        if (turning && !channel->kick_on && (int64_t)edge->last_us > channel->kick_released_us) {
+            // Kicked back into turning, so the duty it stalled at was too low to keep it going
+            fan_health_kick_stop(fan_i);
+            fan_health_enter(fan_i, FAN_HEALTH_RUNNING, now);
+            fans_learn_min(fan_i, channel->stall_duty);
+            return false;
+        }
+        if (!channel->kicking && now >= channel->retry_us) {
+            fan_health_kick_start(fan_i, now);
+        }
+        break;
+    case FAN_HEALTH_DISCONNECTED:
+        if (turning || current_ma >= CONFIG_FAN_HEALTH_OPEN_MA) {
+            fan_health_enter(fan_i, FAN_HEALTH_SPINNING_UP, now);
+        }
+        return false;
+    }
+
+    if (channel->kicking) {
+        fault |= fan_health_kick_step(fan_i, now);
+    }
+    return fault;
+}
+
+void fan_health_evaluate(void)
+{
+    fans_output_t output;
+    tacho_edges_t edges;
+    adc_samples_t samples;
+    supervisor_state_t supervisor;
+
+    fans_fetch_output(output);
+    tacho_fetch_edges(edges);
+    adc_fetch(&samples);
+    supervisor_fetch(&supervisor);
+
+    bool fault = false;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        const bool tripped = supervisor.bus.tripped || supervisor.fans[i].tripped;
+        fault |= fan_health_step(i, now, output[i].pwm8, &edges[i], samples.vfan_ma[i].rms, tripped);
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (fault) {
+        periodic_activity();
+    }
+}
+
+esp_err_t fan_health_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    return ESP_OK;
+}
+
+void fan_health_fetch(fans_health_t health_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        health_out[i] = s_channels[i].health;
+    }
+    xSemaphoreGive(s_mutex);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+#include "fans.h"
+
+typedef enum {
+    FAN_HEALTH_OFF, // Not driven, or switched off by the supervisor
+    FAN_HEALTH_SPINNING_UP,
+    FAN_HEALTH_RUNNING,
+    FAN_HEALTH_STALLED, // Driven with current flowing but not turning, being kick-started
+    FAN_HEALTH_BLOCKED, // Still not turning after a full kick-start sequence
+    FAN_HEALTH_DISCONNECTED, // Driven but neither current nor tacho pulses
+} fan_health_state_t;
+
+typedef struct
+{
+    fan_health_state_t state;
+    int64_t since_us;
+    fan_health_state_t fault; // Last fault state, FAN_HEALTH_OFF if there was none
+    int64_t fault_us;
+    uint32_t stalls; // Since boot
+    uint32_t kicks; // Kick-start pulses since boot
+} fan_health_t;
+
+typedef fan_health_t fans_health_t[FANS_COUNT];
+
+esp_err_t fan_health_init(void);
+// Called by the control task every CONFIG_FAN_HEALTH_INTERVAL_MS
+void fan_health_evaluate(void);
+
+void fan_health_fetch(fans_health_t health_out);
+
+const char* fan_health_state_name(fan_health_state_t state);
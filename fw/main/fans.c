@@ -1,11 +1,23 @@
 #include "fans.h"
 
 #include <driver/ledc.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <nvs.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <sdkconfig.h>
+
+#include "events.h"
+#include "latency.h"
 #include "led.h"
+#include "periodic.h"
+#include "settings.h"
 #include "util.h"
 
 #define TAG "fans"
@@ -13,7 +25,6 @@
 #define LEDC_TIMER LEDC_TIMER_0
 #define LEDC_MODE LEDC_LOW_SPEED_MODE
 #define LEDC_DUTY_RES LEDC_TIMER_8_BIT
-#define LEDC_FREQUENCY (24000)
 
 #define LEDC_FAN1_CHANNEL (LEDC_CHANNEL_0)
 #define LEDC_FAN2_CHANNEL (LEDC_CHANNEL_1)
@@ -28,8 +39,65 @@
 #define GPIO_FAN5_PWM (38)
 #define GPIO_12V_EN (21)
 
+#define FANS_PWM8_MAX 0xff
+#define FANS_MPWM_PER_PWM8 1000 // The output is kept finer than the PWM, so slow slews still move
+#define FANS_LEARN_MAX_PWM8 0x80 // A stall above this is a fault rather than too little duty
+
+#define FANS_NVS_NAMESPACE "fans"
+#define FANS_NVS_KEY "resume"
+#define FANS_RTC_MAGIC 0x46414e53 // "FANS"
+#define FANS_RESUME_PERSIST_US (CONFIG_FANS_RESUME_PERSIST_S * 1000000LL)
+
+typedef struct
+{
+    int32_t output_mpwm;
+    fan_pwm8_t goal; // Commanded duty the output heads for, only moved by changes beyond the deadband
+    bool moving;
+    int64_t settled_us; // When the output last reached its goal, for the dwell
+    fan_pwm8_t learned_min;
+    int16_t written; // Last duty written to the channel, -1 before the first
+} fans_channel_t;
+
+// The output part of settings_t
+typedef struct
+{
+    uint16_t slew_pwm8_per_s[FANS_COUNT];
+    uint16_t dwell_ms[FANS_COUNT];
+    uint8_t deadband_pwm8[FANS_COUNT];
+    uint8_t min_pwm8[FANS_COUNT];
+} fans_output_settings_t;
+
+// Survives software resets, panics and watchdogs. NVS covers power loss, with the duties held for a while.
+typedef struct
+{
+    uint32_t magic;
+    fans_pwm8_t duty;
+    uint32_t checksum;
+} fans_rtc_t;
+
+static const ledc_channel_t s_ledc_channels[FANS_COUNT] = {
+    LEDC_FAN1_CHANNEL, LEDC_FAN2_CHANNEL, LEDC_FAN3_CHANNEL, LEDC_FAN4_CHANNEL, LEDC_FAN5_CHANNEL
+};
+
 static fans_pwm8_t s_state;
+static fans_channel_t s_channels[FANS_COUNT];
+static fans_output_settings_t s_settings;
+static int64_t s_step_us;
+static int s_any_running = -1;
 static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static uint8_t s_tripped_mask;
+static uint8_t s_override_mask;
+static fans_pwm8_t s_override;
+static volatile bool s_bus_tripped;
+static portMUX_TYPE s_bus_lock = portMUX_INITIALIZER_UNLOCKED; // The 12V enable is also cut from the monitor ISR
+static fans_resume_source_t s_resume_source;
+#if CONFIG_FANS_RESUME
+static RTC_NOINIT_ATTR fans_rtc_t s_rtc;
+static fans_pwm8_t s_resume; // Commanded duties of the channels that are not tripped
+static int64_t s_resume_changed_us;
+static fans_pwm8_t s_resume_stored; // As in NVS
+#endif
 
 static esp_err_t channel_config(ledc_channel_t channel, int gpio_num)
 {
@@ -45,28 +113,51 @@ static esp_err_t channel_config(ledc_channel_t channel, int gpio_num)
     return ledc_channel_config(&config);
 }
 
-static bool fans_persist_channel_unsafe(ledc_channel_t channel, fan_pwm8_t duty)
+// Only touches the channel when its duty changed, the control loop calls this on every output step
+static bool fans_persist_channel_unsafe(uint8_t fan_i, fan_pwm8_t duty)
 {
-    if (duty == 0x00) {
-        ESP_ERROR_CHECK(ledc_stop(LEDC_MODE, channel, 1)); // Inverted
-    } else {
-        ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, channel, 0xff - duty)); // Inverted
-        ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, channel));
+    fans_channel_t* channel = &s_channels[fan_i];
+    if (channel->written != duty) {
+        channel->written = duty;
+        if (duty == 0x00) {
+            ESP_ERROR_CHECK(ledc_stop(LEDC_MODE, s_ledc_channels[fan_i], 1)); // Inverted
+        } else {
+            ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, s_ledc_channels[fan_i], 0xff - duty)); // Inverted
+            ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, s_ledc_channels[fan_i]));
+        }
+        latency_command_applied(fan_i, true);
     }
     return duty > 0;
 }
 
+static fan_pwm8_t fans_mpwm_to_pwm8(int32_t mpwm)
+{
+    return (mpwm + FANS_MPWM_PER_PWM8 / 2) / FANS_MPWM_PER_PWM8;
+}
+
+static fan_pwm8_t fans_output_unsafe(uint8_t fan_i)
+{
+    if (s_tripped_mask & (1 << fan_i)) {
+        return 0x00;
+    }
+    return (s_override_mask & (1 << fan_i)) ? s_override[fan_i] : fans_mpwm_to_pwm8(s_channels[fan_i].output_mpwm);
+}
+
 static void fans_persist_unsafe(void)
 {
     bool any = false;
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        any |= fans_persist_channel_unsafe(i, fans_output_unsafe(i));
+    }
 
-    any |= fans_persist_channel_unsafe(LEDC_FAN1_CHANNEL, s_state[0]);
-    any |= fans_persist_channel_unsafe(LEDC_FAN2_CHANNEL, s_state[1]);
-    any |= fans_persist_channel_unsafe(LEDC_FAN3_CHANNEL, s_state[2]);
-    any |= fans_persist_channel_unsafe(LEDC_FAN4_CHANNEL, s_state[3]);
-    any |= fans_persist_channel_unsafe(LEDC_FAN5_CHANNEL, s_state[4]);
-
-    gpio_set_level(GPIO_12V_EN, any);
+    // A cutoff from the ISR between the read and the write would otherwise be undone
+    portENTER_CRITICAL_SAFE(&s_bus_lock);
+    gpio_set_level(GPIO_12V_EN, any && !s_bus_tripped);
+    portEXIT_CRITICAL_SAFE(&s_bus_lock);
+    if (any == s_any_running) {
+        return;
+    }
+    s_any_running = any;
 
     // TODO Temporary emotes until controller is written
     if (any) {
@@ -84,9 +175,214 @@ static void fans_persist_unsafe(void)
     }
 }
 
+static void fans_settings_apply_unsafe(const settings_t* settings)
+{
+    memcpy(s_settings.slew_pwm8_per_s, settings->output_slew_pwm8_per_s, sizeof(s_settings.slew_pwm8_per_s));
+    memcpy(s_settings.dwell_ms, settings->output_dwell_ms, sizeof(s_settings.dwell_ms));
+    memcpy(s_settings.deadband_pwm8, settings->output_deadband_pwm8, sizeof(s_settings.deadband_pwm8));
+    memcpy(s_settings.min_pwm8, settings->output_min_pwm8, sizeof(s_settings.min_pwm8));
+}
+
+static fan_pwm8_t fans_min_unsafe(uint8_t fan_i)
+{
+    return (s_settings.min_pwm8[fan_i] != 0) ? s_settings.min_pwm8[fan_i] : s_channels[fan_i].learned_min;
+}
+
+// One control tick of a channel, returns whether its duty changed
+static bool fans_condition_unsafe(uint8_t fan_i, int64_t now, int64_t dt_us)
+{
+    fans_channel_t* channel = &s_channels[fan_i];
+    const fan_pwm8_t min = fans_min_unsafe(fan_i);
+    const fan_pwm8_t before = fans_mpwm_to_pwm8(channel->output_mpwm);
+
+    // Hysteresis against a controller dithering by a step or two, switching on and off and full
+    // speed always go through
+    fan_pwm8_t target = s_state[fan_i];
+    if (target != 0 && target < min) {
+        target = min;
+    }
+    if (abs(target - channel->goal) > s_settings.deadband_pwm8[fan_i] || target == 0 || target == FANS_PWM8_MAX
+        || channel->goal == 0) {
+        channel->goal = target;
+    }
+
+    const int32_t goal_mpwm = channel->goal * FANS_MPWM_PER_PWM8;
+    if (channel->output_mpwm == goal_mpwm) {
+        if (channel->moving) {
+            channel->moving = false;
+            channel->settled_us = now;
+        }
+        return false;
+    }
+    if (!channel->moving) {
+        // Full speed is what a hot system asks for, it does not wait out the dwell
+        if (channel->goal != FANS_PWM8_MAX && now - channel->settled_us < s_settings.dwell_ms[fan_i] * 1000LL) {
+            return false;
+        }
+        channel->moving = true;
+    }
+
+    // Starting and stopping skip the range below the minimum where the fan would not turn
+    int32_t output = channel->output_mpwm;
+    const int32_t min_mpwm = min * FANS_MPWM_PER_PWM8;
+    const uint16_t slew = s_settings.slew_pwm8_per_s[fan_i];
+    if (output == 0 && min_mpwm > 0) {
+        output = (goal_mpwm < min_mpwm) ? goal_mpwm : min_mpwm;
+    } else if (slew == 0) {
+        output = goal_mpwm;
+    } else {
+        const int32_t step = slew * dt_us / (1000000 / FANS_MPWM_PER_PWM8);
+        if (output < goal_mpwm) {
+            output = (goal_mpwm - output > step) ? output + step : goal_mpwm;
+        } else {
+            output = (output - goal_mpwm > step) ? output - step : goal_mpwm;
+        }
+        if (goal_mpwm == 0 && output < min_mpwm) {
+            output = 0;
+        }
+    }
+    channel->output_mpwm = output;
+
+    return fans_mpwm_to_pwm8(output) != before;
+}
+
+#if CONFIG_FANS_RESUME
+static bool fans_load_rtc(fans_pwm8_t duty)
+{
+    if (esp_reset_reason() == ESP_RST_POWERON || s_rtc.magic != FANS_RTC_MAGIC
+        || s_rtc.checksum != fnv1a32(s_rtc.duty, sizeof(s_rtc.duty))) {
+        return false;
+    }
+
+    memcpy(duty, s_rtc.duty, sizeof(fans_pwm8_t));
+    return true;
+}
+
+static bool fans_load_nvs(fans_pwm8_t duty)
+{
+    nvs_handle_t handle;
+    if (nvs_open(FANS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t length = sizeof(fans_pwm8_t);
+    esp_err_t ret = nvs_get_blob(handle, FANS_NVS_KEY, duty, &length);
+    nvs_close(handle);
+
+    return ret == ESP_OK && length == sizeof(fans_pwm8_t);
+}
+
+static esp_err_t fans_store_nvs(const fans_pwm8_t duty)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+
+    ERROR_CHECK_SIMPLE(nvs_open(FANS_NVS_NAMESPACE, NVS_READWRITE, &handle));
+    ret = nvs_set_blob(handle, FANS_NVS_KEY, duty, sizeof(fans_pwm8_t));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    ERROR_CHECK_SIMPLE(ret);
+
+    return ESP_OK;
+err:
+    return ret;
+}
+
+// Called on every output step, the RTC copy follows within one control interval
+static void fans_resume_update_unsafe(int64_t now_us)
+{
+    fans_pwm8_t resume;
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        resume[i] = (s_bus_tripped || (s_tripped_mask & (1 << i))) ? 0 : s_state[i];
+    }
+    if (memcmp(resume, s_resume, sizeof(resume)) == 0) {
+        return;
+    }
+
+    memcpy(s_resume, resume, sizeof(s_resume));
+    s_resume_changed_us = now_us;
+    memcpy(s_rtc.duty, resume, sizeof(s_rtc.duty));
+    s_rtc.checksum = fnv1a32(s_rtc.duty, sizeof(s_rtc.duty));
+    s_rtc.magic = FANS_RTC_MAGIC;
+}
+
+// Drives the fans at the duties from before the reset right away, rather than waiting for a controller
+static void fans_resume_unsafe(void)
+{
+    fans_pwm8_t duty = { 0 };
+    if (fans_load_nvs(s_resume_stored)) {
+        memcpy(duty, s_resume_stored, sizeof(duty));
+        s_resume_source = FANS_RESUME_NVS;
+    }
+    if (fans_load_rtc(duty)) {
+        s_resume_source = FANS_RESUME_RTC;
+    }
+
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        s_state[i] = duty[i];
+        s_channels[i].goal = duty[i];
+        s_channels[i].output_mpwm = duty[i] * FANS_MPWM_PER_PWM8;
+    }
+    fans_resume_update_unsafe(esp_timer_get_time());
+
+    if (s_resume_source != FANS_RESUME_NONE) {
+        ESP_LOGI(TAG, "Resumed from %s at %u %u %u %u %u", (s_resume_source == FANS_RESUME_RTC) ? "RTC memory" : "NVS",
+            duty[0], duty[1], duty[2], duty[3], duty[4]);
+    }
+}
+
+// Writes from the event loop once the duties have been held, flash writes stall the caller for a while
+static void fans_adc_sampled_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    const int64_t now = esp_timer_get_time();
+    fans_pwm8_t resume;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const bool due = memcmp(s_resume, s_resume_stored, sizeof(s_resume)) != 0 && now - s_resume_changed_us >= FANS_RESUME_PERSIST_US;
+    memcpy(resume, s_resume, sizeof(resume));
+    xSemaphoreGive(s_mutex);
+
+    if (!due || fans_store_nvs(resume) != ESP_OK) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    memcpy(s_resume_stored, resume, sizeof(s_resume_stored));
+    xSemaphoreGive(s_mutex);
+}
+#endif
+
+static void fans_settings_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    const uint32_t groups = *(const uint32_t*)event_data;
+    if (!(groups & (SETTINGS_PWM | SETTINGS_OUTPUT))) {
+        return;
+    }
+
+    settings_t settings;
+    settings_fetch(&settings);
+    if (groups & SETTINGS_PWM) {
+        ESP_ERROR_CHECK(ledc_set_freq(LEDC_MODE, LEDC_TIMER, settings.pwm_frequency_hz));
+    }
+    if (groups & SETTINGS_OUTPUT) {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        fans_settings_apply_unsafe(&settings);
+        xSemaphoreGive(s_mutex);
+    }
+}
+
 esp_err_t fans_init(void)
 {
-    s_mutex = xSemaphoreCreateMutex();
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    settings_t settings;
+    settings_fetch(&settings);
+    fans_settings_apply_unsafe(&settings);
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        s_channels[i].written = -1;
+    }
 
     gpio_config_t io_conf = {
         .intr_type = GPIO_INTR_DISABLE,
@@ -101,8 +397,8 @@ esp_err_t fans_init(void)
         .speed_mode = LEDC_MODE,
         .timer_num = LEDC_TIMER,
         .duty_resolution = LEDC_DUTY_RES,
-        .freq_hz = LEDC_FREQUENCY,
-        .clk_cfg = LEDC_AUTO_CLK
+        .freq_hz = settings.pwm_frequency_hz,
+        .clk_cfg = LEDC_USE_XTAL_CLK // APB is scaled down by DFS, which would shift the PWM frequency
     };
     ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
 
@@ -112,22 +408,37 @@ esp_err_t fans_init(void)
     ESP_ERROR_CHECK(channel_config(LEDC_FAN4_CHANNEL, GPIO_FAN4_PWM));
     ESP_ERROR_CHECK(channel_config(LEDC_FAN5_CHANNEL, GPIO_FAN5_PWM));
 
+#if CONFIG_FANS_RESUME
+    fans_resume_unsafe();
+#endif
     fans_persist_unsafe();
 
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_SETTINGS_CHANGED, fans_settings_handler, NULL));
+#if CONFIG_FANS_RESUME
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ADC_SAMPLED, fans_adc_sampled_handler, NULL));
+#endif
+
     return ESP_OK;
 }
 
 esp_err_t fans_command(uint8_t fan_i, fan_pwm8_t duty)
 {
-    if (fan_i > ARRAY_SIZE(s_state)) {
+    if (fan_i >= ARRAY_SIZE(s_state)) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    // Producers never wait for the PWM, the control loop applies the duty
     xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool duty_changed = (s_state[fan_i] != duty);
     s_state[fan_i] = duty;
-    fans_persist_unsafe();
     xSemaphoreGive(s_mutex);
 
+    if (duty_changed) {
+        periodic_activity(); // The fan is about to ramp
+    } else {
+        latency_command_applied(fan_i, false); // Nothing for the output to write
+    }
+
     return ESP_OK;
 }
 
@@ -139,3 +450,127 @@ esp_err_t fans_fetch(fans_pwm8_t duty_out)
 
     return ESP_OK;
 }
+
+esp_err_t fans_fetch_output(fans_output_t output_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        output_out[i] = (fan_output_t) {
+            .pwm8 = fans_mpwm_to_pwm8(s_channels[i].output_mpwm),
+            .min_pwm8 = fans_min_unsafe(i),
+        };
+    }
+    xSemaphoreGive(s_mutex);
+
+    return ESP_OK;
+}
+
+bool fans_output_step(int64_t now_us)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t dt_us = (s_step_us != 0) ? now_us - s_step_us : 0;
+    s_step_us = now_us;
+
+    bool changed = false;
+    bool unsettled = false;
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        changed |= fans_condition_unsafe(i, now_us, dt_us);
+        unsettled |= s_channels[i].output_mpwm != s_channels[i].goal * FANS_MPWM_PER_PWM8;
+    }
+    if (changed) {
+        fans_persist_unsafe();
+    }
+#if CONFIG_FANS_RESUME
+    fans_resume_update_unsafe(now_us);
+#endif
+    xSemaphoreGive(s_mutex);
+
+    return unsettled;
+}
+
+fans_resume_source_t fans_fetch_resume_source(void)
+{
+    return s_resume_source;
+}
+
+void fans_learn_min(uint8_t fan_i, fan_pwm8_t stalled_pwm8)
+{
+    if (fan_i >= FANS_COUNT || stalled_pwm8 == 0 || stalled_pwm8 >= FANS_LEARN_MAX_PWM8) {
+        return;
+    }
+
+    const unsigned int learned = stalled_pwm8 + CONFIG_FANS_OUTPUT_LEARN_MARGIN_PWM8;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    fans_channel_t* channel = &s_channels[fan_i];
+    if (learned > channel->learned_min) {
+        channel->learned_min = (learned < FANS_LEARN_MAX_PWM8) ? learned : FANS_LEARN_MAX_PWM8;
+        ESP_LOGI(TAG, "Fan %u needs at least %u", fan_i + 1, channel->learned_min);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t fans_trip(uint8_t fan_i)
+{
+    if (fan_i >= ARRAY_SIZE(s_state)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_tripped_mask |= (1 << fan_i);
+    fans_persist_unsafe();
+    xSemaphoreGive(s_mutex);
+
+    return ESP_OK;
+}
+
+void IRAM_ATTR fans_bus_cutoff(void)
+{
+    // Needs CONFIG_GPIO_CTRL_FUNC_IN_IRAM when called from an ISR
+    portENTER_CRITICAL_SAFE(&s_bus_lock);
+    s_bus_tripped = true;
+    gpio_set_level(GPIO_12V_EN, 0);
+    portEXIT_CRITICAL_SAFE(&s_bus_lock);
+}
+
+void fans_trip_clear(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_tripped_mask = 0;
+    portENTER_CRITICAL_SAFE(&s_bus_lock);
+    s_bus_tripped = false;
+    portEXIT_CRITICAL_SAFE(&s_bus_lock);
+    fans_persist_unsafe();
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t fans_override(uint8_t fan_i, fan_pwm8_t duty)
+{
+    if (fan_i >= ARRAY_SIZE(s_state)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_override_mask |= (1 << fan_i);
+    s_override[fan_i] = duty;
+    fans_persist_unsafe();
+    xSemaphoreGive(s_mutex);
+
+    periodic_activity(); // The kick is timed by the control loop
+    return ESP_OK;
+}
+
+esp_err_t fans_override_release(uint8_t fan_i)
+{
+    if (fan_i >= ARRAY_SIZE(s_state)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_override_mask & (1 << fan_i)) {
+        s_override_mask &= ~(1 << fan_i);
+        fans_persist_unsafe();
+    }
+    xSemaphoreGive(s_mutex);
+
+    return ESP_OK;
+}
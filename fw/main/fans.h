@@ -1,13 +1,49 @@
 #pragma once
 
 #include <esp_err.h>
+#include <stdint.h>
 
 typedef uint8_t fan_pwm8_t;
 typedef fan_pwm8_t fans_pwm8_t[5];
 
 #define FANS_COUNT (sizeof(fans_pwm8_t) / sizeof(fan_pwm8_t))
 
+typedef struct
+{
+    fan_pwm8_t pwm8; // After the output conditioning, before trips and overrides
+    fan_pwm8_t min_pwm8; // Configured, else learned from stalls, 0 while unknown
+} fan_output_t;
+
+typedef fan_output_t fans_output_t[FANS_COUNT];
+
+// Where the duties driven right after boot came from
+typedef enum {
+    FANS_RESUME_NONE, // All off until the first command
+    FANS_RESUME_RTC, // Software reset, panic or watchdog
+    FANS_RESUME_NVS, // Power loss, the last duties held for CONFIG_FANS_RESUME_PERSIST_S
+} fans_resume_source_t;
+
 esp_err_t fans_init(void);
 
+// Only sets the target, the output follows it at the next fans_output_step
 esp_err_t fans_command(uint8_t fan_i, const fan_pwm8_t duty);
+// Commanded duties
 esp_err_t fans_fetch(fans_pwm8_t duty_out);
+esp_err_t fans_fetch_output(fans_output_t output_out);
+fans_resume_source_t fans_fetch_resume_source(void);
+
+// Moves the outputs towards the commanded duties within the slew, dwell and deadband settings,
+// called from the control loop. Returns whether an output has yet to reach its goal.
+bool fans_output_step(int64_t now_us);
+// The fan stalled at this output and came back after a kick-start, so it needs more than that
+void fans_learn_min(uint8_t fan_i, fan_pwm8_t stalled_pwm8);
+
+// Hold a channel off regardless of the commanded duty until fans_trip_clear
+esp_err_t fans_trip(uint8_t fan_i);
+// Cut the 12V supply to all fans, safe to call from an ISR
+void fans_bus_cutoff(void);
+void fans_trip_clear(void);
+
+// Drive a channel at another duty than commanded, e.g. to kick-start a stalled fan
+esp_err_t fans_override(uint8_t fan_i, fan_pwm8_t duty);
+esp_err_t fans_override_release(uint8_t fan_i);
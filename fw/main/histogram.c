@@ -0,0 +1,58 @@
+#include "histogram.h"
+
+static uint32_t histogram_bucket_upper_bound(size_t bucket, uint32_t max)
+{
+    uint32_t bound = (bucket >= 32) ? UINT32_MAX : ((1UL << bucket) - 1);
+    return (bound < max) ? bound : max;
+}
+
+void histogram_merge(histogram_t* dst, const histogram_t* src)
+{
+    if (src->count == 0) {
+        return;
+    }
+
+    if (dst->count == 0 || src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    dst->count += src->count;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+bool histogram_stats(const histogram_t* histogram, histogram_stats_t* stats_out)
+{
+    if (histogram->count == 0) {
+        return false;
+    }
+
+    *stats_out = (histogram_stats_t) {
+        .count = histogram->count,
+        .min = histogram->min,
+        .p50 = histogram->max,
+        .p99 = histogram->max,
+        .max = histogram->max,
+    };
+
+    const uint64_t p50_rank = ((uint64_t)histogram->count * 50 + 99) / 100;
+    const uint64_t p99_rank = ((uint64_t)histogram->count * 99 + 99) / 100;
+    uint64_t seen = 0;
+    bool p50_found = false;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (!p50_found && seen >= p50_rank) {
+            stats_out->p50 = histogram_bucket_upper_bound(i, histogram->max);
+            p50_found = true;
+        }
+        if (seen >= p99_rank) {
+            stats_out->p99 = histogram_bucket_upper_bound(i, histogram->max);
+            break;
+        }
+    }
+
+    return true;
+}
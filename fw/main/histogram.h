@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 33 // Bucket i holds values in [2^(i-1), 2^i)
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t max;
+} histogram_stats_t;
+
+static inline void histogram_record(histogram_t* histogram, uint32_t value)
+{
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->buckets[(value == 0) ? 0 : (32 - __builtin_clz(value))]++;
+    histogram->count++;
+}
+
+void histogram_merge(histogram_t* dst, const histogram_t* src);
+
+// Percentiles are reported as the upper bound of the bucket they fall in, returns false when empty
+bool histogram_stats(const histogram_t* histogram, histogram_stats_t* stats_out);
@@ -1,35 +1,276 @@
 #include "http_server.h"
 
-#include <cJSON.h>
 #include <esp_chip_info.h>
 #include <esp_http_server.h>
 #include <esp_log.h>
 #include <esp_random.h>
+#include <esp_timer.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "data.h"
+#include "ota.h"
+#include "power.h"
+#include "tasks.h"
+#include "trace.h"
 #include "util.h"
 
 #define TAG "http_server"
 
+#define MAX_COMMAND_SIZE (256)
+#define MAX_ACCEPT_SIZE (128)
+#define CBOR_CONTENT_TYPE "application/cbor"
+#define OTA_SHA256_HEADER "X-Image-SHA256"
+#define OTA_RECV_TIMEOUTS_MAX 3
+
+// Responses and upload chunks, the server handles one request at a time
+static char s_buffer[CONFIG_STATUS_BUFFER_SIZE];
+
+// A browser sends a long Accept list, the start of it is enough to look for CBOR
+static bool status_accepts_cbor(httpd_req_t* req)
+{
+    char accept[MAX_ACCEPT_SIZE];
+    const esp_err_t ret = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    return (ret == ESP_OK || ret == ESP_ERR_HTTPD_RESULT_TRUNC) && strstr(accept, CBOR_CONTENT_TYPE) != NULL;
+}
+
 /* Simple handler for getting system handler */
 static esp_err_t status_get_handler(httpd_req_t* req)
 {
+    TRACE_SPAN_BEGIN(HTTP_STATUS);
+    power_busy_begin();
+    esp_err_t ret;
+    if (status_accepts_cbor(req)) {
+        size_t len;
+        ret = data_print_cbor(data_status_to_cbor, (uint8_t*)s_buffer, sizeof(s_buffer), &len);
+        if (ret == ESP_OK) {
+            httpd_resp_set_type(req, CBOR_CONTENT_TYPE);
+            httpd_resp_send(req, s_buffer, len);
+        }
+    } else {
+        ret = data_print(data_status_to_json, s_buffer, sizeof(s_buffer));
+        if (ret == ESP_OK) {
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_sendstr(req, s_buffer);
+        }
+    }
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Status does not fit");
+    }
+    power_busy_end();
+    TRACE_SPAN_END(HTTP_STATUS);
+    return ret;
+}
+
+static esp_err_t duty_post_handler(httpd_req_t* req)
+{
+    const int64_t received_us = esp_timer_get_time();
+    char buf[MAX_COMMAND_SIZE];
+
+    if (req->content_len >= sizeof(buf)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Command too long");
+        return ESP_FAIL;
+    }
+
+    size_t len = 0;
+    while (len < req->content_len) {
+        int ret = httpd_req_recv(req, buf + len, req->content_len - len);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        len += ret;
+    }
+
+    if (data_process_duty_json_str(buf, len, received_us) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid command");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_sendstr(req, "");
+    return ESP_OK;
+}
+
+static esp_err_t settings_get_handler(httpd_req_t* req)
+{
+    esp_err_t ret = data_print(data_settings_to_json, s_buffer, sizeof(s_buffer));
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Settings do not fit");
+        return ret;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, s_buffer);
+    return ESP_OK;
+}
+
+static esp_err_t settings_post_handler(httpd_req_t* req)
+{
+    if (req->content_len >= sizeof(s_buffer)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Settings too long");
+        return ESP_FAIL;
+    }
+
+    size_t len = 0;
+    while (len < req->content_len) {
+        int ret = httpd_req_recv(req, s_buffer + len, req->content_len - len);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        len += ret;
+    }
+
+    esp_err_t ret = data_process_settings_json_str(s_buffer, len);
+    if (ret == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid settings");
+        return ESP_FAIL;
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Settings not stored");
+        return ESP_FAIL;
+    }
+
+    return settings_get_handler(req);
+}
+
+static esp_err_t calibration_get_handler(httpd_req_t* req)
+{
+    esp_err_t ret = data_print(data_calibration_to_json, s_buffer, sizeof(s_buffer));
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Calibration does not fit");
+        return ret;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, s_buffer);
+    return ESP_OK;
+}
+
+static esp_err_t calibration_post_handler(httpd_req_t* req)
+{
+    if (req->content_len >= sizeof(s_buffer)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Calibration too long");
+        return ESP_FAIL;
+    }
+
+    size_t len = 0;
+    while (len < req->content_len) {
+        int ret = httpd_req_recv(req, s_buffer + len, req->content_len - len);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        len += ret;
+    }
+
+    esp_err_t ret = data_process_calibration_json_str(s_buffer, len);
+    if (ret == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid calibration point");
+        return ESP_FAIL;
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Calibration not stored");
+        return ESP_FAIL;
+    }
+
+    return calibration_get_handler(req);
+}
+
+static bool hex_to_bytes(const char* hex, uint8_t* out, size_t len)
+{
+    if (strlen(hex) != len * 2) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        unsigned int byte;
+        if (sscanf(&hex[i * 2], "%2x", &byte) != 1) {
+            return false;
+        }
+        out[i] = byte;
+    }
+    return true;
+}
+
+// Streams the request body into the inactive OTA partition, chunk by chunk through s_buffer
+static esp_err_t ota_post_handler(httpd_req_t* req)
+{
+    char hex[OTA_SHA256_LEN * 2 + 1];
+    uint8_t sha256[OTA_SHA256_LEN];
+
+    if (httpd_req_get_hdr_value_str(req, OTA_SHA256_HEADER, hex, sizeof(hex)) != ESP_OK || !hex_to_bytes(hex, sha256, sizeof(sha256))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid " OTA_SHA256_HEADER);
+        return ESP_FAIL;
+    }
+    if (req->content_len == 0) {
+        httpd_resp_send_err(req, HTTPD_411_LENGTH_REQUIRED, "Image size required");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ota_begin(req->content_len);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "Update in progress or running image not yet confirmed");
+        return ESP_FAIL;
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(ret));
+        return ESP_FAIL;
+    }
+
+    size_t remaining = req->content_len;
+    unsigned int timeouts = 0;
+    while (remaining > 0) {
+        int received = httpd_req_recv(req, s_buffer, (remaining < sizeof(s_buffer)) ? remaining : sizeof(s_buffer));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < OTA_RECV_TIMEOUTS_MAX) {
+            continue;
+        }
+        if (received <= 0) {
+            ota_abort(ESP_ERR_TIMEOUT);
+            return ESP_FAIL;
+        }
+
+        if (ota_write(s_buffer, received) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid image");
+            return ESP_FAIL;
+        }
+        remaining -= received;
+        timeouts = 0;
+    }
+
+    if (ota_end(sha256) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image verification failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_sendstr(req, "");
+    return ESP_OK;
+}
+
+#if CONFIG_TRACE_SPANS
+static esp_err_t trace_get_handler(httpd_req_t* req)
+{
+    esp_err_t ret = data_print(data_trace_to_json, s_buffer, sizeof(s_buffer));
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Trace does not fit");
+        return ret;
+    }
     httpd_resp_set_type(req, "application/json");
-    cJSON* root = cJSON_CreateObject();
-    ESP_ERROR_CHECK(data_status_to_json(root));
-    const char* resp = cJSON_PrintUnformatted(root);
-    httpd_resp_sendstr(req, resp);
-    free((void*)resp);
-    cJSON_Delete(root);
+    httpd_resp_sendstr(req, s_buffer);
     return ESP_OK;
 }
+#endif
 
 esp_err_t http_server_init(void)
 {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.task_priority = tasks_config(TASK_HTTPD)->priority;
+    config.stack_size = tasks_config(TASK_HTTPD)->stack_size;
+    config.core_id = tasks_config(TASK_HTTPD)->core_id;
 
     ESP_LOGI(TAG, "Starting HTTP Server");
     ERROR_CHECK(httpd_start(&server, &config) == ESP_OK, "Start server failed", err);
@@ -42,6 +283,64 @@ esp_err_t http_server_init(void)
     };
     httpd_register_uri_handler(server, &system_info_get_uri);
 
+    httpd_uri_t duty_post_uri = {
+        .uri = "/api/v1/duty",
+        .method = HTTP_POST,
+        .handler = duty_post_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &duty_post_uri);
+
+    httpd_uri_t settings_get_uri = {
+        .uri = "/api/v1/settings",
+        .method = HTTP_GET,
+        .handler = settings_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &settings_get_uri);
+
+    httpd_uri_t settings_post_uri = {
+        .uri = "/api/v1/settings",
+        .method = HTTP_POST,
+        .handler = settings_post_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &settings_post_uri);
+
+    httpd_uri_t calibration_get_uri = {
+        .uri = "/api/v1/calibration",
+        .method = HTTP_GET,
+        .handler = calibration_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &calibration_get_uri);
+
+    httpd_uri_t calibration_post_uri = {
+        .uri = "/api/v1/calibration",
+        .method = HTTP_POST,
+        .handler = calibration_post_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &calibration_post_uri);
+
+    httpd_uri_t ota_post_uri = {
+        .uri = "/api/v1/ota",
+        .method = HTTP_POST,
+        .handler = ota_post_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &ota_post_uri);
+
+#if CONFIG_TRACE_SPANS
+    httpd_uri_t trace_get_uri = {
+        .uri = "/api/v1/trace",
+        .method = HTTP_GET,
+        .handler = trace_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &trace_get_uri);
+#endif
+
     return ESP_OK;
 err:
     return ESP_FAIL;
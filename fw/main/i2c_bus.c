@@ -2,11 +2,17 @@
 
 #define TAG "i2c_bus"
 
-#include <driver/i2c.h>
+#include <driver/gpio.h>
+#include <driver/i2c_master.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#include "tasks.h"
+#include "util.h"
 
 #define I2C_BUS_PRIMARY_SCL_IO (37)
 #define I2C_BUS_PRIMARY_SDA_IO (36)
@@ -15,50 +21,242 @@
 #define I2C_BUS_EXTERNAL_SDA_IO (41)
 
 #define I2C_MASTER_FREQ_HZ 400000
-#define I2C_MASTER_TX_BUF_DISABLE 0
-#define I2C_MASTER_RX_BUF_DISABLE 0
+#define I2C_MASTER_TIMEOUT_MS 50
+#define I2C_MASTER_GLITCH_IGNORE_CNT 7
+
+#define I2C_BUS_MAX_DEVICES 4
+#define I2C_BUS_QUEUE_LEN 8
+#define I2C_BUS_ASYNC_TX_MAX_LEN 8
+
+struct i2c_bus_device {
+    i2c_bus_t bus;
+    i2c_master_dev_handle_t handle;
+    i2c_bus_device_stats_t stats;
+};
+
+typedef struct
+{
+    i2c_bus_device_t* device;
+    bool is_read;
+    uint8_t tx[I2C_BUS_ASYNC_TX_MAX_LEN];
+    uint8_t* rx;
+    size_t len;
+    i2c_bus_done_cb_t cb;
+    void* ctx;
+} i2c_bus_request_t;
 
-static SemaphoreHandle_t s_mutex[SOC_I2C_NUM];
+typedef struct
+{
+    i2c_master_bus_config_t config;
+    i2c_master_bus_handle_t handle;
+    SemaphoreHandle_t mutex; // Serializes transactions with recovery, protects stats
+    StaticSemaphore_t mutex_buffer;
+    QueueHandle_t queue;
+    StaticQueue_t queue_buffer;
+    uint8_t queue_storage[I2C_BUS_QUEUE_LEN * sizeof(i2c_bus_request_t)];
+    i2c_bus_device_t devices[I2C_BUS_MAX_DEVICES];
+    size_t devices_number;
+} i2c_bus_state_t;
+
+static i2c_bus_state_t s_buses[I2C_BUS_MAX_COUNT] = {
+    [I2C_BUS_PRIMARY] = {
+        .config = {
+            .i2c_port = I2C_NUM_0,
+            .sda_io_num = I2C_BUS_PRIMARY_SDA_IO,
+            .scl_io_num = I2C_BUS_PRIMARY_SCL_IO,
+            .clk_source = I2C_CLK_SRC_DEFAULT,
+            .glitch_ignore_cnt = I2C_MASTER_GLITCH_IGNORE_CNT,
+            .flags.enable_internal_pullup = false,
+        },
+    },
+    [I2C_BUS_EXTERNAL] = {
+        .config = {
+            .i2c_port = I2C_NUM_1,
+            .sda_io_num = I2C_BUS_EXTERNAL_SDA_IO,
+            .scl_io_num = I2C_BUS_EXTERNAL_SCL_IO,
+            .clk_source = I2C_CLK_SRC_DEFAULT,
+            .glitch_ignore_cnt = I2C_MASTER_GLITCH_IGNORE_CNT,
+            .flags.enable_internal_pullup = true,
+        },
+    },
+};
+
+static esp_err_t i2c_bus_recover_unsafe(i2c_bus_state_t* bus)
+{
+    // Resetting the master FSM makes the controller clock out SCL pulses until the
+    // device holding SDA low has shifted out its byte and releases the line.
+    esp_err_t ret = i2c_master_bus_reset(bus->handle);
+
+    if (gpio_get_level(bus->config.sda_io_num) == 0) {
+        ESP_LOGW(TAG, "Bus %d: SDA still stuck low after recovery", bus->config.i2c_port);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Bus %d: recovered", bus->config.i2c_port);
+    return ret;
+}
+
+static esp_err_t i2c_bus_execute(i2c_bus_device_t* device, bool is_read, const uint8_t* tx, uint8_t* rx, size_t len)
+{
+    i2c_bus_state_t* bus = &s_buses[device->bus];
+    esp_err_t ret;
+
+    xSemaphoreTake(bus->mutex, portMAX_DELAY);
+    if (is_read) {
+        ret = i2c_master_receive(device->handle, rx, len, I2C_MASTER_TIMEOUT_MS);
+    } else {
+        ret = i2c_master_transmit(device->handle, tx, len, I2C_MASTER_TIMEOUT_MS);
+    }
+
+    device->stats.transactions++;
+    if (ret != ESP_OK) {
+        device->stats.errors++;
+        if (ret == ESP_ERR_TIMEOUT) {
+            device->stats.timeouts++;
+        }
+
+        // A device that lost clock sync mid-byte (e.g. a glitch on the connector) keeps SDA low forever
+        if (gpio_get_level(bus->config.sda_io_num) == 0 && i2c_bus_recover_unsafe(bus) == ESP_OK) {
+            device->stats.recoveries++;
+        }
+    }
+    xSemaphoreGive(bus->mutex);
+
+    return ret;
+}
+
+static void i2c_bus_task(void* arg)
+{
+    i2c_bus_state_t* bus = (i2c_bus_state_t*)arg;
+    i2c_bus_request_t request;
+
+    while (1) {
+        if (xQueueReceive(bus->queue, &request, portMAX_DELAY)) {
+            esp_err_t ret = i2c_bus_execute(request.device, request.is_read, request.tx, request.rx, request.len);
+
+            if (request.cb != NULL) {
+                request.cb(request.device, ret, request.ctx);
+            }
+        }
+    }
+}
 
 esp_err_t i2c_bus_init(void)
 {
-    for (size_t i = 0; i < SOC_I2C_NUM; ++i) {
-        s_mutex[i] = xSemaphoreCreateMutex();
+    esp_err_t ret;
+
+    for (i2c_bus_t i = 0; i < I2C_BUS_MAX_COUNT; ++i) {
+        i2c_bus_state_t* bus = &s_buses[i];
+
+        bus->mutex = xSemaphoreCreateMutexStatic(&bus->mutex_buffer);
+        bus->queue = xQueueCreateStatic(I2C_BUS_QUEUE_LEN, sizeof(i2c_bus_request_t), bus->queue_storage, &bus->queue_buffer);
+        bus->devices_number = 0;
+
+        ERROR_CHECK_SIMPLE(i2c_new_master_bus(&bus->config, &bus->handle));
+
+        ERROR_CHECK_SIMPLE(tasks_create((i == I2C_BUS_PRIMARY) ? TASK_I2C_PRIMARY : TASK_I2C_EXTERNAL, i2c_bus_task, bus, NULL));
     }
 
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_BUS_PRIMARY_SDA_IO,
-        .scl_io_num = I2C_BUS_PRIMARY_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_DISABLE,
-        .scl_pullup_en = GPIO_PULLUP_DISABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
-    };
+    return ESP_OK;
+err:
+    return ret;
+}
 
-    i2c_param_config(I2C_BUS_PRIMARY_NUM, &conf);
-    i2c_driver_install(I2C_BUS_PRIMARY_NUM, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
+esp_err_t i2c_bus_device_add(i2c_bus_t bus_i, uint16_t address, i2c_bus_device_t** device_out)
+{
+    esp_err_t ret;
+
+    if (bus_i >= I2C_BUS_MAX_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    i2c_bus_state_t* bus = &s_buses[bus_i];
+    if (bus->devices_number >= ARRAY_SIZE(bus->devices)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    i2c_bus_device_t* device = &bus->devices[bus->devices_number];
+    *device = (i2c_bus_device_t) {
+        .bus = bus_i,
+    };
 
-    conf = (i2c_config_t) {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_BUS_EXTERNAL_SDA_IO,
-        .scl_io_num = I2C_BUS_EXTERNAL_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
+    i2c_device_config_t config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = I2C_MASTER_FREQ_HZ,
     };
+    ERROR_CHECK_SIMPLE(i2c_master_bus_add_device(bus->handle, &config, &device->handle));
 
-    i2c_param_config(I2C_BUS_EXTERNAL_NUM, &conf);
-    i2c_driver_install(I2C_BUS_EXTERNAL_NUM, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
+    bus->devices_number++;
+    *device_out = device;
 
     return ESP_OK;
+err:
+    return ret;
 }
 
-esp_err_t i2c_bus_take(i2c_port_t port)
+esp_err_t i2c_bus_transmit(i2c_bus_device_t* device, const uint8_t* data, size_t len)
 {
-    return (xSemaphoreTake(s_mutex[port], portMAX_DELAY) == pdTRUE) ? ESP_OK : ESP_ERR_INVALID_STATE;
+    return i2c_bus_execute(device, false, data, NULL, len);
 }
 
-esp_err_t i2c_bus_give(i2c_port_t port)
+esp_err_t i2c_bus_receive(i2c_bus_device_t* device, uint8_t* data, size_t len)
 {
-    return (xSemaphoreGive(s_mutex[port]) == pdTRUE) ? ESP_OK : ESP_ERR_INVALID_STATE;
-}
\ No newline at end of file
+    return i2c_bus_execute(device, true, NULL, data, len);
+}
+
+esp_err_t i2c_bus_transmit_async(i2c_bus_device_t* device, const uint8_t* data, size_t len, i2c_bus_done_cb_t cb, void* ctx)
+{
+    if (len > I2C_BUS_ASYNC_TX_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    i2c_bus_request_t request = {
+        .device = device,
+        .is_read = false,
+        .len = len,
+        .cb = cb,
+        .ctx = ctx,
+    };
+    memcpy(request.tx, data, len);
+
+    return (xQueueSend(s_buses[device->bus].queue, &request, 0) == pdTRUE) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2c_bus_receive_async(i2c_bus_device_t* device, uint8_t* data, size_t len, i2c_bus_done_cb_t cb, void* ctx)
+{
+    i2c_bus_request_t request = {
+        .device = device,
+        .is_read = true,
+        .rx = data,
+        .len = len,
+        .cb = cb,
+        .ctx = ctx,
+    };
+
+    return (xQueueSend(s_buses[device->bus].queue, &request, 0) == pdTRUE) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2c_bus_recover(i2c_bus_t bus_i)
+{
+    if (bus_i >= I2C_BUS_MAX_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    i2c_bus_state_t* bus = &s_buses[bus_i];
+
+    xSemaphoreTake(bus->mutex, portMAX_DELAY);
+    esp_err_t ret = i2c_bus_recover_unsafe(bus);
+    xSemaphoreGive(bus->mutex);
+
+    return ret;
+}
+
+void i2c_bus_device_stats(const i2c_bus_device_t* device, i2c_bus_device_stats_t* stats_out)
+{
+    i2c_bus_state_t* bus = &s_buses[device->bus];
+
+    xSemaphoreTake(bus->mutex, portMAX_DELAY);
+    memcpy(stats_out, &device->stats, sizeof(device->stats));
+    xSemaphoreGive(bus->mutex);
+}
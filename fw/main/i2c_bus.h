@@ -1,13 +1,40 @@
 #pragma once
 
 #include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#include <driver/i2c.h>
+typedef enum {
+    I2C_BUS_PRIMARY = 0,
+    I2C_BUS_EXTERNAL = 1,
+    I2C_BUS_MAX_COUNT,
+} i2c_bus_t;
 
-#define I2C_BUS_PRIMARY_NUM 0
-#define I2C_BUS_EXTERNAL_NUM 1
+typedef struct i2c_bus_device i2c_bus_device_t;
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t recoveries;
+} i2c_bus_device_stats_t;
+
+// Called from the bus worker task once a queued transaction has completed
+typedef void (*i2c_bus_done_cb_t)(i2c_bus_device_t* device, esp_err_t result, void* ctx);
 
 esp_err_t i2c_bus_init(void);
 
-esp_err_t i2c_bus_take(i2c_port_t port);
-esp_err_t i2c_bus_give(i2c_port_t port);
+esp_err_t i2c_bus_device_add(i2c_bus_t bus, uint16_t address, i2c_bus_device_t** device_out);
+
+esp_err_t i2c_bus_transmit(i2c_bus_device_t* device, const uint8_t* data, size_t len);
+esp_err_t i2c_bus_receive(i2c_bus_device_t* device, uint8_t* data, size_t len);
+
+// Queue a transaction on the bus worker. The receive buffer must remain valid until cb has been called.
+esp_err_t i2c_bus_transmit_async(i2c_bus_device_t* device, const uint8_t* data, size_t len, i2c_bus_done_cb_t cb, void* ctx);
+esp_err_t i2c_bus_receive_async(i2c_bus_device_t* device, uint8_t* data, size_t len, i2c_bus_done_cb_t cb, void* ctx);
+
+esp_err_t i2c_bus_recover(i2c_bus_t bus);
+
+void i2c_bus_device_stats(const i2c_bus_device_t* device, i2c_bus_device_stats_t* stats_out);
@@ -0,0 +1,97 @@
+#include "json_pool.h"
+
+#include <cJSON.h>
+#include <freertos/FreeRTOS.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "util.h"
+
+#define TAG "json_pool"
+
+#if CONFIG_STATIC_ALLOCATION
+// Fits a cJSON node (40 bytes on the ESP32), keys and short string values
+#define JSON_POOL_BLOCK_MIN_SIZE 32
+#define JSON_POOL_BLOCK_SIZE (((sizeof(cJSON) > JSON_POOL_BLOCK_MIN_SIZE ? sizeof(cJSON) : JSON_POOL_BLOCK_MIN_SIZE) + 7) & ~7)
+
+typedef union json_pool_block {
+    union json_pool_block* next;
+    uint8_t data[JSON_POOL_BLOCK_SIZE];
+    double align;
+} json_pool_block_t;
+
+static json_pool_block_t s_blocks[CONFIG_STATIC_JSON_POOL_BLOCKS];
+static json_pool_block_t* s_free;
+static json_pool_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void* json_pool_malloc(size_t size)
+{
+    json_pool_block_t* block = NULL;
+
+    portENTER_CRITICAL(&s_lock);
+    if (size <= JSON_POOL_BLOCK_SIZE && s_free != NULL) {
+        block = s_free;
+        s_free = block->next;
+        if (++s_stats.used > s_stats.peak) {
+            s_stats.peak = s_stats.used;
+        }
+    } else {
+        s_stats.fallbacks++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return (block != NULL) ? block : malloc(size);
+}
+
+static void json_pool_free(void* ptr)
+{
+    json_pool_block_t* block = ptr;
+
+    if (block < &s_blocks[0] || block >= &s_blocks[ARRAY_SIZE(s_blocks)]) {
+        free(ptr);
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    block->next = s_free;
+    s_free = block;
+    s_stats.used--;
+    portEXIT_CRITICAL(&s_lock);
+}
+#endif
+
+esp_err_t json_pool_init(void)
+{
+#if CONFIG_STATIC_ALLOCATION
+    for (size_t i = 0; i < ARRAY_SIZE(s_blocks); ++i) {
+        s_blocks[i].next = (i + 1 < ARRAY_SIZE(s_blocks)) ? &s_blocks[i + 1] : NULL;
+    }
+    s_free = &s_blocks[0];
+    s_stats = (json_pool_stats_t) {
+        .blocks = ARRAY_SIZE(s_blocks),
+        .block_size = JSON_POOL_BLOCK_SIZE,
+    };
+
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_pool_malloc,
+        .free_fn = json_pool_free,
+    };
+    cJSON_InitHooks(&hooks);
+#endif
+
+    return ESP_OK;
+}
+
+void json_pool_fetch(json_pool_stats_t* stats_out)
+{
+#if CONFIG_STATIC_ALLOCATION
+    portENTER_CRITICAL(&s_lock);
+    *stats_out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+#else
+    memset(stats_out, 0, sizeof(*stats_out));
+#endif
+}
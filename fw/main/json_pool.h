@@ -0,0 +1,18 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t blocks; // 0 without CONFIG_STATIC_ALLOCATION
+    uint32_t block_size;
+    uint32_t used;
+    uint32_t peak;
+    uint32_t fallbacks; // Allocations that did not fit a block and went to the heap
+} json_pool_stats_t;
+
+// Serves cJSON nodes and strings from a static pool, call before anything uses cJSON
+esp_err_t json_pool_init(void);
+
+void json_pool_fetch(json_pool_stats_t* stats_out);
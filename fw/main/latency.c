@@ -0,0 +1,157 @@
+#include "latency.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "fans.h"
+#include "util.h"
+
+#define TAG "latency"
+
+#define LATENCY_RPM_TIMEOUT_US 5000000 // Give up waiting for the fan to respond after 5 seconds
+#define LATENCY_RPM_CHANGE_MIN 50
+#define LATENCY_RPM_CHANGE_PERMILLE 50 // An RPM change of 5% counts as a response
+
+typedef struct
+{
+    volatile bool armed;
+    int64_t received_us;
+    uint32_t rpm_baseline;
+} latency_pending_t;
+
+static const char* s_stage_names[LATENCY_STAGE_MAX_COUNT] = {
+    [LATENCY_STAGE_PARSED] = "parsed",
+    [LATENCY_STAGE_APPLIED] = "applied",
+    [LATENCY_STAGE_RPM] = "rpm",
+};
+
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static latency_pending_t s_pending[FANS_COUNT];
+static histogram_t s_histograms[LATENCY_STAGE_MAX_COUNT];
+static uint32_t s_timeouts;
+
+static uint32_t latency_elapsed_us(int64_t from_us, int64_t to_us)
+{
+    int64_t elapsed = to_us - from_us;
+    return (elapsed < 0) ? 0 : ((elapsed > UINT32_MAX) ? UINT32_MAX : elapsed);
+}
+
+esp_err_t latency_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    return ESP_OK;
+}
+
+void latency_command_parsed(int64_t received_us, int64_t parsed_us)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    histogram_record(&s_histograms[LATENCY_STAGE_PARSED], latency_elapsed_us(received_us, parsed_us));
+    xSemaphoreGive(s_mutex);
+}
+
+void latency_command_pending(uint8_t fan_i, int64_t received_us)
+{
+    if (fan_i >= FANS_COUNT) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_pending[fan_i].armed = false;
+    s_pending[fan_i].received_us = received_us;
+    xSemaphoreGive(s_mutex);
+}
+
+void latency_command_applied(uint8_t fan_i, bool duty_changed)
+{
+    if (fan_i >= FANS_COUNT) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    latency_pending_t* pending = &s_pending[fan_i];
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    // Only the first write after the command counts, the output keeps stepping while it ramps
+    if (pending->received_us != 0 && !pending->armed) {
+        histogram_record(&s_histograms[LATENCY_STAGE_APPLIED], latency_elapsed_us(pending->received_us, now));
+
+        // Only a changed duty can lead to an RPM change, the baseline is taken at the next tacho edge
+        pending->armed = duty_changed;
+        pending->rpm_baseline = 0;
+        if (!duty_changed) {
+            pending->received_us = 0;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+void latency_rpm_observed(uint8_t fan_i, uint32_t rpm)
+{
+    if (fan_i >= FANS_COUNT || !s_pending[fan_i].armed) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    latency_pending_t* pending = &s_pending[fan_i];
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (!pending->armed) {
+        // Disarmed while waiting for the mutex
+    } else if (pending->rpm_baseline == 0) {
+        pending->rpm_baseline = rpm;
+    } else {
+        uint32_t change = (rpm > pending->rpm_baseline) ? (rpm - pending->rpm_baseline) : (pending->rpm_baseline - rpm);
+        uint32_t threshold = pending->rpm_baseline * LATENCY_RPM_CHANGE_PERMILLE / 1000;
+        if (threshold < LATENCY_RPM_CHANGE_MIN) {
+            threshold = LATENCY_RPM_CHANGE_MIN;
+        }
+
+        if (change >= threshold) {
+            histogram_record(&s_histograms[LATENCY_STAGE_RPM], latency_elapsed_us(pending->received_us, now));
+            pending->armed = false;
+            pending->received_us = 0;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+void latency_expire(int64_t now)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < FANS_COUNT; ++i) {
+        // Also a command the output never got to write, e.g. one held back while the fan is tripped
+        latency_pending_t* pending = &s_pending[i];
+        if (pending->received_us != 0 && now - pending->received_us > LATENCY_RPM_TIMEOUT_US) {
+            pending->armed = false;
+            pending->received_us = 0;
+            s_timeouts++;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+const char* latency_stage_name(latency_stage_t stage)
+{
+    return (stage < ARRAY_SIZE(s_stage_names)) ? s_stage_names[stage] : "unknown";
+}
+
+bool latency_fetch(latency_stage_t stage, histogram_stats_t* stats_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool valid = histogram_stats(&s_histograms[stage], stats_out);
+    xSemaphoreGive(s_mutex);
+
+    return valid;
+}
+
+uint32_t latency_fetch_timeouts(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    uint32_t timeouts = s_timeouts;
+    xSemaphoreGive(s_mutex);
+
+    return timeouts;
+}
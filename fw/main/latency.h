@@ -0,0 +1,30 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+typedef enum {
+    LATENCY_STAGE_PARSED, // Command received -> command parsed
+    LATENCY_STAGE_APPLIED, // Command received -> LEDC duty updated
+    LATENCY_STAGE_RPM, // Command received -> tacho observed the RPM change
+    LATENCY_STAGE_MAX_COUNT,
+} latency_stage_t;
+
+esp_err_t latency_init(void);
+
+// Once per command, however many fans it sets
+void latency_command_parsed(int64_t received_us, int64_t parsed_us);
+// For every fan the command sets, before the fan is commanded
+void latency_command_pending(uint8_t fan_i, int64_t received_us);
+// When the LEDC duty is written, or right away for a command that did not change the duty
+void latency_command_applied(uint8_t fan_i, bool duty_changed);
+void latency_rpm_observed(uint8_t fan_i, uint32_t rpm);
+// From the control tick, so a fan without tacho edges times out too
+void latency_expire(int64_t now);
+
+const char* latency_stage_name(latency_stage_t stage);
+bool latency_fetch(latency_stage_t stage, histogram_stats_t* stats_out);
+uint32_t latency_fetch_timeouts(void);
@@ -21,6 +21,7 @@
 #define GPIO_B_PWM (35)
 
 static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
 
 static esp_err_t channel_config(ledc_channel_t channel, int gpio_num)
 {
@@ -50,7 +51,7 @@ static bool channel_persist_channel_unsafe(ledc_channel_t channel, uint8_t duty)
 
 esp_err_t led_init(void)
 {
-    s_mutex = xSemaphoreCreateMutex();
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
 
     ledc_timer_config_t ledc_timer = {
         .speed_mode = LEDC_MODE,
@@ -6,20 +6,49 @@
 
 #include "data.h"
 #include "events.h"
+#include "periodic.h"
+#include "power.h"
+#include "settings.h"
+#include "tasks.h"
+#include "trace.h"
+#include "util.h"
 
 #define TAG "mqtt"
 
 #define MAX_TOPIC_SIZE (64)
 
+#ifdef CONFIG_REPORT_MQTT_CBOR
+#define STATUS_TOPIC_FORMAT "fancontroller/%s/status/cbor"
+#else
+#define STATUS_TOPIC_FORMAT "fancontroller/%s/status"
+#endif
+
 typedef struct
 {
     char duty[MAX_TOPIC_SIZE];
+    char settings[MAX_TOPIC_SIZE];
+    char calibration[MAX_TOPIC_SIZE];
     char status[MAX_TOPIC_SIZE];
 } mqtt_topics_t;
 
 static esp_mqtt_client_handle_t m_client;
 static mqtt_topics_t m_topics;
 static volatile bool m_connected;
+static bool m_online;
+
+#ifdef CONFIG_POWER_SAVE
+// Rendered reports waiting to be published together, so the radio wakes up once per batch
+static char m_batch[CONFIG_POWER_SAVE_REPORT_BATCH][CONFIG_STATUS_BUFFER_SIZE];
+static size_t m_batch_len[CONFIG_POWER_SAVE_REPORT_BATCH];
+static size_t m_batch_number;
+#else
+static char m_report[CONFIG_STATUS_BUFFER_SIZE];
+#endif
+
+static bool mqtt_topic_is(esp_mqtt_event_handle_t event, const char* topic)
+{
+    return event->topic_len == strlen(topic) && strncmp(event->topic, topic, event->topic_len) == 0;
+}
 
 static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data)
 {
@@ -32,6 +61,8 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
         esp_mqtt_client_subscribe(client, m_topics.duty, 0);
+        esp_mqtt_client_subscribe(client, m_topics.settings, 1);
+        esp_mqtt_client_subscribe(client, m_topics.calibration, 1);
         m_connected = true;
         break;
     case MQTT_EVENT_DISCONNECTED:
@@ -39,8 +70,17 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
         m_connected = false;
         break;
     case MQTT_EVENT_DATA:
-        if (strcmp(event->topic, m_topics.duty)) {
-            data_process_duty_json_str(event->data, event->data_len);
+        // The topic is not terminated
+        if (mqtt_topic_is(event, m_topics.duty)) {
+            data_process_duty_json_str(event->data, event->data_len, esp_timer_get_time());
+        } else if (mqtt_topic_is(event, m_topics.settings)) {
+            if (data_process_settings_json_str(event->data, event->data_len) != ESP_OK) {
+                ESP_LOGW(TAG, "Rejected settings update");
+            }
+        } else if (mqtt_topic_is(event, m_topics.calibration)) {
+            if (data_process_calibration_json_str(event->data, event->data_len) != ESP_OK) {
+                ESP_LOGW(TAG, "Rejected calibration point");
+            }
         } else {
             ESP_LOGW(TAG, "MQTT_EVENT_DATA %.*s (not matched); %.*s", event->topic_len, event->topic, event->data_len, event->data);
         }
@@ -61,14 +101,48 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
     }
 }
 
+#ifdef CONFIG_POWER_SAVE
+static void mqtt_batch_flush(bool publish)
+{
+    for (size_t i = 0; i < m_batch_number && publish; ++i) {
+        esp_mqtt_client_publish(m_client, m_topics.status, m_batch[i], m_batch_len[i], 0, 0);
+    }
+    m_batch_number = 0;
+}
+#endif
+
+// CBOR reports are binary, so the length is always passed on
+static esp_err_t mqtt_render(char* buffer, size_t size, size_t* len_out)
+{
+#ifdef CONFIG_REPORT_MQTT_CBOR
+    return data_print_cbor(data_status_to_cbor, (uint8_t*)buffer, size, len_out);
+#else
+    const esp_err_t ret = data_print(data_status_to_json, buffer, size);
+    *len_out = (ret == ESP_OK) ? strlen(buffer) : 0;
+    return ret;
+#endif
+}
+
 static void mqtt_report(void)
 {
-    cJSON* root = cJSON_CreateObject();
-    ESP_ERROR_CHECK(data_status_to_json(root));
-    const char* resp = cJSON_PrintUnformatted(root);
-    esp_mqtt_client_publish(m_client, m_topics.status, resp, 0, 0, 0);
-    free((void*)resp);
-    cJSON_Delete(root);
+    TRACE_SPAN_BEGIN(MQTT_REPORT);
+    power_busy_begin();
+
+#ifdef CONFIG_POWER_SAVE
+    if (mqtt_render(m_batch[m_batch_number], sizeof(m_batch[0]), &m_batch_len[m_batch_number]) == ESP_OK) {
+        m_batch_number++;
+    }
+    if (m_batch_number >= ARRAY_SIZE(m_batch) || periodic_is_active()) {
+        mqtt_batch_flush(true);
+    }
+#else
+    size_t len;
+    if (mqtt_render(m_report, sizeof(m_report), &len) == ESP_OK) {
+        esp_mqtt_client_publish(m_client, m_topics.status, m_report, len, 0, 0);
+    }
+#endif
+    power_busy_end();
+    TRACE_SPAN_END(MQTT_REPORT);
 }
 
 static void mqtt_status_handler(void* _event_handler_arg,
@@ -81,26 +155,83 @@ static void mqtt_status_handler(void* _event_handler_arg,
         if (m_connected) {
             mqtt_report();
         }
+#ifdef CONFIG_POWER_SAVE
+        else {
+            mqtt_batch_flush(false); // Stale by the time we are back
+        }
+#endif
         break;
     case EVENT_ONLINE:
+        m_online = true;
         esp_mqtt_client_start(m_client);
         break;
     case EVENT_OFFLINE:
+        m_online = false;
         esp_mqtt_client_stop(m_client);
         break;
     }
 }
 
+static periodic_consumer_config_t mqtt_report_config(const settings_t* settings)
+{
+    return (periodic_consumer_config_t) {
+        .name = "mqtt",
+        .event_id = EVENT_STATUS_PING,
+        .fast_interval_ms = settings->report_fast_interval_ms,
+        .slow_interval_ms = settings->report_slow_interval_ms,
+    };
+}
+
+// Runs on the event loop like the status handler, so m_online is not racing
+static void mqtt_settings_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    const uint32_t groups = *(const uint32_t*)event_data;
+    settings_t settings;
+    settings_fetch(&settings);
+
+    if (groups & SETTINGS_MQTT) {
+        const esp_mqtt_client_config_t mqtt_cfg = {
+            .broker.address.uri = settings.mqtt_broker_url,
+        };
+
+        ESP_LOGI(TAG, "Switching to broker %s", settings.mqtt_broker_url);
+        if (m_online) {
+            esp_mqtt_client_stop(m_client);
+        }
+        const esp_err_t ret = esp_mqtt_set_config(m_client, &mqtt_cfg);
+        if (ret != ESP_OK) {
+            // The client keeps the broker it had
+            ESP_LOGE(TAG, "Rejected the broker URL: %s", esp_err_to_name(ret));
+        }
+        if (m_online) {
+            esp_mqtt_client_start(m_client);
+        }
+    }
+    if (groups & SETTINGS_REPORT) {
+        const periodic_consumer_config_t report_config = mqtt_report_config(&settings);
+        ESP_ERROR_CHECK(periodic_reconfigure(&report_config));
+    }
+}
+
 esp_err_t mqtt_init(void)
 {
     snprintf(m_topics.duty, MAX_TOPIC_SIZE, "fancontroller/%s/duty", data_get_id());
-    snprintf(m_topics.status, MAX_TOPIC_SIZE, "fancontroller/%s/status", data_get_id());
+    snprintf(m_topics.settings, MAX_TOPIC_SIZE, "fancontroller/%s/settings", data_get_id());
+    snprintf(m_topics.calibration, MAX_TOPIC_SIZE, "fancontroller/%s/calibration", data_get_id());
+    snprintf(m_topics.status, MAX_TOPIC_SIZE, STATUS_TOPIC_FORMAT, data_get_id());
+
+    settings_t settings;
+    settings_fetch(&settings);
 
+    // The client keeps its own copy of the strings
     esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = CONFIG_MQTT_BROKER_URL,
+        .broker.address.uri = settings.mqtt_broker_url,
         .session.protocol_ver = MQTT_PROTOCOL_UNDEFINED,
         .network.disable_auto_reconnect = false,
         .network.reconnect_timeout_ms = 1000,
+        // The core comes from CONFIG_MQTT_USE_CORE_0
+        .task.priority = tasks_config(TASK_MQTT)->priority,
+        .task.stack_size = tasks_config(TASK_MQTT)->stack_size,
     };
 
     m_client = esp_mqtt_client_init(&mqtt_cfg);
@@ -113,6 +244,11 @@ esp_err_t mqtt_init(void)
         mqtt_status_handler, NULL, NULL);
     esp_event_handler_instance_register(EVENTS, EVENT_OFFLINE,
         mqtt_status_handler, NULL, NULL);
+    esp_event_handler_instance_register(EVENTS, EVENT_SETTINGS_CHANGED,
+        mqtt_settings_handler, NULL, NULL);
+
+    const periodic_consumer_config_t report_config = mqtt_report_config(&settings);
+    ESP_ERROR_CHECK(periodic_register(&report_config));
 
     return ESP_OK;
 }
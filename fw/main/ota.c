@@ -0,0 +1,242 @@
+#include "ota.h"
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "events.h"
+#include "power.h"
+#include "supervisor.h"
+#include "util.h"
+#include "watchdog.h"
+
+#define TAG "ota"
+
+// Long enough for the HTTP response to go out before the restart
+#define OTA_RESTART_DELAY_US (500 * 1000)
+
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static ota_status_t s_status;
+
+// Only touched by the uploading task between ota_begin() and ota_end()/ota_abort()
+static esp_ota_handle_t s_handle;
+static const esp_partition_t* s_partition;
+static mbedtls_sha256_context s_sha256;
+
+static esp_timer_handle_t s_restart_timer;
+static esp_timer_handle_t s_check_timer;
+static volatile bool s_online;
+static volatile uint32_t s_adc_frames;
+
+const char* ota_state_name(ota_state_t state)
+{
+    switch (state) {
+    case OTA_STATE_IDLE:
+        return "idle";
+    case OTA_STATE_RECEIVING:
+        return "receiving";
+    case OTA_STATE_REBOOTING:
+        return "rebooting";
+    case OTA_STATE_FAILED:
+        return "failed";
+    default:
+        return "unknown";
+    }
+}
+
+static void ota_set_state(ota_state_t state, esp_err_t error)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_status.state = state;
+    if (error != ESP_OK) {
+        s_status.error = error;
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+static void ota_restart_cb(void* arg)
+{
+    esp_restart();
+}
+
+static void ota_online_handler(void* arg, esp_event_base_t base, int32_t id, void* event_data)
+{
+    s_online = true;
+}
+
+static void ota_adc_sampled_handler(void* arg, esp_event_base_t base, int32_t id, void* event_data)
+{
+    s_adc_frames++;
+}
+
+// The new image has to sample, stay within the current limits, keep its tasks running and (optionally)
+// reach the network, otherwise the previous one is booted again. A crash before this point rolls back in the bootloader.
+static void ota_health_check_cb(void* arg)
+{
+    supervisor_state_t supervisor;
+    supervisor_fetch(&supervisor);
+
+    const bool sampling = (s_adc_frames > 0);
+    const bool network = s_online || !CONFIG_OTA_HEALTH_REQUIRE_NETWORK;
+    const bool untripped = (supervisor.trips == 0);
+    const bool responsive = (watchdog_fetch_faults() == 0);
+
+    esp_event_handler_unregister(EVENTS, EVENT_ONLINE, ota_online_handler);
+    esp_event_handler_unregister(EVENTS, EVENT_ADC_SAMPLED, ota_adc_sampled_handler);
+
+    if (sampling && network && untripped && responsive) {
+        ESP_LOGI(TAG, "Health check passed, keeping this image");
+        esp_ota_mark_app_valid_cancel_rollback();
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_status.pending_verify = false;
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+
+    ESP_LOGE(TAG, "Health check failed (sampling %d, network %d, untripped %d, responsive %d), rolling back",
+        sampling, network, untripped, responsive);
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+esp_err_t ota_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    const esp_timer_create_args_t restart_args = {
+        .callback = ota_restart_cb,
+        .name = "ota_restart",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&restart_args, &s_restart_timer));
+
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    strlcpy(s_status.running, running->label, sizeof(s_status.running));
+
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGW(TAG, "Running a new image from %s, health check in %ds", running->label, CONFIG_OTA_HEALTH_CHECK_S);
+        s_status.pending_verify = true;
+
+        ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ONLINE, ota_online_handler, NULL));
+        ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ADC_SAMPLED, ota_adc_sampled_handler, NULL));
+
+        const esp_timer_create_args_t check_args = {
+            .callback = ota_health_check_cb,
+            .name = "ota_check",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&check_args, &s_check_timer));
+        ESP_ERROR_CHECK(esp_timer_start_once(s_check_timer, CONFIG_OTA_HEALTH_CHECK_S * 1000000LL));
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ota_begin(size_t image_size)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    // An image on trial can't be replaced before it is confirmed, the rollback would pick the wrong one
+    const bool busy = (s_status.state == OTA_STATE_RECEIVING || s_status.state == OTA_STATE_REBOOTING || s_status.pending_verify);
+    if (!busy) {
+        s_status.state = OTA_STATE_RECEIVING;
+        s_status.written = 0;
+        s_status.size = image_size;
+        s_status.started_us = esp_timer_get_time();
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_partition = esp_ota_get_next_update_partition(NULL);
+    if (s_partition == NULL) {
+        ota_set_state(OTA_STATE_FAILED, ESP_ERR_NOT_FOUND);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (image_size > s_partition->size) {
+        ota_set_state(OTA_STATE_FAILED, ESP_ERR_INVALID_SIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Sequential writes erase sector by sector as the image arrives, instead of the whole partition up front
+    esp_err_t ret = esp_ota_begin(s_partition, OTA_WITH_SEQUENTIAL_WRITES, &s_handle);
+    if (ret != ESP_OK) {
+        ota_set_state(OTA_STATE_FAILED, ret);
+        return ret;
+    }
+
+    mbedtls_sha256_init(&s_sha256);
+    mbedtls_sha256_starts(&s_sha256, 0);
+    power_busy_begin();
+
+    ESP_LOGI(TAG, "Receiving %u bytes into %s", (unsigned int)image_size, s_partition->label);
+    return ESP_OK;
+}
+
+esp_err_t ota_write(const void* data, size_t len)
+{
+    esp_err_t ret = esp_ota_write(s_handle, data, len);
+    if (ret != ESP_OK) {
+        ota_abort(ret);
+        return ret;
+    }
+    mbedtls_sha256_update(&s_sha256, data, len);
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_status.written += len;
+    xSemaphoreGive(s_mutex);
+
+    return ESP_OK;
+}
+
+esp_err_t ota_end(const uint8_t expected_sha256[OTA_SHA256_LEN])
+{
+    uint8_t sha256[OTA_SHA256_LEN];
+    mbedtls_sha256_finish(&s_sha256, sha256);
+    mbedtls_sha256_free(&s_sha256);
+
+    if (memcmp(sha256, expected_sha256, sizeof(sha256)) != 0) {
+        ESP_LOGE(TAG, "Image SHA-256 does not match");
+        ota_abort(ESP_ERR_INVALID_CRC);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Checks the image structure and its own appended digest, releases the handle either way
+    esp_err_t ret;
+    ERROR_CHECK_SIMPLE(esp_ota_end(s_handle));
+    ERROR_CHECK_SIMPLE(esp_ota_set_boot_partition(s_partition));
+
+    ESP_LOGW(TAG, "Booting %s next, restarting", s_partition->label);
+    ota_set_state(OTA_STATE_REBOOTING, ESP_OK);
+    power_busy_end();
+    esp_timer_start_once(s_restart_timer, OTA_RESTART_DELAY_US);
+    return ESP_OK;
+
+err:
+    ota_set_state(OTA_STATE_FAILED, ret);
+    power_busy_end();
+    return ret;
+}
+
+void ota_abort(esp_err_t error)
+{
+    ESP_LOGE(TAG, "Upload aborted: %s", esp_err_to_name(error));
+    esp_ota_abort(s_handle);
+    mbedtls_sha256_free(&s_sha256); // Harmless after ota_end() already freed it
+    ota_set_state(OTA_STATE_FAILED, error);
+    power_busy_end();
+}
+
+void ota_fetch(ota_status_t* status_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *status_out = s_status;
+    xSemaphoreGive(s_mutex);
+}
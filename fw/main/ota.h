@@ -0,0 +1,39 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_SHA256_LEN 32
+
+typedef enum {
+    OTA_STATE_IDLE,
+    OTA_STATE_RECEIVING,
+    OTA_STATE_REBOOTING, // Image verified and selected for the next boot
+    OTA_STATE_FAILED,
+} ota_state_t;
+
+typedef struct
+{
+    ota_state_t state;
+    uint32_t written; // Bytes of the current or last upload
+    uint32_t size; // Announced image size, 0 if unknown
+    int64_t started_us;
+    esp_err_t error; // Of the last failed upload
+    char running[17]; // Label of the partition we booted from
+    bool pending_verify; // Booted a new image that has not passed the health check yet
+} ota_status_t;
+
+// Starts the post-boot health check when the running image is on trial
+esp_err_t ota_init(void);
+
+// An upload streams into the inactive OTA partition, one at a time. Size may be 0 if unknown.
+esp_err_t ota_begin(size_t image_size);
+esp_err_t ota_write(const void* data, size_t len);
+// Verifies the image against the expected SHA-256, selects it for the next boot and restarts shortly after
+esp_err_t ota_end(const uint8_t expected_sha256[OTA_SHA256_LEN]);
+void ota_abort(esp_err_t error);
+
+void ota_fetch(ota_status_t* status_out);
+const char* ota_state_name(ota_state_t state);
@@ -1,32 +1,52 @@
 #include "performance.h"
 
+#include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <sdkconfig.h>
+
+#include "tasks.h"
 #include "util.h"
 
-#define MAX_NUMBER_OF_TASKS 16
+#define TAG "performance"
 
-#define ARRAY_SIZE_OFFSET 5 // Increase this if print_real_time_stats returns ESP_ERR_INVALID_SIZE
+#define ARRAY_SIZE_OFFSET 5 // Headroom for tasks created between uxTaskGetNumberOfTasks and uxTaskGetSystemState
 
 typedef struct
 {
-    TaskHandle_t task_handle;
     UBaseType_t task_number;
+    char task_name[configMAX_TASK_NAME_LEN];
     uint8_t percentage;
+    int8_t core_id;
+    uint8_t priority;
+    uint32_t stack_high_water_mark;
 } performance_result_entry_t;
 
 typedef struct
 {
-    performance_result_entry_t entries[MAX_NUMBER_OF_TASKS];
+    performance_result_entry_t* entries;
+    size_t entries_capacity;
     size_t entries_number;
+    uint8_t core_percentage[portNUM_PROCESSORS];
 } performance_result_t;
 
+typedef struct
+{
+    TaskStatus_t* tasks;
+    size_t capacity;
+    UBaseType_t number;
+    uint32_t run_time;
+} performance_snapshot_t;
+
 static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
 static performance_result_t s_result;
+static volatile uint32_t s_interval_ms = CONFIG_PERFORMANCE_INTERVAL_MS;
 
 static int task_status_handle_cmp(const void* x, const void* y)
 {
@@ -39,79 +59,172 @@ static int task_status_handle_cmp(const void* x, const void* y)
     return x2->xHandle < y2->xHandle ? -1 : 1;
 }
 
-static void performance_task(void* arg)
+static esp_err_t performance_snapshot_take(performance_snapshot_t* snapshot)
 {
-    TaskStatus_t prev_tasks[MAX_NUMBER_OF_TASKS];
-    uint32_t prev_run_time;
+    while (1) {
+        size_t required = uxTaskGetNumberOfTasks() + ARRAY_SIZE_OFFSET;
+        if (snapshot->capacity < required) {
+            TaskStatus_t* tasks = realloc(snapshot->tasks, required * sizeof(TaskStatus_t));
+            if (tasks == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            snapshot->tasks = tasks;
+            snapshot->capacity = required;
+        }
 
-    UBaseType_t prev_tasks_number = uxTaskGetSystemState(prev_tasks, MAX_NUMBER_OF_TASKS, &prev_run_time);
+        // Returns 0 if more tasks were created than fit the array, size up and try again
+        snapshot->number = uxTaskGetSystemState(snapshot->tasks, snapshot->capacity, &snapshot->run_time);
+        if (snapshot->number > 0) {
+            break;
+        }
+    }
 
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+    qsort(snapshot->tasks, snapshot->number, sizeof(TaskStatus_t), task_status_handle_cmp);
 
-        TaskStatus_t current_tasks[MAX_NUMBER_OF_TASKS];
-        uint32_t current_run_time;
+    return ESP_OK;
+}
 
-        UBaseType_t current_tasks_number = uxTaskGetSystemState(current_tasks, MAX_NUMBER_OF_TASKS, &current_run_time);
+static esp_err_t performance_result_reserve_unsafe(size_t entries_number)
+{
+    if (s_result.entries_capacity >= entries_number) {
+        return ESP_OK;
+    }
 
-        uint32_t total_elapsed_time = (current_run_time - prev_run_time);
+    performance_result_entry_t* entries = realloc(s_result.entries, entries_number * sizeof(performance_result_entry_t));
+    if (entries == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_result.entries = entries;
+    s_result.entries_capacity = entries_number;
 
-        qsort(current_tasks, current_tasks_number, sizeof(TaskStatus_t), task_status_handle_cmp);
+    return ESP_OK;
+}
 
-        xSemaphoreTake(s_mutex, portMAX_DELAY);
-        s_result.entries_number = 0;
-        for (size_t i = 0; i < current_tasks_number; i++) {
-            size_t k = MAX_NUMBER_OF_TASKS;
-            for (size_t j = 0; j < prev_tasks_number; j++) {
-                if (current_tasks[i].xHandle == prev_tasks[j].xHandle) {
-                    k = j;
-                    break;
-                }
-            }
+static uint8_t performance_percentage(uint32_t part, uint64_t total)
+{
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t percentage = ((uint64_t)part * 100) / total;
+    return (percentage > 100) ? 100 : percentage;
+}
 
-            // Check if matching task found
-            if (k < MAX_NUMBER_OF_TASKS) {
-                uint32_t task_elapsed_time = current_tasks[i].ulRunTimeCounter - prev_tasks[k].ulRunTimeCounter;
-                uint32_t percentage_time = (task_elapsed_time * 100UL) / (total_elapsed_time * portNUM_PROCESSORS);
+static void performance_update(const performance_snapshot_t* prev, const performance_snapshot_t* current)
+{
+    const uint32_t total_elapsed_time = current->run_time - prev->run_time;
 
-                performance_result_entry_t* entry = &s_result.entries[s_result.entries_number++];
-                entry->task_handle = current_tasks[i].xHandle;
-                entry->task_number = current_tasks[i].xTaskNumber;
-                entry->percentage = percentage_time;
+    TaskHandle_t idle_tasks[portNUM_PROCESSORS];
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core) {
+        idle_tasks[core] = xTaskGetIdleTaskHandleForCore(core);
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (performance_result_reserve_unsafe(current->number) != ESP_OK) {
+        ESP_LOGE(TAG, "Out of memory for %u tasks", current->number);
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core) {
+        s_result.core_percentage[core] = 0;
+    }
+
+    // Both snapshots are sorted by handle, so matching is a single merge pass
+    s_result.entries_number = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < current->number; i++) {
+        const TaskStatus_t* task = &current->tasks[i];
+
+        while (j < prev->number && prev->tasks[j].xHandle < task->xHandle) {
+            j++;
+        }
+        if (j >= prev->number || prev->tasks[j].xHandle != task->xHandle) {
+            continue; // Task was created during this interval
+        }
+
+        uint32_t task_elapsed_time = task->ulRunTimeCounter - prev->tasks[j].ulRunTimeCounter;
+
+        for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core) {
+            if (task->xHandle == idle_tasks[core]) {
+                s_result.core_percentage[core] = 100 - performance_percentage(task_elapsed_time, total_elapsed_time);
             }
         }
-        xSemaphoreGive(s_mutex);
 
-        memcpy(prev_tasks, current_tasks, sizeof(prev_tasks));
-        prev_tasks_number = current_tasks_number;
-        prev_run_time = current_run_time;
+        performance_result_entry_t* entry = &s_result.entries[s_result.entries_number++];
+        entry->task_number = task->xTaskNumber;
+        strlcpy(entry->task_name, task->pcTaskName, sizeof(entry->task_name));
+        entry->percentage = performance_percentage(task_elapsed_time, (uint64_t)total_elapsed_time * portNUM_PROCESSORS);
+        entry->core_id = (task->xCoreID < portNUM_PROCESSORS) ? task->xCoreID : -1;
+        entry->priority = task->uxCurrentPriority;
+        entry->stack_high_water_mark = task->usStackHighWaterMark;
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+static void performance_task(void* arg)
+{
+    performance_snapshot_t snapshots[2] = { 0 };
+    performance_snapshot_t* prev = &snapshots[0];
+    performance_snapshot_t* current = &snapshots[1];
+
+    ESP_ERROR_CHECK(performance_snapshot_take(prev));
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(s_interval_ms));
+
+        if (performance_snapshot_take(current) != ESP_OK) {
+            ESP_LOGE(TAG, "Out of memory for task snapshot");
+            continue;
+        }
+
+        performance_update(prev, current);
+
+        performance_snapshot_t* tmp = prev;
+        prev = current;
+        current = tmp;
     }
 }
 
 esp_err_t performance_init(void)
 {
     s_result.entries_number = 0;
-    s_mutex = xSemaphoreCreateMutex();
-    xTaskCreate(performance_task, "performance", 1024 * 4, (void*)0, 9, NULL);
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+    ESP_ERROR_CHECK(tasks_create(TASK_PERFORMANCE, performance_task, NULL, NULL));
 
     return ESP_OK;
 }
 
+void performance_set_interval(uint32_t interval_ms)
+{
+    s_interval_ms = (interval_ms > 0) ? interval_ms : CONFIG_PERFORMANCE_INTERVAL_MS;
+}
+
 void performance_fetch(performance_fetch_cb_t cb, void* ctx)
 {
-    char str[128];
+    char str[configMAX_TASK_NAME_LEN + 12];
 
     xSemaphoreTake(s_mutex, portMAX_DELAY);
     for (size_t i = 0; i < s_result.entries_number; i++) {
         const performance_result_entry_t* entry = &s_result.entries[i];
 
-        snprintf(str, sizeof(str), "%s-%i", pcTaskGetName(entry->task_handle), entry->task_number);
+        snprintf(str, sizeof(str), "%s-%u", entry->task_name, entry->task_number);
 
         cb((performance_entry_t) {
                .task_name = str,
                .percentage = entry->percentage,
+               .core_id = entry->core_id,
+               .priority = entry->priority,
+               .stack_high_water_mark = entry->stack_high_water_mark,
            },
             ctx);
     }
     xSemaphoreGive(s_mutex);
-}
\ No newline at end of file
+}
+
+void performance_fetch_summary(performance_summary_t* summary_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    summary_out->interval_ms = s_interval_ms;
+    memcpy(summary_out->core_percentage, s_result.core_percentage, sizeof(s_result.core_percentage));
+    xSemaphoreGive(s_mutex);
+}
@@ -1,14 +1,27 @@
 #pragma once
 
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
 
 typedef struct
 {
     const char* task_name;
     uint8_t percentage;
+    int8_t core_id; // -1 when the task is not pinned to a core
+    uint8_t priority;
+    uint32_t stack_high_water_mark; // Minimum amount of free stack in bytes since the task started
 } performance_entry_t;
 
+typedef struct
+{
+    uint32_t interval_ms;
+    uint8_t core_percentage[portNUM_PROCESSORS];
+} performance_summary_t;
+
 typedef void (*performance_fetch_cb_t)(performance_entry_t, void*);
 
 esp_err_t performance_init(void);
+void performance_set_interval(uint32_t interval_ms);
+
 void performance_fetch(performance_fetch_cb_t cb, void* ctx);
+void performance_fetch_summary(performance_summary_t* summary_out);
@@ -1,25 +1,216 @@
 #include "periodic.h"
 
+#include <esp_log.h>
 #include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <sdkconfig.h>
 
 #include "events.h"
+#include "util.h"
+
+#define TAG "periodic"
+
+#define PERIODIC_MAX_CONSUMERS 8
+#define PERIODIC_MERGE_WINDOW_US (10 * 1000) // Consumers due within this window of each other are dispatched together
+#define PERIODIC_ACTIVITY_HOLD_US (CONFIG_REPORT_ACTIVITY_HOLD_MS * 1000LL)
+
+typedef struct
+{
+    periodic_consumer_config_t config;
+    int64_t interval_us;
+    int64_t deadline_us;
+} periodic_consumer_t;
+
+static periodic_consumer_t s_consumers[PERIODIC_MAX_CONSUMERS];
+static size_t s_consumers_number;
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static esp_timer_handle_t s_timer;
+static int64_t s_active_until_us;
+
+// A single one-shot timer is re-armed for the earliest deadline of all consumers
+static void periodic_arm_unsafe(int64_t now)
+{
+    if (s_consumers_number == 0) {
+        return;
+    }
+
+    int64_t next_us = s_consumers[0].deadline_us;
+    for (size_t i = 1; i < s_consumers_number; ++i) {
+        if (s_consumers[i].deadline_us < next_us) {
+            next_us = s_consumers[i].deadline_us;
+        }
+    }
+
+    esp_timer_stop(s_timer); // Not running when called from the callback
+    ESP_ERROR_CHECK(esp_timer_start_once(s_timer, (next_us > now) ? next_us - now : 1));
+}
 
 static void periodic_timer_callback(void* arg)
 {
-    ESP_ERROR_CHECK(esp_event_post(EVENTS, EVENT_STATUS_PING,
-        NULL, 0, portMAX_DELAY));
+    int32_t due[PERIODIC_MAX_CONSUMERS];
+    size_t due_number = 0;
+    periodic_callback_t callbacks[PERIODIC_MAX_CONSUMERS];
+    size_t callbacks_number = 0;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t now = esp_timer_get_time();
+    const bool active = (now < s_active_until_us);
+
+    for (size_t i = 0; i < s_consumers_number; ++i) {
+        periodic_consumer_t* consumer = &s_consumers[i];
+        if (consumer->deadline_us > now + PERIODIC_MERGE_WINDOW_US) {
+            continue;
+        }
+
+        if (consumer->config.callback != NULL) {
+            callbacks[callbacks_number++] = consumer->config.callback;
+        } else {
+            // Consumers sharing an event are only posted once
+            bool duplicate = false;
+            for (size_t j = 0; j < due_number; ++j) {
+                duplicate |= (due[j] == consumer->config.event_id);
+            }
+            if (!duplicate) {
+                due[due_number++] = consumer->config.event_id;
+            }
+        }
+
+        // Back off exponentially once things have settled
+        const int64_t slow_us = consumer->config.slow_interval_ms * 1000LL;
+        if (active) {
+            consumer->interval_us = consumer->config.fast_interval_ms * 1000LL;
+        } else if (consumer->interval_us < slow_us) {
+            consumer->interval_us = (consumer->interval_us * 2 < slow_us) ? consumer->interval_us * 2 : slow_us;
+        }
+        consumer->deadline_us = now + consumer->interval_us;
+    }
+
+    periodic_arm_unsafe(now);
+    xSemaphoreGive(s_mutex);
+
+    for (size_t i = 0; i < callbacks_number; ++i) {
+        callbacks[i](now);
+    }
+    for (size_t i = 0; i < due_number; ++i) {
+        ESP_ERROR_CHECK(esp_event_post(EVENTS, due[i],
+            NULL, 0, portMAX_DELAY));
+    }
+}
+
+static void periodic_event_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    periodic_activity();
 }
 
 esp_err_t periodic_init(void)
 {
-    const esp_timer_create_args_t periodic_timer_args = {
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    const esp_timer_create_args_t timer_args = {
         .callback = &periodic_timer_callback,
         .name = "report_timer"
     };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_timer));
+
+    // Someone plugging in a probe wants to see it show up
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_SENSOR_ATTACHED, periodic_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_SENSOR_DETACHED, periodic_event_handler, NULL));
+
+    return ESP_OK;
+}
+
+esp_err_t periodic_register(const periodic_consumer_config_t* config)
+{
+    if (config->fast_interval_ms == 0 || config->slow_interval_ms < config->fast_interval_ms) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_consumers_number >= ARRAY_SIZE(s_consumers)) {
+        xSemaphoreGive(s_mutex);
+        return ESP_ERR_NO_MEM;
+    }
+
+    const int64_t now = esp_timer_get_time();
+    periodic_consumer_t* consumer = &s_consumers[s_consumers_number++];
+    *consumer = (periodic_consumer_t) {
+        .config = *config,
+        .interval_us = config->fast_interval_ms * 1000LL,
+        .deadline_us = now + config->fast_interval_ms * 1000LL,
+    };
+    periodic_arm_unsafe(now);
+    xSemaphoreGive(s_mutex);
 
-    esp_timer_handle_t periodic_timer;
-    ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &periodic_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(periodic_timer, 100000));
+    ESP_LOGI(TAG, "Registered %s, %" PRIu32 "ms to %" PRIu32 "ms", config->name, config->fast_interval_ms, config->slow_interval_ms);
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t periodic_reconfigure(const periodic_consumer_config_t* config)
+{
+    if (config->fast_interval_ms == 0 || config->slow_interval_ms < config->fast_interval_ms) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < s_consumers_number; ++i) {
+        periodic_consumer_t* consumer = &s_consumers[i];
+        if (strcmp(consumer->config.name, config->name) != 0) {
+            continue;
+        }
+
+        // Starts over at the fast rate, the back off continues from there
+        consumer->config.fast_interval_ms = config->fast_interval_ms;
+        consumer->config.slow_interval_ms = config->slow_interval_ms;
+        consumer->interval_us = config->fast_interval_ms * 1000LL;
+        consumer->deadline_us = now + consumer->interval_us;
+        periodic_arm_unsafe(now);
+        ret = ESP_OK;
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Reconfigured %s, %" PRIu32 "ms to %" PRIu32 "ms", config->name, config->fast_interval_ms, config->slow_interval_ms);
+    }
+    return ret;
+}
+
+void periodic_activity(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t now = esp_timer_get_time();
+    s_active_until_us = now + PERIODIC_ACTIVITY_HOLD_US;
+
+    // Pull backed off consumers in, so the change is reported within one fast interval
+    bool rearm = false;
+    for (size_t i = 0; i < s_consumers_number; ++i) {
+        periodic_consumer_t* consumer = &s_consumers[i];
+        const int64_t fast_us = consumer->config.fast_interval_ms * 1000LL;
+
+        consumer->interval_us = fast_us;
+        if (consumer->deadline_us > now + fast_us) {
+            consumer->deadline_us = now + fast_us;
+            rearm = true;
+        }
+    }
+    if (rearm) {
+        periodic_arm_unsafe(now);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+bool periodic_is_active(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool active = (esp_timer_get_time() < s_active_until_us);
+    xSemaphoreGive(s_mutex);
+
+    return active;
+}
@@ -1,5 +1,28 @@
 #pragma once
 
 #include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Called from the timer task, must not block
+typedef void (*periodic_callback_t)(int64_t now_us);
+
+typedef struct
+{
+    const char* name;
+    int32_t event_id; // Posted on EVENTS whenever the consumer is due
+    periodic_callback_t callback; // Called instead of posting, for a consumer that only wakes its own task
+    uint32_t fast_interval_ms; // Used while values are changing
+    uint32_t slow_interval_ms; // Backed off to in steady state
+} periodic_consumer_config_t;
 
 esp_err_t periodic_init(void);
+
+esp_err_t periodic_register(const periodic_consumer_config_t* config);
+// Changes the intervals of the consumer registered under config->name
+esp_err_t periodic_reconfigure(const periodic_consumer_config_t* config);
+
+// Something is changing (a fan ramping, the load moving), report at the fast rate for a while
+void periodic_activity(void);
+
+bool periodic_is_active(void);
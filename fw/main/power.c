@@ -0,0 +1,92 @@
+#include "power.h"
+
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <math.h>
+
+#include <sdkconfig.h>
+
+#include "adc.h"
+#include "events.h"
+
+#define TAG "power"
+
+#define POWER_AVERAGE_TIME_CONSTANT_S 60.0f
+
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static esp_pm_lock_handle_t s_busy_lock;
+
+static int64_t s_first_us;
+static int64_t s_last_us;
+static double s_charge_mas; // Integrated bus current since the first sample
+static float s_avg_1m_ma;
+
+static void power_adc_sampled_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    adc_samples_t samples;
+    adc_fetch(&samples);
+    const int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_first_us == 0) {
+        s_first_us = now;
+        s_avg_1m_ma = samples.vbus_ma.mean;
+    } else {
+        // Samples may be bursts far apart in low power mode, so weigh them by the time they represent
+        const float dt_s = (now - s_last_us) / 1e6f;
+        s_charge_mas += samples.vbus_ma.mean * dt_s;
+        s_avg_1m_ma += (samples.vbus_ma.mean - s_avg_1m_ma) * (1.0f - expf(-dt_s / POWER_AVERAGE_TIME_CONSTANT_S));
+    }
+    s_last_us = now;
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t power_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+#ifdef CONFIG_PM_ENABLE
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "busy", &s_busy_lock));
+#endif
+
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ADC_SAMPLED, power_adc_sampled_handler, NULL));
+
+#ifdef CONFIG_POWER_SAVE
+    ESP_LOGI(TAG, "Low power mode");
+#endif
+
+    return ESP_OK;
+}
+
+void power_busy_begin(void)
+{
+    if (s_busy_lock != NULL) {
+        esp_pm_lock_acquire(s_busy_lock);
+    }
+}
+
+void power_busy_end(void)
+{
+    if (s_busy_lock != NULL) {
+        esp_pm_lock_release(s_busy_lock);
+    }
+}
+
+void power_fetch(power_stats_t* stats_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t elapsed_us = s_last_us - s_first_us;
+
+    *stats_out = (power_stats_t) {
+#ifdef CONFIG_POWER_SAVE
+        .low_power = true,
+#endif
+        .vbus_avg_ma = (elapsed_us > 0) ? (uint32_t)(s_charge_mas * 1e6 / elapsed_us) : (uint32_t)s_avg_1m_ma,
+        .vbus_avg_1m_ma = s_avg_1m_ma,
+    };
+    xSemaphoreGive(s_mutex);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    bool low_power;
+    uint32_t vbus_avg_ma; // Since boot
+    uint32_t vbus_avg_1m_ma; // Exponentially weighted, one minute time constant
+} power_stats_t;
+
+esp_err_t power_init(void);
+
+// Keep the CPU at full clock while doing a burst of work, so it finishes quickly and can scale down after
+void power_busy_begin(void);
+void power_busy_end(void);
+
+void power_fetch(power_stats_t* stats_out);
@@ -0,0 +1,307 @@
+#include "settings.h"
+
+#include <driver/gpio.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <nvs.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "events.h"
+#include "util.h"
+
+#define TAG "settings"
+
+#define SETTINGS_NVS_NAMESPACE "settings"
+#define SETTINGS_NVS_KEY "settings"
+#define SETTINGS_VERSION 2 // Bump when the layout of settings_t changes, stored blobs are then ignored
+#define SETTINGS_VERSION_1_SIZE offsetof(settings_t, output_slew_pwm8_per_s) // Fields appended since keep their defaults
+
+// Groups the running firmware picks up only at boot
+#if CONFIG_SUPERVISOR_BUS_HW_MONITOR
+#define SETTINGS_RESTART_GROUPS (SETTINGS_TACHO | SETTINGS_ADC | SETTINGS_CURRENT_SENSE) // The peak monitor threshold
+#else
+#define SETTINGS_RESTART_GROUPS (SETTINGS_TACHO | SETTINGS_ADC)
+#endif
+
+#define SETTINGS_PER_FAN(value) { value, value, value, value, value }
+
+#define SETTINGS_SSID_LEN_MAX 32
+#define SETTINGS_PASSPHRASE_LEN_MIN 8 // WPA2, shorter ones are rejected by the Wi-Fi driver
+#define SETTINGS_PASSPHRASE_LEN_MAX 63
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t size;
+    settings_t settings;
+} settings_blob_t;
+
+static const settings_t s_defaults = {
+    .wifi_ssid = CONFIG_WIFI_SSID,
+    .wifi_passphrase = CONFIG_WIFI_PASSPHRASE,
+    .mqtt_broker_url = CONFIG_MQTT_BROKER_URL,
+    .report_fast_interval_ms = CONFIG_REPORT_FAST_INTERVAL_MS,
+    .report_slow_interval_ms = CONFIG_REPORT_SLOW_INTERVAL_MS,
+    .pwm_frequency_hz = 24000,
+    .tacho_gpio = { 11, 13, 15, 17, 39 },
+    .adc_oversampling = 32,
+    .current_sense_milliohm = 30,
+    .current_sense_gain = 20,
+    .output_slew_pwm8_per_s = SETTINGS_PER_FAN(CONFIG_FANS_OUTPUT_SLEW_PWM8_PER_S),
+    .output_dwell_ms = SETTINGS_PER_FAN(CONFIG_FANS_OUTPUT_DWELL_MS),
+    .output_deadband_pwm8 = SETTINGS_PER_FAN(CONFIG_FANS_OUTPUT_DEADBAND_PWM8),
+    .output_min_pwm8 = SETTINGS_PER_FAN(CONFIG_FANS_OUTPUT_MIN_PWM8),
+};
+
+static settings_t s_settings;
+static settings_t s_boot; // What the boot-only groups were set up with
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static SemaphoreHandle_t s_update_mutex; // Serializes updates, without holding up readers during the flash write
+static StaticSemaphore_t s_update_mutex_buffer;
+
+// Pins the board uses for something else, none of them can take a tacho input
+static const uint8_t s_reserved_gpio[] = {
+    0, 3, 45, 46, // Strapping
+    1, 2, 4, 5, 6, 7, 8, 9, // ADC inputs, adc.c
+    10, 12, 14, 16, 38, 21, // Fan PWM and 12V enable, fans.c
+    19, 20, // USB
+    26, 27, 28, 29, 30, 31, 32, // SPI flash
+    35, 47, 48, // LED, led.c
+    36, 37, 41, 42, // I2C, i2c_bus.c
+    40, // External probe interrupt, temperature.c
+};
+
+static bool settings_gpio_reserved(uint8_t gpio)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(s_reserved_gpio); ++i) {
+        if (s_reserved_gpio[i] == gpio) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The Wi-Fi driver and the MQTT client reject these, after the settings were already stored
+static bool settings_strings_valid(const settings_t* settings)
+{
+    // The strings come in fixed buffers, they have to be terminated within them
+    if (memchr(settings->wifi_ssid, '\0', sizeof(settings->wifi_ssid)) == NULL
+        || memchr(settings->wifi_passphrase, '\0', sizeof(settings->wifi_passphrase)) == NULL
+        || memchr(settings->mqtt_broker_url, '\0', sizeof(settings->mqtt_broker_url)) == NULL) {
+        return false;
+    }
+
+    // Both empty is a controller that was never given a network
+    const size_t ssid_len = strlen(settings->wifi_ssid);
+    const size_t passphrase_len = strlen(settings->wifi_passphrase);
+    if (ssid_len > SETTINGS_SSID_LEN_MAX || (ssid_len == 0 && passphrase_len != 0)) {
+        return false;
+    }
+    if (passphrase_len != 0 && (passphrase_len < SETTINGS_PASSPHRASE_LEN_MIN || passphrase_len > SETTINGS_PASSPHRASE_LEN_MAX)) {
+        return false;
+    }
+
+    static const char* const schemes[] = { "mqtt://", "mqtts://", "ws://", "wss://" };
+    for (size_t i = 0; i < ARRAY_SIZE(schemes); ++i) {
+        const size_t len = strlen(schemes[i]);
+        if (strncmp(settings->mqtt_broker_url, schemes[i], len) == 0 && settings->mqtt_broker_url[len] != '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool settings_valid(const settings_t* settings)
+{
+    if (settings->report_fast_interval_ms < 50 || settings->report_fast_interval_ms > 10000
+        || settings->report_slow_interval_ms < settings->report_fast_interval_ms || settings->report_slow_interval_ms > 600000) {
+        return false;
+    }
+    if (settings->pwm_frequency_hz < 1000 || settings->pwm_frequency_hz > 50000) {
+        return false;
+    }
+    if (settings->adc_oversampling == 0 || settings->adc_oversampling > SETTINGS_ADC_OVERSAMPLING_MAX) {
+        return false;
+    }
+    if (settings->current_sense_milliohm == 0 || settings->current_sense_gain == 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < FANS_COUNT; ++i) {
+        if (settings->output_dwell_ms[i] > 60000 || settings->output_deadband_pwm8[i] > 64) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(settings->tacho_gpio); ++i) {
+        if (settings->tacho_gpio[i] >= GPIO_NUM_MAX || settings_gpio_reserved(settings->tacho_gpio[i])) {
+            return false;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (settings->tacho_gpio[i] == settings->tacho_gpio[j]) {
+                return false;
+            }
+        }
+    }
+
+    return settings_strings_valid(settings);
+}
+
+static uint32_t settings_diff(const settings_t* a, const settings_t* b)
+{
+    uint32_t groups = 0;
+
+    if (strcmp(a->wifi_ssid, b->wifi_ssid) != 0 || strcmp(a->wifi_passphrase, b->wifi_passphrase) != 0) {
+        groups |= SETTINGS_WIFI;
+    }
+    if (strcmp(a->mqtt_broker_url, b->mqtt_broker_url) != 0) {
+        groups |= SETTINGS_MQTT;
+    }
+    if (a->report_fast_interval_ms != b->report_fast_interval_ms || a->report_slow_interval_ms != b->report_slow_interval_ms) {
+        groups |= SETTINGS_REPORT;
+    }
+    if (a->pwm_frequency_hz != b->pwm_frequency_hz) {
+        groups |= SETTINGS_PWM;
+    }
+    if (memcmp(a->tacho_gpio, b->tacho_gpio, sizeof(a->tacho_gpio)) != 0) {
+        groups |= SETTINGS_TACHO;
+    }
+    if (a->adc_oversampling != b->adc_oversampling) {
+        groups |= SETTINGS_ADC;
+    }
+    if (a->current_sense_milliohm != b->current_sense_milliohm || a->current_sense_gain != b->current_sense_gain) {
+        groups |= SETTINGS_CURRENT_SENSE;
+    }
+    if (memcmp(a->output_slew_pwm8_per_s, b->output_slew_pwm8_per_s, sizeof(a->output_slew_pwm8_per_s)) != 0
+        || memcmp(a->output_dwell_ms, b->output_dwell_ms, sizeof(a->output_dwell_ms)) != 0
+        || memcmp(a->output_deadband_pwm8, b->output_deadband_pwm8, sizeof(a->output_deadband_pwm8)) != 0
+        || memcmp(a->output_min_pwm8, b->output_min_pwm8, sizeof(a->output_min_pwm8)) != 0) {
+        groups |= SETTINGS_OUTPUT;
+    }
+
+    return groups;
+}
+
+static bool settings_load_nvs(settings_t* settings)
+{
+    nvs_handle_t handle;
+    if (nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    settings_blob_t blob;
+    size_t length = sizeof(blob);
+    esp_err_t ret = nvs_get_blob(handle, SETTINGS_NVS_KEY, &blob, &length);
+    nvs_close(handle);
+
+    // Version 1 only lacks the output conditioning at the end
+    if (ret == ESP_OK && blob.version == 1 && blob.size >= SETTINGS_VERSION_1_SIZE && blob.size < sizeof(blob.settings)
+        && length == offsetof(settings_blob_t, settings) + blob.size) {
+        settings_t migrated = s_defaults;
+        memcpy(&migrated, &blob.settings, SETTINGS_VERSION_1_SIZE);
+        blob.settings = migrated;
+        ESP_LOGI(TAG, "Migrated stored settings from version 1");
+    } else if (ret != ESP_OK || length != sizeof(blob) || blob.version != SETTINGS_VERSION || blob.size != sizeof(blob.settings)) {
+        ESP_LOGW(TAG, "Ignoring stored settings (%s, %u bytes)", esp_err_to_name(ret), (unsigned int)length);
+        return false;
+    }
+    if (!settings_valid(&blob.settings)) {
+        ESP_LOGW(TAG, "Ignoring invalid stored settings");
+        return false;
+    }
+
+    *settings = blob.settings;
+    return true;
+}
+
+// One blob, so a power loss during the write leaves either the old or the new settings
+static esp_err_t settings_store_nvs(const settings_t* settings)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    const settings_blob_t blob = {
+        .version = SETTINGS_VERSION,
+        .size = sizeof(blob.settings),
+        .settings = *settings,
+    };
+
+    ERROR_CHECK_SIMPLE(nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &handle));
+    ret = nvs_set_blob(handle, SETTINGS_NVS_KEY, &blob, sizeof(blob));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    ERROR_CHECK_SIMPLE(ret);
+
+    return ESP_OK;
+err:
+    return ret;
+}
+
+esp_err_t settings_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+    s_update_mutex = xSemaphoreCreateMutexStatic(&s_update_mutex_buffer);
+
+    if (settings_load_nvs(&s_settings)) {
+        ESP_LOGI(TAG, "Loaded settings from NVS");
+    } else {
+        s_settings = s_defaults;
+    }
+    s_boot = s_settings;
+
+    return ESP_OK;
+}
+
+void settings_fetch(settings_t* settings)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *settings = s_settings;
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t settings_update(const settings_t* settings)
+{
+    if (!settings_valid(settings)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_update_mutex, portMAX_DELAY);
+    settings_t current;
+    settings_fetch(&current);
+
+    const uint32_t groups = settings_diff(&current, settings);
+    esp_err_t ret = (groups != 0) ? settings_store_nvs(settings) : ESP_OK;
+    if (ret == ESP_OK && groups != 0) {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_settings = *settings;
+        xSemaphoreGive(s_mutex);
+
+        ESP_LOGI(TAG, "Updated settings (groups 0x%02x)", (unsigned int)groups);
+        ESP_ERROR_CHECK(esp_event_post(EVENTS, EVENT_SETTINGS_CHANGED,
+            &groups, sizeof(groups), portMAX_DELAY));
+    }
+    xSemaphoreGive(s_update_mutex);
+
+    return ret;
+}
+
+esp_err_t settings_reset(void)
+{
+    return settings_update(&s_defaults);
+}
+
+uint32_t settings_restart_pending(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const uint32_t groups = settings_diff(&s_boot, &s_settings);
+    xSemaphoreGive(s_mutex);
+
+    return groups & SETTINGS_RESTART_GROUPS;
+}
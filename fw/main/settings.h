@@ -0,0 +1,52 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+#include "fans.h"
+
+#define SETTINGS_ADC_OVERSAMPLING_MAX 64
+
+// Parts of the settings, an update posts EVENT_SETTINGS_CHANGED with the mask of the ones it changed
+typedef enum {
+    SETTINGS_WIFI = (1 << 0),
+    SETTINGS_MQTT = (1 << 1),
+    SETTINGS_REPORT = (1 << 2),
+    SETTINGS_PWM = (1 << 3),
+    SETTINGS_TACHO = (1 << 4),
+    SETTINGS_ADC = (1 << 5),
+    SETTINGS_CURRENT_SENSE = (1 << 6),
+    SETTINGS_OUTPUT = (1 << 7),
+} settings_group_t;
+
+typedef struct
+{
+    char wifi_ssid[33];
+    char wifi_passphrase[65];
+    char mqtt_broker_url[128];
+    uint32_t report_fast_interval_ms;
+    uint32_t report_slow_interval_ms;
+    uint32_t pwm_frequency_hz;
+    uint8_t tacho_gpio[FANS_COUNT];
+    uint8_t adc_oversampling;
+    uint16_t current_sense_milliohm;
+    uint16_t current_sense_gain;
+    // Output conditioning per fan, added in version 2
+    uint16_t output_slew_pwm8_per_s[FANS_COUNT]; // 0 follows the command at once
+    uint16_t output_dwell_ms[FANS_COUNT];
+    uint8_t output_deadband_pwm8[FANS_COUNT];
+    uint8_t output_min_pwm8[FANS_COUNT]; // 0 uses the minimum learned from stalls
+} settings_t;
+
+// Loads the settings from NVS once, falls back to the build defaults
+esp_err_t settings_init(void);
+
+// Copies the cached settings, never touches NVS
+void settings_fetch(settings_t* settings);
+
+// All or nothing: validates, persists as a single NVS blob, then swaps the cached copy
+esp_err_t settings_update(const settings_t* settings);
+esp_err_t settings_reset(void);
+
+// Groups changed since boot that only take effect after a restart
+uint32_t settings_restart_pending(void);
@@ -0,0 +1,142 @@
+#pragma once
+
+// Schema of the CBOR status report written by data_status_to_cbor, the same data as the JSON one
+// with integer keys. Per fan values are arrays in fan order, and records that are always complete
+// (ADC samples, histograms, counters) are arrays in the order noted. Energy is in integer µJ
+// rather than Wh. Free of ESP-IDF headers so host side decoders can include it.
+//
+// Keys are only ever appended, removing or reordering anything bumps STATUS_CBOR_SCHEMA_VERSION.
+
+#define STATUS_CBOR_SCHEMA_VERSION 1
+
+typedef enum {
+    STATUS_CBOR_SCHEMA = 0, // STATUS_CBOR_SCHEMA_VERSION, always first
+    STATUS_CBOR_ID,
+    STATUS_CBOR_FREE_HEAP,
+    STATUS_CBOR_MINIMUM_HEAP,
+    STATUS_CBOR_FREE_HEAP_INTERNAL,
+    STATUS_CBOR_MINIMUM_HEAP_INTERNAL,
+    STATUS_CBOR_JSON_POOL, // [blocks, block_size, used, peak, fallbacks]
+    STATUS_CBOR_CHIP_REVISION,
+    STATUS_CBOR_ESP_IDF_VERSION,
+    STATUS_CBOR_APP_VERSION,
+    STATUS_CBOR_APP_HASH,
+    STATUS_CBOR_COMPILE_DATE,
+    STATUS_CBOR_COMPILE_TIME,
+    STATUS_CBOR_RUNTIME_US,
+    STATUS_CBOR_RESET_REASON,
+    STATUS_CBOR_DUTY, // [pwm8] per fan
+    STATUS_CBOR_POWER, // status_cbor_power_t
+    STATUS_CBOR_ENERGY, // status_cbor_energy_t
+    STATUS_CBOR_SUPERVISOR, // status_cbor_supervisor_t
+    STATUS_CBOR_OTA, // status_cbor_ota_t
+    STATUS_CBOR_TACHO, // [rpm] per fan
+    STATUS_CBOR_HEALTH, // [status_cbor_health_t] per fan
+    STATUS_CBOR_SENSORS, // status_cbor_sensors_t
+    STATUS_CBOR_LATENCY, // status_cbor_latency_t
+    STATUS_CBOR_PERFORMANCE, // status_cbor_performance_t
+    STATUS_CBOR_OUTPUT, // [[pwm8, min_pwm8]] per fan
+    STATUS_CBOR_BOOT, // status_cbor_boot_t
+    STATUS_CBOR_WATCHDOG, // status_cbor_watchdog_t
+} status_cbor_t;
+
+// A sample is [rms, max, mean, min, p95, p99], the peak-to-peak ripple is max - min
+typedef enum {
+    STATUS_CBOR_POWER_VBUS_MV = 0, // sample
+    STATUS_CBOR_POWER_VBUS_MA, // sample
+    STATUS_CBOR_POWER_VFAN_MV, // sample
+    STATUS_CBOR_POWER_VFAN_MA, // [sample] per fan
+    STATUS_CBOR_POWER_VBUS_MW,
+    STATUS_CBOR_POWER_VFAN_MW, // [mW] per fan
+    STATUS_CBOR_POWER_LOW_POWER,
+    STATUS_CBOR_POWER_VBUS_AVG_MA,
+    STATUS_CBOR_POWER_VBUS_AVG_1M_MA,
+    STATUS_CBOR_POWER_ADC, // [frames, pool_overflows, sample_freq_hz, frame_conversions]
+} status_cbor_power_t;
+
+typedef enum {
+    STATUS_CBOR_ENERGY_VBUS_UJ = 0,
+    STATUS_CBOR_ENERGY_VFAN_UJ, // [µJ] per fan
+    STATUS_CBOR_ENERGY_NVS_WRITES,
+    STATUS_CBOR_ENERGY_PERSISTED_US,
+} status_cbor_energy_t;
+
+// A trip is [time_us, current_ma, hardware], or null when not tripped
+typedef enum {
+    STATUS_CBOR_SUPERVISOR_TRIPPED = 0,
+    STATUS_CBOR_SUPERVISOR_TRIPS,
+    STATUS_CBOR_SUPERVISOR_BUS, // trip
+    STATUS_CBOR_SUPERVISOR_FANS, // [trip] per fan
+} status_cbor_supervisor_t;
+
+typedef enum {
+    STATUS_CBOR_OTA_RUNNING = 0,
+    STATUS_CBOR_OTA_PENDING_VERIFY,
+    STATUS_CBOR_OTA_STATE,
+    STATUS_CBOR_OTA_WRITTEN,
+    STATUS_CBOR_OTA_SIZE,
+    STATUS_CBOR_OTA_ERROR, // Only after a failed upload
+} status_cbor_ota_t;
+
+typedef enum {
+    STATUS_CBOR_HEALTH_STATE = 0,
+    STATUS_CBOR_HEALTH_SINCE_US,
+    STATUS_CBOR_HEALTH_STALLS,
+    STATUS_CBOR_HEALTH_KICKS,
+    STATUS_CBOR_HEALTH_FAULT, // Fault and its time only once there was one
+    STATUS_CBOR_HEALTH_FAULT_US,
+} status_cbor_health_t;
+
+// Readings are [temperature_mc, rel_hum_mperct], bus statistics [transactions, errors, timeouts,
+// recoveries], both left out for a sensor that has none yet
+typedef enum {
+    STATUS_CBOR_SENSORS_ON_BOARD = 0,
+    STATUS_CBOR_SENSORS_EXTERNAL,
+    STATUS_CBOR_SENSORS_EXTERNAL_PRESENT,
+    STATUS_CBOR_SENSORS_I2C_ON_BOARD,
+    STATUS_CBOR_SENSORS_I2C_EXTERNAL,
+} status_cbor_sensors_t;
+
+// Histograms are [count, min, p50, p99, max] in µs
+typedef enum {
+    STATUS_CBOR_LATENCY_STAGES = 0, // {stage name: histogram}
+    STATUS_CBOR_LATENCY_RPM_TIMEOUTS,
+} status_cbor_latency_t;
+
+typedef enum {
+    STATUS_CBOR_PERFORMANCE_INTERVAL_MS = 0,
+    STATUS_CBOR_PERFORMANCE_CORES, // [percentage] per core
+    STATUS_CBOR_PERFORMANCE_TASKS, // {task name: [percentage, core, priority, stack_free]}
+    STATUS_CBOR_PERFORMANCE_WAKEUP, // {task name: histogram}
+} status_cbor_performance_t;
+
+typedef enum {
+    STATUS_CBOR_BOOT_DONE_US = 0, // 0 while stages are still running
+    STATUS_CBOR_BOOT_FANS_RESUME, // fans_resume_source_t, 0 none, 1 RTC, 2 NVS
+    STATUS_CBOR_BOOT_STAGES, // {stage name: duration_us}
+    STATUS_CBOR_BOOT_PARALLEL, // [stage name] of the stages that ran in the parallel lane
+} status_cbor_boot_t;
+
+typedef enum {
+    STATUS_CBOR_WATCHDOG_FAULTS = 0,
+    STATUS_CBOR_WATCHDOG_TASKS, // {task name: [watchdog_state_t, processed, lost, misses, restarts]}
+} status_cbor_watchdog_t;
+
+// Telemetry frames sent over UDP multicast by telemetry.c, one array in this order. Positions are
+// only ever appended, anything else bumps STATUS_CBOR_TELEMETRY_VERSION.
+#define STATUS_CBOR_TELEMETRY_VERSION 1
+
+typedef enum {
+    STATUS_CBOR_TELEMETRY_FORMAT = 0, // STATUS_CBOR_TELEMETRY_VERSION
+    STATUS_CBOR_TELEMETRY_SEQUENCE, // Counts up from 0 at boot, a gap is a lost frame
+    STATUS_CBOR_TELEMETRY_TIMESTAMP_US, // Since boot, when the frame was taken
+    STATUS_CBOR_TELEMETRY_ID,
+    STATUS_CBOR_TELEMETRY_DUTY, // [pwm8] per fan
+    STATUS_CBOR_TELEMETRY_RPM, // [rpm] per fan
+    STATUS_CBOR_TELEMETRY_VFAN_MA, // [rms] per fan
+    STATUS_CBOR_TELEMETRY_VBUS_MV, // rms
+    STATUS_CBOR_TELEMETRY_VBUS_MA, // rms
+    STATUS_CBOR_TELEMETRY_VBUS_MW,
+    STATUS_CBOR_TELEMETRY_TRIPPED,
+    STATUS_CBOR_TELEMETRY_TEMPERATURE_MC, // External probe, else on-board, null without a reading
+} status_cbor_telemetry_t;
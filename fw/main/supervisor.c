@@ -0,0 +1,108 @@
+#include "supervisor.h"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "periodic.h"
+#include "util.h"
+
+#define TAG "supervisor"
+
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static supervisor_state_t s_state;
+static volatile bool s_bus_hw_tripped;
+
+static bool supervisor_latch_unsafe(supervisor_trip_t* trip, bool hardware, uint16_t current_ma)
+{
+    if (trip->tripped) {
+        return false;
+    }
+
+    *trip = (supervisor_trip_t) {
+        .tripped = true,
+        .hardware = hardware,
+        .time_us = esp_timer_get_time(),
+        .current_ma = current_ma,
+    };
+    s_state.trips++;
+    return true;
+}
+
+esp_err_t supervisor_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+
+    return ESP_OK;
+}
+
+void supervisor_check(const adc_samples_t* samples)
+{
+    bool changed = false;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    // The ISR already cut the supply, cut it again in case a fan update raced it, the ISR only fires once
+    if (s_bus_hw_tripped) {
+        fans_bus_cutoff();
+    }
+    if (s_bus_hw_tripped && supervisor_latch_unsafe(&s_state.bus, true, samples->vbus_ma.max)) {
+        ESP_LOGE(TAG, "Bus current peak above the monitor threshold, supply cut");
+        changed = true;
+    }
+
+    if (samples->vbus_ma.rms > CONFIG_SUPERVISOR_BUS_LIMIT_MA && !s_state.bus.tripped) {
+        fans_bus_cutoff();
+        supervisor_latch_unsafe(&s_state.bus, false, samples->vbus_ma.rms);
+        ESP_LOGE(TAG, "Bus current %umA above %dmA, supply cut", samples->vbus_ma.rms, CONFIG_SUPERVISOR_BUS_LIMIT_MA);
+        changed = true;
+    }
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(s_state.fans); ++i) {
+        if (samples->vfan_ma[i].rms > CONFIG_SUPERVISOR_FAN_LIMIT_MA && !s_state.fans[i].tripped) {
+            fans_trip(i);
+            supervisor_latch_unsafe(&s_state.fans[i], false, samples->vfan_ma[i].rms);
+            ESP_LOGE(TAG, "Fan %u current %umA above %dmA, channel off", i + 1, samples->vfan_ma[i].rms, CONFIG_SUPERVISOR_FAN_LIMIT_MA);
+            changed = true;
+        }
+    }
+
+    xSemaphoreGive(s_mutex);
+
+    if (changed) {
+        periodic_activity();
+    }
+}
+
+void IRAM_ATTR supervisor_bus_trip_from_isr(void)
+{
+    if (!s_bus_hw_tripped) {
+        fans_bus_cutoff();
+        s_bus_hw_tripped = true;
+    }
+}
+
+void supervisor_fetch(supervisor_state_t* state_out)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    memcpy(state_out, &s_state, sizeof(s_state));
+    xSemaphoreGive(s_mutex);
+}
+
+void supervisor_clear(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_state.bus = (supervisor_trip_t) { 0 };
+    memset(s_state.fans, 0, sizeof(s_state.fans));
+    s_bus_hw_tripped = false;
+    fans_trip_clear();
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGI(TAG, "Trips cleared");
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adc.h"
+#include "fans.h"
+
+typedef struct
+{
+    bool tripped;
+    bool hardware; // Caught by the ADC digital monitor rather than a frame average
+    int64_t time_us;
+    uint16_t current_ma;
+} supervisor_trip_t;
+
+typedef struct
+{
+    supervisor_trip_t bus;
+    supervisor_trip_t fans[FANS_COUNT];
+    uint32_t trips; // Since boot
+} supervisor_state_t;
+
+esp_err_t supervisor_init(void);
+
+// Evaluate the limits against one ADC frame, called from the ADC task
+void supervisor_check(const adc_samples_t* samples);
+
+// The bus current crossed the hardware monitor threshold, called from the ADC monitor ISR
+void supervisor_bus_trip_from_isr(void);
+
+void supervisor_fetch(supervisor_state_t* state_out);
+
+// Release all latched trips, channels come back at their commanded duty
+void supervisor_clear(void);
@@ -7,18 +7,21 @@
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
 
+#include "latency.h"
+#include "settings.h"
+#include "tasks.h"
+#include "trace.h"
 #include "util.h"
+#include "watchdog.h"
 
 #define TAG "tacho"
 
-#define GPIO_FAN1_TACHO (11)
-#define GPIO_FAN2_TACHO (13)
-#define GPIO_FAN3_TACHO (15)
-#define GPIO_FAN4_TACHO (17)
-#define GPIO_FAN5_TACHO (39)
-
 #define TACHO_DELTA_GLITCH_FILTER_US 1000 // 1 millisecond or 60000RPM
 #define TACHO_READING_MAX_AGE_US 1000000 // 1 seconds or 60RPM
+#define TACHO_QUEUE_LEN 10
+#define TACHO_RESTART_LOCK_MS 20 // Readers only hold the mutex for a copy
+#define TACHO_IDLE_BEAT_MS 250 // Stopped fans send no edges, the task still has to show it is alive
+#define TACHO_DEADLINE_MS 1000
 
 typedef struct
 {
@@ -34,7 +37,11 @@ typedef struct
 
 static tacho_fan_state_t s_tacho_fan_state[5];
 static QueueHandle_t s_event_queue = NULL;
+static StaticQueue_t s_event_queue_buffer;
+static uint8_t s_event_queue_storage[TACHO_QUEUE_LEN * sizeof(tacho_event_t)];
 static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static TaskHandle_t s_task_handle;
 
 static void IRAM_ATTR gpio_isr_handler(void* arg)
 {
@@ -43,49 +50,90 @@ static void IRAM_ATTR gpio_isr_handler(void* arg)
         .time = esp_timer_get_time(),
     };
 
-    xQueueSendFromISR(s_event_queue, &event, NULL);
+    if (xQueueSendFromISR(s_event_queue, &event, NULL) != pdTRUE) {
+        watchdog_lost(TASK_TACHO, 1);
+    }
+}
+
+static void tacho_event_process(const tacho_event_t* event)
+{
+    tacho_fan_state_t* state = &s_tacho_fan_state[event->gpio_i];
+    uint64_t delta = event->time - state->last_time;
+
+    if (delta >= TACHO_DELTA_GLITCH_FILTER_US) // Glitch filter
+    {
+        // The latency lock is only ever taken inside ours, so a restart that holds ours knows the task holds neither
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        state->delta = delta;
+        state->last_time = event->time;
+        latency_rpm_observed(event->gpio_i, (60 * 1000 * 1000) / delta);
+        xSemaphoreGive(s_mutex);
+    }
 }
 
 static void tacho_task(void* arg)
 {
+    // The pin mapping is only read here, changes take effect after a restart
+    settings_t settings;
+    settings_fetch(&settings);
+
+    uint64_t pin_bit_mask = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(settings.tacho_gpio); ++i) {
+        pin_bit_mask |= 1ULL << settings.tacho_gpio[i];
+    }
+
     gpio_config_t io_conf = {
         .intr_type = GPIO_INTR_POSEDGE,
         .mode = GPIO_MODE_INPUT,
-        .pin_bit_mask = (1ULL << GPIO_FAN1_TACHO) | (1ULL << GPIO_FAN2_TACHO) | (1ULL << GPIO_FAN3_TACHO) | (1ULL << GPIO_FAN4_TACHO) | (1ULL << GPIO_FAN5_TACHO),
+        .pin_bit_mask = pin_bit_mask,
         .pull_down_en = 0,
         .pull_up_en = 0,
     };
     gpio_config(&io_conf);
 
     gpio_install_isr_service(0);
-    gpio_isr_handler_add(GPIO_FAN1_TACHO, gpio_isr_handler, (void*)0);
-    gpio_isr_handler_add(GPIO_FAN2_TACHO, gpio_isr_handler, (void*)1);
-    gpio_isr_handler_add(GPIO_FAN3_TACHO, gpio_isr_handler, (void*)2);
-    gpio_isr_handler_add(GPIO_FAN4_TACHO, gpio_isr_handler, (void*)3);
-    gpio_isr_handler_add(GPIO_FAN5_TACHO, gpio_isr_handler, (void*)4);
+    for (size_t i = 0; i < ARRAY_SIZE(settings.tacho_gpio); ++i) {
+        gpio_isr_handler_add(settings.tacho_gpio[i], gpio_isr_handler, (void*)i);
+    }
 
     tacho_event_t event;
     while (1) {
-        if (xQueueReceive(s_event_queue, &event, portMAX_DELAY)) {
-            tacho_fan_state_t* state = &s_tacho_fan_state[event.gpio_i];
-            uint64_t delta = event.time - state->last_time;
-
-            if (delta >= TACHO_DELTA_GLITCH_FILTER_US) // Glitch filter
-            {
-                xSemaphoreTake(s_mutex, portMAX_DELAY);
-                state->delta = delta;
-                state->last_time = event.time;
-                xSemaphoreGive(s_mutex);
-            }
+        if (xQueueReceive(s_event_queue, &event, pdMS_TO_TICKS(TACHO_IDLE_BEAT_MS))) {
+            tasks_wakeup(TASK_TACHO, event.time);
+            TRACE_SPAN_BEGIN(TACHO_EDGE);
+            tacho_event_process(&event);
+            TRACE_SPAN_END(TACHO_EDGE);
+            watchdog_beat(TASK_TACHO, 1);
+        } else {
+            watchdog_beat(TASK_TACHO, 0);
         }
     }
 }
 
+// The queue keeps the edges while the task is gone. Holding the mutex keeps the task out of its locked
+// section until it is deleted, a task stuck inside it cannot be restarted.
+static bool tacho_restart(void)
+{
+    if (xSemaphoreTake(s_mutex, pdMS_TO_TICKS(TACHO_RESTART_LOCK_MS)) != pdTRUE) {
+        return false;
+    }
+    ESP_ERROR_CHECK(tasks_restart(TASK_TACHO, s_task_handle, tacho_task, NULL, &s_task_handle));
+    xSemaphoreGive(s_mutex);
+
+    return true;
+}
+
 esp_err_t tacho_init(void)
 {
-    s_mutex = xSemaphoreCreateMutex();
-    s_event_queue = xQueueCreate(10, sizeof(tacho_event_t));
-    xTaskCreate(tacho_task, "tacho", 1024 * 4, NULL, 10, NULL);
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+    s_event_queue = xQueueCreateStatic(TACHO_QUEUE_LEN, sizeof(tacho_event_t), s_event_queue_storage, &s_event_queue_buffer);
+
+    const watchdog_config_t watchdog = {
+        .deadline_ms = TACHO_DEADLINE_MS,
+        .restart = tacho_restart,
+    };
+    ESP_ERROR_CHECK(watchdog_register(TASK_TACHO, &watchdog));
+    ESP_ERROR_CHECK(tasks_create(TASK_TACHO, tacho_task, NULL, &s_task_handle));
 
     return ESP_OK;
 }
@@ -103,4 +151,16 @@ void tacho_fetch(tacho_fans_rpm_t fans)
         fans[i] = rpm;
     }
     xSemaphoreGive(s_mutex);
-}
\ No newline at end of file
+}
+
+void tacho_fetch_edges(tacho_edges_t edges)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < ARRAY_SIZE(s_tacho_fan_state); ++i) {
+        edges[i] = (tacho_edge_t) {
+            .last_us = s_tacho_fan_state[i].last_time,
+            .period_us = s_tacho_fan_state[i].delta,
+        };
+    }
+    xSemaphoreGive(s_mutex);
+}
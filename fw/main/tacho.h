@@ -5,6 +5,15 @@
 typedef uint32_t tacho_fan_rpm_t;
 typedef tacho_fan_rpm_t tacho_fans_rpm_t[5];
 
+typedef struct
+{
+    uint64_t last_us; // Time of the last edge, 0 if none was seen yet
+    uint64_t period_us;
+} tacho_edge_t;
+typedef tacho_edge_t tacho_edges_t[5];
+
 esp_err_t tacho_init(void);
 
 void tacho_fetch(tacho_fans_rpm_t fans);
+// Raw edge timing, for callers that need to notice a stop sooner than the RPM reading expires
+void tacho_fetch_edges(tacho_edges_t edges);
@@ -0,0 +1,151 @@
+#include "tasks.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <sdkconfig.h>
+
+#include "util.h"
+
+#define TAG "tasks"
+
+#if CONFIG_TASKS_PIN_CORES
+#define TASKS_CORE(core) (core)
+#else
+#define TASKS_CORE(core) tskNO_AFFINITY
+#endif
+
+// Stack sizes in bytes, shared by the table and the static stacks
+#define TASKS_STACK_TACHO (1024 * 4)
+#define TASKS_STACK_ADC (1024 * 4)
+#define TASKS_STACK_CONTROL (1024 * 3)
+#define TASKS_STACK_I2C (1024 * 3)
+#define TASKS_STACK_TEMPERATURE (1024 * 4)
+#define TASKS_STACK_PERFORMANCE (1024 * 4)
+#define TASKS_STACK_NETWORK (1024 * 6)
+
+#define TASKS_RESTART_CLEANUP_TICKS 2
+
+// Every firmware task, and the component tasks that take their settings from us. For reference, the
+// IDF defaults are Wi-Fi 23, esp_timer 22, the default event loop 20 and lwIP 18, on the network core.
+static const task_config_t s_tasks[TASK_MAX_COUNT] = {
+    // Control loop, alone on its core so nothing but interrupts delays it
+    [TASK_TACHO] = { "tacho", TASKS_CORE(TASKS_CORE_REALTIME), 14, TASKS_STACK_TACHO, true },
+    [TASK_ADC] = { "adc", TASKS_CORE(TASKS_CORE_REALTIME), 13, TASKS_STACK_ADC, true },
+    [TASK_CONTROL] = { "control", TASKS_CORE(TASKS_CORE_REALTIME), 12, TASKS_STACK_CONTROL, true },
+
+    // Housekeeping, fills whatever time is left on either core
+    [TASK_I2C_PRIMARY] = { "i2c_primary", tskNO_AFFINITY, 8, TASKS_STACK_I2C, false },
+    [TASK_I2C_EXTERNAL] = { "i2c_external", tskNO_AFFINITY, 8, TASKS_STACK_I2C, false },
+    [TASK_TEMPERATURE] = { "temperature", tskNO_AFFINITY, 7, TASKS_STACK_TEMPERATURE, false },
+    [TASK_PERFORMANCE] = { "performance", tskNO_AFFINITY, 3, TASKS_STACK_PERFORMANCE, false },
+
+    // Networking, next to Wi-Fi and lwIP
+    [TASK_HTTPD] = { "httpd", TASKS_CORE(TASKS_CORE_NETWORK), 5, TASKS_STACK_NETWORK, false },
+    [TASK_MQTT] = { "mqtt_task", TASKS_CORE(TASKS_CORE_NETWORK), 5, TASKS_STACK_NETWORK, false },
+    // Parallel boot lane, on whichever core app_main is not using
+    [TASK_BOOT] = { "boot", tskNO_AFFINITY, 2, TASKS_STACK_NETWORK, false },
+};
+
+#if CONFIG_STATIC_ALLOCATION
+typedef struct
+{
+    StackType_t* stack;
+    StaticTask_t tcb;
+} task_storage_t;
+
+static StackType_t s_stack_tacho[TASKS_STACK_TACHO];
+static StackType_t s_stack_adc[TASKS_STACK_ADC];
+static StackType_t s_stack_control[TASKS_STACK_CONTROL];
+static StackType_t s_stack_i2c_primary[TASKS_STACK_I2C];
+static StackType_t s_stack_i2c_external[TASKS_STACK_I2C];
+static StackType_t s_stack_temperature[TASKS_STACK_TEMPERATURE];
+static StackType_t s_stack_performance[TASKS_STACK_PERFORMANCE];
+
+// The HTTP server and MQTT client allocate their own stacks, once when they start. The boot lane
+// takes its stack from the heap and gives it back when it ends.
+static task_storage_t s_storage[TASK_MAX_COUNT] = {
+    [TASK_TACHO] = { s_stack_tacho },
+    [TASK_ADC] = { s_stack_adc },
+    [TASK_CONTROL] = { s_stack_control },
+    [TASK_I2C_PRIMARY] = { s_stack_i2c_primary },
+    [TASK_I2C_EXTERNAL] = { s_stack_i2c_external },
+    [TASK_TEMPERATURE] = { s_stack_temperature },
+    [TASK_PERFORMANCE] = { s_stack_performance },
+};
+#endif
+
+// Only the task itself writes its histogram, readers accept slightly torn snapshots
+static histogram_t s_wakeup[TASK_MAX_COUNT];
+
+const task_config_t* tasks_config(task_id_t id)
+{
+    return (id < ARRAY_SIZE(s_tasks)) ? &s_tasks[id] : NULL;
+}
+
+esp_err_t tasks_create(task_id_t id, TaskFunction_t fn, void* arg, TaskHandle_t* handle_out)
+{
+    const task_config_t* config = tasks_config(id);
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#if CONFIG_STATIC_ALLOCATION
+    // StackType_t is a byte on the ESP32, the stack depth is in bytes like for xTaskCreate()
+    task_storage_t* storage = &s_storage[id];
+    if (storage->stack != NULL) {
+        TaskHandle_t handle = xTaskCreateStaticPinnedToCore(fn, config->name, config->stack_size, arg, config->priority,
+            storage->stack, &storage->tcb, config->core_id);
+        if (handle_out != NULL) {
+            *handle_out = handle;
+        }
+        return ESP_OK;
+    }
+#endif
+
+    if (xTaskCreatePinnedToCore(fn, config->name, config->stack_size, arg, config->priority, handle_out, config->core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Creating %s failed", config->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tasks_restart(task_id_t id, TaskHandle_t handle, TaskFunction_t fn, void* arg, TaskHandle_t* handle_out)
+{
+    if (tasks_config(id) == NULL || handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    vTaskDelete(handle);
+
+#if CONFIG_STATIC_ALLOCATION
+    // A task running on the other core is only unlinked by that core's idle task, which runs right
+    // away once the task is gone. Its control block and stack must not be reused before.
+    if (s_storage[id].stack != NULL) {
+        vTaskDelay(TASKS_RESTART_CLEANUP_TICKS);
+    }
+#endif
+
+    return tasks_create(id, fn, arg, handle_out);
+}
+
+void tasks_wakeup(task_id_t id, int64_t ready_us)
+{
+    if (id >= ARRAY_SIZE(s_wakeup) || ready_us == 0) {
+        return;
+    }
+
+    int64_t elapsed = esp_timer_get_time() - ready_us;
+    histogram_record(&s_wakeup[id], (elapsed < 0) ? 0 : ((elapsed > UINT32_MAX) ? UINT32_MAX : elapsed));
+}
+
+bool tasks_fetch_wakeup(task_id_t id, histogram_stats_t* stats_out)
+{
+    if (id >= ARRAY_SIZE(s_wakeup)) {
+        return false;
+    }
+
+    histogram_t snapshot = s_wakeup[id];
+    return histogram_stats(&snapshot, stats_out);
+}
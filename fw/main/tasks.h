@@ -0,0 +1,46 @@
+#pragma once
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+
+#include "histogram.h"
+
+// Wi-Fi and lwIP are pinned to the PRO CPU in sdkconfig.default, the APP CPU is left to the control loop
+#define TASKS_CORE_NETWORK 0
+#define TASKS_CORE_REALTIME 1
+
+typedef enum {
+    TASK_TACHO,
+    TASK_ADC,
+    TASK_CONTROL,
+    TASK_I2C_PRIMARY,
+    TASK_I2C_EXTERNAL,
+    TASK_TEMPERATURE,
+    TASK_PERFORMANCE,
+    TASK_HTTPD,
+    TASK_MQTT,
+    TASK_BOOT,
+    TASK_MAX_COUNT,
+} task_id_t;
+
+typedef struct
+{
+    const char* name;
+    BaseType_t core_id; // tskNO_AFFINITY to let the scheduler pick
+    UBaseType_t priority;
+    uint32_t stack_size;
+    bool realtime; // Wake-up latency is recorded
+} task_config_t;
+
+const task_config_t* tasks_config(task_id_t id);
+
+esp_err_t tasks_create(task_id_t id, TaskFunction_t fn, void* arg, TaskHandle_t* handle_out);
+// Deletes the task and creates it again in the same storage, for a task that stopped responding
+esp_err_t tasks_restart(task_id_t id, TaskHandle_t handle, TaskFunction_t fn, void* arg, TaskHandle_t* handle_out);
+
+// Called by a real-time task once it runs, with the time it was made ready (e.g. by an ISR)
+void tasks_wakeup(task_id_t id, int64_t ready_us);
+
+bool tasks_fetch_wakeup(task_id_t id, histogram_stats_t* stats_out);
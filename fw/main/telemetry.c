@@ -0,0 +1,146 @@
+#include "telemetry.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sdkconfig.h>
+
+#include "cbor.h"
+#include "data.h"
+#include "events.h"
+#include "trace.h"
+
+#define TAG "telemetry"
+
+#ifdef CONFIG_TELEMETRY_UDP
+
+#define TELEMETRY_FRAME_SIZE 128 // A frame is about 90 bytes, well within one datagram
+#define TELEMETRY_TTL 1 // Stays on the local network
+#define TELEMETRY_INTERVAL_US (CONFIG_TELEMETRY_INTERVAL_MS * 1000LL)
+
+// Only touched by the handlers below, which all run on the event loop
+static uint8_t s_frame[TELEMETRY_FRAME_SIZE];
+static int s_socket = -1;
+static struct sockaddr_in s_group;
+static uint32_t s_sequence;
+static int64_t s_last_us;
+static bool s_failing;
+
+static void telemetry_close(void)
+{
+    if (s_socket >= 0) {
+        close(s_socket);
+        s_socket = -1;
+    }
+}
+
+static esp_err_t telemetry_open(void)
+{
+    s_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s_socket < 0) {
+        ESP_LOGE(TAG, "Creating the socket failed: %d", errno);
+        return ESP_FAIL;
+    }
+
+    // lwIP takes the multicast options as single bytes
+    const uint8_t ttl = TELEMETRY_TTL;
+    const uint8_t loop = 1;
+    if (setsockopt(s_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0
+        || setsockopt(s_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+        ESP_LOGE(TAG, "Setting the multicast options failed: %d", errno);
+        telemetry_close();
+        return ESP_FAIL;
+    }
+
+    // Without an address the stack sends on the interface of the default route
+    if (strlen(CONFIG_TELEMETRY_INTERFACE) > 0) {
+        struct in_addr interface = { .s_addr = inet_addr(CONFIG_TELEMETRY_INTERFACE) };
+        if (setsockopt(s_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0) {
+            ESP_LOGE(TAG, "Sending from %s failed: %d", CONFIG_TELEMETRY_INTERFACE, errno);
+            telemetry_close();
+            return ESP_FAIL;
+        }
+    }
+
+    ESP_LOGI(TAG, "Sending to %s:%d", CONFIG_TELEMETRY_GROUP, CONFIG_TELEMETRY_PORT);
+    return ESP_OK;
+}
+
+// Serialized once per tick into the static frame, then handed to the stack as it is
+static void telemetry_send(void)
+{
+    const int64_t now = esp_timer_get_time();
+    if (s_socket < 0 || now - s_last_us < TELEMETRY_INTERVAL_US) {
+        return;
+    }
+    s_last_us = now;
+
+    TRACE_SPAN_BEGIN(TELEMETRY_FRAME);
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, s_frame, sizeof(s_frame));
+    data_telemetry_to_cbor(&writer, s_sequence++, now);
+    if (writer.overflow) {
+        ESP_LOGW(TAG, "Frame does not fit %u bytes", (unsigned int)sizeof(s_frame));
+        return;
+    }
+
+    // Never waits for the stack, a frame that cannot go out now is stale by the next one
+    const bool sent = sendto(s_socket, s_frame, writer.len, MSG_DONTWAIT, (const struct sockaddr*)&s_group, sizeof(s_group)) >= 0;
+    TRACE_SPAN_END(TELEMETRY_FRAME);
+
+    if (!sent && !s_failing) {
+        ESP_LOGW(TAG, "Sending failed: %d", errno);
+    }
+    s_failing = !sent;
+}
+
+static void telemetry_event_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    switch (id) {
+    case EVENT_ADC_SAMPLED:
+        telemetry_send();
+        break;
+    case EVENT_ONLINE:
+        if (s_socket < 0) {
+            telemetry_open();
+        }
+        break;
+    case EVENT_OFFLINE:
+        telemetry_close();
+        break;
+    }
+}
+
+esp_err_t telemetry_init(void)
+{
+    s_group = (struct sockaddr_in) {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_TELEMETRY_PORT),
+        .sin_addr.s_addr = inet_addr(CONFIG_TELEMETRY_GROUP),
+    };
+    if (!IN_MULTICAST(ntohl(s_group.sin_addr.s_addr))) {
+        ESP_LOGE(TAG, "%s is not a multicast group", CONFIG_TELEMETRY_GROUP);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ONLINE, telemetry_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_OFFLINE, telemetry_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_ADC_SAMPLED, telemetry_event_handler, NULL));
+
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t telemetry_init(void)
+{
+    return ESP_OK;
+}
+
+#endif
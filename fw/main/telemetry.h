@@ -0,0 +1,8 @@
+#pragma once
+
+#include <esp_err.h>
+
+// Sends a telemetry frame to the CONFIG_TELEMETRY_GROUP multicast group after every ADC frame,
+// at most every CONFIG_TELEMETRY_INTERVAL_MS, while the network is up. Nothing without
+// CONFIG_TELEMETRY_UDP.
+esp_err_t telemetry_init(void);
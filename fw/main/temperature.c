@@ -1,38 +1,51 @@
 #include "temperature.h"
 
-#include <driver/i2c.h>
+#include <driver/gpio.h>
 #include <driver/shtc3.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
 #include <string.h>
 
+#include "events.h"
 #include "i2c_bus.h"
+#include "tasks.h"
 #include "util.h"
+#include "watchdog.h"
 
 #define TAG "temperature"
 
 #define GPIO_EXT_INT (40)
 
+#define TEMPERATURE_PRESENCE_DEBOUNCE_MS 50
+#define TEMPERATURE_DEADLINE_MS 3000 // A cycle with every bus transaction timing out still fits
+
 typedef struct
 {
+    i2c_bus_device_t* device;
     SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutex_buffer;
     shtc3_sample_t sample;
     bool sample_valid;
+    TimerHandle_t presence_timer;
+    StaticTimer_t presence_timer_buffer;
+    volatile bool present;
 } temperature_sensor_t;
 
 static temperature_sensor_t s_sensors[TEMPERATURE_CHANNEL_MAX_COUNT];
+static TaskHandle_t s_task_handle;
 
-static esp_err_t temperature_measure(i2c_port_t port, shtc3_sample_t* sample)
+static i2c_bus_t temperature_get_bus(temperature_channel_t channel)
 {
-    esp_err_t ret;
-
-    ERROR_CHECK_SIMPLE(i2c_bus_take(port));
-    ret = shtc3_measure(port, sample);
-    i2c_bus_give(port); // Ignore error
-err:
-    return ret;
+    switch (channel) {
+    case TEMPERATURE_CHANNEL_EXTERNAL:
+        return I2C_BUS_EXTERNAL;
+    default:
+        return I2C_BUS_PRIMARY;
+    }
 }
 
 static gpio_num_t temperature_get_presence_gpio(temperature_channel_t channel)
@@ -47,29 +60,63 @@ static gpio_num_t temperature_get_presence_gpio(temperature_channel_t channel)
 
 static bool temperature_is_present_unsafe(temperature_channel_t channel)
 {
-    const gpio_num_t gpio_presence = temperature_get_presence_gpio(channel);
+    return s_sensors[channel].present;
+}
+
+static void IRAM_ATTR temperature_presence_isr_handler(void* arg)
+{
+    temperature_sensor_t* sensor = &s_sensors[(temperature_channel_t)arg];
+    BaseType_t must_yield = pdFALSE;
 
-    if (gpio_presence == GPIO_NUM_NC) {
-        return true; // Having no detection GPIO implies that it is always present.
+    // Every edge restarts the debounce window, the level is only sampled once it has settled
+    xTimerResetFromISR(sensor->presence_timer, &must_yield);
+
+    if (must_yield == pdTRUE) {
+        portYIELD_FROM_ISR();
     }
+}
 
-    // Strobe GPIO pin pull down in case it is not connected (and hence not pulled to a known state)
-    gpio_set_pull_mode(gpio_presence, GPIO_PULLDOWN_ONLY);
-    vTaskDelay(1); // Wait for one tick.
-    gpio_set_pull_mode(gpio_presence, GPIO_FLOATING);
-    vTaskDelay(1); // Wait for one tick.
+static void temperature_presence_timer_callback(TimerHandle_t timer)
+{
+    const temperature_channel_t channel = (temperature_channel_t)pvTimerGetTimerID(timer);
+    temperature_sensor_t* sensor = &s_sensors[channel];
+
+    const bool present = (gpio_get_level(temperature_get_presence_gpio(channel)) == 1);
+    if (present == sensor->present) {
+        return;
+    }
+    sensor->present = present;
 
-    return (gpio_get_level(gpio_presence) == 1);
+    ESP_LOGI(TAG, "Sensor on channel %d %s", channel, present ? "attached" : "detached");
+    esp_event_post(EVENTS, present ? EVENT_SENSOR_ATTACHED : EVENT_SENSOR_DETACHED,
+        &channel, sizeof(channel), 0);
+
+    // Sample a freshly attached probe right away (or invalidate a removed one) instead of waiting for the next cycle
+    if (s_task_handle != NULL) {
+        xTaskNotifyGive(s_task_handle);
+    }
 }
 
-static void temperature_measure_store_unsafe(temperature_channel_t channel, i2c_port_t port)
+static bool temperature_measure_start_unsafe(temperature_channel_t channel)
+{
+    temperature_sensor_t* sensor = &s_sensors[channel];
+
+    return sensor->device != NULL
+        && temperature_is_present_unsafe(channel)
+        && shtc3_measure_start(sensor->device) == ESP_OK;
+}
+
+static void temperature_measure_store_unsafe(temperature_channel_t channel, bool started)
 {
     shtc3_sample_t sample;
     temperature_sensor_t* sensor = &s_sensors[channel];
+    esp_err_t ret = started ? shtc3_measure_read(sensor->device, &sample) : ESP_FAIL;
 
-    bool is_present = temperature_is_present_unsafe(channel);
+    if (ret == ESP_ERR_TIMEOUT) {
+        watchdog_lost(TASK_TEMPERATURE, 1);
+    }
 
-    if (is_present && temperature_measure(port, &sample) == ESP_OK) {
+    if (ret == ESP_OK) {
         xSemaphoreTake(sensor->mutex, portMAX_DELAY);
         memcpy(&sensor->sample, &sample, sizeof(sample));
         sensor->sample_valid = true;
@@ -83,10 +130,23 @@ static void temperature_measure_store_unsafe(temperature_channel_t channel, i2c_
 
 static void temperature_task(void* arg)
 {
+    bool started[TEMPERATURE_CHANNEL_MAX_COUNT];
+
     while (1) {
-        temperature_measure_store_unsafe(TEMPERATURE_CHANNEL_ON_BOARD, I2C_BUS_PRIMARY_NUM);
-        temperature_measure_store_unsafe(TEMPERATURE_CHANNEL_EXTERNAL, I2C_BUS_EXTERNAL_NUM);
-        vTaskDelay(pdMS_TO_TICKS(500));
+        // Start all sensors first so their conversions overlap, the buses are only in use per command
+        for (temperature_channel_t channel = 0; channel < TEMPERATURE_CHANNEL_MAX_COUNT; ++channel) {
+            started[channel] = temperature_measure_start_unsafe(channel);
+        }
+
+        // The current tick is already partially elapsed, wait one more to cover the full duration
+        vTaskDelay(pdMS_TO_TICKS(SHTC3_MEASUREMENT_DURATION_MS) + 1);
+
+        for (temperature_channel_t channel = 0; channel < TEMPERATURE_CHANNEL_MAX_COUNT; ++channel) {
+            temperature_measure_store_unsafe(channel, started[channel]);
+        }
+        watchdog_beat(TASK_TEMPERATURE, 1);
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500));
     }
 }
 
@@ -106,28 +166,69 @@ bool temperature_fetch(temperature_channel_t channel, temperature_sample_t* samp
     return sample_valid;
 }
 
+bool temperature_is_present(temperature_channel_t channel)
+{
+    return s_sensors[channel].present;
+}
+
+bool temperature_fetch_i2c_stats(temperature_channel_t channel, i2c_bus_device_stats_t* stats_out)
+{
+    const temperature_sensor_t* sensor = &s_sensors[channel];
+
+    if (sensor->device == NULL) {
+        return false;
+    }
+
+    i2c_bus_device_stats(sensor->device, stats_out);
+    return true;
+}
+
 esp_err_t temperature_init(void)
 {
+    // The tacho task may or may not have installed the shared ISR service yet
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        return ret;
+    }
+
     for (temperature_channel_t channel = 0; channel < TEMPERATURE_CHANNEL_MAX_COUNT; ++channel) {
         temperature_sensor_t* sensor = &s_sensors[channel];
-        sensor->mutex = xSemaphoreCreateMutex();
+        sensor->mutex = xSemaphoreCreateMutexStatic(&sensor->mutex_buffer);
         sensor->sample_valid = false;
+        sensor->present = true; // Having no detection GPIO implies that it is always present.
+
+        if (shtc3_init(temperature_get_bus(channel), &sensor->device) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to add sensor for channel %d", channel);
+            sensor->device = NULL;
+        }
 
         gpio_num_t gpio_presence = temperature_get_presence_gpio(channel);
 
         if (gpio_presence != GPIO_NUM_NC) {
+            // Keep the pin pulled down so an unconnected input reads as a stable low
             gpio_config_t io_conf = {
-                .intr_type = GPIO_INTR_DISABLE,
+                .intr_type = GPIO_INTR_ANYEDGE,
                 .mode = GPIO_MODE_INPUT,
                 .pin_bit_mask = (1ULL << gpio_presence),
-                .pull_down_en = 0,
+                .pull_down_en = 1,
                 .pull_up_en = 0,
             };
             gpio_config(&io_conf);
+
+            sensor->presence_timer = xTimerCreateStatic("presence", pdMS_TO_TICKS(TEMPERATURE_PRESENCE_DEBOUNCE_MS),
+                pdFALSE, (void*)channel, temperature_presence_timer_callback, &sensor->presence_timer_buffer);
+            sensor->present = (gpio_get_level(gpio_presence) == 1);
+
+            gpio_isr_handler_add(gpio_presence, temperature_presence_isr_handler, (void*)channel);
         }
     }
 
-    xTaskCreate(temperature_task, "temperature", 1024 * 4, NULL, 10, NULL);
+    // A stuck task may hold a bus, so it is not restarted but escalates to a reboot
+    const watchdog_config_t watchdog = {
+        .deadline_ms = TEMPERATURE_DEADLINE_MS,
+    };
+    ESP_ERROR_CHECK(watchdog_register(TASK_TEMPERATURE, &watchdog));
+    ESP_ERROR_CHECK(tasks_create(TASK_TEMPERATURE, temperature_task, NULL, &s_task_handle));
 
     return ESP_OK;
-}
\ No newline at end of file
+}
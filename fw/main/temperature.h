@@ -3,6 +3,8 @@
 #include <esp_err.h>
 #include <stdbool.h>
 
+#include "i2c_bus.h"
+
 typedef struct
 {
     int32_t temperature_mc;
@@ -18,3 +20,5 @@ typedef enum {
 esp_err_t temperature_init(void);
 
 bool temperature_fetch(temperature_channel_t channel, temperature_sample_t* sample_out);
+bool temperature_is_present(temperature_channel_t channel);
+bool temperature_fetch_i2c_stats(temperature_channel_t channel, i2c_bus_device_stats_t* stats_out);
@@ -0,0 +1,54 @@
+#include "trace.h"
+
+#include <esp_attr.h>
+#include <esp_cpu.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+#include "util.h"
+
+static const char* s_span_names[TRACE_SPAN_MAX_COUNT] = {
+    [TRACE_SPAN_ADC_FRAME] = "adc_frame",
+    [TRACE_SPAN_TACHO_EDGE] = "tacho_edge",
+    [TRACE_SPAN_MQTT_REPORT] = "mqtt_report",
+    [TRACE_SPAN_HTTP_STATUS] = "http_status",
+    [TRACE_SPAN_TELEMETRY_FRAME] = "telemetry_frame",
+};
+
+#if CONFIG_TRACE_SPANS
+
+// Every core only writes its own histograms, readers accept slightly torn snapshots
+static histogram_t s_histograms[portNUM_PROCESSORS][TRACE_SPAN_MAX_COUNT];
+
+void IRAM_ATTR trace_span_record(trace_span_t span, trace_stamp_t begin, trace_stamp_t end)
+{
+    if (begin.core < 0 || begin.core != end.core) {
+        return;
+    }
+    histogram_record(&s_histograms[end.core][span], end.cycles - begin.cycles);
+}
+
+bool trace_fetch(trace_span_t span, histogram_stats_t* stats_out)
+{
+    histogram_t merged = { 0 };
+
+    for (size_t core = 0; core < portNUM_PROCESSORS; ++core) {
+        histogram_merge(&merged, &s_histograms[core][span]);
+    }
+
+    return histogram_stats(&merged, stats_out);
+}
+
+#else
+
+bool trace_fetch(trace_span_t span, histogram_stats_t* stats_out)
+{
+    return false;
+}
+
+#endif
+
+const char* trace_span_name(trace_span_t span)
+{
+    return (span < ARRAY_SIZE(s_span_names)) ? s_span_names[span] : "unknown";
+}
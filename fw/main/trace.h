@@ -0,0 +1,62 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sdkconfig.h>
+
+#include "histogram.h"
+
+typedef enum {
+    TRACE_SPAN_ADC_FRAME,
+    TRACE_SPAN_TACHO_EDGE,
+    TRACE_SPAN_MQTT_REPORT,
+    TRACE_SPAN_HTTP_STATUS,
+    TRACE_SPAN_TELEMETRY_FRAME,
+    TRACE_SPAN_MAX_COUNT,
+} trace_span_t;
+
+#if CONFIG_TRACE_SPANS
+
+#include <esp_cpu.h>
+
+typedef struct
+{
+    uint32_t cycles;
+    int core; // -1 when the task moved while it was read
+} trace_stamp_t;
+
+// The cycle counters of the cores are not synchronised, the core is read on both sides of the counter
+static inline trace_stamp_t trace_stamp(void)
+{
+    const int core = esp_cpu_get_core_id();
+    const uint32_t cycles = esp_cpu_get_cycle_count();
+    return (trace_stamp_t) {
+        .cycles = cycles,
+        .core = (esp_cpu_get_core_id() == core) ? core : -1,
+    };
+}
+
+// A span must only be recorded from one task, the per-core histograms are not protected otherwise.
+// Spans in unpinned tasks may migrate, a span that ended on another core than it began is dropped.
+#define TRACE_SPAN_BEGIN(span) const trace_stamp_t trace_span_begin_##span = trace_stamp()
+#define TRACE_SPAN_END(span) trace_span_record(TRACE_SPAN_##span, trace_span_begin_##span, trace_stamp())
+
+void trace_span_record(trace_span_t span, trace_stamp_t begin, trace_stamp_t end);
+
+#else
+
+#define TRACE_SPAN_BEGIN(span) \
+    do {                       \
+    } while (0)
+#define TRACE_SPAN_END(span) \
+    do {                     \
+    } while (0)
+
+#endif
+
+const char* trace_span_name(trace_span_t span);
+
+// Merges the histograms of all cores, returns false when nothing was recorded (or tracing is disabled)
+bool trace_fetch(trace_span_t span, histogram_stats_t* stats_out);
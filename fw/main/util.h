@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
 
 #define ERROR_CHECK(a, str, goto_tag, ...)                                        \
@@ -18,3 +21,14 @@
             goto err;                                                       \
         }                                                                   \
     } while (0)
+
+// FNV-1a, for checksums of data kept across a reset and for hash tables
+static inline uint32_t fnv1a32(const void* data, size_t length)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,219 @@
+#include "watchdog.h"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <sdkconfig.h>
+
+#include "events.h"
+#include "util.h"
+
+#define TAG "watchdog"
+
+#define WATCHDOG_CHECK_INTERVAL_US (100 * 1000LL)
+
+typedef struct
+{
+    bool registered;
+    watchdog_config_t config;
+
+    // Written by the task only, read without the lock
+    volatile uint32_t beats;
+    volatile uint32_t processed;
+    // Written by the task and its ISR, under s_lost_lock
+    volatile uint32_t lost;
+
+    // Owned by the check
+    uint32_t seen_beats;
+    int64_t seen_us; // When the beats last moved, or the task was (re)started
+    bool restarted; // Since the last beat, so a second escalation reboots
+    watchdog_state_t state;
+    uint32_t misses;
+    uint32_t restarts;
+} watchdog_task_t;
+
+static watchdog_task_t s_tasks[TASK_MAX_COUNT];
+static uint32_t s_faults;
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buffer;
+static portMUX_TYPE s_lost_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_timer;
+
+static const char* const s_state_names[] = {
+    [WATCHDOG_OK] = "ok",
+    [WATCHDOG_LATE] = "late",
+    [WATCHDOG_FAULT] = "fault",
+};
+
+const char* watchdog_state_name(watchdog_state_t state)
+{
+    return (state < ARRAY_SIZE(s_state_names)) ? s_state_names[state] : "unknown";
+}
+
+static void watchdog_reboot(const char* name)
+{
+#if CONFIG_WATCHDOG_REBOOT
+    // The fans come back at their duties from RTC memory
+    ESP_LOGE(TAG, "Task %s is stuck, restarting the controller", name);
+    esp_restart();
+#else
+    ESP_LOGE(TAG, "Task %s is stuck", name);
+#endif
+}
+
+// One step up the ladder per deadline that passes without a beat: log, fault flag, task restart, reboot
+static void watchdog_escalate_unsafe(task_id_t id, watchdog_task_t* task, int64_t now)
+{
+    const char* name = tasks_config(id)->name;
+    const int64_t overdue_us = now - task->seen_us;
+    const int64_t deadline_us = task->config.deadline_ms * 1000LL;
+
+    if (overdue_us >= 3 * deadline_us && task->state == WATCHDOG_FAULT) {
+        if (task->config.restart == NULL || task->restarted) {
+            watchdog_reboot(name);
+            task->seen_us = now; // Without a reboot, the task only gets logged once per three deadlines
+            return;
+        }
+
+        // Deleting and recreating the task can block, which the timer task must not. Retried at the next
+        // check if the event loop is full.
+        if (esp_event_post(EVENTS, EVENT_TASK_STUCK, &id, sizeof(id), 0) == ESP_OK) {
+            task->restarted = true;
+            task->seen_us = now;
+        }
+    } else if (overdue_us >= 2 * deadline_us && task->state == WATCHDOG_LATE) {
+        ESP_LOGE(TAG, "Task %s missed its deadline twice", name);
+        task->state = WATCHDOG_FAULT;
+        s_faults++;
+    } else if (overdue_us >= deadline_us && task->state == WATCHDOG_OK) {
+        ESP_LOGW(TAG, "Task %s missed its deadline of %lu ms", name, (unsigned long)task->config.deadline_ms);
+        task->state = WATCHDOG_LATE;
+        task->misses++;
+    }
+}
+
+static void watchdog_task_stuck_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    const task_id_t id = *(const task_id_t*)event_data;
+    watchdog_task_t* task = &s_tasks[id];
+    const char* name = tasks_config(id)->name;
+
+    ESP_LOGE(TAG, "Restarting task %s", name);
+    if (!task->config.restart()) {
+        watchdog_reboot(name);
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    task->restarts++;
+    task->seen_us = esp_timer_get_time(); // The deadline runs from the new task
+    xSemaphoreGive(s_mutex);
+}
+
+static void watchdog_check_cb(void* arg)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const int64_t now = esp_timer_get_time();
+
+    for (task_id_t id = 0; id < ARRAY_SIZE(s_tasks); ++id) {
+        watchdog_task_t* task = &s_tasks[id];
+        if (!task->registered) {
+            continue;
+        }
+
+        const uint32_t beats = task->beats;
+        if (beats != task->seen_beats) {
+            if (task->state != WATCHDOG_OK) {
+                ESP_LOGI(TAG, "Task %s is beating again", tasks_config(id)->name);
+            }
+            task->seen_beats = beats;
+            task->seen_us = now;
+            task->restarted = false;
+            task->state = WATCHDOG_OK;
+            continue;
+        }
+
+        watchdog_escalate_unsafe(id, task, now);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t watchdog_init(void)
+{
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buffer);
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_TASK_STUCK, watchdog_task_stuck_handler, NULL));
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = watchdog_check_cb,
+        .name = "watchdog",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(s_timer, WATCHDOG_CHECK_INTERVAL_US));
+
+    return ESP_OK;
+}
+
+esp_err_t watchdog_register(task_id_t id, const watchdog_config_t* config)
+{
+    if (id >= ARRAY_SIZE(s_tasks) || config->deadline_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    watchdog_task_t* task = &s_tasks[id];
+    task->config = *config;
+    task->seen_beats = task->beats;
+    task->seen_us = esp_timer_get_time();
+    task->registered = true;
+    xSemaphoreGive(s_mutex);
+
+    return ESP_OK;
+}
+
+void watchdog_beat(task_id_t id, uint32_t processed)
+{
+    watchdog_task_t* task = &s_tasks[id];
+    task->processed += processed;
+    task->beats++;
+}
+
+void IRAM_ATTR watchdog_lost(task_id_t id, uint32_t count)
+{
+    portENTER_CRITICAL_SAFE(&s_lost_lock);
+    s_tasks[id].lost += count;
+    portEXIT_CRITICAL_SAFE(&s_lost_lock);
+}
+
+bool watchdog_fetch(task_id_t id, watchdog_stats_t* stats_out)
+{
+    if (id >= ARRAY_SIZE(s_tasks)) {
+        return false;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const watchdog_task_t* task = &s_tasks[id];
+    const bool registered = task->registered;
+    *stats_out = (watchdog_stats_t) {
+        .state = task->state,
+        .processed = task->processed,
+        .lost = task->lost,
+        .misses = task->misses,
+        .restarts = task->restarts,
+    };
+    xSemaphoreGive(s_mutex);
+
+    return registered;
+}
+
+uint32_t watchdog_fetch_faults(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    const uint32_t faults = s_faults;
+    xSemaphoreGive(s_mutex);
+
+    return faults;
+}
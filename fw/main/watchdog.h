@@ -0,0 +1,49 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tasks.h"
+
+typedef enum {
+    WATCHDOG_OK,
+    WATCHDOG_LATE, // Missed one deadline, logged
+    WATCHDOG_FAULT, // Missed two, flagged in the status and restarted (if it can be) at the third
+} watchdog_state_t;
+
+// Recreates a task that stopped beating, called from the default event loop task. Returns false when
+// the task cannot be deleted safely, e.g. because it is stuck holding a lock.
+typedef bool (*watchdog_restart_t)(void);
+
+typedef struct
+{
+    uint32_t deadline_ms; // Longest time between two beats of a healthy task
+    watchdog_restart_t restart; // NULL if the task can never be restarted, it escalates to a reboot
+} watchdog_config_t;
+
+typedef struct
+{
+    watchdog_state_t state;
+    uint32_t processed; // Frames, edges or measurement cycles since boot
+    uint32_t lost; // Dropped edges, overflowed frames, dropped events or reads that timed out since boot
+    uint32_t misses; // Times the task went late
+    uint32_t restarts;
+} watchdog_stats_t;
+
+esp_err_t watchdog_init(void);
+
+// Before the task is created, its deadline runs from here
+esp_err_t watchdog_register(task_id_t id, const watchdog_config_t* config);
+
+// Called by the task every time around its loop, also when it woke up without work (processed 0)
+void watchdog_beat(task_id_t id, uint32_t processed);
+// Work the task or its ISR had to drop, safe to call from both
+void watchdog_lost(task_id_t id, uint32_t count);
+
+// False for tasks that are not watched
+bool watchdog_fetch(task_id_t id, watchdog_stats_t* stats_out);
+// Deadlines missed twice in a row since boot, over all tasks
+uint32_t watchdog_fetch_faults(void);
+
+const char* watchdog_state_name(watchdog_state_t state);
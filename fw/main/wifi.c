@@ -6,16 +6,26 @@
 #include <esp_netif.h>
 #include <esp_wifi.h>
 #include <lwip/apps/netbiosns.h>
+#include <string.h>
+
+#include <sdkconfig.h>
 
 #include "events.h"
+#include "settings.h"
 
 #define TAG "wifi"
 
 #define DNS_HOST_NAME "fancontroller"
 
-#define DEFAULT_LISTEN_INTERVAL 3
 #define DEFAULT_BEACON_TIMEOUT 100
+
+#ifdef CONFIG_POWER_SAVE
+#define DEFAULT_LISTEN_INTERVAL CONFIG_POWER_SAVE_LISTEN_INTERVAL
+#define DEFAULT_PS_MODE WIFI_PS_MAX_MODEM // Wake up every listen interval instead of every DTIM
+#else
+#define DEFAULT_LISTEN_INTERVAL 3
 #define DEFAULT_PS_MODE WIFI_PS_NONE
+#endif
 
 static void event_handler(void* arg, esp_event_base_t event_base,
     int32_t event_id, void* event_data)
@@ -40,6 +50,40 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     }
 }
 
+static void wifi_config_from_settings(wifi_config_t* wifi_config)
+{
+    settings_t settings;
+    settings_fetch(&settings);
+
+    *wifi_config = (wifi_config_t) {
+        .sta = {
+            .listen_interval = DEFAULT_LISTEN_INTERVAL,
+        },
+    };
+    strlcpy((char*)wifi_config->sta.ssid, settings.wifi_ssid, sizeof(wifi_config->sta.ssid));
+    strlcpy((char*)wifi_config->sta.password, settings.wifi_passphrase, sizeof(wifi_config->sta.password));
+}
+
+// Reconnects with the new credentials, the disconnect event connects again
+static void settings_handler(void* arg, esp_event_base_t event_base,
+    int32_t event_id, void* event_data)
+{
+    if (!(*(const uint32_t*)event_data & SETTINGS_WIFI)) {
+        return;
+    }
+
+    wifi_config_t wifi_config;
+    wifi_config_from_settings(&wifi_config);
+    ESP_LOGI(TAG, "Switching to SSID %s", (const char*)wifi_config.sta.ssid);
+    const esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (ret != ESP_OK) {
+        // The driver keeps the previous credentials, and the connection with them
+        ESP_LOGE(TAG, "Rejected the new credentials: %s", esp_err_to_name(ret));
+        return;
+    }
+    esp_wifi_disconnect();
+}
+
 esp_err_t wifi_init(void)
 {
     ESP_ERROR_CHECK(esp_netif_init());
@@ -55,16 +99,16 @@ esp_err_t wifi_init(void)
 
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(EVENTS, EVENT_SETTINGS_CHANGED, &settings_handler, NULL, NULL));
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = CONFIG_WIFI_SSID,
-            .password = CONFIG_WIFI_PASSPHRASE,
-            .listen_interval = DEFAULT_LISTEN_INTERVAL,
-        },
-    };
+    wifi_config_t wifi_config;
+    wifi_config_from_settings(&wifi_config);
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    const esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (ret != ESP_OK) {
+        // Only the build defaults can get here, stored settings are validated. Stays offline rather than boot looping.
+        ESP_LOGE(TAG, "Rejected the credentials: %s", esp_err_to_name(ret));
+    }
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_ERROR_CHECK(esp_wifi_set_inactive_time(WIFI_IF_STA, DEFAULT_BEACON_TIMEOUT));
 
@@ -0,0 +1,279 @@
+// Microbenchmarks for the firmware data paths, run on the host against the mock HAL
+
+#include <cJSON.h>
+#include <esp_app_desc.h>
+#include <esp_log.h>
+#include <getopt.h>
+#include <nvs_flash.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adc.h"
+#include "bench.h"
+#include "boot.h"
+#include "calibration.h"
+#include "control.h"
+#include "data.h"
+#include "energy.h"
+#include "events.h"
+#include "fan_health.h"
+#include "fans.h"
+#include "i2c_bus.h"
+#include "json_pool.h"
+#include "latency.h"
+#include "led.h"
+#include "ota.h"
+#include "performance.h"
+#include "periodic.h"
+#include "power.h"
+#include "settings.h"
+#include "sim.h"
+#include "supervisor.h"
+#include "tacho.h"
+#include "temperature.h"
+#include "watchdog.h"
+
+#define BENCH_MAX_ITERATIONS 1000000000ULL
+
+// Allocation counting, interposes the C library allocator for the benchmarking thread only
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static __thread bool s_alloc_counting;
+static __thread uint64_t s_allocs;
+static __thread uint64_t s_alloc_bytes;
+
+static void bench_alloc_count(void* ptr, size_t size)
+{
+    if (s_alloc_counting && ptr != NULL) {
+        s_allocs++;
+        s_alloc_bytes += size;
+    }
+}
+
+void* malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    bench_alloc_count(ptr, size);
+    return ptr;
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    void* ptr = __libc_calloc(nmemb, size);
+    bench_alloc_count(ptr, nmemb * size);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    void* new_ptr = __libc_realloc(ptr, size);
+    bench_alloc_count(new_ptr, size);
+    return new_ptr;
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+static int64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bench_timer_start(bench_t* b)
+{
+    s_allocs = 0;
+    s_alloc_bytes = 0;
+    s_alloc_counting = true;
+    b->start_ns = bench_now_ns();
+}
+
+void bench_timer_stop(bench_t* b)
+{
+    b->elapsed_ns = bench_now_ns() - b->start_ns;
+    s_alloc_counting = false;
+    b->allocs = s_allocs;
+    b->bytes = s_alloc_bytes;
+}
+
+void bench_sink(const void* p)
+{
+    __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+// Grow the iteration count until a run takes at least min_time_ns
+static bench_t bench_run(const bench_case_t* bench_case, int64_t min_time_ns)
+{
+    bench_t b = { .iterations = 1 };
+
+    while (1) {
+        b.elapsed_ns = 0;
+        bench_case->fn(&b);
+
+        if (b.elapsed_ns >= min_time_ns || b.iterations >= BENCH_MAX_ITERATIONS) {
+            return b;
+        }
+
+        uint64_t next = (b.elapsed_ns > 0) ? (uint64_t)((double)min_time_ns * 1.2 * b.iterations / b.elapsed_ns) : b.iterations * 100;
+        if (next > b.iterations * 100) {
+            next = b.iterations * 100;
+        }
+        b.iterations = (next > b.iterations) ? next : b.iterations + 1;
+    }
+}
+
+static void bench_init(void)
+{
+    sim_plant_config_t plant = {
+        .speed = 1,
+        .ambient_c = 25,
+        .heat_load_w = 20,
+        .external_probe = true,
+        .noise_permille = 5,
+    };
+    sim_clock_init(plant.speed);
+    sim_plant_start(&plant);
+
+    // Same sequence as app_main, minus the network stack and reporting
+    ESP_ERROR_CHECK(boot_init());
+    ESP_ERROR_CHECK(json_pool_init());
+    ESP_ERROR_CHECK(data_init());
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(events_init());
+    ESP_ERROR_CHECK(settings_init());
+    ESP_ERROR_CHECK(periodic_init());
+    ESP_ERROR_CHECK(power_init());
+    ESP_ERROR_CHECK(performance_init());
+    ESP_ERROR_CHECK(latency_init());
+    ESP_ERROR_CHECK(i2c_bus_init());
+    ESP_ERROR_CHECK(led_init());
+    ESP_ERROR_CHECK(supervisor_init());
+    ESP_ERROR_CHECK(watchdog_init());
+    ESP_ERROR_CHECK(energy_init());
+    ESP_ERROR_CHECK(calibration_init());
+    ESP_ERROR_CHECK(adc_init());
+    ESP_ERROR_CHECK(tacho_init());
+    ESP_ERROR_CHECK(fans_init());
+    ESP_ERROR_CHECK(fan_health_init());
+    ESP_ERROR_CHECK(control_init());
+    ESP_ERROR_CHECK(temperature_init());
+    ESP_ERROR_CHECK(ota_init());
+
+    // Let the tasks produce a first set of readings
+    sim_clock_sleep_us(1500 * 1000);
+}
+
+static void bench_usage(const char* argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --filter TEXT      only run benchmarks whose name contains TEXT\n"
+        "  --min-time-ms N    minimum measured time per benchmark (default 500)\n"
+        "  --json             print results as a JSON document\n",
+        argv0);
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = {
+        { "filter", required_argument, NULL, 'f' },
+        { "min-time-ms", required_argument, NULL, 't' },
+        { "json", no_argument, NULL, 'j' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+    static const bench_case_t* suites[] = {
+        bench_adc_cases,
+        bench_tacho_cases,
+        bench_data_cases,
+        bench_performance_cases,
+    };
+
+    const char* filter = NULL;
+    int64_t min_time_ns = 500 * 1000000LL;
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            filter = optarg;
+            break;
+        case 't':
+            min_time_ns = strtoll(optarg, NULL, 10) * 1000000LL;
+            break;
+        case 'j':
+            json = true;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // Background task logging would interleave with the results
+    esp_log_level_set("*", ESP_LOG_WARN);
+    bench_init();
+
+    const esp_app_desc_t* app_desc = esp_app_get_description();
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "app_version", app_desc->version);
+    cJSON* results = cJSON_AddArrayToObject(root, "benchmarks");
+
+    if (!json) {
+        printf("%-36s %12s %12s %10s %10s %10s\n", "benchmark", "iterations", "ns/op", "allocs/op", "B/op", "output B");
+    }
+
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); ++i) {
+        for (const bench_case_t* bench_case = suites[i]; bench_case->name != NULL; ++bench_case) {
+            if (filter != NULL && strstr(bench_case->name, filter) == NULL) {
+                continue;
+            }
+
+            bench_t b = bench_run(bench_case, min_time_ns);
+            double ns_per_op = (double)b.elapsed_ns / b.iterations;
+            double allocs_per_op = (double)b.allocs / b.iterations;
+            double bytes_per_op = (double)b.bytes / b.iterations;
+
+            if (json) {
+                cJSON* result = cJSON_CreateObject();
+                cJSON_AddStringToObject(result, "name", bench_case->name);
+                cJSON_AddNumberToObject(result, "iterations", b.iterations);
+                cJSON_AddNumberToObject(result, "ns_per_op", ns_per_op);
+                cJSON_AddNumberToObject(result, "allocs_per_op", allocs_per_op);
+                cJSON_AddNumberToObject(result, "bytes_per_op", bytes_per_op);
+                if (b.output_bytes > 0) {
+                    cJSON_AddNumberToObject(result, "output_bytes", b.output_bytes);
+                }
+                cJSON_AddItemToArray(results, result);
+            } else {
+                printf("%-36s %12llu %12.1f %10.2f %10.1f", bench_case->name, (unsigned long long)b.iterations, ns_per_op, allocs_per_op, bytes_per_op);
+                if (b.output_bytes > 0) {
+                    printf(" %10llu", (unsigned long long)b.output_bytes);
+                }
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (json) {
+        char* str = cJSON_PrintUnformatted(root);
+        puts(str);
+        cJSON_free(str);
+    }
+    cJSON_Delete(root);
+
+    // Firmware tasks never return, leave them running while the process exits
+    exit(EXIT_SUCCESS);
+}
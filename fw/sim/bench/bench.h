@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint64_t iterations;
+    int64_t start_ns;
+    int64_t elapsed_ns;
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t output_bytes; // Size of what one iteration renders, set by the cases that render something
+} bench_t;
+
+typedef void (*bench_fn_t)(bench_t* b);
+
+typedef struct
+{
+    const char* name;
+    bench_fn_t fn;
+} bench_case_t;
+
+// Setup that should not be measured goes before bench_timer_start
+void bench_timer_start(bench_t* b);
+void bench_timer_stop(bench_t* b);
+
+// Keeps the compiler from optimizing away a result
+void bench_sink(const void* p);
+
+extern const bench_case_t bench_adc_cases[];
+extern const bench_case_t bench_tacho_cases[];
+extern const bench_case_t bench_data_cases[];
+extern const bench_case_t bench_performance_cases[];
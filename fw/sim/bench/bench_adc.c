@@ -0,0 +1,74 @@
+// Built against the module source to reach its static frame processing
+#include "adc.c"
+
+#include "bench.h"
+
+#define BENCH_ADC_FRAME_LEN ADC_FRAME_LEN(32) // The default oversampling
+
+static void bench_adc_frame_prepare(uint8_t frame[BENCH_ADC_FRAME_LEN])
+{
+    for (size_t i = 0; i < BENCH_ADC_FRAME_LEN / SOC_ADC_DIGI_RESULT_BYTES; ++i) {
+        adc_digi_output_data_t* p = (void*)&frame[i * SOC_ADC_DIGI_RESULT_BYTES];
+        p->val = 0;
+        // Same order as the weighted pattern in continuous_adc_init
+        const size_t entry = i % ADC_PATTERN_LEN;
+        const size_t channel = (entry < ADC_VOLTAGE_CHANNELS)
+            ? entry
+            : ADC_VOLTAGE_CHANNELS + (entry - ADC_VOLTAGE_CHANNELS) % (ARRAY_SIZE(adc_channel) - ADC_VOLTAGE_CHANNELS);
+        p->type2.channel = adc_channel[channel];
+        p->type2.data = 1000 + (i * 37) % 2000;
+    }
+}
+
+static void bench_adc_cali_prepare(void)
+{
+    if (s_millivolts[ADC_RAW_RANGE - 1] != 0) {
+        return;
+    }
+
+    millivolts_init();
+}
+
+static void bench_adc_frame(bench_t* b)
+{
+    static uint8_t frame[BENCH_ADC_FRAME_LEN];
+    uint8_t channel_map[SOC_ADC_PATT_LEN_MAX];
+    samples_intermediate_t samples;
+
+    bench_adc_cali_prepare();
+    bench_adc_frame_prepare(frame);
+    channel_map_init(channel_map);
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        samples_intermediate_from_frame(channel_map, frame, BENCH_ADC_FRAME_LEN, samples);
+        bench_sink(samples);
+    }
+    bench_timer_stop(b);
+}
+
+static void bench_adc_samples_from_intermediate(bench_t* b)
+{
+    static uint8_t frame[BENCH_ADC_FRAME_LEN];
+    uint8_t channel_map[SOC_ADC_PATT_LEN_MAX];
+    samples_intermediate_t samples;
+    adc_samples_t result;
+
+    bench_adc_cali_prepare();
+    bench_adc_frame_prepare(frame);
+    channel_map_init(channel_map);
+    samples_intermediate_from_frame(channel_map, frame, BENCH_ADC_FRAME_LEN, samples);
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        samples_from_intermediate(samples, &result);
+        bench_sink(&result);
+    }
+    bench_timer_stop(b);
+}
+
+const bench_case_t bench_adc_cases[] = {
+    { "adc/frame", bench_adc_frame },
+    { "adc/samples_from_intermediate", bench_adc_samples_from_intermediate },
+    { 0 },
+};
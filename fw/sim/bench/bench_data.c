@@ -0,0 +1,68 @@
+#include <cJSON.h>
+#include <esp_timer.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+#include "bench.h"
+#include "data.h"
+
+static void bench_data_status_to_json(bench_t* b)
+{
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        cJSON* root = cJSON_CreateObject();
+        data_status_to_json(root);
+        char* str = cJSON_PrintUnformatted(root);
+        bench_sink(str);
+        cJSON_free(str);
+        cJSON_Delete(root);
+    }
+    bench_timer_stop(b);
+}
+
+static void bench_data_status_print(bench_t* b)
+{
+    static char buffer[CONFIG_STATUS_BUFFER_SIZE];
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        data_print(data_status_to_json, buffer, sizeof(buffer));
+        bench_sink(buffer);
+    }
+    bench_timer_stop(b);
+    b->output_bytes = strlen(buffer);
+}
+
+static void bench_data_status_print_cbor(bench_t* b)
+{
+    static uint8_t buffer[CONFIG_STATUS_BUFFER_SIZE];
+    size_t len = 0;
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        data_print_cbor(data_status_to_cbor, buffer, sizeof(buffer), &len);
+        bench_sink(buffer);
+    }
+    bench_timer_stop(b);
+    b->output_bytes = len;
+}
+
+static void bench_data_process_duty(bench_t* b)
+{
+    static const char command[] = "{\"fans_pwm8\":128,\"fan1_pwm8\":200,\"fan5_pwm8\":64}";
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        data_process_duty_json_str(command, strlen(command), esp_timer_get_time());
+    }
+    bench_timer_stop(b);
+}
+
+const bench_case_t bench_data_cases[] = {
+    { "data/status_to_json", bench_data_status_to_json },
+    { "data/status_print", bench_data_status_print },
+    { "data/status_print_cbor", bench_data_status_print_cbor },
+    { "data/process_duty_json_str", bench_data_process_duty },
+    { 0 },
+};
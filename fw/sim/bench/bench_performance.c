@@ -0,0 +1,42 @@
+// Built against the module source to reach its static snapshot matching
+#include "performance.c"
+
+#include "bench.h"
+
+static void bench_performance_snapshot(bench_t* b)
+{
+    performance_snapshot_t snapshot = { 0 };
+    ESP_ERROR_CHECK(performance_snapshot_take(&snapshot));
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        performance_snapshot_take(&snapshot);
+    }
+    bench_timer_stop(b);
+
+    free(snapshot.tasks);
+}
+
+static void bench_performance_update(bench_t* b)
+{
+    performance_snapshot_t prev = { 0 };
+    performance_snapshot_t current = { 0 };
+    ESP_ERROR_CHECK(performance_snapshot_take(&prev));
+    vTaskDelay(pdMS_TO_TICKS(10));
+    ESP_ERROR_CHECK(performance_snapshot_take(&current));
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        performance_update(&prev, &current);
+    }
+    bench_timer_stop(b);
+
+    free(prev.tasks);
+    free(current.tasks);
+}
+
+const bench_case_t bench_performance_cases[] = {
+    { "performance/snapshot", bench_performance_snapshot },
+    { "performance/update", bench_performance_update },
+    { 0 },
+};
@@ -0,0 +1,38 @@
+// Built against the module source to reach its static edge processing
+#include "tacho.c"
+
+#include "bench.h"
+
+static void bench_tacho_event(bench_t* b)
+{
+    tacho_event_t event = {
+        .time = esp_timer_get_time(),
+    };
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        // Five fans around 1800RPM, each one a revolution later than the previous edge
+        event.gpio_i = i % ARRAY_SIZE(s_tacho_fan_state);
+        event.time += 33333 / ARRAY_SIZE(s_tacho_fan_state);
+        tacho_event_process(&event);
+    }
+    bench_timer_stop(b);
+}
+
+static void bench_tacho_fetch(bench_t* b)
+{
+    tacho_fans_rpm_t rpm;
+
+    bench_timer_start(b);
+    for (uint64_t i = 0; i < b->iterations; ++i) {
+        tacho_fetch(rpm);
+        bench_sink(rpm);
+    }
+    bench_timer_stop(b);
+}
+
+const bench_case_t bench_tacho_cases[] = {
+    { "tacho/event", bench_tacho_event },
+    { "tacho/fetch", bench_tacho_fetch },
+    { 0 },
+};
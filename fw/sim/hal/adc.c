@@ -0,0 +1,313 @@
+// Continuous ADC driver producing DMA frames from the plant model at the configured sample rate
+
+#include <esp_adc/adc_cali_scheme.h>
+#include <esp_adc/adc_continuous.h>
+#include <esp_adc/adc_monitor.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_ADC_FULL_SCALE_MV 750 // ADC_ATTEN_DB_0
+#define SIM_ADC_RAW_MAX 4095
+
+struct adc_monitor_t {
+    adc_continuous_handle_t handle;
+    adc_monitor_config_t config;
+    adc_monitor_evt_cbs_t cbs;
+    void* user_data;
+    volatile bool enabled;
+};
+
+struct adc_continuous_ctx_t {
+    adc_continuous_handle_cfg_t handle_config;
+    adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX];
+    uint32_t pattern_num;
+    uint32_t sample_freq_hz;
+
+    adc_continuous_evt_cbs_t cbs;
+    void* user_data;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t* pool;
+    uint32_t pool_frames;
+    uint32_t head;
+    uint32_t count;
+
+    pthread_t thread;
+    volatile bool running;
+
+    struct adc_monitor_t* monitors[SOC_ADC_DIGI_MONITOR_NUM];
+};
+
+struct adc_cali_scheme_t {
+    adc_atten_t atten;
+};
+
+// The digital monitor compares every conversion as it is made, before the frame is complete
+static void adc_continuous_monitor_check(adc_continuous_handle_t handle, adc_channel_t channel, int32_t raw)
+{
+    for (int i = 0; i < SOC_ADC_DIGI_MONITOR_NUM; ++i) {
+        struct adc_monitor_t* monitor = handle->monitors[i];
+        if (monitor == NULL || !monitor->enabled || monitor->config.channel != channel) {
+            continue;
+        }
+
+        adc_monitor_evt_data_t edata = { };
+        if (monitor->config.h_threshold >= 0 && raw > monitor->config.h_threshold && monitor->cbs.on_over_high_thresh != NULL) {
+            monitor->cbs.on_over_high_thresh(monitor, &edata, monitor->user_data);
+        }
+        if (monitor->config.l_threshold >= 0 && raw < monitor->config.l_threshold && monitor->cbs.on_below_low_thresh != NULL) {
+            monitor->cbs.on_below_low_thresh(monitor, &edata, monitor->user_data);
+        }
+    }
+}
+
+static void* adc_continuous_thread(void* arg)
+{
+    adc_continuous_handle_t handle = arg;
+    const uint32_t frame_size = handle->handle_config.conv_frame_size;
+    const uint32_t conversions = frame_size / SOC_ADC_DIGI_RESULT_BYTES;
+    const int64_t frame_duration_us = (int64_t)conversions * 1000000 / handle->sample_freq_hz;
+
+    uint8_t* frame = malloc(frame_size);
+    uint32_t pattern_i = 0;
+    int64_t next_frame_us = sim_clock_now_us() + frame_duration_us;
+
+    while (handle->running) {
+        sim_clock_sleep_us(next_frame_us - sim_clock_now_us());
+        next_frame_us += frame_duration_us;
+
+        for (uint32_t i = 0; i < conversions; ++i) {
+            const adc_digi_pattern_config_t* pattern = &handle->pattern[pattern_i];
+            pattern_i = (pattern_i + 1) % handle->pattern_num;
+
+            uint32_t raw = (uint64_t)sim_plant_adc_mv(pattern->channel) * SIM_ADC_RAW_MAX / SIM_ADC_FULL_SCALE_MV;
+            adc_digi_output_data_t data = {
+                .type2 = {
+                    .data = (raw > SIM_ADC_RAW_MAX) ? SIM_ADC_RAW_MAX : raw,
+                    .channel = pattern->channel,
+                    .unit = pattern->unit,
+                },
+            };
+            memcpy(&frame[i * SOC_ADC_DIGI_RESULT_BYTES], &data, sizeof(data));
+
+            adc_continuous_monitor_check(handle, pattern->channel, data.type2.data);
+        }
+
+        adc_continuous_evt_data_t edata = {
+            .conv_frame_buffer = frame,
+            .size = frame_size,
+        };
+
+        pthread_mutex_lock(&handle->lock);
+        bool overflow = (handle->count == handle->pool_frames);
+        if (overflow) {
+            // The DMA keeps writing, the oldest frame is lost
+            handle->head = (handle->head + 1) % handle->pool_frames;
+            handle->count--;
+        }
+        uint32_t tail = (handle->head + handle->count) % handle->pool_frames;
+        memcpy(&handle->pool[tail * frame_size], frame, frame_size);
+        handle->count++;
+        pthread_cond_broadcast(&handle->cond);
+        pthread_mutex_unlock(&handle->lock);
+
+        if (overflow && handle->cbs.on_pool_ovf != NULL) {
+            handle->cbs.on_pool_ovf(handle, &edata, handle->user_data);
+        }
+        if (handle->cbs.on_conv_done != NULL) {
+            handle->cbs.on_conv_done(handle, &edata, handle->user_data);
+        }
+    }
+
+    free(frame);
+    return NULL;
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t* hdl_config, adc_continuous_handle_t* ret_handle)
+{
+    if (hdl_config->conv_frame_size == 0 || hdl_config->conv_frame_size % SOC_ADC_DIGI_RESULT_BYTES != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    adc_continuous_handle_t handle = calloc(1, sizeof(struct adc_continuous_ctx_t));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle->handle_config = *hdl_config;
+    handle->pool_frames = hdl_config->max_store_buf_size / hdl_config->conv_frame_size;
+    if (handle->pool_frames == 0) {
+        handle->pool_frames = 1;
+    }
+    handle->pool = malloc(handle->pool_frames * hdl_config->conv_frame_size);
+    pthread_mutex_init(&handle->lock, NULL);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&handle->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    *ret_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t* config)
+{
+    if (config->pattern_num == 0 || config->pattern_num > SOC_ADC_PATT_LEN_MAX
+        || config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW || config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(handle->pattern, config->adc_pattern, config->pattern_num * sizeof(adc_digi_pattern_config_t));
+    handle->pattern_num = config->pattern_num;
+    handle->sample_freq_hz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t* cbs, void* user_data)
+{
+    handle->cbs = *cbs;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle)
+{
+    if (handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = true;
+    pthread_create(&handle->thread, NULL, adc_continuous_thread, handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle)
+{
+    if (!handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = false;
+    pthread_join(handle->thread, NULL);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_read(adc_continuous_handle_t handle, uint8_t* buf, uint32_t length_max, uint32_t* out_length, uint32_t timeout_ms)
+{
+    const uint32_t frame_size = handle->handle_config.conv_frame_size;
+    struct timespec deadline = sim_clock_deadline((int64_t)timeout_ms * 1000);
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+
+    pthread_mutex_lock(&handle->lock);
+    while (handle->count == 0 && timeout_ms > 0) {
+        if (pthread_cond_timedwait(&handle->cond, &handle->lock, &deadline) != 0) {
+            break;
+        }
+    }
+    if (handle->count > 0) {
+        uint32_t length = (length_max < frame_size) ? length_max : frame_size;
+        memcpy(buf, &handle->pool[handle->head * frame_size], length);
+        handle->head = (handle->head + 1) % handle->pool_frames;
+        handle->count--;
+        *out_length = length;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&handle->lock);
+
+    return ret;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle)
+{
+    if (handle->running) {
+        adc_continuous_stop(handle);
+    }
+    free(handle->pool);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_new_continuous_monitor(adc_continuous_handle_t handle, const adc_monitor_config_t* monitor_cfg, adc_monitor_handle_t* ret_handle)
+{
+    if (handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (int i = 0; i < SOC_ADC_DIGI_MONITOR_NUM; ++i) {
+        if (handle->monitors[i] == NULL) {
+            struct adc_monitor_t* monitor = calloc(1, sizeof(struct adc_monitor_t));
+            if (monitor == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            monitor->handle = handle;
+            monitor->config = *monitor_cfg;
+            handle->monitors[i] = monitor;
+            *ret_handle = monitor;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t adc_continuous_monitor_register_event_callbacks(adc_monitor_handle_t monitor_handle, const adc_monitor_evt_cbs_t* cbs, void* user_data)
+{
+    monitor_handle->cbs = *cbs;
+    monitor_handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_monitor_enable(adc_monitor_handle_t monitor_handle)
+{
+    monitor_handle->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_monitor_disable(adc_monitor_handle_t monitor_handle)
+{
+    monitor_handle->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t adc_del_continuous_monitor(adc_monitor_handle_t monitor_handle)
+{
+    if (monitor_handle->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    adc_continuous_handle_t handle = monitor_handle->handle;
+    for (int i = 0; i < SOC_ADC_DIGI_MONITOR_NUM; ++i) {
+        if (handle->monitors[i] == monitor_handle) {
+            handle->monitors[i] = NULL;
+        }
+    }
+    free(monitor_handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_curve_fitting(const adc_cali_curve_fitting_config_t* config, adc_cali_handle_t* ret_handle)
+{
+    adc_cali_handle_t handle = calloc(1, sizeof(struct adc_cali_scheme_t));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->atten = config->atten;
+    *ret_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_delete_scheme_curve_fitting(adc_cali_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage)
+{
+    *voltage = raw * SIM_ADC_FULL_SCALE_MV / SIM_ADC_RAW_MAX;
+    return ESP_OK;
+}
@@ -0,0 +1,50 @@
+#include "sim.h"
+
+#include <errno.h>
+
+static double s_speed = 1.0;
+static int64_t s_start_real_us;
+
+int64_t sim_clock_real_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void sim_clock_init(double speed)
+{
+    s_speed = (speed > 0) ? speed : 1.0;
+    s_start_real_us = sim_clock_real_us();
+}
+
+int64_t sim_clock_now_us(void)
+{
+    return (int64_t)((sim_clock_real_us() - s_start_real_us) * s_speed);
+}
+
+void sim_clock_sleep_us(int64_t duration_us)
+{
+    if (duration_us <= 0) {
+        return;
+    }
+
+    struct timespec deadline = sim_clock_deadline(duration_us);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+struct timespec sim_clock_deadline(int64_t duration_us)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    int64_t real_ns = (int64_t)(duration_us * 1000 / s_speed);
+    ts.tv_sec += real_ns / 1000000000;
+    ts.tv_nsec += real_ns % 1000000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
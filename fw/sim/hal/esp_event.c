@@ -0,0 +1,149 @@
+#include <esp_event.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct sim_event_handler {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void* arg;
+    volatile bool active;
+    struct sim_event_handler* next;
+} sim_event_handler_t;
+
+typedef struct sim_event {
+    esp_event_base_t base;
+    int32_t id;
+    void* data;
+    struct sim_event* next;
+} sim_event_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static sim_event_handler_t* s_handlers;
+static sim_event_t* s_head;
+static sim_event_t* s_tail;
+static bool s_started;
+
+static void* esp_event_thread(void* arg)
+{
+    while (1) {
+        pthread_mutex_lock(&s_lock);
+        while (s_head == NULL) {
+            pthread_cond_wait(&s_cond, &s_lock);
+        }
+        sim_event_t* event = s_head;
+        s_head = event->next;
+        if (s_head == NULL) {
+            s_tail = NULL;
+        }
+        pthread_mutex_unlock(&s_lock);
+
+        // Handlers are only ever added, so the list can be walked without the lock
+        for (sim_event_handler_t* handler = s_handlers; handler != NULL; handler = handler->next) {
+            if (handler->active
+                && (handler->base == ESP_EVENT_ANY_BASE || handler->base == event->base)
+                && (handler->id == ESP_EVENT_ANY_ID || handler->id == event->id)) {
+                handler->handler(handler->arg, event->base, event->id, event->data);
+            }
+        }
+
+        free(event->data);
+        free(event);
+    }
+    return NULL;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    pthread_mutex_lock(&s_lock);
+    bool started = s_started;
+    s_started = true;
+    pthread_mutex_unlock(&s_lock);
+
+    if (started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, esp_event_thread, NULL);
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void* event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    sim_event_t* event = calloc(1, sizeof(sim_event_t));
+    if (event == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    event->base = event_base;
+    event->id = event_id;
+    if (event_data != NULL && event_data_size > 0) {
+        event->data = malloc(event_data_size);
+        memcpy(event->data, event_data, event_data_size);
+    }
+
+    pthread_mutex_lock(&s_lock);
+    if (s_tail != NULL) {
+        s_tail->next = event;
+    } else {
+        s_head = event;
+    }
+    s_tail = event;
+    pthread_cond_signal(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_event_isr_post(esp_event_base_t event_base, int32_t event_id, const void* event_data, size_t event_data_size, BaseType_t* task_unblocked)
+{
+    if (task_unblocked != NULL) {
+        *task_unblocked = pdFALSE;
+    }
+    return esp_event_post(event_base, event_id, event_data, event_data_size, 0);
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void* event_handler_arg)
+{
+    return esp_event_handler_instance_register(event_base, event_id, event_handler, event_handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void* event_handler_arg, esp_event_handler_instance_t* instance)
+{
+    sim_event_handler_t* handler = calloc(1, sizeof(sim_event_handler_t));
+    if (handler == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handler->base = event_base;
+    handler->id = event_id;
+    handler->handler = event_handler;
+    handler->arg = event_handler_arg;
+    handler->active = true;
+
+    pthread_mutex_lock(&s_lock);
+    handler->next = s_handlers;
+    s_handlers = handler;
+    pthread_mutex_unlock(&s_lock);
+
+    if (instance != NULL) {
+        *instance = handler;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler)
+{
+    pthread_mutex_lock(&s_lock);
+    for (sim_event_handler_t* handler = s_handlers; handler != NULL; handler = handler->next) {
+        if (handler->base == event_base && handler->id == event_id && handler->handler == event_handler) {
+            handler->active = false; // The entry is kept so dispatch can walk the list without the lock
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    return ESP_OK;
+}
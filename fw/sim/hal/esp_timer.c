@@ -0,0 +1,181 @@
+#include <esp_timer.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    int64_t alarm_us;
+    uint64_t period_us;
+    bool armed;
+    struct esp_timer* next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static struct esp_timer* s_timers;
+
+static void* esp_timer_thread(void* arg)
+{
+    pthread_mutex_lock(&s_lock);
+    while (1) {
+        struct esp_timer* next = NULL;
+        for (struct esp_timer* timer = s_timers; timer != NULL; timer = timer->next) {
+            if (timer->armed && (next == NULL || timer->alarm_us < next->alarm_us)) {
+                next = timer;
+            }
+        }
+
+        if (next == NULL) {
+            pthread_cond_wait(&s_cond, &s_lock);
+            continue;
+        }
+
+        int64_t now = sim_clock_now_us();
+        if (next->alarm_us > now) {
+            struct timespec deadline = sim_clock_deadline(next->alarm_us - now);
+            pthread_cond_timedwait(&s_cond, &s_lock, &deadline);
+            continue; // The timer list may have changed
+        }
+
+        if (next->period_us > 0) {
+            next->alarm_us += next->period_us;
+            if (next->alarm_us < now) {
+                next->alarm_us = now + next->period_us; // Skip events we could not keep up with
+            }
+        } else {
+            next->armed = false;
+        }
+
+        esp_timer_cb_t callback = next->callback;
+        void* callback_arg = next->arg;
+        pthread_mutex_unlock(&s_lock);
+        callback(callback_arg);
+        pthread_mutex_lock(&s_lock);
+    }
+    return NULL;
+}
+
+static void esp_timer_start_thread(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, esp_timer_thread, NULL);
+    pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+    pthread_once(&s_once, esp_timer_start_thread);
+
+    struct esp_timer* timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+
+    pthread_mutex_lock(&s_lock);
+    timer->next = s_timers;
+    s_timers = timer;
+    pthread_mutex_unlock(&s_lock);
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t esp_timer_arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us, bool restart)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&s_lock);
+    if (timer->armed && !restart) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->alarm_us = sim_clock_now_us() + timeout_us;
+        timer->period_us = period_us;
+        timer->armed = true;
+        pthread_cond_broadcast(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    return ret;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return esp_timer_arm(timer, timeout_us, 0, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return esp_timer_arm(timer, period, period, false);
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    pthread_mutex_lock(&s_lock);
+    bool armed = timer->armed;
+    uint64_t period_us = timer->period_us;
+    pthread_mutex_unlock(&s_lock);
+
+    if (!armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_timer_arm(timer, timeout_us, (period_us > 0) ? timeout_us : 0, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&s_lock);
+    if (!timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_lock);
+
+    return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_lock);
+    for (struct esp_timer** it = &s_timers; *it != NULL; it = &(*it)->next) {
+        if (*it == timer) {
+            *it = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_lock);
+    bool armed = timer->armed;
+    pthread_mutex_unlock(&s_lock);
+    return armed;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_clock_now_us();
+}
@@ -0,0 +1,688 @@
+// FreeRTOS on top of POSIX threads. Priorities are recorded but not enforced, cores map onto the
+// first host CPUs when there are enough of them.
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+
+#include <errno.h>
+#include <esp_timer.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define SIM_TICK_US (1000000 / configTICK_RATE_HZ)
+
+struct sim_task {
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void* arg;
+    UBaseType_t priority;
+    UBaseType_t number;
+    BaseType_t core_id;
+    uint32_t stack_depth;
+    int64_t stall_until_us; // Injected by sim_task_stall, in simulated time
+    clockid_t cpu_clock;
+    bool cpu_clock_valid;
+    bool deleted;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+
+    struct sim_task* next;
+};
+
+struct sim_semaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t* storage;
+    bool storage_owned;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct sim_timer {
+    esp_timer_handle_t timer;
+    TimerCallbackFunction_t callback;
+    void* id;
+    TickType_t period;
+    bool auto_reload;
+};
+
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task* s_tasks;
+static UBaseType_t s_tasks_number;
+static __thread struct sim_task* s_current_task;
+
+static bool s_ignore_affinity;
+
+static pthread_mutex_t s_critical_lock;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void sim_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void sim_cond_wait_cancelled(void* lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+// Returns false once the deadline has passed. A task deleted while it waits gives the lock back,
+// the waits re-acquire it before the thread is cancelled.
+static bool sim_cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, const struct timespec* deadline)
+{
+    bool signalled = true;
+
+    pthread_cleanup_push(sim_cond_wait_cancelled, lock);
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+    } else {
+        signalled = (pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT);
+    }
+    pthread_cleanup_pop(0);
+
+    return signalled;
+}
+
+// A stalled task hangs at its next blocking call, before it takes any lock
+static void sim_task_stall_point(void)
+{
+    struct sim_task* task = s_current_task;
+    if (task != NULL && task->stall_until_us > 0) {
+        sim_clock_sleep_us(task->stall_until_us - sim_clock_now_us());
+        task->stall_until_us = 0;
+    }
+}
+
+static void sim_critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void sim_critical_enter(portMUX_TYPE* mux)
+{
+    pthread_once(&s_critical_once, sim_critical_init);
+    pthread_mutex_lock(&s_critical_lock);
+}
+
+void sim_critical_exit(portMUX_TYPE* mux)
+{
+    pthread_mutex_unlock(&s_critical_lock);
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    int cpu = sched_getcpu();
+    return (cpu < 0) ? 0 : (cpu % portNUM_PROCESSORS);
+}
+
+/* Tasks */
+
+void sim_tasks_ignore_affinity(bool ignore)
+{
+    s_ignore_affinity = ignore;
+}
+
+bool sim_task_stall(const char* name, int64_t duration_us)
+{
+    bool found = false;
+
+    // Newest first, so a restarted task is stalled rather than the deleted one
+    pthread_mutex_lock(&s_tasks_lock);
+    for (struct sim_task* task = s_tasks; task != NULL; task = task->next) {
+        if (!task->deleted && strcmp(task->name, name) == 0) {
+            task->stall_until_us = sim_clock_now_us() + duration_us;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+
+    return found;
+}
+
+// Unpinned tasks still share the same host CPUs as the target cores, so they compete the same way
+static void sim_task_set_affinity(struct sim_task* task)
+{
+    static bool warned;
+
+    if (sysconf(_SC_NPROCESSORS_ONLN) < portNUM_PROCESSORS) {
+        if (!warned) {
+            warned = true;
+            fprintf(stderr, "Fewer host CPUs than target cores, core affinity is not enforced\n");
+        }
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (task->core_id < portNUM_PROCESSORS && !s_ignore_affinity) {
+        CPU_SET(task->core_id, &set);
+    } else {
+        for (int cpu = 0; cpu < portNUM_PROCESSORS; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    pthread_setaffinity_np(task->thread, sizeof(set), &set);
+}
+
+static void* sim_task_entry(void* arg)
+{
+    struct sim_task* task = arg;
+    s_current_task = task;
+    task->cpu_clock_valid = (pthread_getcpuclockid(pthread_self(), &task->cpu_clock) == 0);
+
+    task->fn(task->arg);
+
+    // Returning from a task function is a bug on the target, be lenient here
+    task->deleted = true;
+    return NULL;
+}
+
+static struct sim_task* sim_task_create(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority, BaseType_t core_id)
+{
+    struct sim_task* task = calloc(1, sizeof(struct sim_task));
+    if (task == NULL) {
+        return NULL;
+    }
+
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->fn = fn;
+    task->arg = arg;
+    task->priority = priority;
+    task->core_id = core_id;
+    task->stack_depth = stack_depth;
+    pthread_mutex_init(&task->lock, NULL);
+    sim_cond_init(&task->cond);
+
+    pthread_mutex_lock(&s_tasks_lock);
+    task->number = ++s_tasks_number;
+    task->next = s_tasks;
+    s_tasks = task;
+    pthread_mutex_unlock(&s_tasks_lock);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&task->thread, &attr, sim_task_entry, task);
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        task->deleted = true;
+        return NULL;
+    }
+    sim_task_set_affinity(task);
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char* pcName, const uint32_t usStackDepth,
+    void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask, const BaseType_t xCoreID)
+{
+    struct sim_task* task = sim_task_create(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, xCoreID);
+    if (pxCreatedTask != NULL) {
+        *pxCreatedTask = task;
+    }
+    return (task != NULL) ? pdPASS : pdFAIL;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t pxTaskCode, const char* pcName, const uint32_t ulStackDepth,
+    void* pvParameters, UBaseType_t uxPriority, StackType_t* puxStackBuffer, StaticTask_t* pxTaskBuffer, const BaseType_t xCoreID)
+{
+    // Host threads bring their own stack, the buffers only need to exist
+    pxTaskBuffer->stack = puxStackBuffer;
+    pxTaskBuffer->depth = ulStackDepth;
+    return sim_task_create(pxTaskCode, pcName, ulStackDepth, pvParameters, uxPriority, xCoreID);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    struct sim_task* task = (xTaskToDelete != NULL) ? xTaskToDelete : s_current_task;
+    if (task == NULL) {
+        return;
+    }
+
+    task->deleted = true;
+    if (task == s_current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    sim_task_stall_point();
+    if (xTicksToDelay == 0) {
+        sched_yield();
+        return;
+    }
+    sim_clock_sleep_us((int64_t)xTicksToDelay * SIM_TICK_US);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_clock_now_us() / SIM_TICK_US;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t xCoreID)
+{
+    return NULL; // There are no idle tasks on the host
+}
+
+char* pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    struct sim_task* task = (xTaskToQuery != NULL) ? xTaskToQuery : s_current_task;
+    return (task != NULL) ? task->name : "main";
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    UBaseType_t number = 0;
+
+    pthread_mutex_lock(&s_tasks_lock);
+    for (struct sim_task* task = s_tasks; task != NULL; task = task->next) {
+        number += task->deleted ? 0 : 1;
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+
+    return number;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* const pxTaskStatusArray, const UBaseType_t uxArraySize, uint32_t* const pulTotalRunTime)
+{
+    UBaseType_t number = 0;
+
+    pthread_mutex_lock(&s_tasks_lock);
+    for (struct sim_task* task = s_tasks; task != NULL; task = task->next) {
+        if (task->deleted) {
+            continue;
+        }
+        if (number >= uxArraySize) {
+            number = 0;
+            break;
+        }
+
+        // Run time is host CPU time, the total is host wall clock time
+        uint32_t run_time = 0;
+        struct timespec ts;
+        if (task->cpu_clock_valid && clock_gettime(task->cpu_clock, &ts) == 0) {
+            run_time = (uint32_t)((int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+        }
+
+        pxTaskStatusArray[number++] = (TaskStatus_t) {
+            .xHandle = task,
+            .pcTaskName = task->name,
+            .xTaskNumber = task->number,
+            .eCurrentState = eReady,
+            .uxCurrentPriority = task->priority,
+            .uxBasePriority = task->priority,
+            .ulRunTimeCounter = run_time,
+            .usStackHighWaterMark = task->stack_depth,
+            .xCoreID = task->core_id,
+        };
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+
+    if (pulTotalRunTime != NULL) {
+        *pulTotalRunTime = (uint32_t)sim_clock_real_us();
+    }
+    return number;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    struct sim_task* task = (xTask != NULL) ? xTask : s_current_task;
+    return (task != NULL) ? task->stack_depth : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct sim_task* task = s_current_task;
+    assert(task != NULL);
+
+    sim_task_stall_point();
+    struct timespec deadline = sim_clock_deadline((int64_t)xTicksToWait * SIM_TICK_US);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_value == 0 && xTicksToWait > 0) {
+        if (!sim_cond_wait(&task->cond, &task->lock, xTicksToWait, &deadline)) {
+            break;
+        }
+    }
+    uint32_t value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = xClearCountOnExit ? 0 : (value - 1);
+    }
+    pthread_mutex_unlock(&task->lock);
+
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    struct sim_task* task = xTaskToNotify;
+
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+}
+
+/* Semaphores */
+
+SemaphoreHandle_t sim_semaphore_create(UBaseType_t max_count, UBaseType_t initial_count, StaticSemaphore_t* buffer)
+{
+    struct sim_semaphore* semaphore = calloc(1, sizeof(struct sim_semaphore));
+    if (semaphore == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&semaphore->lock, NULL);
+    sim_cond_init(&semaphore->cond);
+    semaphore->count = initial_count;
+    semaphore->max_count = max_count;
+
+    if (buffer != NULL) {
+        buffer->storage = semaphore;
+    }
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    sim_task_stall_point();
+    struct timespec deadline = sim_clock_deadline((int64_t)xBlockTime * SIM_TICK_US);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&xSemaphore->lock);
+    while (xSemaphore->count == 0 && xBlockTime > 0) {
+        if (!sim_cond_wait(&xSemaphore->cond, &xSemaphore->lock, xBlockTime, &deadline)) {
+            break;
+        }
+    }
+    if (xSemaphore->count > 0) {
+        xSemaphore->count--;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&xSemaphore->lock);
+
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&xSemaphore->lock);
+    if (xSemaphore->count < xSemaphore->max_count) {
+        xSemaphore->count++;
+        pthread_cond_signal(&xSemaphore->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&xSemaphore->lock);
+
+    return ret;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t* pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xSemaphoreGive(xSemaphore);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_destroy(&xSemaphore->lock);
+    pthread_cond_destroy(&xSemaphore->cond);
+    free(xSemaphore);
+}
+
+/* Queues */
+
+static QueueHandle_t sim_queue_create(UBaseType_t length, UBaseType_t item_size, uint8_t* storage)
+{
+    struct sim_queue* queue = calloc(1, sizeof(struct sim_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    queue->storage_owned = (storage == NULL);
+    queue->storage = (storage != NULL) ? storage : malloc((size_t)length * item_size);
+    if (queue->storage == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    pthread_mutex_init(&queue->lock, NULL);
+    sim_cond_init(&queue->cond);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    return sim_queue_create(uxQueueLength, uxItemSize, NULL);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t* pucQueueStorageBuffer, StaticQueue_t* pxQueueBuffer)
+{
+    QueueHandle_t queue = sim_queue_create(uxQueueLength, uxItemSize, pucQueueStorageBuffer);
+    pxQueueBuffer->storage = queue;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    if (xQueue->storage_owned) {
+        free(xQueue->storage);
+    }
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->cond);
+    free(xQueue);
+}
+
+static BaseType_t sim_queue_send(QueueHandle_t queue, const void* item, TickType_t ticks, bool overwrite)
+{
+    struct timespec deadline = sim_clock_deadline((int64_t)ticks * SIM_TICK_US);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    while (!overwrite && queue->count == queue->length && ticks > 0) {
+        if (!sim_cond_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+            break;
+        }
+    }
+    if (overwrite && queue->count == queue->length) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+    if (queue->count < queue->length) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->storage[(size_t)tail * queue->item_size], item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return ret;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait)
+{
+    return sim_queue_send(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void* pvItemToQueue, BaseType_t* pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return sim_queue_send(xQueue, pvItemToQueue, 0, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t xQueue, const void* pvItemToQueue)
+{
+    return sim_queue_send(xQueue, pvItemToQueue, 0, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait)
+{
+    sim_task_stall_point();
+    struct timespec deadline = sim_clock_deadline((int64_t)xTicksToWait * SIM_TICK_US);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0 && xTicksToWait > 0) {
+        if (!sim_cond_wait(&xQueue->cond, &xQueue->lock, xTicksToWait, &deadline)) {
+            break;
+        }
+    }
+    if (xQueue->count > 0) {
+        memcpy(pvBuffer, &xQueue->storage[(size_t)xQueue->head * xQueue->item_size], xQueue->item_size);
+        xQueue->head = (xQueue->head + 1) % xQueue->length;
+        xQueue->count--;
+        pthread_cond_broadcast(&xQueue->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+
+    return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t xQueue)
+{
+    return xQueue->length - uxQueueMessagesWaiting(xQueue);
+}
+
+/* Software timers, dispatched from the esp_timer thread instead of a timer service task */
+
+static void sim_timer_callback(void* arg)
+{
+    struct sim_timer* timer = arg;
+    timer->callback(timer);
+}
+
+TimerHandle_t xTimerCreate(const char* pcTimerName, const TickType_t xTimerPeriodInTicks, const BaseType_t xAutoReload,
+    void* const pvTimerID, TimerCallbackFunction_t pxCallbackFunction)
+{
+    struct sim_timer* timer = calloc(1, sizeof(struct sim_timer));
+    if (timer == NULL) {
+        return NULL;
+    }
+
+    timer->callback = pxCallbackFunction;
+    timer->id = pvTimerID;
+    timer->period = xTimerPeriodInTicks;
+    timer->auto_reload = xAutoReload;
+
+    const esp_timer_create_args_t args = {
+        .callback = sim_timer_callback,
+        .arg = timer,
+        .name = pcTimerName,
+    };
+    if (esp_timer_create(&args, &timer->timer) != ESP_OK) {
+        free(timer);
+        return NULL;
+    }
+    return timer;
+}
+
+TimerHandle_t xTimerCreateStatic(const char* pcTimerName, const TickType_t xTimerPeriodInTicks, const BaseType_t xAutoReload,
+    void* const pvTimerID, TimerCallbackFunction_t pxCallbackFunction, StaticTimer_t* pxTimerBuffer)
+{
+    TimerHandle_t timer = xTimerCreate(pcTimerName, xTimerPeriodInTicks, xAutoReload, pvTimerID, pxCallbackFunction);
+    pxTimerBuffer->timer = timer;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    uint64_t period_us = (uint64_t)xTimer->period * SIM_TICK_US;
+
+    esp_timer_stop(xTimer->timer);
+    esp_err_t ret = xTimer->auto_reload ? esp_timer_start_periodic(xTimer->timer, period_us) : esp_timer_start_once(xTimer->timer, period_us);
+    return (ret == ESP_OK) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    esp_timer_stop(xTimer->timer);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerResetFromISR(TimerHandle_t xTimer, BaseType_t* pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xTimerStart(xTimer, 0);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+{
+    xTimer->period = xNewPeriod;
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+void* pvTimerGetTimerID(const TimerHandle_t xTimer)
+{
+    return xTimer->id;
+}
@@ -0,0 +1,189 @@
+#include <driver/gpio.h>
+
+#include <pthread.h>
+
+#include "sim.h"
+
+typedef struct
+{
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    int input_level;
+    int output_level;
+    gpio_isr_t isr_handler;
+    void* isr_arg;
+} sim_gpio_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_gpio_t s_gpios[GPIO_NUM_MAX];
+static bool s_isr_service_installed;
+
+static bool gpio_is_valid(gpio_num_t gpio_num)
+{
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX;
+}
+
+esp_err_t gpio_config(const gpio_config_t* pGPIOConfig)
+{
+    pthread_mutex_lock(&s_lock);
+    for (gpio_num_t i = 0; i < GPIO_NUM_MAX; ++i) {
+        if (pGPIOConfig->pin_bit_mask & (1ULL << i)) {
+            s_gpios[i].mode = pGPIOConfig->mode;
+            s_gpios[i].intr_type = pGPIOConfig->intr_type;
+            s_gpios[i].intr_enabled = (pGPIOConfig->intr_type != GPIO_INTR_DISABLE);
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_gpios[gpio_num].mode = GPIO_MODE_INPUT;
+    s_gpios[gpio_num].intr_type = GPIO_INTR_DISABLE;
+    s_gpios[gpio_num].intr_enabled = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpios[gpio_num].output_level = level ? 1 : 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return 0;
+    }
+    return (s_gpios[gpio_num].mode & GPIO_MODE_OUTPUT) ? s_gpios[gpio_num].output_level : s_gpios[gpio_num].input_level;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpios[gpio_num].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return gpio_is_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpios[gpio_num].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpios[gpio_num].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpios[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    pthread_mutex_lock(&s_lock);
+    bool installed = s_isr_service_installed;
+    s_isr_service_installed = true;
+    pthread_mutex_unlock(&s_lock);
+
+    return installed ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args)
+{
+    if (!gpio_is_valid(gpio_num) || !s_isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_gpios[gpio_num].isr_handler = isr_handler;
+    s_gpios[gpio_num].isr_arg = args;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    return gpio_isr_handler_add(gpio_num, NULL, NULL);
+}
+
+esp_err_t gpio_hold_en(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+void sim_gpio_set_input(gpio_num_t gpio_num, int level)
+{
+    if (!gpio_is_valid(gpio_num)) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    sim_gpio_t* gpio = &s_gpios[gpio_num];
+    int prev_level = gpio->input_level;
+    gpio->input_level = level ? 1 : 0;
+
+    bool fire = false;
+    if (gpio->intr_enabled && gpio->isr_handler != NULL && prev_level != gpio->input_level) {
+        switch (gpio->intr_type) {
+        case GPIO_INTR_POSEDGE:
+            fire = (gpio->input_level == 1);
+            break;
+        case GPIO_INTR_NEGEDGE:
+            fire = (gpio->input_level == 0);
+            break;
+        case GPIO_INTR_ANYEDGE:
+            fire = true;
+            break;
+        default:
+            break;
+        }
+    }
+    gpio_isr_t handler = gpio->isr_handler;
+    void* arg = gpio->isr_arg;
+    pthread_mutex_unlock(&s_lock);
+
+    // The plant thread plays the role of the interrupt controller
+    if (fire) {
+        handler(arg);
+    }
+}
+
+int sim_gpio_get_output(gpio_num_t gpio_num)
+{
+    return gpio_is_valid(gpio_num) ? s_gpios[gpio_num].output_level : 0;
+}
@@ -0,0 +1,152 @@
+// I2C master driver with an SHTC3 at 0x70 on both buses, backed by the plant model
+
+#include <driver/i2c_master.h>
+
+#include <stdlib.h>
+
+#include "sim.h"
+
+#define SIM_SHTC3_ADDR 0x70
+#define SIM_SHTC3_MEASUREMENT_US 12100
+
+struct i2c_master_bus_t {
+    i2c_master_bus_config_t config;
+};
+
+struct i2c_master_dev_t {
+    struct i2c_master_bus_t* bus;
+    uint16_t address;
+    bool awake;
+    int64_t measurement_start_us;
+};
+
+static uint8_t sim_shtc3_crc8(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0xff;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x31) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t* bus_config, i2c_master_bus_handle_t* ret_bus_handle)
+{
+    struct i2c_master_bus_t* bus = calloc(1, sizeof(struct i2c_master_bus_t));
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bus->config = *bus_config;
+
+    // Pulled-up idle bus
+    sim_gpio_set_input(bus_config->sda_io_num, 1);
+    sim_gpio_set_input(bus_config->scl_io_num, 1);
+
+    *ret_bus_handle = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle)
+{
+    free(bus_handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t* dev_config, i2c_master_dev_handle_t* ret_handle)
+{
+    struct i2c_master_dev_t* device = calloc(1, sizeof(struct i2c_master_dev_t));
+    if (device == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    device->bus = bus_handle;
+    device->address = dev_config->device_address;
+
+    *ret_handle = device;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+static bool sim_i2c_device_acks(i2c_master_dev_handle_t device)
+{
+    return device->address == SIM_SHTC3_ADDR && sim_plant_sht_present(device->bus->config.i2c_port);
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size, int xfer_timeout_ms)
+{
+    if (!sim_i2c_device_acks(i2c_dev)) {
+        return ESP_FAIL; // Address NACK
+    }
+    if (write_size != 2) {
+        return ESP_FAIL;
+    }
+
+    uint16_t command = ((uint16_t)write_buffer[0] << 8) | write_buffer[1];
+    switch (command) {
+    case 0x3517: // Wakeup
+        i2c_dev->awake = true;
+        return ESP_OK;
+    case 0xB098: // Sleep
+        i2c_dev->awake = false;
+        return ESP_OK;
+    case 0x7866: // Measure, T first, no clock stretching
+        if (!i2c_dev->awake) {
+            return ESP_FAIL;
+        }
+        i2c_dev->measurement_start_us = sim_clock_now_us();
+        return ESP_OK;
+    default:
+        return ESP_FAIL;
+    }
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    if (!sim_i2c_device_acks(i2c_dev) || !i2c_dev->awake || i2c_dev->measurement_start_us == 0) {
+        return ESP_FAIL;
+    }
+    if (sim_clock_now_us() - i2c_dev->measurement_start_us < SIM_SHTC3_MEASUREMENT_US) {
+        return ESP_FAIL; // Still measuring
+    }
+
+    int32_t temperature_mc;
+    int32_t rel_hum_mperct;
+    sim_plant_sht_read(i2c_dev->bus->config.i2c_port, &temperature_mc, &rel_hum_mperct);
+
+    uint16_t temp_raw = ((int64_t)(temperature_mc + 45000) << 13) / 21875;
+    uint16_t hum_raw = ((int64_t)rel_hum_mperct << 13) / 12500;
+    uint8_t data[6] = {
+        temp_raw >> 8,
+        temp_raw & 0xff,
+        0,
+        hum_raw >> 8,
+        hum_raw & 0xff,
+        0,
+    };
+    data[2] = sim_shtc3_crc8(&data[0], 2);
+    data[5] = sim_shtc3_crc8(&data[3], 2);
+
+    for (size_t i = 0; i < read_size; ++i) {
+        read_buffer[i] = (i < sizeof(data)) ? data[i] : 0xff;
+    }
+    i2c_dev->measurement_start_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    esp_err_t ret = i2c_master_transmit(i2c_dev, write_buffer, write_size, xfer_timeout_ms);
+    return (ret == ESP_OK) ? i2c_master_receive(i2c_dev, read_buffer, read_size, xfer_timeout_ms) : ret;
+}
+
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle)
+{
+    sim_gpio_set_input(bus_handle->config.sda_io_num, 1);
+    return ESP_OK;
+}
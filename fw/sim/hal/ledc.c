@@ -0,0 +1,99 @@
+#include <driver/ledc.h>
+
+#include "sim.h"
+
+typedef struct
+{
+    bool configured;
+    ledc_timer_t timer;
+    uint32_t duty;
+    uint32_t pending_duty;
+    bool running;
+    uint32_t idle_level;
+} sim_ledc_channel_t;
+
+static ledc_timer_config_t s_timers[LEDC_TIMER_MAX];
+static sim_ledc_channel_t s_channels[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* timer_conf)
+{
+    if (timer_conf->timer_num >= LEDC_TIMER_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_timers[timer_conf->timer_num] = *timer_conf;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* ledc_conf)
+{
+    if (ledc_conf->channel >= LEDC_CHANNEL_MAX || ledc_conf->timer_sel >= LEDC_TIMER_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_channels[ledc_conf->channel] = (sim_ledc_channel_t) {
+        .configured = true,
+        .timer = ledc_conf->timer_sel,
+        .duty = ledc_conf->duty,
+        .pending_duty = ledc_conf->duty,
+        .running = true,
+    };
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_channels[channel].pending_duty = duty;
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    return (channel < LEDC_CHANNEL_MAX) ? s_channels[channel].duty : 0;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_channels[channel].duty = s_channels[channel].pending_duty;
+    s_channels[channel].running = true;
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_channels[channel].running = false;
+    s_channels[channel].idle_level = idle_level;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t speed_mode, ledc_timer_t timer_num, uint32_t freq_hz)
+{
+    if (timer_num >= LEDC_TIMER_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_timers[timer_num].freq_hz = freq_hz;
+    return ESP_OK;
+}
+
+float sim_ledc_get_high_fraction(ledc_channel_t channel)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) {
+        return 0.0f;
+    }
+
+    const sim_ledc_channel_t* state = &s_channels[channel];
+    if (!state->running) {
+        return state->idle_level ? 1.0f : 0.0f;
+    }
+
+    uint32_t resolution = s_timers[state->timer].duty_resolution;
+    uint32_t range = 1UL << ((resolution > 0) ? resolution : 8);
+    return (float)state->duty / range;
+}
@@ -0,0 +1,208 @@
+// Non-volatile storage kept in process memory, only survives the simulation run with sim_nvs_set_file
+
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_NVS_MAX_ENTRIES 32
+#define SIM_NVS_MAX_NAMESPACES 8
+#define SIM_NVS_KEY_MAX 16 // Including the terminator, as on the target
+
+typedef struct
+{
+    uint8_t namespace_i;
+    char key[SIM_NVS_KEY_MAX];
+    void* value;
+    size_t length;
+} sim_nvs_entry_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static char s_namespaces[SIM_NVS_MAX_NAMESPACES][SIM_NVS_KEY_MAX];
+static size_t s_namespaces_number;
+static sim_nvs_entry_t s_entries[SIM_NVS_MAX_ENTRIES];
+static size_t s_entries_number;
+static const char* s_file;
+
+static sim_nvs_entry_t* sim_nvs_find(nvs_handle_t handle, const char* key)
+{
+    for (size_t i = 0; i < s_entries_number; ++i) {
+        if (s_entries[i].namespace_i == handle && strcmp(s_entries[i].key, key) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Records of namespace, key, length and value, rewritten as a whole
+static void sim_nvs_save_locked(void)
+{
+    FILE* file = fopen(s_file, "wb");
+    if (file == NULL) {
+        perror(s_file);
+        return;
+    }
+    for (size_t i = 0; i < s_entries_number; ++i) {
+        const sim_nvs_entry_t* entry = &s_entries[i];
+        const uint32_t length = entry->length;
+        fwrite(s_namespaces[entry->namespace_i], SIM_NVS_KEY_MAX, 1, file);
+        fwrite(entry->key, SIM_NVS_KEY_MAX, 1, file);
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(entry->value, entry->length, 1, file);
+    }
+    fclose(file);
+}
+
+bool sim_nvs_set_file(const char* path)
+{
+    s_file = path;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return true; // Blank flash
+    }
+
+    bool ok = true;
+    char namespace_name[SIM_NVS_KEY_MAX];
+    char key[SIM_NVS_KEY_MAX];
+    uint32_t length;
+    while (ok && fread(namespace_name, SIM_NVS_KEY_MAX, 1, file) == 1) {
+        void* value = NULL;
+        nvs_handle_t handle;
+        ok = fread(key, SIM_NVS_KEY_MAX, 1, file) == 1 && fread(&length, sizeof(length), 1, file) == 1
+            && namespace_name[SIM_NVS_KEY_MAX - 1] == '\0' && key[SIM_NVS_KEY_MAX - 1] == '\0'
+            && (value = malloc(length)) != NULL && fread(value, length, 1, file) == 1
+            && nvs_open(namespace_name, NVS_READWRITE, &handle) == ESP_OK
+            && nvs_set_blob(handle, key, value, length) == ESP_OK;
+        free(value);
+    }
+    fclose(file);
+    return ok;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&s_lock);
+    for (size_t i = 0; i < s_entries_number; ++i) {
+        free(s_entries[i].value);
+    }
+    s_entries_number = 0;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* namespace_name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+{
+    if (strlen(namespace_name) >= SIM_NVS_KEY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    size_t i = 0;
+    while (i < s_namespaces_number && strcmp(s_namespaces[i], namespace_name) != 0) {
+        ++i;
+    }
+    if (i == s_namespaces_number) {
+        if (open_mode == NVS_READONLY) {
+            ret = ESP_ERR_NVS_NOT_FOUND;
+        } else if (s_namespaces_number == SIM_NVS_MAX_NAMESPACES) {
+            ret = ESP_ERR_NVS_NO_FREE_PAGES;
+        } else {
+            strcpy(s_namespaces[s_namespaces_number++], namespace_name);
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    *out_handle = i;
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if (s_file != NULL) {
+        pthread_mutex_lock(&s_lock);
+        sim_nvs_save_locked();
+        pthread_mutex_unlock(&s_lock);
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    sim_nvs_entry_t* entry = sim_nvs_find(handle, key);
+    if (entry == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = entry->length;
+    } else if (*length < entry->length) {
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->value, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    if (strlen(key) >= SIM_NVS_KEY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    void* copy = malloc(length);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    sim_nvs_entry_t* entry = sim_nvs_find(handle, key);
+    if (entry == NULL && s_entries_number < SIM_NVS_MAX_ENTRIES) {
+        entry = &s_entries[s_entries_number++];
+        entry->namespace_i = handle;
+        strcpy(entry->key, key);
+        entry->value = NULL;
+    }
+    if (entry == NULL) {
+        ret = ESP_ERR_NVS_NO_FREE_PAGES;
+        free(copy);
+    } else {
+        free(entry->value);
+        entry->value = copy;
+        entry->length = length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+    pthread_mutex_lock(&s_lock);
+    sim_nvs_entry_t* entry = sim_nvs_find(handle, key);
+    if (entry != NULL) {
+        free(entry->value);
+        *entry = s_entries[--s_entries_number];
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
@@ -0,0 +1,127 @@
+// Two OTA app partitions and the otadata state, without a flash behind them
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+#define TAG "sim_ota"
+
+#define SIM_OTA_IMAGE_MAGIC 0xe9
+#define SIM_OTA_IMAGE_HEADER_LEN 24
+#define SIM_OTA_SECTOR_SIZE 4096
+#define SIM_OTA_SECTOR_ERASE_US 25000 // Typical 4 KB erase, the uploading task waits for it
+
+static const esp_partition_t s_partitions[] = {
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x20000, 0x300000, "ota_0", false },
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x320000, 0x300000, "ota_1", false },
+};
+
+static const esp_partition_t* s_running = &s_partitions[0];
+static esp_ota_img_states_t s_running_state = ESP_OTA_IMG_VALID;
+
+static struct {
+    const esp_partition_t* partition;
+    size_t written;
+} s_update;
+
+void sim_ota_set_pending_verify(bool pending)
+{
+    s_running_state = pending ? ESP_OTA_IMG_PENDING_VERIFY : ESP_OTA_IMG_VALID;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void)
+{
+    return s_running;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from)
+{
+    return (s_running == &s_partitions[0]) ? &s_partitions[1] : &s_partitions[0];
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state)
+{
+    if (partition != s_running) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *ota_state = s_running_state;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle)
+{
+    if (partition == s_running) {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    if (s_update.partition != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_update.partition = partition;
+    s_update.written = 0;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+
+    if (s_update.partition == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_update.written == 0 && size > 0 && bytes[0] != SIM_OTA_IMAGE_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (s_update.written + size > s_update.partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Sequential writes erase each sector when the image reaches it
+    size_t sectors = (s_update.written + size + SIM_OTA_SECTOR_SIZE - 1) / SIM_OTA_SECTOR_SIZE
+        - (s_update.written + SIM_OTA_SECTOR_SIZE - 1) / SIM_OTA_SECTOR_SIZE;
+    sim_clock_sleep_us(sectors * SIM_OTA_SECTOR_ERASE_US);
+
+    s_update.written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    size_t written = s_update.written;
+
+    if (s_update.partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_update.partition = NULL;
+
+    return (written < SIM_OTA_IMAGE_HEADER_LEN) ? ESP_ERR_OTA_VALIDATE_FAILED : ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    s_update.partition = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition)
+{
+    ESP_LOGI(TAG, "Boot partition set to %s", partition->label);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    ESP_LOGI(TAG, "%s marked valid", s_running->label);
+    s_running_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void)
+{
+    ESP_LOGW(TAG, "%s marked invalid, rolling back to %s", s_running->label, esp_ota_get_next_update_partition(NULL)->label);
+    esp_restart();
+}
@@ -0,0 +1,226 @@
+// Remaining ESP-IDF system services
+
+#include <esp_app_desc.h>
+#include <esp_chip_info.h>
+#include <esp_cpu.h>
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_pm.h>
+#include <esp_rom_sys.h>
+#include <esp_system.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+{
+    s_log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char levels[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+    if (level > s_log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&s_log_lock);
+    fprintf(stderr, "%c (%lld) %s: ", levels[level], (long long)(sim_clock_now_us() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&s_log_lock);
+    va_end(args);
+}
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    case 0x1503: // ESP_ERR_OTA_VALIDATE_FAILED
+        return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec); // Nanoseconds stand in for cycles
+}
+
+int esp_cpu_get_core_id(void)
+{
+    return xPortGetCoreID();
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    sim_clock_sleep_us(us);
+}
+
+// There is no clock to scale, the locks only count
+struct sim_pm_lock {
+    const char* name;
+    int count;
+};
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char* name, esp_pm_lock_handle_t* out_handle)
+{
+    struct sim_pm_lock* lock = calloc(1, sizeof(struct sim_pm_lock));
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    lock->name = name;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    __atomic_add_fetch(&handle->count, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    return (__atomic_sub_fetch(&handle->count, 1, __ATOMIC_RELAXED) >= 0) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type)
+{
+    static const uint8_t sim_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x5e, 0x00 };
+    memcpy(mac, sim_mac, sizeof(sim_mac));
+    mac[5] += type;
+    return ESP_OK;
+}
+
+void esp_chip_info(esp_chip_info_t* out_info)
+{
+    *out_info = (esp_chip_info_t) {
+        .model = CHIP_ESP32S3,
+        .revision = 0,
+        .cores = portNUM_PROCESSORS,
+    };
+}
+
+const esp_app_desc_t* esp_app_get_description(void)
+{
+    static const esp_app_desc_t desc = {
+        .version = SIM_APP_VERSION,
+        .project_name = "fancontroller-sim",
+        .time = __TIME__,
+        .date = __DATE__,
+        .idf_ver = "host",
+    };
+    return &desc;
+}
+
+int esp_app_get_elf_sha256(char* dst, size_t size)
+{
+    return snprintf(dst, size, "%s", "0000000000000000");
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 256 * 1024;
+}
+
+uint32_t esp_get_free_internal_heap_size(void)
+{
+    return 256 * 1024;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 256 * 1024;
+}
+
+const char* esp_get_idf_version(void)
+{
+    return "host";
+}
+
+void esp_restart(void)
+{
+    ESP_LOGW("system", "esp_restart() called, exiting");
+    exit(1);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return 256 * 1024;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return 256 * 1024;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return 128 * 1024;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char* dst, const char* src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t copy = (len < size) ? len : (size - 1);
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+#endif
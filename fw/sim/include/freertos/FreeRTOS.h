@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs) * (uint64_t)configTICK_RATE_HZ) / (uint64_t)1000U))
+#define pdTICKS_TO_MS(xTicks) ((TickType_t)((uint64_t)(xTicks) * 1000 / configTICK_RATE_HZ))
+
+#define portNUM_PROCESSORS 2
+#define configMAX_TASK_NAME_LEN 16
+#define configSTACK_DEPTH_TYPE uint32_t
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+#define configASSERT(x) assert(x)
+
+typedef struct
+{
+    int owner;
+    int count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { .owner = 0, .count = 0 }
+
+// There are no interrupts on the host, critical sections serialize against the simulated ISRs instead
+void sim_critical_enter(portMUX_TYPE* mux);
+void sim_critical_exit(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux) sim_critical_enter(mux)
+#define portEXIT_CRITICAL(mux) sim_critical_exit(mux)
+#define portENTER_CRITICAL_ISR(mux) sim_critical_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux) sim_critical_exit(mux)
+#define portENTER_CRITICAL_SAFE(mux) sim_critical_enter(mux)
+#define portEXIT_CRITICAL_SAFE(mux) sim_critical_exit(mux)
+#define taskENTER_CRITICAL(mux) sim_critical_enter(mux)
+#define taskEXIT_CRITICAL(mux) sim_critical_exit(mux)
+#define taskENTER_CRITICAL_ISR(mux) sim_critical_enter(mux)
+#define taskEXIT_CRITICAL_ISR(mux) sim_critical_exit(mux)
+
+#define portYIELD_FROM_ISR(...) \
+    do {                        \
+    } while (0)
+
+BaseType_t xPortGetCoreID(void);
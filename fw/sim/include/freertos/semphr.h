@@ -0,0 +1,23 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct sim_semaphore* SemaphoreHandle_t;
+
+typedef struct
+{
+    void* storage;
+} StaticSemaphore_t;
+
+SemaphoreHandle_t sim_semaphore_create(UBaseType_t max_count, UBaseType_t initial_count, StaticSemaphore_t* buffer);
+
+#define xSemaphoreCreateMutex() sim_semaphore_create(1, 1, NULL)
+#define xSemaphoreCreateBinary() sim_semaphore_create(1, 0, NULL)
+#define xSemaphoreCreateCounting(max, initial) sim_semaphore_create(max, initial, NULL)
+#define xSemaphoreCreateMutexStatic(buffer) sim_semaphore_create(1, 1, buffer)
+#define xSemaphoreCreateBinaryStatic(buffer) sim_semaphore_create(1, 0, buffer)
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t* pxHigherPriorityTaskWoken);
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore);
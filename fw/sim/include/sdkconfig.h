@@ -0,0 +1,65 @@
+#pragma once
+
+// Configuration of the host simulation build, mirrors the defaults in Kconfig.projbuild
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_PERFORMANCE_INTERVAL_MS 1000
+#define CONFIG_TRACE_SPANS 1
+#define CONFIG_MQTT_BROKER_URL "mqtt://localhost"
+#define CONFIG_WIFI_SSID ""
+#define CONFIG_WIFI_PASSPHRASE ""
+#define CONFIG_PM_ENABLE 1
+#define CONFIG_BOOT_PARALLEL 1
+#define CONFIG_TASKS_PIN_CORES 1
+#define CONFIG_WATCHDOG_REBOOT 1
+#define CONFIG_ADC_HIGH_RATE 1
+#define CONFIG_ADC_SAMPLE_FREQ_HZ 80000
+#define CONFIG_ADC_CURRENT_WEIGHT 2
+#define CONFIG_ADC_POOL_FRAMES 8
+#define CONFIG_SUPERVISOR_FAN_LIMIT_MA 800
+#define CONFIG_SUPERVISOR_BUS_LIMIT_MA 1150
+#define CONFIG_SUPERVISOR_BUS_HW_MONITOR 1
+#define CONFIG_SUPERVISOR_BUS_PEAK_LIMIT_MA 1240
+#define CONFIG_ENERGY_PERSIST_INTERVAL_S 60
+#define CONFIG_CONTROL_INTERVAL_MS 10
+#define CONFIG_FANS_OUTPUT_SLEW_PWM8_PER_S 255
+#define CONFIG_FANS_OUTPUT_DWELL_MS 250
+#define CONFIG_FANS_OUTPUT_DEADBAND_PWM8 2
+#define CONFIG_FANS_OUTPUT_MIN_PWM8 0
+#define CONFIG_FANS_OUTPUT_LEARN_MARGIN_PWM8 8
+#define CONFIG_FANS_RESUME 1
+#define CONFIG_FANS_RESUME_PERSIST_S 10
+#define CONFIG_FAN_HEALTH_INTERVAL_MS 50
+#define CONFIG_FAN_HEALTH_STALL_TIMEOUT_MS 300
+#define CONFIG_FAN_HEALTH_SPINUP_MS 1000
+#define CONFIG_FAN_HEALTH_OPEN_MA 10
+#define CONFIG_FAN_HEALTH_KICK_DUTY 255
+#define CONFIG_FAN_HEALTH_KICK_PULSE_MS 250
+#define CONFIG_FAN_HEALTH_KICK_PULSES 3
+#define CONFIG_FAN_HEALTH_RETRY_MS 10000
+#define CONFIG_STATIC_ALLOCATION 1
+#define CONFIG_STATIC_JSON_POOL_BLOCKS 768
+#define CONFIG_STATUS_BUFFER_SIZE 6144
+#define CONFIG_OTA_HEALTH_CHECK_S 60
+#define CONFIG_OTA_HEALTH_REQUIRE_NETWORK 1
+
+// cmake -DSIM_POWER_SAVE=ON
+#ifdef SIM_POWER_SAVE
+#define CONFIG_POWER_SAVE 1
+#define CONFIG_POWER_SAVE_LISTEN_INTERVAL 10
+#define CONFIG_POWER_SAVE_ADC_INTERVAL_MS 250
+#define CONFIG_POWER_SAVE_REPORT_BATCH 5
+#define CONFIG_REPORT_FAST_INTERVAL_MS 1000
+#else
+#define CONFIG_REPORT_FAST_INTERVAL_MS 100
+#endif
+#define CONFIG_REPORT_SLOW_INTERVAL_MS 5000
+#define CONFIG_REPORT_ACTIVITY_HOLD_MS 5000
+#define CONFIG_REPORT_MQTT_JSON 1
+
+// Only started with --telemetry, on loopback so it works without a multicast route
+#define CONFIG_TELEMETRY_UDP 1
+#define CONFIG_TELEMETRY_GROUP "239.255.70.67"
+#define CONFIG_TELEMETRY_PORT 47000
+#define CONFIG_TELEMETRY_INTERVAL_MS 10
+#define CONFIG_TELEMETRY_INTERFACE "127.0.0.1"
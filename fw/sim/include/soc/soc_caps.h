@@ -0,0 +1,13 @@
+#pragma once
+
+// ESP32-S3 capabilities used by the firmware
+
+#define SOC_ADC_DIGI_MAX_BITWIDTH 12
+#define SOC_ADC_DIGI_DATA_BYTES_PER_CONV 4
+#define SOC_ADC_DIGI_RESULT_BYTES 4
+#define SOC_ADC_PATT_LEN_MAX 24
+#define SOC_ADC_CHANNEL_NUM(unit) 10
+#define SOC_ADC_SAMPLE_FREQ_THRES_HIGH 83333
+#define SOC_ADC_SAMPLE_FREQ_THRES_LOW 611
+#define SOC_ADC_MONITOR_SUPPORTED 1
+#define SOC_ADC_DIGI_MONITOR_NUM 2
@@ -0,0 +1,259 @@
+// Fan and thermal plant model driven by the simulated LEDC/GPIO outputs
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "sim.h"
+
+#define PLANT_STEP_US 1000
+#define PLANT_FANS_COUNT 5
+
+// Board wiring, mirrors fans.c, tacho.c and temperature.c
+#define PLANT_GPIO_12V_EN 21
+#define PLANT_GPIO_EXT_INT 40
+static const gpio_num_t s_tacho_gpios[PLANT_FANS_COUNT] = { 11, 13, 15, 17, 39 };
+static const ledc_channel_t s_pwm_channels[PLANT_FANS_COUNT] = { LEDC_CHANNEL_0, LEDC_CHANNEL_1, LEDC_CHANNEL_2, LEDC_CHANNEL_3, LEDC_CHANNEL_4 };
+
+#define PLANT_VBUS_MV 12000
+#define PLANT_BOARD_MA 60
+#define PLANT_BOARD_SELF_HEATING_C 6.0 // The on-board sensor sits next to the ESP32
+#define PLANT_SHORT_MA 1500
+#define PLANT_STALL_FACTOR 2.0 // Locked rotor current relative to full speed
+#define PLANT_RUN_DUTY 0.05 // A turning fan keeps turning down to this, a stopped one needs its start duty
+
+#define PLANT_VOLTAGE_DIVIDER(mv) ((mv) * 47 / (1000 + 47))
+#define PLANT_CURRENT_SENSE(ma) ((ma) * 30 * 20 / 1000) // 30mOhm, 20x amplification
+
+typedef struct
+{
+    double max_rpm;
+    double tau_s;
+    double idle_ma;
+    double max_ma;
+    double start_duty;
+    bool stuck; // Driven below the start duty from standstill
+    double rpm;
+    double target_rpm;
+    double phase;
+    double duty;
+    sim_fault_t fault;
+} plant_fan_t;
+
+typedef struct
+{
+    sim_plant_config_t config;
+    plant_fan_t fans[PLANT_FANS_COUNT];
+    bool bus_enabled;
+    bool bus_short;
+    double external_c;
+    bool external_probe;
+} plant_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static plant_t s_plant;
+
+static double plant_fan_current_ma(const plant_fan_t* fan, bool bus_enabled)
+{
+    if (!bus_enabled) {
+        return 0;
+    }
+
+    const bool driven = (fan->duty >= PLANT_RUN_DUTY);
+    switch (fan->fault) {
+    case SIM_FAULT_SHORT:
+        return driven ? PLANT_SHORT_MA : 0;
+    case SIM_FAULT_BLOCKED:
+        return driven ? fan->max_ma * PLANT_STALL_FACTOR * fan->duty : fan->idle_ma;
+    case SIM_FAULT_DISCONNECTED:
+        return 0;
+    default:
+        break;
+    }
+    if (fan->stuck) {
+        return fan->max_ma * PLANT_STALL_FACTOR * fan->duty;
+    }
+
+    double speed = fan->rpm / fan->max_rpm;
+    double accelerating = fmax(0, fan->target_rpm - fan->rpm) / fan->max_rpm;
+    return fan->idle_ma + (fan->max_ma - fan->idle_ma) * (speed * speed * speed + 0.5 * accelerating);
+}
+
+static double plant_noise(unsigned int* seed, double value)
+{
+    double noise = ((double)rand_r(seed) / RAND_MAX * 2.0 - 1.0) * s_plant.config.noise_permille / 1000.0;
+    return value * (1.0 + noise);
+}
+
+static void plant_step(double dt_s, bool edges[PLANT_FANS_COUNT])
+{
+    s_plant.bus_enabled = sim_gpio_get_output(PLANT_GPIO_12V_EN);
+
+    double airflow = 0;
+    for (int i = 0; i < PLANT_FANS_COUNT; ++i) {
+        plant_fan_t* fan = &s_plant.fans[i];
+
+        // The PWM output is inverted by the fan driver transistor
+        fan->duty = 1.0 - sim_ledc_get_high_fraction(s_pwm_channels[i]);
+        const bool standstill = fan->rpm < fan->max_rpm * PLANT_RUN_DUTY;
+        const bool driven = s_plant.bus_enabled && fan->duty >= PLANT_RUN_DUTY;
+        fan->stuck = driven && standstill && fan->duty < fan->start_duty;
+        fan->target_rpm = (!driven || fan->stuck) ? 0 : fan->max_rpm * (0.2 + 0.8 * fan->duty);
+        if (fan->fault == SIM_FAULT_BLOCKED || fan->fault == SIM_FAULT_DISCONNECTED) {
+            fan->target_rpm = 0;
+            fan->rpm = 0;
+        }
+        fan->rpm += (fan->target_rpm - fan->rpm) * fmin(1.0, dt_s / fan->tau_s);
+
+        fan->phase += fan->rpm / 60.0 * dt_s;
+        edges[i] = (fan->phase >= 1.0);
+        fan->phase -= floor(fan->phase);
+
+        airflow += fan->rpm / fan->max_rpm / PLANT_FANS_COUNT;
+    }
+
+    // Single thermal mass heated by the load and cooled by ambient air, more so with airflow
+    const double heat_capacity_j_per_k = 600.0;
+    const double conductance_w_per_k = 1.0 + 9.0 * airflow;
+    s_plant.external_c += (s_plant.config.heat_load_w - (s_plant.external_c - s_plant.config.ambient_c) * conductance_w_per_k)
+        * dt_s / heat_capacity_j_per_k;
+}
+
+static void* plant_thread(void* arg)
+{
+    int64_t last_us = sim_clock_now_us();
+    bool edges[PLANT_FANS_COUNT];
+
+    while (1) {
+        sim_clock_sleep_us(PLANT_STEP_US);
+        int64_t now_us = sim_clock_now_us();
+
+        pthread_mutex_lock(&s_lock);
+        plant_step((now_us - last_us) / 1e6, edges);
+        bool external_probe = s_plant.external_probe;
+        pthread_mutex_unlock(&s_lock);
+        last_us = now_us;
+
+        for (int i = 0; i < PLANT_FANS_COUNT; ++i) {
+            if (edges[i]) {
+                sim_gpio_set_input(s_tacho_gpios[i], 1);
+                sim_gpio_set_input(s_tacho_gpios[i], 0);
+            }
+        }
+        sim_gpio_set_input(PLANT_GPIO_EXT_INT, external_probe);
+    }
+    return NULL;
+}
+
+void sim_plant_start(const sim_plant_config_t* config)
+{
+    static const double max_rpms[PLANT_FANS_COUNT] = { 1800, 2200, 3000, 1500, 2500 };
+
+    s_plant.config = *config;
+    s_plant.external_c = config->ambient_c;
+    s_plant.external_probe = config->external_probe;
+    for (int i = 0; i < PLANT_FANS_COUNT; ++i) {
+        s_plant.fans[i] = (plant_fan_t) {
+            .max_rpm = max_rpms[i],
+            .tau_s = 0.6 + 0.2 * i,
+            .idle_ma = 20,
+            .max_ma = 120 + 40 * i,
+            .start_duty = 0.12 + 0.04 * i,
+        };
+    }
+
+    sim_gpio_set_input(PLANT_GPIO_EXT_INT, config->external_probe);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, plant_thread, NULL);
+    pthread_detach(thread);
+}
+
+void sim_plant_set_external_probe(bool present)
+{
+    pthread_mutex_lock(&s_lock);
+    s_plant.external_probe = present;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void sim_plant_set_fault(int target, sim_fault_t fault)
+{
+    pthread_mutex_lock(&s_lock);
+    if (target == SIM_FAULT_TARGET_BUS) {
+        s_plant.bus_short = (fault == SIM_FAULT_SHORT);
+    } else if (target >= 0 && target < PLANT_FANS_COUNT) {
+        s_plant.fans[target].fault = fault;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+uint32_t sim_plant_adc_mv(adc_channel_t channel)
+{
+    static __thread unsigned int seed = 1;
+    double mv = 0;
+
+    pthread_mutex_lock(&s_lock);
+    double vfan_mv = s_plant.bus_enabled ? PLANT_VBUS_MV : 0;
+    double fans_ma = 0;
+    for (int i = 0; i < PLANT_FANS_COUNT; ++i) {
+        fans_ma += plant_fan_current_ma(&s_plant.fans[i], s_plant.bus_enabled);
+    }
+    if (s_plant.bus_short && s_plant.bus_enabled) {
+        fans_ma += PLANT_SHORT_MA;
+    }
+
+    switch (channel) {
+    case ADC_CHANNEL_0:
+        mv = PLANT_VOLTAGE_DIVIDER(PLANT_VBUS_MV);
+        break;
+    case ADC_CHANNEL_1:
+        mv = PLANT_VOLTAGE_DIVIDER(vfan_mv);
+        break;
+    case ADC_CHANNEL_3:
+        mv = PLANT_CURRENT_SENSE(PLANT_BOARD_MA + fans_ma);
+        break;
+    case ADC_CHANNEL_4:
+    case ADC_CHANNEL_5:
+    case ADC_CHANNEL_6:
+    case ADC_CHANNEL_7:
+    case ADC_CHANNEL_8:
+        mv = PLANT_CURRENT_SENSE(plant_fan_current_ma(&s_plant.fans[channel - ADC_CHANNEL_4], s_plant.bus_enabled));
+        break;
+    default:
+        break;
+    }
+    mv = plant_noise(&seed, mv);
+    pthread_mutex_unlock(&s_lock);
+
+    return (mv < 0) ? 0 : (uint32_t)mv;
+}
+
+bool sim_plant_sht_present(int port)
+{
+    if (port == 0) {
+        return true;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    bool present = s_plant.external_probe;
+    pthread_mutex_unlock(&s_lock);
+    return present;
+}
+
+void sim_plant_sht_read(int port, int32_t* temperature_mc, int32_t* rel_hum_mperct)
+{
+    pthread_mutex_lock(&s_lock);
+    double temperature_c = (port == 0) ? (s_plant.config.ambient_c + PLANT_BOARD_SELF_HEATING_C) : s_plant.external_c;
+    pthread_mutex_unlock(&s_lock);
+
+    *temperature_mc = temperature_c * 1000;
+    *rel_hum_mperct = 45000;
+}
+
+uint32_t sim_plant_fan_rpm(int fan_i)
+{
+    pthread_mutex_lock(&s_lock);
+    uint32_t rpm = (fan_i >= 0 && fan_i < PLANT_FANS_COUNT) ? s_plant.fans[fan_i].rpm : 0;
+    pthread_mutex_unlock(&s_lock);
+    return rpm;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <esp_adc/adc_continuous.h>
+
+// Simulated time runs `speed` times faster than the host clock
+void sim_clock_init(double speed);
+int64_t sim_clock_now_us(void);
+void sim_clock_sleep_us(int64_t duration_us);
+struct timespec sim_clock_deadline(int64_t duration_us);
+int64_t sim_clock_real_us(void);
+
+// Run every task on any of the target cores, as with CONFIG_TASKS_PIN_CORES disabled
+void sim_tasks_ignore_affinity(bool ignore);
+// The task with this name hangs at its next blocking call for the duration, false if there is none
+bool sim_task_stall(const char* name, int64_t duration_us);
+
+// Boot as if the running image was just updated and has to pass the health check
+void sim_ota_set_pending_verify(bool pending);
+
+// Keep the NVS contents in a file across runs, as flash across power cycles. Loaded now, written on every commit.
+bool sim_nvs_set_file(const char* path);
+
+// Host side of the peripherals, used by the plant model
+void sim_gpio_set_input(gpio_num_t gpio_num, int level);
+int sim_gpio_get_output(gpio_num_t gpio_num);
+float sim_ledc_get_high_fraction(ledc_channel_t channel);
+
+typedef struct
+{
+    double speed;
+    double ambient_c;
+    double heat_load_w;
+    bool external_probe;
+    double noise_permille;
+} sim_plant_config_t;
+
+typedef enum {
+    SIM_FAULT_NONE,
+    SIM_FAULT_SHORT, // Draws well above any limit while powered
+    SIM_FAULT_BLOCKED, // Rotor locked, no tacho pulses and stall current while driven
+    SIM_FAULT_DISCONNECTED, // No current and no tacho pulses
+} sim_fault_t;
+
+#define SIM_FAULT_TARGET_BUS (-1)
+
+void sim_plant_start(const sim_plant_config_t* config);
+void sim_plant_set_external_probe(bool present);
+// Target is a fan index, or SIM_FAULT_TARGET_BUS for a short on the 12V rail
+void sim_plant_set_fault(int target, sim_fault_t fault);
+uint32_t sim_plant_adc_mv(adc_channel_t channel);
+bool sim_plant_sht_present(int port);
+void sim_plant_sht_read(int port, int32_t* temperature_mc, int32_t* rel_hum_mperct);
+uint32_t sim_plant_fan_rpm(int fan_i);
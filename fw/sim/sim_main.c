@@ -0,0 +1,535 @@
+// Host simulation entry point, runs the firmware modules against the mock HAL and plant model
+
+#include <cJSON.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <getopt.h>
+#include <mbedtls/sha256.h>
+#include <nvs_flash.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc.h"
+#include "boot.h"
+#include "calibration.h"
+#include "control.h"
+#include "data.h"
+#include "energy.h"
+#include "events.h"
+#include "fan_health.h"
+#include "fans.h"
+#include "i2c_bus.h"
+#include "json_pool.h"
+#include "latency.h"
+#include "ota.h"
+#include "led.h"
+#include "performance.h"
+#include "periodic.h"
+#include "power.h"
+#include "settings.h"
+#include "sim.h"
+#include "supervisor.h"
+#include "tasks.h"
+#include "tacho.h"
+#include "telemetry.h"
+#include "temperature.h"
+#include "util.h"
+#include "watchdog.h"
+
+#define TAG "sim"
+
+#define SIM_MAX_ACTIONS 32
+#define SIM_OTA_CHUNK_SIZE 4096
+#define SIM_OTA_BYTES_PER_S (200 * 1024) // Wi-Fi upload rate
+
+typedef enum {
+    SIM_ACTION_COMMAND,
+    SIM_ACTION_PROBE,
+    SIM_ACTION_FAULT,
+    SIM_ACTION_OTA,
+    SIM_ACTION_SETTINGS,
+    SIM_ACTION_CALIBRATION,
+    SIM_ACTION_STALL,
+} sim_action_type_t;
+
+typedef struct
+{
+    int64_t at_us;
+    sim_action_type_t type;
+    const char* command;
+    bool probe_present;
+    int fault_target;
+    sim_fault_t fault;
+    char stall_task[16];
+    double stall_s;
+} sim_action_t;
+
+static sim_action_t s_actions[SIM_MAX_ACTIONS];
+static size_t s_actions_number;
+static unsigned int s_report_every = 1;
+static unsigned int s_report_count;
+static FILE* s_cbor_file;
+static bool s_telemetry;
+
+static void sim_usage(const char* argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --speed X          simulated time runs X times faster than real time (default 10)\n"
+        "  --duration S       simulated seconds to run (default 30)\n"
+        "  --report-every N   print every Nth status report as JSON, 0 disables (default 1)\n"
+        "  --command T=JSON   process a duty command at simulated second T (repeatable)\n"
+        "  --settings T=JSON  update the settings at simulated second T (repeatable)\n"
+        "  --calibrate T=JSON take or clear an ADC calibration point at simulated second T (repeatable)\n"
+        "  --probe T=0|1      detach or attach the external probe at simulated second T (repeatable)\n"
+        "  --fault T=WHERE:KIND  inject a fault at simulated second T (repeatable), WHERE is fan1..fan5 or bus,\n"
+        "                     KIND is none, short, blocked or disconnected\n"
+        "  --stall T=TASK:S   hang TASK (e.g. tacho, adc) at its next blocking call for S seconds, from simulated second T\n"
+        "  --ambient C        ambient temperature (default 25)\n"
+        "  --heat W           heat load on the external probe (default 20)\n"
+        "  --noise P          ADC noise in permille (default 5)\n"
+        "  --load N           run N tasks rendering status reports back to back, standing in for HTTP/MQTT load\n"
+        "  --unpinned         ignore the core affinity of the task table\n"
+        "  --ota T=PATH[:SHA256]  upload the image at PATH at simulated second T, the hash defaults to the right one\n"
+        "  --ota-pending      boot as a freshly updated image that has to pass the health check\n"
+        "  --offline          never report the network as connected\n"
+        "  --cbor FILE        also write the printed status reports to FILE as a CBOR sequence\n"
+        "  --telemetry        send UDP telemetry to CONFIG_TELEMETRY_GROUP over loopback\n"
+        "  --nvs FILE         keep the NVS contents (settings, calibration, energy, fan duties) in FILE across runs\n",
+        argv0);
+}
+
+static bool sim_fault_parse(const char* arg, int* target, sim_fault_t* fault)
+{
+    static const char* const kinds[] = {
+        [SIM_FAULT_NONE] = "none",
+        [SIM_FAULT_SHORT] = "short",
+        [SIM_FAULT_BLOCKED] = "blocked",
+        [SIM_FAULT_DISCONNECTED] = "disconnected",
+    };
+
+    const char* colon = strchr(arg, ':');
+    if (colon == NULL) {
+        return false;
+    }
+
+    if (strncmp(arg, "bus:", 4) == 0) {
+        *target = SIM_FAULT_TARGET_BUS;
+    } else if (strncmp(arg, "fan", 3) == 0 && arg[3] >= '1' && arg[3] <= '0' + FANS_COUNT && colon == &arg[4]) {
+        *target = arg[3] - '1';
+    } else {
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) {
+        if (strcmp(colon + 1, kinds[i]) == 0) {
+            *fault = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static sim_action_type_t sim_action_type(int opt)
+{
+    switch (opt) {
+    case 'p':
+        return SIM_ACTION_PROBE;
+    case 'f':
+        return SIM_ACTION_FAULT;
+    case 'o':
+        return SIM_ACTION_OTA;
+    case 'e':
+        return SIM_ACTION_SETTINGS;
+    case 'k':
+        return SIM_ACTION_CALIBRATION;
+    case 'x':
+        return SIM_ACTION_STALL;
+    default:
+        return SIM_ACTION_COMMAND;
+    }
+}
+
+static bool sim_action_add(sim_action_type_t type, const char* arg)
+{
+    const char* eq = strchr(arg, '=');
+    if (eq == NULL || s_actions_number >= SIM_MAX_ACTIONS) {
+        return false;
+    }
+
+    sim_action_t action = {
+        .at_us = (int64_t)(strtod(arg, NULL) * 1000000),
+        .type = type,
+        .command = eq + 1,
+        .probe_present = (atoi(eq + 1) != 0),
+    };
+    if (type == SIM_ACTION_FAULT && !sim_fault_parse(eq + 1, &action.fault_target, &action.fault)) {
+        return false;
+    }
+    if (type == SIM_ACTION_STALL) {
+        const char* colon = strchr(eq + 1, ':');
+        if (colon == NULL || (size_t)(colon - eq - 1) >= sizeof(action.stall_task)) {
+            return false;
+        }
+        memcpy(action.stall_task, eq + 1, colon - eq - 1);
+        action.stall_s = strtod(colon + 1, NULL);
+    }
+
+    s_actions[s_actions_number++] = action;
+    return true;
+}
+
+static int sim_action_compare(const void* a, const void* b)
+{
+    const sim_action_t* lhs = a;
+    const sim_action_t* rhs = b;
+    return (lhs->at_us > rhs->at_us) - (lhs->at_us < rhs->at_us);
+}
+
+static void sim_print_json(cJSON* root)
+{
+    char* str = cJSON_PrintUnformatted(root);
+    if (str != NULL) {
+        puts(str);
+        fflush(stdout);
+        cJSON_free(str);
+    }
+    cJSON_Delete(root);
+}
+
+// Streams an image like the HTTP handler does, paced at the upload rate
+static void sim_ota_task(void* arg)
+{
+    static uint8_t chunk[SIM_OTA_CHUNK_SIZE];
+    const char* spec = arg;
+    const char* colon = strchr(spec, ':');
+    char path[256];
+    uint8_t sha256[OTA_SHA256_LEN];
+
+    snprintf(path, sizeof(path), "%.*s", (int)((colon != NULL) ? (size_t)(colon - spec) : strlen(spec)), spec);
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Can't open %s", path);
+        vTaskDelete(NULL);
+    }
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        mbedtls_sha256_update(&ctx, chunk, len);
+    }
+    mbedtls_sha256_finish(&ctx, sha256);
+    for (size_t i = 0; colon != NULL && i < sizeof(sha256); ++i) {
+        unsigned int byte = 0;
+        sscanf(&colon[1 + i * 2], "%2x", &byte);
+        sha256[i] = byte;
+    }
+
+    const long size = ftell(file);
+    rewind(file);
+    esp_err_t ret = ota_begin(size);
+    while (ret == ESP_OK && (len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        sim_clock_sleep_us((int64_t)len * 1000000 / SIM_OTA_BYTES_PER_S);
+        ret = ota_write(chunk, len);
+    }
+    if (ret == ESP_OK) {
+        ret = ota_end(sha256);
+    }
+    ESP_LOGI(TAG, "Upload of %s: %s", path, esp_err_to_name(ret));
+
+    fclose(file);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t sim_status_to_json(cJSON* root)
+{
+    cJSON_AddNumberToObject(root, "sim_time_ms", esp_timer_get_time() / 1000);
+    return data_status_to_json(root);
+}
+
+static void sim_status_ping_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    static char buffer[CONFIG_STATUS_BUFFER_SIZE];
+
+    if (s_report_every == 0 || (s_report_count++ % s_report_every) != 0) {
+        return;
+    }
+
+    if (data_print(sim_status_to_json, buffer, sizeof(buffer)) == ESP_OK) {
+        puts(buffer);
+        fflush(stdout);
+    }
+
+    size_t len;
+    if (s_cbor_file != NULL && data_print_cbor(data_status_to_cbor, (uint8_t*)buffer, sizeof(buffer), &len) == ESP_OK) {
+        fwrite(buffer, 1, len, s_cbor_file);
+        fflush(s_cbor_file);
+    }
+}
+
+static periodic_consumer_config_t sim_report_config(const settings_t* settings)
+{
+    return (periodic_consumer_config_t) {
+        .name = "sim",
+        .event_id = EVENT_STATUS_PING,
+        .fast_interval_ms = settings->report_fast_interval_ms,
+        .slow_interval_ms = settings->report_slow_interval_ms,
+    };
+}
+
+static void sim_settings_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    if (!(*(const uint32_t*)event_data & SETTINGS_REPORT)) {
+        return;
+    }
+
+    settings_t settings;
+    settings_fetch(&settings);
+    const periodic_consumer_config_t report_config = sim_report_config(&settings);
+    ESP_ERROR_CHECK(periodic_reconfigure(&report_config));
+}
+
+// Renders status reports as fast as it can, on the network core like the HTTP server and MQTT client
+static void sim_load_task(void* arg)
+{
+    char* buffer = malloc(CONFIG_STATUS_BUFFER_SIZE);
+    while (1) {
+        data_print(data_status_to_json, buffer, CONFIG_STATUS_BUFFER_SIZE);
+    }
+}
+
+#if CONFIG_BOOT_PARALLEL
+// Stands in for Wi-Fi in the parallel lane, the sensor probing is the slowest chain here
+static const boot_stage_config_t s_sensor_stages[] = {
+    { "i2c_bus", i2c_bus_init },
+    { "temperature", temperature_init },
+};
+#endif
+
+static void sim_app_init(void)
+{
+    // Same sequence as app_main, minus the network stack
+    ESP_ERROR_CHECK(boot_init());
+    boot_run("nvs", nvs_flash_init);
+    boot_run("events", events_init);
+    boot_run("settings", settings_init);
+
+    boot_run("latency", latency_init); // The fans record their first LEDC writes
+    boot_run("led", led_init);
+    boot_run("fans", fans_init);
+
+    boot_run("json_pool", json_pool_init);
+    boot_run("data", data_init);
+    boot_run("periodic", periodic_init);
+    boot_run("power", power_init);
+    boot_run("performance", performance_init);
+    boot_run("supervisor", supervisor_init);
+    boot_run("watchdog", watchdog_init);
+    boot_run("energy", energy_init);
+    boot_run("calibration", calibration_init);
+    boot_run("ota", ota_init);
+
+#if CONFIG_BOOT_PARALLEL
+    ESP_ERROR_CHECK(boot_run_parallel(s_sensor_stages, ARRAY_SIZE(s_sensor_stages)));
+#else
+    boot_run("i2c_bus", i2c_bus_init);
+    boot_run("temperature", temperature_init);
+#endif
+
+    boot_run("adc", adc_init);
+    boot_run("tacho", tacho_init);
+    boot_run("fan_health", fan_health_init);
+    boot_run("control", control_init);
+
+#if CONFIG_BOOT_PARALLEL
+    boot_join();
+#endif
+    if (s_telemetry) {
+        ESP_ERROR_CHECK(telemetry_init());
+    }
+
+    // Stands in for the MQTT reporting
+    settings_t settings;
+    settings_fetch(&settings);
+    const periodic_consumer_config_t report_config = sim_report_config(&settings);
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_STATUS_PING, sim_status_ping_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(EVENTS, EVENT_SETTINGS_CHANGED, sim_settings_handler, NULL));
+    ESP_ERROR_CHECK(periodic_register(&report_config));
+
+    boot_done();
+    ESP_LOGI(TAG, "Device initialized, running simulation");
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option options[] = {
+        { "speed", required_argument, NULL, 's' },
+        { "duration", required_argument, NULL, 'd' },
+        { "report-every", required_argument, NULL, 'r' },
+        { "command", required_argument, NULL, 'c' },
+        { "settings", required_argument, NULL, 'e' },
+        { "calibrate", required_argument, NULL, 'k' },
+        { "probe", required_argument, NULL, 'p' },
+        { "fault", required_argument, NULL, 'f' },
+        { "stall", required_argument, NULL, 'x' },
+        { "ambient", required_argument, NULL, 'a' },
+        { "heat", required_argument, NULL, 'w' },
+        { "noise", required_argument, NULL, 'n' },
+        { "load", required_argument, NULL, 'l' },
+        { "unpinned", no_argument, NULL, 'u' },
+        { "ota", required_argument, NULL, 'o' },
+        { "ota-pending", no_argument, NULL, 'P' },
+        { "offline", no_argument, NULL, 'O' },
+        { "cbor", required_argument, NULL, 'C' },
+        { "telemetry", no_argument, NULL, 'T' },
+        { "nvs", required_argument, NULL, 'N' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    sim_plant_config_t plant = {
+        .speed = 10,
+        .ambient_c = 25,
+        .heat_load_w = 20,
+        .external_probe = true,
+        .noise_permille = 5,
+    };
+    double duration_s = 30;
+    unsigned int load_tasks = 0;
+    bool online = true;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            plant.speed = strtod(optarg, NULL);
+            break;
+        case 'd':
+            duration_s = strtod(optarg, NULL);
+            break;
+        case 'r':
+            s_report_every = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+        case 'p':
+        case 'f':
+        case 'o':
+        case 'e':
+        case 'k':
+        case 'x':
+            if (!sim_action_add(sim_action_type(opt), optarg)) {
+                sim_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'a':
+            plant.ambient_c = strtod(optarg, NULL);
+            break;
+        case 'w':
+            plant.heat_load_w = strtod(optarg, NULL);
+            break;
+        case 'n':
+            plant.noise_permille = strtod(optarg, NULL);
+            break;
+        case 'l':
+            load_tasks = strtoul(optarg, NULL, 10);
+            break;
+        case 'u':
+            sim_tasks_ignore_affinity(true);
+            break;
+        case 'P':
+            sim_ota_set_pending_verify(true);
+            break;
+        case 'O':
+            online = false;
+            break;
+        case 'C':
+            s_cbor_file = fopen(optarg, "wb");
+            if (s_cbor_file == NULL) {
+                perror(optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            s_telemetry = true;
+            break;
+        case 'N':
+            if (!sim_nvs_set_file(optarg)) {
+                fprintf(stderr, "%s: not an NVS file\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            sim_usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (s_actions_number == 0) {
+        // Default scenario: spin up, go full speed, then settle low
+        sim_action_add(SIM_ACTION_COMMAND, "1={\"fans_pwm8\":128}");
+        sim_action_add(SIM_ACTION_COMMAND, "10={\"fans_pwm8\":255}");
+        sim_action_add(SIM_ACTION_COMMAND, "20={\"fans_pwm8\":64,\"fan5_pwm8\":0}");
+    }
+    qsort(s_actions, s_actions_number, sizeof(s_actions[0]), sim_action_compare);
+
+    sim_clock_init(plant.speed);
+    const int64_t real_start_us = sim_clock_real_us();
+    sim_plant_start(&plant);
+    sim_app_init();
+
+    if (online) {
+        // Stands in for Wi-Fi getting an address
+        ESP_ERROR_CHECK(esp_event_post(EVENTS, EVENT_ONLINE, NULL, 0, portMAX_DELAY));
+    }
+
+    for (unsigned int i = 0; i < load_tasks; ++i) {
+        xTaskCreatePinnedToCore(sim_load_task, "load", 1024 * 6, NULL, tasks_config(TASK_HTTPD)->priority, NULL, TASKS_CORE_NETWORK);
+    }
+
+    const int64_t duration_us = (int64_t)(duration_s * 1000000);
+    for (size_t i = 0; i < s_actions_number && s_actions[i].at_us <= duration_us; ++i) {
+        const sim_action_t* action = &s_actions[i];
+        sim_clock_sleep_us(action->at_us - esp_timer_get_time());
+
+        if (action->type == SIM_ACTION_COMMAND) {
+            ESP_LOGI(TAG, "Command: %s", action->command);
+            data_process_duty_json_str(action->command, strlen(action->command), esp_timer_get_time());
+        } else if (action->type == SIM_ACTION_PROBE) {
+            ESP_LOGI(TAG, "External probe %s", action->probe_present ? "attached" : "detached");
+            sim_plant_set_external_probe(action->probe_present);
+        } else if (action->type == SIM_ACTION_SETTINGS) {
+            esp_err_t ret = data_process_settings_json_str(action->command, strlen(action->command));
+            ESP_LOGI(TAG, "Settings %s: %s", action->command, esp_err_to_name(ret));
+        } else if (action->type == SIM_ACTION_CALIBRATION) {
+            esp_err_t ret = data_process_calibration_json_str(action->command, strlen(action->command));
+            ESP_LOGI(TAG, "Calibration %s: %s", action->command, esp_err_to_name(ret));
+        } else if (action->type == SIM_ACTION_STALL) {
+            ESP_LOGI(TAG, "Stall: %s for %.1f s", action->stall_task, action->stall_s);
+            if (!sim_task_stall(action->stall_task, (int64_t)(action->stall_s * 1000000))) {
+                ESP_LOGW(TAG, "No task %s to stall", action->stall_task);
+            }
+        } else if (action->type == SIM_ACTION_OTA) {
+            ESP_LOGI(TAG, "OTA upload: %s", action->command);
+            xTaskCreatePinnedToCore(sim_ota_task, "ota_upload", 1024 * 6, (void*)action->command, tasks_config(TASK_HTTPD)->priority, NULL, TASKS_CORE_NETWORK);
+        } else {
+            ESP_LOGI(TAG, "Fault: %s", action->command);
+            sim_plant_set_fault(action->fault_target, action->fault);
+        }
+    }
+    sim_clock_sleep_us(duration_us - esp_timer_get_time());
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "sim_time_ms", esp_timer_get_time() / 1000);
+    cJSON_AddNumberToObject(root, "real_time_ms", (sim_clock_real_us() - real_start_us) / 1000);
+    data_latency_to_json(cJSON_AddObjectToObject(root, "latency"));
+    data_trace_to_json(cJSON_AddObjectToObject(root, "trace"));
+    data_wakeup_to_json(cJSON_AddObjectToObject(root, "wakeup"));
+    sim_print_json(root);
+
+    // Firmware tasks never return, leave them running while the process exits
+    exit(EXIT_SUCCESS);
+}
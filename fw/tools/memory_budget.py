@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""Static RAM per firmware module from a GNU ld map file, checked against a budget.
+
+Works on the ESP-IDF map (build/fancontroller-fw.map) and on the host simulation map,
+modules are the objects of the main component, everything else is summed per library.
+Exits with 1 when a module is over its budget, so it can fail the build.
+"""
+
+import argparse
+import csv
+import os
+import re
+import sys
+
+# Input section prefixes and the memory they end up in. Flash (.text, .rodata, .flash.*) is left out.
+SECTION_KINDS = (
+    ('.rtc_noinit', 'rtc'),
+    ('.rtc.', 'rtc'),
+    ('.iram1', 'iram'),
+    ('.iram', 'iram'),
+    ('.dram1', 'data'),
+    ('.dram0', 'data'),
+    ('.sdata', 'data'),
+    ('.tdata', 'data'),
+    ('.data', 'data'),
+    ('.sbss', 'bss'),
+    ('.tbss', 'bss'),
+    ('.bss', 'bss'),
+    ('COMMON', 'bss'),
+)
+KINDS = ('data', 'bss', 'rtc', 'iram')
+
+# Archives holding the firmware modules: the IDF main component and the host simulation library
+MAIN_ARCHIVES = ('libmain.a', 'libfirmware.a')
+
+ENTRY_RE = re.compile(r'^\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(\S.*)$')
+ARCHIVE_RE = re.compile(r'^(.*?)([^/\\]+\.a)\((.+)\)$')
+
+
+def section_kind(name):
+    for prefix, kind in SECTION_KINDS:
+        if name.startswith(prefix):
+            return kind
+    return None
+
+
+def module_of(source):
+    match = ARCHIVE_RE.match(source)
+    if match is None:
+        return os.path.basename(source), False
+    archive, member = match.group(2), match.group(3)
+    if archive in MAIN_ARCHIVES:
+        # adc.c.obj, driver/shtc3.c.o
+        return re.sub(r'\.c\.o(bj)?$', '', os.path.basename(member)), True
+    return re.sub(r'^lib|\.a$', '', archive), False
+
+
+def parse_map(path):
+    usage = {}
+    in_memory_map = False
+    pending = None  # Section name whose address and size follow on the next line
+
+    with open(path, errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if not in_memory_map:
+                in_memory_map = line.startswith('Linker script and memory map')
+                continue
+
+            # Input sections are indented by one space, output sections start at column 0
+            if pending is None and line.startswith(' ') and not line.startswith('  '):
+                fields = line.split()
+                if len(fields) == 1:
+                    pending = fields[0]
+                    continue
+                if len(fields) >= 4 and fields[1].startswith('0x') and fields[2].startswith('0x'):
+                    name, size, source = fields[0], int(fields[2], 16), ' '.join(fields[3:])
+                else:
+                    continue
+            elif pending is not None:
+                match = ENTRY_RE.match(line)
+                name, pending = pending, None
+                if match is None:
+                    continue
+                size, source = int(match.group(2), 16), match.group(3)
+            else:
+                continue
+
+            kind = section_kind(name)
+            if kind is None or size == 0:
+                continue
+            module, is_main = module_of(source)
+            entry = usage.setdefault((is_main, module), dict.fromkeys(KINDS, 0))
+            entry[kind] += size
+    return usage
+
+
+def load_budget(path):
+    budget = {}
+    with open(path, newline='') as f:
+        for row in csv.reader(f):
+            if not row or row[0].strip().startswith('#'):
+                continue
+            budget[row[0].strip()] = int(row[1])
+    return budget
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('map', help='linker map file')
+    parser.add_argument('--budget', help='CSV of module,bytes limits on data + bss + rtc')
+    parser.add_argument('--all', action='store_true', help='list every library, not only the ten largest')
+    args = parser.parse_args()
+
+    usage = parse_map(args.map)
+    budget = load_budget(args.budget) if args.budget else {}
+    over = []
+
+    row = '{:<24} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}'
+    print(row.format('module', 'data', 'bss', 'rtc', 'iram', 'static', 'budget'))
+
+    modules = sorted((m for is_main, m in usage if is_main))
+    totals = dict.fromkeys(KINDS, 0)
+    for module in modules:
+        entry = usage[(True, module)]
+        static = entry['data'] + entry['bss'] + entry['rtc']
+        limit = budget.get(module)
+        flag = ''
+        if limit is not None and static > limit:
+            over.append(module)
+            flag = '  OVER'
+        print(row.format(module, entry['data'], entry['bss'], entry['rtc'], entry['iram'], static, '-' if limit is None else limit) + flag)
+        for kind in KINDS:
+            totals[kind] += entry[kind]
+    print(row.format('= firmware', totals['data'], totals['bss'], totals['rtc'], totals['iram'],
+                     totals['data'] + totals['bss'] + totals['rtc'], ''))
+
+    libraries = sorted(((sum(v[k] for k in ('data', 'bss', 'rtc')), m, v) for (is_main, m), v in usage.items() if not is_main), reverse=True)
+    if libraries:
+        print()
+        shown = libraries if args.all else libraries[:10]
+        for static, module, entry in shown:
+            print(row.format(module[:24], entry['data'], entry['bss'], entry['rtc'], entry['iram'], static, ''))
+        if len(shown) < len(libraries):
+            rest = libraries[len(shown):]
+            print(row.format('= {} more'.format(len(rest)), *(sum(e[k] for _, _, e in rest) for k in KINDS), sum(s for s, _, _ in rest), ''))
+
+    if over:
+        print('\nOver budget: ' + ', '.join(over), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""Minimal MQTT 3.1.1 broker with a simulated fleet of controllers, for testing the fleet gateway.
+
+Only QoS 0 is routed (higher QoS subscriptions are granted as 0), there are no retained messages,
+sessions or authentication. With --fleet N the broker itself plays N controllers: each publishes the
+status reports from --sample to fancontroller/<id>/status at --rate and logs what it receives on
+fancontroller/<id>/duty.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import struct
+import sys
+import time
+
+CONNECT = 1
+CONNACK = 2
+PUBLISH = 3
+SUBSCRIBE = 8
+SUBACK = 9
+UNSUBSCRIBE = 10
+UNSUBACK = 11
+PINGREQ = 12
+PINGRESP = 13
+DISCONNECT = 14
+
+
+def encode_length(length):
+    out = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        out.append(byte | (0x80 if length else 0))
+        if not length:
+            return bytes(out)
+
+
+def encode_string(value):
+    return struct.pack('>H', len(value)) + value
+
+
+def publish_packet(topic, payload):
+    body = encode_string(topic) + payload
+    return bytes([PUBLISH << 4]) + encode_length(len(body)) + body
+
+
+def topic_matches(pattern, topic):
+    pattern = pattern.split(b'/')
+    topic = topic.split(b'/')
+    for i, level in enumerate(pattern):
+        if level == b'#':
+            return True
+        if i >= len(topic) or (level != b'+' and level != topic[i]):
+            return False
+    return len(pattern) == len(topic)
+
+
+class Broker:
+    def __init__(self):
+        self.clients = {}  # writer -> list of subscribed filters
+        self.local = []  # (filter, callback) of the simulated controllers
+        self.routed = 0
+
+    def route(self, topic, payload):
+        packet = None
+        for writer, filters in self.clients.items():
+            if any(topic_matches(f, topic) for f in filters):
+                packet = packet or publish_packet(topic, payload)
+                # A slow subscriber is dropped rather than holding up the fleet
+                if writer.transport.get_write_buffer_size() > 16 * 1024 * 1024:
+                    writer.close()
+                    continue
+                writer.write(packet)
+                self.routed += 1
+        for pattern, callback in self.local:
+            if topic_matches(pattern, topic):
+                callback(topic, payload)
+
+    async def read_packet(self, reader):
+        header = await reader.readexactly(1)
+        length = 0
+        for shift in range(0, 28, 7):
+            byte = (await reader.readexactly(1))[0]
+            length |= (byte & 0x7f) << shift
+            if not byte & 0x80:
+                break
+        return header[0], await reader.readexactly(length)
+
+    async def serve(self, reader, writer):
+        try:
+            header, body = await self.read_packet(reader)
+            if header >> 4 != CONNECT:
+                return
+            writer.write(bytes([CONNACK << 4, 2, 0, 0]))
+            self.clients[writer] = []
+
+            while True:
+                header, body = await self.read_packet(reader)
+                kind = header >> 4
+                if kind == PUBLISH:
+                    topic_len = struct.unpack('>H', body[:2])[0]
+                    skip = 2 + topic_len + (2 if header & 0x06 else 0)
+                    self.route(body[2:2 + topic_len], body[skip:])
+                elif kind == SUBSCRIBE:
+                    packet_id = body[:2]
+                    position = 2
+                    granted = bytearray()
+                    while position < len(body):
+                        length = struct.unpack('>H', body[position:position + 2])[0]
+                        self.clients[writer].append(body[position + 2:position + 2 + length])
+                        position += 3 + length
+                        granted.append(0)
+                    payload = packet_id + granted
+                    writer.write(bytes([SUBACK << 4]) + encode_length(len(payload)) + payload)
+                elif kind == UNSUBSCRIBE:
+                    writer.write(bytes([UNSUBACK << 4, 2]) + body[:2])
+                elif kind == PINGREQ:
+                    writer.write(bytes([PINGRESP << 4, 0]))
+                elif kind == DISCONNECT:
+                    return
+                await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            self.clients.pop(writer, None)
+            writer.close()
+
+
+class Controller:
+    def __init__(self, broker, index, samples, verbose):
+        self.broker = broker
+        self.id = '02:00:00:%02x:%02x:%02x' % ((index >> 16) & 0xff, (index >> 8) & 0xff, index & 0xff)
+        self.samples = samples
+        self.position = random.randrange(len(samples))
+        self.commands = 0
+        self.verbose = verbose
+        broker.local.append((('fancontroller/%s/duty' % self.id).encode(), self.on_duty))
+
+    def on_duty(self, topic, payload):
+        self.commands += 1
+        if self.verbose:
+            print('%s duty %s' % (self.id, payload.decode(errors='replace')), flush=True)
+
+    def publish(self):
+        sample = self.samples[self.position]
+        self.position = (self.position + 1) % len(self.samples)
+        self.broker.route(('fancontroller/%s/status' % self.id).encode(), sample.replace(b'@ID@', self.id.encode()))
+
+
+def load_samples(path):
+    samples = []
+    with open(path, 'rb') as f:
+        for line in f:
+            line = line.strip()
+            try:
+                report = json.loads(line)
+            except ValueError:
+                continue
+            # The simulation also prints summaries, only status reports are kept
+            if isinstance(report, dict) and 'duty' in report:
+                report['id'] = '@ID@'
+                samples.append(json.dumps(report, separators=(',', ':')).encode())
+    return samples
+
+
+async def run_fleet(controllers, rate):
+    interval = 1 / rate
+    # Spread the controllers over the interval like independent boards would be
+    started = time.monotonic()
+    ticks = 0
+    while True:
+        for i, controller in enumerate(controllers):
+            controller.publish()
+            if i % 64 == 63:
+                await asyncio.sleep(0)
+        ticks += 1
+        await asyncio.sleep(max(0, started + ticks * interval - time.monotonic()))
+
+
+async def report(broker, controllers):
+    last = 0
+    while True:
+        await asyncio.sleep(5)
+        commands = sum(c.commands for c in controllers)
+        print('%d clients, %.0f msgs/s routed, %d duty commands received' % (
+            len(broker.clients), (broker.routed - last) / 5, commands), flush=True)
+        last = broker.routed
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--port', type=int, default=1883, help='listening port (default 1883)')
+    parser.add_argument('--fleet', type=int, default=0, help='simulated controllers (default none)')
+    parser.add_argument('--rate', type=float, default=10, help='status reports per second per controller (default 10)')
+    parser.add_argument('--sample', help='status reports to replay, e.g. the output of fancontroller-sim')
+    parser.add_argument('--verbose', action='store_true', help='print every duty command')
+    args = parser.parse_args()
+
+    broker = Broker()
+    controllers = []
+    if args.fleet:
+        if not args.sample:
+            parser.error('--fleet needs --sample')
+        samples = load_samples(args.sample)
+        if not samples:
+            sys.exit('%s: no status reports' % args.sample)
+        controllers = [Controller(broker, i, samples, args.verbose) for i in range(args.fleet)]
+
+    server = await asyncio.start_server(broker.serve, port=args.port)
+    print('listening on port %d with %d simulated controllers' % (args.port, len(controllers)), flush=True)
+    tasks = [asyncio.create_task(report(broker, controllers))]
+    if controllers:
+        tasks.append(asyncio.create_task(run_fleet(controllers, args.rate)))
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == '__main__':
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
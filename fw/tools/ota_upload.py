@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Uploads a firmware image to one or more fan controllers over HTTP.
+
+The image is streamed to /api/v1/ota with its SHA-256, each controller verifies it, switches the
+boot partition and restarts. After the restart the new image has to pass its health check or it is
+rolled back, poll /api/v1/status for `ota.running` to see which one stuck.
+Exits with 1 when any upload failed.
+"""
+
+import argparse
+import hashlib
+import sys
+import urllib.error
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+
+def upload(host, image, sha256, timeout):
+    request = urllib.request.Request(
+        'http://%s/api/v1/ota' % host,
+        data=image,
+        method='POST',
+        headers={
+            'Content-Type': 'application/octet-stream',
+            'X-Image-SHA256': sha256,
+        })
+    try:
+        with urllib.request.urlopen(request, timeout=timeout) as response:
+            return host, True, response.read().decode(errors='replace').strip()
+    except urllib.error.HTTPError as e:
+        return host, False, '%d %s' % (e.code, e.read().decode(errors='replace').strip())
+    except (urllib.error.URLError, OSError) as e:
+        return host, False, str(e)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('image', help='application image, e.g. build/fancontroller-fw.bin')
+    parser.add_argument('hosts', nargs='+', help='controller addresses')
+    parser.add_argument('--parallel', type=int, default=4, help='uploads at the same time (default 4)')
+    parser.add_argument('--timeout', type=float, default=120, help='seconds per upload (default 120)')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        image = f.read()
+    sha256 = hashlib.sha256(image).hexdigest()
+    print('%s: %d bytes, sha256 %s' % (args.image, len(image), sha256))
+
+    failed = 0
+    with ThreadPoolExecutor(max_workers=max(1, args.parallel)) as executor:
+        for host, ok, message in executor.map(lambda host: upload(host, image, sha256, args.timeout), args.hosts):
+            print('%-24s %s %s' % (host, 'ok' if ok else 'FAILED', message))
+            failed += not ok
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+"""Decodes CBOR status reports into the JSON status document.
+
+Reads a CBOR sequence (one report after the other, as written by fancontroller-sim --cbor or
+captured from fancontroller/<id>/status/cbor) from a file or stdin, or fetches one report from a
+controller with --url. Prints one JSON document per line, --stats compares the sizes instead.
+The integer keys are defined in main/status_cbor.h.
+"""
+
+import argparse
+import json
+import struct
+import sys
+import urllib.request
+
+SCHEMA_VERSION = 1
+UJ_PER_WH = 3600000000.0
+
+_BREAK = object()
+
+
+class DecodeError(ValueError):
+    pass
+
+
+class Decoder:
+    """Minimal CBOR (RFC 8949) decoder: integers, strings, arrays, maps, simple values and floats."""
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def done(self):
+        return self.pos >= len(self.data)
+
+    def _take(self, n):
+        if self.pos + n > len(self.data):
+            raise DecodeError('truncated at byte %d' % self.pos)
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def _argument(self, info):
+        if info < 24:
+            return info
+        if info == 24:
+            return self._take(1)[0]
+        if info == 25:
+            return struct.unpack('>H', self._take(2))[0]
+        if info == 26:
+            return struct.unpack('>I', self._take(4))[0]
+        if info == 27:
+            return struct.unpack('>Q', self._take(8))[0]
+        if info == 31:
+            return None
+        raise DecodeError('reserved additional information %d' % info)
+
+    def _items(self, length):
+        while True:
+            if length is not None:
+                if length == 0:
+                    return
+                length -= 1
+            item = self.decode(allow_break=length is None)
+            if item is _BREAK:
+                return
+            yield item
+
+    def decode(self, allow_break=False):
+        initial = self._take(1)[0]
+        major, info = initial >> 5, initial & 0x1f
+
+        if major == 7:
+            if info == 20:
+                return False
+            if info == 21:
+                return True
+            if info in (22, 23):
+                return None
+            if info == 25:
+                return struct.unpack('>e', self._take(2))[0]
+            if info == 26:
+                return struct.unpack('>f', self._take(4))[0]
+            if info == 27:
+                return struct.unpack('>d', self._take(8))[0]
+            if info == 31 and allow_break:
+                return _BREAK
+            raise DecodeError('unsupported simple value %d' % info)
+
+        argument = self._argument(info)
+        if major == 0:
+            return argument
+        if major == 1:
+            return -1 - argument
+        if major in (2, 3):
+            if argument is None:
+                chunks = list(self._items(None))
+                value = b''.join(chunks) if major == 2 else ''.join(chunks)
+            else:
+                value = self._take(argument)
+                value = bytes(value) if major == 2 else value.decode('utf-8')
+            return value
+        if major == 4:
+            return list(self._items(argument))
+        if major == 5:
+            items = self._items(None if argument is None else argument * 2)
+            return {key: next(items) for key in items}
+        if major == 6:
+            return self.decode()  # Tags carry no meaning here
+        raise DecodeError('unknown major type %d' % major)
+
+
+def _sample(values):
+    sample = dict(zip(('rms', 'max', 'mean', 'min', 'p95', 'p99'), values))
+    if 'min' in sample:
+        sample['p2p'] = sample['max'] - sample['min']
+    return sample
+
+
+def _histogram(values, unit):
+    return dict(zip(('count', 'min_' + unit, 'p50_' + unit, 'p99_' + unit, 'max_' + unit), values))
+
+
+def _per_fan(values, name, convert=lambda v: v):
+    return {name % (i + 1): convert(v) for i, v in enumerate(values)}
+
+
+def _trip(trip):
+    return dict(zip(('time_us', 'current_ma', 'hardware'), trip))
+
+
+def to_json(report):
+    """Maps a decoded report onto the names of the JSON status (data_status_to_json)."""
+    if not isinstance(report, dict) or report.get(0) != SCHEMA_VERSION:
+        raise DecodeError('not a status report of schema %d' % SCHEMA_VERSION)
+
+    out = {}
+    names = (None, 'id', 'free_heap', 'minimum_heap', 'free_heap_internal', 'minimum_heap_internal', 'json_pool',
+             'chip_revision', 'esp_idf_version', 'app_version', 'app_hash', 'compile_date', 'compile_time',
+             'runtime_us', 'reset_reason')
+    for key, name in enumerate(names):
+        if name is not None and key in report:
+            out[name] = report[key]
+    if 'json_pool' in out:
+        out['json_pool'] = dict(zip(('blocks', 'block_size', 'used', 'peak', 'fallbacks'), out['json_pool']))
+
+    if 15 in report:
+        out['duty'] = _per_fan(report[15], 'fan%d_pwm8')
+
+    if 16 in report:
+        p = report[16]
+        power = {'vbus_mv': _sample(p[0]), 'vbus_ma': _sample(p[1]), 'vfan_mv': _sample(p[2])}
+        power.update(_per_fan(p[3], 'vfan%d_ma', _sample))
+        power['vbus_mw'] = p[4]
+        power.update(_per_fan(p[5], 'vfan%d_mw'))
+        power.update({'low_power': p[6], 'vbus_avg_ma': p[7], 'vbus_avg_1m_ma': p[8]})
+        if 9 in p:
+            power['adc'] = dict(zip(('frames', 'pool_overflows', 'sample_freq_hz', 'frame_conversions'), p[9]))
+        out['power'] = power
+
+    if 17 in report:
+        e = report[17]
+        energy = {'vbus_wh': e[0] / UJ_PER_WH}
+        energy.update(_per_fan(e[1], 'vfan%d_wh', lambda uj: uj / UJ_PER_WH))
+        energy.update({'nvs_writes': e[2], 'persisted_us': e[3]})
+        out['energy'] = energy
+
+    if 18 in report:
+        s = report[18]
+        supervisor = {'tripped': s[0], 'trips': s[1]}
+        if s.get(2) is not None:
+            supervisor['bus'] = _trip(s[2])
+        for i, trip in enumerate(s.get(3, [])):
+            if trip is not None:
+                supervisor['fan%d' % (i + 1)] = _trip(trip)
+        out['supervisor'] = supervisor
+
+    if 19 in report:
+        names = ('running', 'pending_verify', 'state', 'written', 'size', 'error')
+        out['ota'] = {name: report[19][key] for key, name in enumerate(names) if key in report[19]}
+
+    if 20 in report:
+        out['tacho'] = _per_fan(report[20], 'fan%d_rpm')
+
+    if 21 in report:
+        names = ('state', 'since_us', 'stalls', 'kicks', 'fault', 'fault_us')
+        out['health'] = _per_fan(report[21], 'fan%d',
+                                 lambda h: {name: h[key] for key, name in enumerate(names) if key in h})
+
+    if 22 in report:
+        s = report[22]
+        sensors = {}
+        for key, name in ((0, 'temphum_on_board'), (1, 'temphum_external')):
+            if key in s:
+                sensors[name] = dict(zip(('temperature_mc', 'rel_hum_mperct'), s[key]))
+        sensors['external_present'] = s[2]
+        for key, name in ((3, 'i2c_on_board'), (4, 'i2c_external')):
+            if key in s:
+                sensors[name] = dict(zip(('transactions', 'errors', 'timeouts', 'recoveries'), s[key]))
+        out['sensors'] = sensors
+
+    if 23 in report:
+        latency = {stage: _histogram(h, 'us') for stage, h in report[23][0].items()}
+        latency['rpm_timeouts'] = report[23][1]
+        out['latency'] = latency
+
+    if 24 in report:
+        p = report[24]
+        out['performance'] = {
+            'interval_ms': p[0],
+            'cores': p[1],
+            'tasks': {name: dict(zip(('percentage', 'core', 'priority', 'stack_free'), t)) for name, t in p[2].items()},
+            'wakeup': {name: _histogram(h, 'us') for name, h in p[3].items()},
+        }
+
+    if 25 in report:
+        out['output'] = _per_fan(report[25], 'fan%d', lambda o: dict(zip(('pwm8', 'min_pwm8'), o)))
+
+    if 26 in report:
+        b = report[26]
+        out['boot'] = {'done_us': b[0], 'fans_resume': ('none', 'rtc', 'nvs')[b[1]], 'stages': b[2], 'parallel': b[3]}
+
+    if 27 in report:
+        w = report[27]
+        names = ('state', 'processed', 'lost', 'misses', 'restarts')
+        tasks = {name: dict(zip(names, t)) for name, t in w[1].items()}
+        for t in tasks.values():
+            t['state'] = ('ok', 'late', 'fault')[t['state']]
+        out['watchdog'] = {'faults': w[0], 'tasks': tasks}
+
+    return out
+
+
+def decode_sequence(data):
+    """Yields (size in bytes, decoded report) for every report in a CBOR sequence."""
+    decoder = Decoder(data)
+    while not decoder.done():
+        start = decoder.pos
+        report = decoder.decode()
+        yield decoder.pos - start, report
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('file', nargs='?', default='-', help='CBOR sequence, - for stdin (default)')
+    parser.add_argument('--url', help='fetch one report, e.g. http://192.168.1.20/api/v1/status')
+    parser.add_argument('--stats', action='store_true', help='compare the CBOR and JSON sizes instead')
+    args = parser.parse_args()
+
+    if args.url:
+        request = urllib.request.Request(args.url, headers={'Accept': 'application/cbor'})
+        with urllib.request.urlopen(request, timeout=10) as response:
+            data = response.read()
+    elif args.file == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+
+    reports = 0
+    cbor_bytes = 0
+    json_bytes = 0
+    try:
+        for size, report in decode_sequence(data):
+            document = json.dumps(to_json(report), separators=(',', ':'))
+            reports += 1
+            cbor_bytes += size
+            json_bytes += len(document)
+            if not args.stats:
+                print(document)
+    except DecodeError as e:
+        sys.exit('report %d: %s' % (reports + 1, e))
+
+    if args.stats and reports:
+        print('%d reports, CBOR %.0f bytes, JSON %.0f bytes on average, %.1f%% of the JSON size' % (
+            reports, cbor_bytes / reports, json_bytes / reports, 100.0 * cbor_bytes / json_bytes))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Receives the UDP multicast telemetry of the controllers (CONFIG_TELEMETRY_UDP).
+
+Joins the group, decodes every frame (the STATUS_CBOR_TELEMETRY array of main/status_cbor.h) and
+tracks the sequence numbers per controller to count lost, duplicated and reordered frames. Prints
+one line per frame, or with --stats a summary per controller every second. The jitter is the
+arrival interval minus the interval of the frame timestamps, so it needs no common clock.
+
+To try it against the simulation on loopback:
+    ./tools/telemetry_recv.py --interface 127.0.0.1 --stats &
+    ./sim/build/fancontroller-sim --telemetry --speed 1 --report-every 0
+"""
+
+import argparse
+import json
+import socket
+import struct
+import sys
+import time
+
+from status_cbor import DecodeError, Decoder
+
+FORMAT_VERSION = 1
+FIELDS = ('format', 'sequence', 'timestamp_us', 'id', 'duty', 'rpm', 'vfan_ma', 'vbus_mv', 'vbus_ma', 'vbus_mw',
+          'tripped', 'temperature_mc')
+
+
+def decode_frame(data):
+    frame = Decoder(data).decode()
+    if not isinstance(frame, list) or not frame or frame[0] != FORMAT_VERSION:
+        raise DecodeError('not a telemetry frame of format %d' % FORMAT_VERSION)
+    return dict(zip(FIELDS, frame))
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100.0))]
+
+
+class Source:
+    """Sequence tracking of one controller."""
+
+    def __init__(self):
+        self.frames = 0
+        self.lost = 0
+        self.duplicated = 0
+        self.reordered = 0
+        self.restarts = 0
+        self.bytes = 0
+        self.next_sequence = None
+        self.last_timestamp_us = None
+        self.last_arrival = None
+        self.jitter_us = []
+
+    def update(self, frame, size, arrival):
+        sequence = frame['sequence']
+        self.frames += 1
+        self.bytes += size
+
+        if self.next_sequence is None:
+            pass
+        elif sequence < self.next_sequence and frame['timestamp_us'] < self.last_timestamp_us - 1000000:
+            self.restarts += 1  # Counts from 0 again after a reboot
+        elif sequence == self.next_sequence - 1:
+            self.duplicated += 1
+            return
+        elif sequence < self.next_sequence:
+            self.reordered += 1
+            self.lost -= 1  # Was counted as lost when the gap opened
+            return
+        else:
+            self.lost += sequence - self.next_sequence
+
+        if self.last_arrival is not None and self.next_sequence == sequence:
+            expected_us = frame['timestamp_us'] - self.last_timestamp_us
+            self.jitter_us.append(abs((arrival - self.last_arrival) * 1e6 - expected_us))
+        self.next_sequence = sequence + 1
+        self.last_timestamp_us = frame['timestamp_us']
+        self.last_arrival = arrival
+
+    def summary(self, controller_id):
+        expected = self.frames + self.lost
+        line = '%s: %d frames (%.0f bytes), %d lost (%.2f%%), %d duplicated, %d reordered, %d restarts' % (
+            controller_id, self.frames, self.bytes / max(self.frames, 1), self.lost,
+            100.0 * self.lost / max(expected, 1), self.duplicated, self.reordered, self.restarts)
+        if self.jitter_us:
+            line += ', jitter p50 %.0f us, p99 %.0f us' % (percentile(self.jitter_us, 50), percentile(self.jitter_us, 99))
+        self.jitter_us = []
+        return line
+
+
+def open_socket(group, port, interface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', port))
+    membership = struct.pack('4s4s', socket.inet_aton(group), socket.inet_aton(interface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--group', default='239.255.70.67', help='multicast group (default 239.255.70.67)')
+    parser.add_argument('--port', type=int, default=47000, help='UDP port (default 47000)')
+    parser.add_argument('--interface', default='0.0.0.0', help='local address to join on, 127.0.0.1 for the simulation')
+    parser.add_argument('--stats', action='store_true', help='print a summary per controller every second instead')
+    parser.add_argument('--duration', type=float, help='stop after this many seconds')
+    args = parser.parse_args()
+
+    sock = open_socket(args.group, args.port, args.interface)
+    sock.settimeout(1.0)
+    sources = {}
+    start = time.monotonic()
+    next_summary = start + 1.0
+
+    try:
+        while args.duration is None or time.monotonic() - start < args.duration:
+            try:
+                data, sender = sock.recvfrom(2048)
+                arrival = time.monotonic()
+                try:
+                    frame = decode_frame(data)
+                except (DecodeError, IndexError) as e:
+                    print('%s: %s' % (sender[0], e), file=sys.stderr)
+                    continue
+                sources.setdefault(frame['id'], Source()).update(frame, len(data), arrival)
+                if not args.stats:
+                    print(json.dumps(frame, separators=(',', ':')), flush=True)
+            except socket.timeout:
+                pass
+
+            if args.stats and time.monotonic() >= next_summary:
+                next_summary += 1.0
+                for controller_id, source in sorted(sources.items()):
+                    print(source.summary(controller_id), flush=True)
+    except KeyboardInterrupt:
+        pass
+
+    if args.stats:
+        for controller_id, source in sorted(sources.items()):
+            print(source.summary(controller_id))
+
+
+if __name__ == '__main__':
+    main()